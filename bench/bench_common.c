@@ -0,0 +1,116 @@
+#define _UHTTP_INTERNAL_
+#include "bench_common.h"
+#include "alloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if UHTTP_STATIC_MEMORY
+/* The heap for static memory builds, whose default allocator always fails. */
+static void* uhttp_bench_malloc(void* context, size_t size)
+{
+    return malloc(size);
+}
+
+static void* uhttp_bench_realloc(void* context, void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void uhttp_bench_free(void* context, void* ptr)
+{
+    free(ptr);
+}
+
+static const uhttp_allocator_t uhttp_bench_allocator = { uhttp_bench_malloc, uhttp_bench_realloc, uhttp_bench_free, NULL };
+#endif
+
+static const char* uhttp_bench_output = NULL;
+static double uhttp_bench_min_time = 0.25;
+
+static double uhttp_bench_now()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int uhttp_bench_init(int argc, char** argv)
+{
+#if UHTTP_STATIC_MEMORY
+    uhttp_alloc_set(&uhttp_bench_allocator);
+#endif
+
+    int i;
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            uhttp_bench_output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            uhttp_bench_min_time = atof(argv[++i]);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+int uhttp_bench_run(const char* suite, const bench_t* benches)
+{
+    FILE* output = NULL;
+    if (uhttp_bench_output && (output = fopen(uhttp_bench_output, "a")) == NULL)
+    {
+        fprintf(stderr, "Could not open %s.\n", uhttp_bench_output);
+        return 1;
+    }
+
+    int result = 0;
+    for (const bench_t* bench = benches; bench->name != NULL; bench++)
+    {
+        // Grow the iteration count until a run takes long enough to measure.
+        size_t n = 1;
+        double elapsed;
+        long long bytes;
+        for (;;)
+        {
+            double start = uhttp_bench_now();
+            bytes = bench->func(n, bench->arg);
+            elapsed = uhttp_bench_now() - start;
+
+            if (bytes < 0 || elapsed >= uhttp_bench_min_time)
+                break;
+
+            double scale = elapsed > 0 ? 1.2 * uhttp_bench_min_time / elapsed : 100;
+            n = (size_t)(n * (scale < 2 ? 2 : scale > 100 ? 100 : scale));
+        }
+
+        if (bytes < 0)
+        {
+            printf("{\"suite\":\"%s\",\"name\":\"%s\",\"error\":true}\n", suite, bench->name);
+            result = 1;
+            continue;
+        }
+
+        char line[512];
+        snprintf(line, sizeof(line),
+            "{\"suite\":\"%s\",\"name\":\"%s\",\"iterations\":%zu,\"seconds\":%.6f,"
+            "\"ns_per_op\":%.2f,\"ops_per_sec\":%.1f,\"bytes_per_sec\":%.1f}\n",
+            suite, bench->name, n, elapsed,
+            elapsed * 1e9 / n, n / elapsed, bytes / elapsed);
+
+        fputs(line, stdout);
+        if (output) fputs(line, output);
+    }
+
+    if (output) fclose(output);
+
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef _UHTTP_INTERNAL_
+#error "This is an internal header file, don't include this."
+#endif
+
+#ifndef _UHTTP_BENCH_COMMON_H_
+#define _UHTTP_BENCH_COMMON_H_
+
+#include <stddef.h>
+
+typedef struct bench_t {
+    const char* name;
+    /* Run n operations, return bytes processed (zero if not applicable) or -1 on failure. */
+    long long (*func)(size_t n, void* arg);
+    void* arg;
+} bench_t;
+
+/**
+ * Parse common benchmark options.
+ *  -o file     Append results to file as JSON lines.
+ *  -t seconds  Minimum measured time per benchmark.
+ * @return Index of the first positional argument.
+ */
+extern int uhttp_bench_init(int argc, char** argv);
+
+/**
+ * Run a null terminated array of benchmarks.
+ * @param suite Name of the suite, written to results.
+ * @param benches Benchmarks.
+ * @return Zero when all benchmarks succeeded.
+ */
+extern int uhttp_bench_run(const char* suite, const bench_t* benches);
+
+#endif
@@ -0,0 +1,92 @@
+#define _UHTTP_INTERNAL_
+#include "../src/list.h"
+#include "bench_common.h"
+
+#define UHTTP_BENCH_LIST_LIVE 256
+
+static unsigned int seed = 1;
+
+static unsigned int uhttp_bench_random()
+{
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+long long uhttp_bench_list_append_clear(size_t n, void* arg)
+{
+    // Grow a list to the live size and clear it again.
+    uhttp_list_t list;
+    uhttp_list_create(&list, sizeof(int));
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int value = (int)i;
+        if (uhttp_list_append(&list, &value)) return -1;
+
+        if (list.nlen == UHTTP_BENCH_LIST_LIVE) uhttp_list_clear(&list);
+    }
+
+    uhttp_list_destroy(&list);
+    return 0;
+}
+
+static long long uhttp_bench_list_churn(size_t n, int pattern)
+{
+    // Keep the list at the live size, replacing one element per operation.
+    uhttp_list_t list;
+    uhttp_list_create(&list, sizeof(int));
+
+    for (int i = 0; i < UHTTP_BENCH_LIST_LIVE; i++)
+    {
+        if (uhttp_list_append(&list, &i)) return -1;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int index;
+        switch (pattern)
+        {
+        default:
+        case 0: index = 0; break;
+        case 1: index = (int)list.nlen - 1; break;
+        case 2: index = (int)(uhttp_bench_random() % list.nlen); break;
+        }
+
+        int value = (int)i;
+        if (uhttp_list_remove(&list, index)) return -1;
+        if (uhttp_list_append(&list, &value)) return -1;
+    }
+
+    uhttp_list_destroy(&list);
+    return 0;
+}
+
+long long uhttp_bench_list_churn_front(size_t n, void* arg)
+{
+    return uhttp_bench_list_churn(n, 0);
+}
+
+long long uhttp_bench_list_churn_back(size_t n, void* arg)
+{
+    return uhttp_bench_list_churn(n, 1);
+}
+
+long long uhttp_bench_list_churn_random(size_t n, void* arg)
+{
+    return uhttp_bench_list_churn(n, 2);
+}
+
+const bench_t uhttp_bench_list[] = {
+    { .name = "append to 256 then clear", .func = uhttp_bench_list_append_clear },
+    { .name = "churn 256 remove front append", .func = uhttp_bench_list_churn_front },
+    { .name = "churn 256 remove back append", .func = uhttp_bench_list_churn_back },
+    { .name = "churn 256 remove random append", .func = uhttp_bench_list_churn_random },
+
+    { .name = NULL, .func = NULL }
+};
+
+int main(int argc, char** argv)
+{
+    uhttp_bench_init(argc, argv);
+    return uhttp_bench_run("list", uhttp_bench_list);
+}
@@ -0,0 +1,103 @@
+#define _UHTTP_INTERNAL_
+#include "../src/request.h"
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Request head parsing over captured header corpora. Corpus files hold one
+ * request head each; line endings are normalized to CRLF on load.
+ */
+
+#define UHTTP_BENCH_MAX_CORPORA 32
+
+typedef struct corpus_t {
+    char name[128];
+    char* data;
+    size_t len;
+} corpus_t;
+
+static corpus_t corpora[UHTTP_BENCH_MAX_CORPORA];
+static bench_t benches[UHTTP_BENCH_MAX_CORPORA + 1];
+
+static int uhttp_bench_load(corpus_t* corpus, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return -1;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* raw = malloc(size + 1);
+    corpus->data = malloc(2 * size + 4);
+    if (raw == NULL || corpus->data == NULL || fread(raw, 1, size, file) != (size_t)size)
+    {
+        fclose(file);
+        free(raw);
+        return -1;
+    }
+    fclose(file);
+
+    // Normalize line endings and make sure the head is terminated.
+    corpus->len = 0;
+    for (long i = 0; i < size; i++)
+    {
+        if (raw[i] == '\r') continue;
+        if (raw[i] == '\n') corpus->data[corpus->len++] = '\r';
+        corpus->data[corpus->len++] = raw[i];
+    }
+    while (corpus->len < 4 || memcmp(corpus->data + corpus->len - 4, "\r\n\r\n", 4))
+    {
+        corpus->data[corpus->len++] = '\r';
+        corpus->data[corpus->len++] = '\n';
+    }
+    free(raw);
+
+    const char* base = strrchr(path, '/');
+    snprintf(corpus->name, sizeof(corpus->name), "parse %s", base ? base + 1 : path);
+
+    return 0;
+}
+
+long long uhttp_bench_request_parse(size_t n, void* arg)
+{
+    const corpus_t* corpus = arg;
+    uhttp_request_t request;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (uhttp_request_parse(&request, corpus->data, corpus->len) != (ssize_t)corpus->len)
+            return -1;
+    }
+
+    return (long long)(n * corpus->len);
+}
+
+int main(int argc, char** argv)
+{
+    int ncorpora = 0;
+    for (int i = uhttp_bench_init(argc, argv); i < argc && ncorpora < UHTTP_BENCH_MAX_CORPORA; i++)
+    {
+        if (uhttp_bench_load(&corpora[ncorpora], argv[i]))
+        {
+            fprintf(stderr, "Could not load corpus %s.\n", argv[i]);
+            return 1;
+        }
+
+        benches[ncorpora].name = corpora[ncorpora].name;
+        benches[ncorpora].func = uhttp_bench_request_parse;
+        benches[ncorpora].arg = &corpora[ncorpora];
+        ncorpora++;
+    }
+
+    if (ncorpora == 0)
+    {
+        fprintf(stderr, "usage: %s [-o file] [-t seconds] corpus...\n", argv[0]);
+        return 1;
+    }
+
+    return uhttp_bench_run("request", benches);
+}
@@ -0,0 +1,199 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/client.h"
+#include "../src/list.h"
+#include "bench_common.h"
+
+#include <errno.h>
+#include <string.h>
+
+/*
+ * Client bookkeeping without a network: clients are added with socket
+ * numbers that were never opened, closing them is a harmless EBADF.
+ */
+
+#if UHTTP_STATIC_MEMORY
+/* No more than the client list of static memory builds holds. */
+#define UHTTP_BENCH_CLIENTS_LIVE 8
+#define UHTTP_BENCH_CLIENTS_OF " of 8"
+#else
+#define UHTTP_BENCH_CLIENTS_LIVE 256
+#define UHTTP_BENCH_CLIENTS_OF " of 256"
+#endif
+#define UHTTP_BENCH_SOCKET_BASE ((uhttp_socket_t)0x100000)
+
+static unsigned int seed = 1;
+
+static unsigned int uhttp_bench_random()
+{
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+static long long uhttp_bench_clients(size_t n, int pattern)
+{
+    uhttp_server_t* sv = uhttp_create();
+    if (sv == NULL) return -1;
+
+    uhttp_addr_t addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.domain = UHTTP_SOCKET_DOMAIN_INET4;
+
+    uhttp_socket_t next = UHTTP_BENCH_SOCKET_BASE;
+    uhttp_client_t* live[UHTTP_BENCH_CLIENTS_LIVE];
+    size_t nlive = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (nlive == UHTTP_BENCH_CLIENTS_LIVE)
+        {
+            size_t index;
+            switch (pattern)
+            {
+            default:
+            case 0: index = 0; break;
+            case 1: index = nlive - 1; break;
+            case 2: index = uhttp_bench_random() % nlive; break;
+            }
+
+            uhttp_server_close_client(live[index]);
+
+            memmove(&live[index], &live[index + 1], (nlive - index - 1) * sizeof(live[0]));
+            nlive--;
+        }
+
+        if ((live[nlive] = uhttp_server_add_client(sv, next++, &addr, 0)) == NULL)
+        {
+            uhttp_destroy(sv);
+            return -1;
+        }
+        nlive++;
+    }
+
+    uhttp_destroy(sv);
+    return 0;
+}
+
+long long uhttp_bench_clients_fifo(size_t n, void* arg)
+{
+    return uhttp_bench_clients(n, 0);
+}
+
+long long uhttp_bench_clients_lifo(size_t n, void* arg)
+{
+    return uhttp_bench_clients(n, 1);
+}
+
+long long uhttp_bench_clients_random(size_t n, void* arg)
+{
+    return uhttp_bench_clients(n, 2);
+}
+
+#if UHTTP_FEATURE_TRANSPORT
+/*
+ * Requests and responses without a network: a peer of the in-memory
+ * transport writes requests and reads the responses between polls, so only
+ * the parser, router and response path are measured.
+ */
+
+static const char uhttp_bench_request[] =
+    "GET /health HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8080\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+static const char uhttp_bench_response[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 2\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "ok";
+
+static void uhttp_bench_health(uhttp_request_t* request, void* user)
+{
+    uhttp_respond(request, 200, "Content-Type: text/plain\r\n", "ok", 2);
+}
+
+static long long uhttp_bench_memory(size_t n, size_t depth)
+{
+    uhttp_transport_t* transport = uhttp_memory_transport_create(1, 64 * 1024);
+    uhttp_server_t* sv = uhttp_create();
+    long long bytes = -1;
+    if (transport == NULL || sv == NULL) goto done;
+
+    uhttp_option_arg_t arg;
+    memset(&arg.addr, 0, sizeof(arg.addr));
+    arg.addr.domain = UHTTP_SOCKET_DOMAIN_INET4;
+    arg.addr.port = 8080;
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+
+    uhttp_route_t route = { .path = "/health", .handler = uhttp_bench_health };
+    uhttp_socket_t sock;
+    if (uhttp_addroute(sv, &route) || uhttp_start(sv) || (sock = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET) goto done;
+
+    char buffer[16 * 1024];
+    bytes = 0;
+    for (size_t done = 0; done < n; done += depth)
+    {
+        size_t count = (n - done < depth) ? n - done : depth;
+        for (size_t i = 0; i < count; i++)
+        {
+            transport->send(transport, sock, uhttp_bench_request, sizeof(uhttp_bench_request) - 1);
+        }
+        bytes += count * (sizeof(uhttp_bench_request) - 1);
+
+        size_t expect = count * (sizeof(uhttp_bench_response) - 1), received = 0;
+        while (received < expect)
+        {
+            uhttp_pollevents(sv);
+
+            ssize_t len = transport->recv(transport, sock, buffer, sizeof(buffer));
+            if (len == 0 || (len < 0 && errno != EAGAIN))
+            {
+                bytes = -1;
+                goto done;
+            }
+            if (len > 0) received += len;
+        }
+        bytes += received;
+    }
+
+    transport->close(transport, sock);
+
+done:
+    if (sv) uhttp_destroy(sv);
+    if (transport) uhttp_memory_transport_destroy(transport);
+    return bytes;
+}
+
+long long uhttp_bench_memory_serial(size_t n, void* arg)
+{
+    return uhttp_bench_memory(n, 1);
+}
+
+long long uhttp_bench_memory_pipelined(size_t n, void* arg)
+{
+    return uhttp_bench_memory(n, 16);
+}
+#endif
+
+const bench_t uhttp_bench_server[] = {
+    { .name = "add client close oldest" UHTTP_BENCH_CLIENTS_OF, .func = uhttp_bench_clients_fifo },
+    { .name = "add client close newest" UHTTP_BENCH_CLIENTS_OF, .func = uhttp_bench_clients_lifo },
+    { .name = "add client close random" UHTTP_BENCH_CLIENTS_OF, .func = uhttp_bench_clients_random },
+#if UHTTP_FEATURE_TRANSPORT
+    { .name = "request response in memory", .func = uhttp_bench_memory_serial },
+    { .name = "16 pipelined requests in memory", .func = uhttp_bench_memory_pipelined },
+#endif
+
+    { .name = NULL, .func = NULL }
+};
+
+int main(int argc, char** argv)
+{
+    uhttp_bench_init(argc, argv);
+    return uhttp_bench_run("server", uhttp_bench_server);
+}
@@ -39,6 +39,8 @@ typedef SOCKET uhttp_socket_t;
 typedef int64_t ssize_t;
 
 #else
+#include <sys/types.h>
+
 #define UHTTP_EXTERN extern
 
 typedef int uhttp_socket_t;
@@ -47,6 +49,7 @@ typedef int uhttp_socket_t;
 /* UHTTP SOCKETS */
 
 typedef enum uhttp_socket_domain_t {
+    UHTTP_SOCKET_DOMAIN_UNIX = 1,
     UHTTP_SOCKET_DOMAIN_INET4 = 4,
     UHTTP_SOCKET_DOMAIN_INET6 = 6
 } uhttp_socket_domain_t;
@@ -54,16 +57,94 @@ typedef enum uhttp_socket_domain_t {
 typedef enum uhttp_event_t {
     UHTTP_EVENT_HANGUP  = 1,
     UHTTP_EVENT_ERROR   = 2,
-    UHTTP_EVENT_RECEIVE = 4
+    UHTTP_EVENT_RECEIVE = 4,
+    UHTTP_EVENT_SEND    = 8
 } uhttp_event_t;
 
+/* Size of a Unix domain socket path, including the terminator. */
+#define UHTTP_ADDR_PATH_MAX 104
+
+/**
+ * A string slice, not null terminated.
+ */
+typedef struct uhttp_str_t
+{
+    const char* ptr;
+    size_t len;
+} uhttp_str_t;
+
+/**
+ * Iterator over the name=value pairs of a query string.
+ * @see uhttp_query_init
+ */
+typedef struct uhttp_query_t
+{
+    const char* pos;
+    const char* end;
+} uhttp_query_t;
+
+typedef struct uhttp_pollfd_t
+{
+    uhttp_socket_t             sock;
+    /* Requested events, hangups and errors are always reported. */
+    uhttp_event_t              events;
+    /* Returned events. */
+    uhttp_event_t              revents;
+} uhttp_pollfd_t;
+
+/**
+ * A pollable handle that becomes readable when signalled from any thread.
+ */
+typedef struct uhttp_wakeup_t
+{
+    /* Polled for UHTTP_EVENT_RECEIVE. */
+    uhttp_socket_t             sock;
+    /* Written to by uhttp_wakeup_signal, may be the same as sock. */
+    uhttp_socket_t             signal;
+} uhttp_wakeup_t;
+
+/**
+ * A kernel pipe data is moved through between sockets without being copied
+ * to user space.
+ */
+typedef struct uhttp_splice_t
+{
+    int                        fds[2];
+    /* Bytes in the pipe. */
+    size_t                     len;
+} uhttp_splice_t;
+
 typedef struct uhttp_addr_t
 {
     uhttp_socket_domain_t      domain;
     uint16_t                   port;
     uint8_t                    address[16];
+    /* Unix domain socket path, a leading '@' selects the abstract namespace. */
+    char                       path[UHTTP_ADDR_PATH_MAX];
 } uhttp_addr_t;
 
+typedef enum uhttp_sockopt_t {
+    /* Disable Nagle's algorithm. */
+    UHTTP_SOCKOPT_NODELAY = 1,
+    /* Hold partial frames until reset (TCP_CORK or TCP_NOPUSH). */
+    UHTTP_SOCKOPT_CORK = 2,
+    /* Seconds to wait for data before waking up accept. */
+    UHTTP_SOCKOPT_DEFER_ACCEPT = 3,
+    /* Length of the TCP fast open queue. */
+    UHTTP_SOCKOPT_FASTOPEN = 4,
+    /* Receive buffer size in bytes. */
+    UHTTP_SOCKOPT_RCVBUF = 5,
+    /* Send buffer size in bytes. */
+    UHTTP_SOCKOPT_SNDBUF = 6,
+    /* Allow binding while old connections linger. */
+    UHTTP_SOCKOPT_REUSEADDR = 7,
+    /* Allow several sockets to bind the same port. */
+    UHTTP_SOCKOPT_REUSEPORT = 8,
+    /* Prefer this socket of a port for connections whose packets a CPU
+       handles (SO_INCOMING_CPU). */
+    UHTTP_SOCKOPT_INCOMING_CPU = 9
+} uhttp_sockopt_t;
+
 #define UHTTP_INVALID_SOCKET ((uhttp_socket_t)-1)
 
 
@@ -85,6 +166,62 @@ UHTTP_EXTERN void uhttp_socket_deinit();
  */
 UHTTP_EXTERN uhttp_socket_t uhttp_socket(uhttp_addr_t* addr);
 
+/**
+ * Create an unbound socket.
+ * @param domain Socket domain.
+ * @return A valid socket object or UHTTP_INVALID_SOCKET.
+ */
+UHTTP_EXTERN uhttp_socket_t uhttp_socket_create(uhttp_socket_domain_t domain);
+
+/**
+ * Bind socket.
+ * @param sock Socket object.
+ * @param addr Binding address of the socket.
+ * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * A Unix domain socket file left behind by a server that is no longer
+ * listening is replaced.
+ */
+UHTTP_EXTERN int uhttp_bind(uhttp_socket_t sock, uhttp_addr_t* addr);
+
+/**
+ * Bind socket, creating the file of a Unix domain socket with permissions.
+ * @param sock Socket object.
+ * @param addr Binding address of the socket.
+ * @param mode Permission bits of the socket file, zero for the umask default.
+ * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * The mode is applied through the process umask for the duration of the
+ * bind, so the file is never accessible to others. Ignored for other
+ * domains and abstract addresses.
+ */
+UHTTP_EXTERN int uhttp_bind_mode(uhttp_socket_t sock, uhttp_addr_t* addr, int mode);
+
+/**
+ * Remove the file system entry of a bound Unix domain socket address.
+ * @param addr Binding address of the socket.
+ * @remarks Does nothing for other domains and abstract addresses.
+ */
+UHTTP_EXTERN void uhttp_unlink(const uhttp_addr_t* addr);
+
+/**
+ * Set the file permissions of a bound Unix domain socket.
+ * @param addr Binding address of the socket.
+ * @param mode Permission bits.
+ * @return Zero when successful, see errno otherwise.
+ */
+UHTTP_EXTERN int uhttp_chmod(const uhttp_addr_t* addr, int mode);
+
+/**
+ * Set socket option.
+ * @param sock Socket object.
+ * @param name Option name.
+ * @param value Option value.
+ * @return Zero when successful, see errno otherwise. ENOPROTOOPT if the
+ * option is not available on this platform.
+ */
+UHTTP_EXTERN int uhttp_setsockopt(uhttp_socket_t sock, uhttp_sockopt_t name, int value);
+
 /**
  * Listen socket.
  * @param sock Socket object.
@@ -101,11 +238,20 @@ UHTTP_EXTERN int uhttp_listen(uhttp_socket_t sock, int backlog);
  */
 UHTTP_EXTERN int uhttp_async(uhttp_socket_t sock, int flag);
 
+/**
+ * Connect a socket.
+ * @param sock Socket handle.
+ * @param addr Address to connect to.
+ * @return Zero when connected, -1 on error (see errno). EINPROGRESS while an
+ * asynchronous socket is connecting, call again once it polls writable.
+ */
+UHTTP_EXTERN int uhttp_connect(uhttp_socket_t sock, const uhttp_addr_t* addr);
+
 /**
  * Accept connection.
  * @param sock Socket object.
  * @param addr Source address of new socket object.
- * @return A new socket object or UHTTP_INVALID_SOCKET if no incoming connections or an error.
+ * @return A new non-blocking socket object or UHTTP_INVALID_SOCKET if no incoming connections or an error.
  */
 UHTTP_EXTERN uhttp_socket_t uhttp_accept(uhttp_socket_t sock, uhttp_addr_t *addr);
 
@@ -117,12 +263,23 @@ UHTTP_EXTERN uhttp_socket_t uhttp_accept(uhttp_socket_t sock, uhttp_addr_t *addr
  */
 UHTTP_EXTERN int uhttp_poll(uhttp_socket_t sock, uhttp_event_t* events);
 
+/**
+ * Poll several sockets at once.
+ * @param fds Sockets to poll, revents is set for each.
+ * @param nfds Number of sockets.
+ * @param timeout Milliseconds to wait for an event, zero to return
+ * immediately or -1 to wait indefinitely.
+ * @return Number of sockets with events, or -1 for error (see errno).
+ */
+UHTTP_EXTERN int uhttp_pollv(uhttp_pollfd_t* fds, size_t nfds, int timeout);
+
 /**
  * Recieve data.
  * @param sock Socket object.
  * @param buffer Buffer to read into.
  * @param len Length of buffer.
- * @return Number of bytes read, or -1 for error (see errno).
+ * @return Number of bytes read, or -1 for error (see errno). EAGAIN if the
+ * socket is non-blocking and there is no data.
  */
 UHTTP_EXTERN ssize_t uhttp_recv(uhttp_socket_t sock, void* buffer, size_t len);
 
@@ -131,16 +288,162 @@ UHTTP_EXTERN ssize_t uhttp_recv(uhttp_socket_t sock, void* buffer, size_t len);
  * @param sock Socket object.
  * @param buffer Buffer to write from.
  * @param len Length of data to send.
- * @return Number of bytes sent, or -1 for error (see errno).
+ * @return Number of bytes sent, or -1 for error (see errno). EAGAIN if the
+ * socket is non-blocking and its send buffer is full.
  */
 UHTTP_EXTERN ssize_t uhttp_send(uhttp_socket_t sock, const void* buffer, size_t len);
 
+/**
+ * Send data gathered from several buffers.
+ * @param sock Socket object.
+ * @param parts Buffers to send in order.
+ * @param nparts Number of buffers.
+ * @return Number of bytes sent, or -1 for error (see errno). EAGAIN if the
+ * socket cannot take any data right now.
+ */
+UHTTP_EXTERN ssize_t uhttp_sendv(uhttp_socket_t sock, const uhttp_str_t* parts, size_t nparts);
+
+/**
+ * Send data from a file without copying it through user space if possible.
+ * @param sock Socket object.
+ * @param fd File descriptor, its file position is not used or changed.
+ * @param offset File offset of the data.
+ * @param len Length of data.
+ * @return Number of bytes sent, zero at the end of the file, or -1 for error
+ * (see errno). EAGAIN if the socket cannot take any data right now.
+ */
+UHTTP_EXTERN ssize_t uhttp_sendfile(uhttp_socket_t sock, int fd, int64_t offset, size_t len);
+
+/**
+ * Open a splice pipe.
+ * @param pipe Splice object.
+ * @return Zero when successful, see errno otherwise. ENOSYS where the
+ * platform cannot splice sockets.
+ */
+UHTTP_EXTERN int uhttp_splice_open(uhttp_splice_t* pipe);
+
+/**
+ * Move data from a socket into a splice pipe.
+ * @param pipe Splice object, empty.
+ * @param sock Socket to read from.
+ * @param len Most bytes to move.
+ * @return Bytes moved, zero at the end of the stream, -1 (see errno).
+ */
+UHTTP_EXTERN ssize_t uhttp_splice_in(uhttp_splice_t* pipe, uhttp_socket_t sock, size_t len);
+
+/**
+ * Move data from a splice pipe to a socket.
+ * @param pipe Splice object.
+ * @param sock Socket to write to.
+ * @return Bytes moved, -1 (see errno).
+ */
+UHTTP_EXTERN ssize_t uhttp_splice_out(uhttp_splice_t* pipe, uhttp_socket_t sock);
+
+/**
+ * Close a splice pipe, dropping data left in it.
+ * @param pipe Splice object.
+ */
+UHTTP_EXTERN void uhttp_splice_close(uhttp_splice_t* pipe);
+
 /**
  * Close socket.
  * @param sock Socket object.
  */
 UHTTP_EXTERN void uhttp_close(uhttp_socket_t sock);
 
+/**
+ * Open a wakeup handle, an eventfd, pipe or loopback socket.
+ * @param wakeup Wakeup object.
+ * @return Zero when successful, see errno otherwise.
+ */
+UHTTP_EXTERN int uhttp_wakeup_open(uhttp_wakeup_t* wakeup);
+
+/**
+ * Make a wakeup handle readable, safe to call from any thread.
+ * @param wakeup Wakeup object.
+ */
+UHTTP_EXTERN void uhttp_wakeup_signal(uhttp_wakeup_t* wakeup);
+
+/**
+ * Consume all signals of a wakeup handle.
+ * @param wakeup Wakeup object.
+ */
+UHTTP_EXTERN void uhttp_wakeup_drain(uhttp_wakeup_t* wakeup);
+
+/**
+ * Close a wakeup handle.
+ * @param wakeup Wakeup object.
+ */
+UHTTP_EXTERN void uhttp_wakeup_close(uhttp_wakeup_t* wakeup);
+
+/**
+ * Pin the calling thread to a range of CPUs.
+ * @param cpu First CPU.
+ * @param count Number of CPUs from the first.
+ * @return Zero when successful, see errno otherwise. EINVAL for CPUs the
+ * process may not run on, ENOSYS where threads cannot be pinned.
+ * @remarks
+ * Memory is placed on the NUMA node of the CPU that first touches it, so a
+ * thread pinned before it allocates keeps its data local.
+ */
+UHTTP_EXTERN int uhttp_thread_affinity(int cpu, int count);
+
+/* UHTTP TRANSPORTS */
+
+/**
+ * Socket functions of a server, its listeners and clients, selected with
+ * UHTTP_OPTION_TRANSPORT. Servers use the kernel sockets above without one.
+ * Each function behaves like its kernel counterpart.
+ */
+typedef struct uhttp_transport_t uhttp_transport_t;
+struct uhttp_transport_t
+{
+    /* Create a non-blocking listen socket for an address, see uhttp_socket
+       and uhttp_listen. */
+    uhttp_socket_t (*listen)(uhttp_transport_t* transport, const uhttp_addr_t* addr, int backlog);
+    uhttp_socket_t (*accept)(uhttp_transport_t* transport, uhttp_socket_t sock, uhttp_addr_t* addr);
+    ssize_t (*recv)(uhttp_transport_t* transport, uhttp_socket_t sock, void* buffer, size_t len);
+    ssize_t (*send)(uhttp_transport_t* transport, uhttp_socket_t sock, const void* buffer, size_t len);
+    ssize_t (*sendv)(uhttp_transport_t* transport, uhttp_socket_t sock, const uhttp_str_t* parts, size_t nparts);
+    ssize_t (*sendfile)(uhttp_transport_t* transport, uhttp_socket_t sock, int fd, int64_t offset, size_t len);
+    /* Also given kernel sockets, the wakeup of the server and sockets of
+       coroutine handlers. */
+    int (*pollv)(uhttp_transport_t* transport, uhttp_pollfd_t* fds, size_t nfds, int timeout);
+    void (*close)(uhttp_transport_t* transport, uhttp_socket_t sock);
+};
+
+/**
+ * Create an in-memory transport. Connections are pairs of lock-free byte
+ * rings between a server and peers in the same process, there are no kernel
+ * sockets and no system calls unless a poll sleeps.
+ * @param connections Connections open at once.
+ * @param capacity Bytes each ring holds in each direction, rounded up to a
+ * power of two.
+ * @return Transport object or NULL (see errno). ENOSYS if uHTTP was built
+ * without UHTTP_FEATURE_TRANSPORT.
+ * @remarks
+ * Peers use the functions of the transport on the sockets returned by
+ * uhttp_memory_connect, from any one thread per socket. One thread at a
+ * time may poll with a timeout, usually the one polling the server.
+ */
+UHTTP_EXTERN uhttp_transport_t* uhttp_memory_transport_create(size_t connections, size_t capacity);
+
+/**
+ * Destroy an in-memory transport, after the servers using it.
+ * @param transport Transport object.
+ */
+UHTTP_EXTERN void uhttp_memory_transport_destroy(uhttp_transport_t* transport);
+
+/**
+ * Connect to a listener of an in-memory transport.
+ * @param transport Transport object.
+ * @param addr Address the listener was created for.
+ * @return Non-blocking socket of the peer, or UHTTP_INVALID_SOCKET (see
+ * errno). ECONNREFUSED if nothing listens on the address, EMFILE if every
+ * connection is in use.
+ */
+UHTTP_EXTERN uhttp_socket_t uhttp_memory_connect(uhttp_transport_t* transport, const uhttp_addr_t* addr);
+
 /* UHTTP SERVER */
 
 /**
@@ -150,6 +453,9 @@ typedef struct uhttp_server_t uhttp_server_t;
 
 /**
  * uHTTP error callback function pointer.
+ * @remarks
+ * Also notified when the server starts shedding load (EBUSY) and when it
+ * stops again (zero).
  */
 typedef void (*uhttp_error_func_t)(int number, const char* description);
 
@@ -161,9 +467,110 @@ typedef void (*uhttp_error_func_t)(int number, const char* description);
 typedef enum uhttp_option_name_t {
     UHTTP_OPTION_BIND_ADDR = 1,
     UHTTP_OPTION_BACKLOG = 2,
-    UHTTP_OPTION_ERROR_FUNC = 3
+    UHTTP_OPTION_ERROR_FUNC = 3,
+    UHTTP_OPTION_TCP_NODELAY = 4,
+    UHTTP_OPTION_TCP_CORK = 5,
+    UHTTP_OPTION_TCP_DEFER_ACCEPT = 6,
+    UHTTP_OPTION_TCP_FASTOPEN = 7,
+    UHTTP_OPTION_RCVBUF = 8,
+    UHTTP_OPTION_SNDBUF = 9,
+    UHTTP_OPTION_REUSEADDR = 10,
+    UHTTP_OPTION_REUSEPORT = 11,
+    UHTTP_OPTION_TCP_PROFILE = 12,
+    UHTTP_OPTION_ACCEPT_BUDGET = 13,
+    UHTTP_OPTION_MAX_CLIENTS = 14,
+    UHTTP_OPTION_MAX_REQUESTS = 15,
+    UHTTP_OPTION_MAX_QUEUED = 16,
+    UHTTP_OPTION_RETRY_AFTER = 17,
+    UHTTP_OPTION_UNIX_MODE = 18,
+    UHTTP_OPTION_POLL_TIMEOUT = 19,
+    UHTTP_OPTION_CACHE_SIZE = 20,
+    UHTTP_OPTION_ALLOCATOR = 21,
+    UHTTP_OPTION_RATE_LIMIT = 22,
+    UHTTP_OPTION_RATE_BURST = 23,
+    UHTTP_OPTION_RATE_PREFIX4 = 24,
+    UHTTP_OPTION_RATE_PREFIX6 = 25,
+    UHTTP_OPTION_TX_HIGH_WATER = 26,
+    UHTTP_OPTION_TX_LOW_WATER = 27,
+    UHTTP_OPTION_TX_BUDGET = 28,
+    UHTTP_OPTION_MIN_SEND_RATE = 29,
+    UHTTP_OPTION_TRANSPORT = 30,
+    UHTTP_OPTION_CPU = 31,
+    UHTTP_OPTION_CPU_COUNT = 32
 } uhttp_option_name_t;
 
+/**
+ * Memory allocator, set with UHTTP_OPTION_ALLOCATOR.
+ * @remarks
+ * Every allocation of uHTTP goes through these functions, which must behave
+ * like malloc, realloc and free and be safe to call from any thread that
+ * uses uHTTP. Zeroed memory is allocated with malloc_func and cleared.
+ */
+typedef struct uhttp_allocator_t
+{
+    void* (*malloc_func)(void* context, size_t size);
+    void* (*realloc_func)(void* context, void* ptr, size_t size);
+    void (*free_func)(void* context, void* ptr);
+    /* Passed to every function. */
+    void* context;
+} uhttp_allocator_t;
+
+/**
+ * Presets for the TCP options, set with UHTTP_OPTION_TCP_PROFILE. Options
+ * set afterwards override the preset.
+ */
+typedef enum uhttp_tcp_profile_t {
+    /* Leave every option at the system default. */
+    UHTTP_TCP_PROFILE_DEFAULT = 0,
+    /* Small responses: no delay, deferred accept, fast open. */
+    UHTTP_TCP_PROFILE_LATENCY = 1,
+    /* Large responses: corked flushes, large send buffers. */
+    UHTTP_TCP_PROFILE_BULK = 2
+} uhttp_tcp_profile_t;
+
+/**
+ * A request being handled, valid until it is answered with uhttp_respond.
+ */
+typedef struct uhttp_request_t uhttp_request_t;
+
+/**
+ * Request handler function pointer.
+ * @param request Request object.
+ * @param user User pointer of the route.
+ * @remarks
+ * Every request must be answered with uhttp_respond, either before the
+ * handler returns or later from the thread polling the server.
+ */
+typedef void (*uhttp_handler_func_t)(uhttp_request_t* request, void* user);
+
+/**
+ * Function run on the thread polling the server.
+ * @param arg Argument passed to uhttp_post.
+ * @see uhttp_post
+ */
+typedef void (*uhttp_post_func_t)(void* arg);
+
+/**
+ * A route, mapping requests to a handler.
+ * @see uhttp_addroute
+ */
+typedef struct uhttp_route_t {
+    /* Request method, NULL for any. */
+    const char* method;
+    /* Request path, a trailing '*' matches any suffix. */
+    const char* path;
+    /* Handler and its user pointer. */
+    uhttp_handler_func_t handler;
+    void* user;
+    /* Milliseconds 200 responses are cached for, zero to not cache. Requests
+       for a response being generated wait for it instead of invoking the
+       handler again. Only GET and HEAD requests are cached. */
+    int cache_ttl;
+    /* Comma separated request header names that are part of the cache key,
+       NULL for none. */
+    const char* cache_vary;
+} uhttp_route_t;
+
 /**
  * Server option arguments.
  * @see uhttp_setoption
@@ -176,6 +583,10 @@ typedef union uhttp_option_arg_t {
     uhttp_addr_t addr;
     /* Error callback. */
     uhttp_error_func_t error_func;
+    /* Memory allocator. */
+    uhttp_allocator_t allocator;
+    /* Transport, NULL for kernel sockets. Set before uhttp_start. */
+    uhttp_transport_t* transport;
 } uhttp_option_arg_t;
 
 /**
@@ -183,6 +594,19 @@ typedef union uhttp_option_arg_t {
  * @return Handle to server object or NULL for failure (see errno)
  */
 UHTTP_EXTERN uhttp_server_t* uhttp_create();
+/**
+ * Create uHTTP server object that allocates only from one memory block.
+ * @param memory Memory block, kept until the server is destroyed.
+ * @param size Size of the memory block.
+ * @return Handle to server object or NULL for failure (see errno). EBUSY if
+ * another server exists, ENOMEM if the block is too small.
+ * @remarks
+ * The server, clients, buffers and routes are carved from the block in power
+ * of two sizes and freed blocks are reused for their size, so the heap is
+ * never touched and the block cannot fragment. No other server may exist
+ * until this one is destroyed. See the README for the size of the block.
+ */
+UHTTP_EXTERN uhttp_server_t* uhttp_create_static(void* memory, size_t size);
 /**
  * Destroy a uHTTP server object.
  * @param sv Server object.
@@ -195,6 +619,10 @@ UHTTP_EXTERN void uhttp_destroy(uhttp_server_t* sv);
  * @param name Option name.
  * @param value Pointer to option value.
  * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * UHTTP_OPTION_ALLOCATOR applies to the whole process and is set with a NULL
+ * server before any server is created, EBUSY otherwise. NULL functions
+ * restore the C library allocator.
  * 
  * @see uhttp_option_name_t
  * @see uhttp_option_arg_t
@@ -213,6 +641,29 @@ UHTTP_EXTERN int uhttp_setoption(uhttp_server_t* sv, uhttp_option_name_t name, c
  */
 UHTTP_EXTERN int uhttp_getoption(uhttp_server_t* sv, uhttp_option_name_t name, uhttp_option_arg_t *value);
 
+/**
+ * Add a listener to the server.
+ * @param sv Server object.
+ * @param addr Address to listen on.
+ * @param tag Value identifying the listener to its connections.
+ * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * The address set with UHTTP_OPTION_BIND_ADDR is the listener with tag zero.
+ * Listeners added to a running server start listening immediately.
+ */
+UHTTP_EXTERN int uhttp_addlistener(uhttp_server_t* sv, const uhttp_addr_t* addr, int tag);
+
+/**
+ * Add a route to the server.
+ * @param sv Server object.
+ * @param route Route, copied into the server.
+ * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * Routes are matched in the order they were added. Requests matching no
+ * route are answered with 404 Not Found.
+ */
+UHTTP_EXTERN int uhttp_addroute(uhttp_server_t* sv, const uhttp_route_t* route);
+
 /**
  * Start server.
  * @param sv Server object.
@@ -224,14 +675,481 @@ UHTTP_EXTERN int uhttp_start(uhttp_server_t* sv);
  * Poll for server events.
  * @param sv Server object.
  * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * All listeners and clients are polled together, waiting for at most
+ * UHTTP_OPTION_POLL_TIMEOUT milliseconds.
  */
 UHTTP_EXTERN int uhttp_pollevents(uhttp_server_t* sv);
 
+/**
+ * Run a function on the thread polling the server, safe to call from any
+ * thread.
+ * @param sv Server object.
+ * @param func Function to run.
+ * @param arg Argument of the function.
+ * @return Zero when successful, see errno otherwise. EAGAIN if too many
+ * functions are waiting to run, ENOSYS without UHTTP_FEATURE_POST.
+ * @remarks
+ * A poll waiting in uhttp_pollevents returns right away to run the function,
+ * so a thread can hand a response over with uhttp_respond from it. Functions
+ * still waiting when the server is destroyed are not run.
+ */
+UHTTP_EXTERN int uhttp_post(uhttp_server_t* sv, uhttp_post_func_t func, void* arg);
+
 /**
  * Stop server, close all connections.
  * param sv Server object.
  * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * Requests not answered yet are discarded and must not be answered after.
  */
 UHTTP_EXTERN int uhttp_stop(uhttp_server_t* sv);
 
+/* UHTTP REQUESTS */
+
+/**
+ * Get the method of a request.
+ * @param request Request object.
+ * @return Method slice.
+ */
+UHTTP_EXTERN uhttp_str_t uhttp_request_method(const uhttp_request_t* request);
+
+/**
+ * Get the target of a request, including its query.
+ * @param request Request object.
+ * @return Target slice.
+ */
+UHTTP_EXTERN uhttp_str_t uhttp_request_target(const uhttp_request_t* request);
+
+/**
+ * Get the decoded path of a request.
+ * @param request Request object.
+ * @return Path slice, without the query.
+ * @remarks
+ * Percent escapes are decoded and dot segments removed when the request is
+ * parsed, routes match this path. The target is left raw. Decoded paths may
+ * contain '/' and any byte but CR, LF and zero, those are refused with 400.
+ */
+UHTTP_EXTERN uhttp_str_t uhttp_request_path(uhttp_request_t* request);
+
+/**
+ * Get the query of a request.
+ * @param request Request object.
+ * @return Query slice without the '?', still encoded. Empty if there is none.
+ */
+UHTTP_EXTERN uhttp_str_t uhttp_request_query(const uhttp_request_t* request);
+
+/**
+ * Find a query parameter of a request.
+ * @param request Request object.
+ * @param name Decoded parameter name, case sensitive.
+ * @param value Receives the encoded value, may be NULL.
+ * @return Non-zero if the parameter is present.
+ */
+UHTTP_EXTERN int uhttp_request_param(const uhttp_request_t* request, const char* name, uhttp_str_t* value);
+
+/**
+ * Find a header field of a request.
+ * @param request Request object.
+ * @param name Header name, case insensitive.
+ * @return Field value or NULL if not present.
+ */
+UHTTP_EXTERN const uhttp_str_t* uhttp_request_header(const uhttp_request_t* request, const char* name);
+
+/**
+ * Get the tag of the listener a request arrived on.
+ * @param request Request object.
+ * @return Listener tag.
+ * @see uhttp_addlistener
+ */
+UHTTP_EXTERN int uhttp_request_tag(const uhttp_request_t* request);
+
+/**
+ * Get the source address of a request.
+ * @param request Request object.
+ * @return Source address.
+ */
+UHTTP_EXTERN const uhttp_addr_t* uhttp_request_source(const uhttp_request_t* request);
+
+/**
+ * Read the request body received so far.
+ * @param request Request object.
+ * @param buffer Buffer to read into.
+ * @param len Size of the buffer.
+ * @return Number of bytes read, zero at the end of the body, -1 (see errno).
+ * EAGAIN if the rest of the body has not arrived yet, see uhttp_await_body,
+ * ECONNRESET if it never will.
+ * @remarks
+ * Bodies not read by the time the request is answered are discarded.
+ */
+UHTTP_EXTERN ssize_t uhttp_request_read(uhttp_request_t* request, void* buffer, size_t len);
+
+/**
+ * Answer a request.
+ * @param request Request object, invalid afterwards.
+ * @param status Status code.
+ * @param headers Additional header lines, each terminated by CRLF, or NULL.
+ * @param body Response body.
+ * @param len Length of the body.
+ * @return Zero when successful, see errno otherwise.
+ */
+UHTTP_EXTERN int uhttp_respond(uhttp_request_t* request, int status, const char* headers, const void* body, size_t len);
+
+/**
+ * Answer a request with 304 Not Modified if the client's copy is current,
+ * so the handler can skip generating the body.
+ * @param request Request object, invalid afterwards if it was answered.
+ * @param etag Entity tag including its quotes, NULL for none.
+ * @param last_modified Modification time in seconds since the epoch, zero
+ * for none.
+ * @return Non-zero if the request was answered, zero if the handler has to
+ * respond in full. Always zero for the request generating a cached response.
+ * @remarks
+ * 200 responses passed to uhttp_respond with ETag or Last-Modified headers,
+ * cached or not, are also answered with 304 when the client's copy matches.
+ */
+UHTTP_EXTERN int uhttp_respond_unmodified(uhttp_request_t* request, const char* etag, int64_t last_modified);
+
+/**
+ * Answer a request with the contents of a file.
+ * @param request Request object, invalid afterwards.
+ * @param headers Additional header lines, each terminated by CRLF, or NULL.
+ * An ETag or Last-Modified among them is used for If-Range and 304.
+ * @param fd File descriptor open for reading, owned by the server afterwards.
+ * @param size Size of the file.
+ * @return Zero when successful, see errno otherwise. ENOSYS without
+ * UHTTP_FEATURE_FILES, the file is closed.
+ * @remarks
+ * GET requests with a Range header are answered with 206 Partial Content,
+ * several ranges as multipart/byteranges, and unsatisfiable ones with 416.
+ * The file is sent with uhttp_sendfile as the socket takes it. Not available
+ * to the request generating a cached response (EINVAL).
+ */
+UHTTP_EXTERN int uhttp_respond_file(uhttp_request_t* request, const char* headers, int fd, int64_t size);
+
+/**
+ * Configuration of uhttp_static_handler.
+ */
+typedef struct uhttp_static_t
+{
+    /* Directory the files are served from. */
+    const char* root;
+    /* Prefix removed from the request path, NULL for none. */
+    const char* strip;
+} uhttp_static_t;
+
+/**
+ * Route handler serving files from a directory.
+ * @param request Request object.
+ * @param user Pointer to a uhttp_static_t.
+ * @remarks
+ * Paths ending in a slash serve index.html. Paths with "..", backslashes or
+ * percent encoding are not served. Supports conditional and range requests.
+ */
+UHTTP_EXTERN void uhttp_static_handler(uhttp_request_t* request, void* user);
+
+/* UHTTP URLS */
+
+/**
+ * Start iterating over a query string.
+ * @param query Iterator.
+ * @param str Query string without the '?', see uhttp_request_query.
+ */
+UHTTP_EXTERN void uhttp_query_init(uhttp_query_t* query, uhttp_str_t str);
+
+/**
+ * Get the next parameter of a query string.
+ * @param query Iterator.
+ * @param name Receives the encoded name.
+ * @param value Receives the encoded value, empty if the pair has no '='.
+ * @return Non-zero while there are parameters left.
+ */
+UHTTP_EXTERN int uhttp_query_next(uhttp_query_t* query, uhttp_str_t* name, uhttp_str_t* value);
+
+/**
+ * Decode percent escapes in place.
+ * @param buffer Buffer holding the encoded string.
+ * @param len Length of the string.
+ * @param plus Non-zero to decode '+' as a space, for query components.
+ * @return Length of the decoded string. Malformed escapes are kept as is.
+ */
+UHTTP_EXTERN size_t uhttp_url_decode(char* buffer, size_t len, int plus);
+
+/* UHTTP MULTIPART */
+
+/**
+ * Streaming multipart/form-data parser.
+ * @see uhttp_multipart_create
+ */
+typedef struct uhttp_multipart_t uhttp_multipart_t;
+
+/**
+ * Multipart parser callbacks, any may be NULL. Returning non-zero stops the
+ * parser, uhttp_multipart_feed then fails with ECANCELED.
+ */
+typedef struct uhttp_multipart_callbacks_t
+{
+    /* Header field of the next part, only valid during the call. */
+    int (*header)(void* user, const uhttp_str_t* name, const uhttp_str_t* value);
+    /* All header fields of the part are reported, data follows. */
+    int (*begin)(void* user);
+    /* Data of the part, in as many pieces as it arrives in. */
+    int (*data)(void* user, const char* data, size_t len);
+    /* The part is complete. */
+    int (*end)(void* user);
+} uhttp_multipart_callbacks_t;
+
+/**
+ * Create a multipart parser.
+ * @param content_type Content-Type of the body, carrying its boundary.
+ * @param callbacks Callbacks, copied. May be NULL.
+ * @param user User data passed to the callbacks.
+ * @return Parser object or NULL (see errno). EINVAL if the type is not
+ * multipart or has no valid boundary.
+ */
+UHTTP_EXTERN uhttp_multipart_t* uhttp_multipart_create(const uhttp_str_t* content_type, const uhttp_multipart_callbacks_t* callbacks, void* user);
+
+/**
+ * Destroy a multipart parser.
+ * @param multipart Parser object.
+ */
+UHTTP_EXTERN void uhttp_multipart_destroy(uhttp_multipart_t* multipart);
+
+/**
+ * Parse the next chunk of a multipart body.
+ * @param multipart Parser object.
+ * @param data Chunk of the body, of any size.
+ * @param len Length of the chunk.
+ * @return Non-zero once the closing delimiter was seen, zero if more is
+ * expected, -1 on error (see errno). EBADMSG for a malformed body, E2BIG for
+ * a header line over UHTTP_MULTIPART_LINE_MAX, ECANCELED if a callback
+ * stopped the parser.
+ * @remarks
+ * Part data is passed to the callbacks straight from the chunk. Only the
+ * bytes of a possible delimiter at the end of a chunk are held back.
+ */
+UHTTP_EXTERN int uhttp_multipart_feed(uhttp_multipart_t* multipart, const char* data, size_t len);
+
+/**
+ * Feed the request body received so far to a multipart parser, without
+ * copying it.
+ * @param request Request object.
+ * @param multipart Parser object.
+ * @return Number of bytes parsed, zero at the end of the body, -1 (see errno).
+ * EAGAIN and ECONNRESET as with uhttp_request_read, EBADMSG if the body ends
+ * before the closing delimiter, or any error of uhttp_multipart_feed.
+ */
+UHTTP_EXTERN ssize_t uhttp_request_multipart(uhttp_request_t* request, uhttp_multipart_t* multipart);
+
+/* UHTTP PROXY */
+
+/**
+ * Reverse proxy to one upstream server.
+ */
+typedef struct uhttp_proxy_t uhttp_proxy_t;
+
+/**
+ * Create a reverse proxy.
+ * @param upstream Address of the upstream server, TCP or Unix domain.
+ * @param idle Idle upstream connections kept for reuse, zero for none.
+ * @param timeout Milliseconds to wait for the upstream, -1 for no limit.
+ * @return Proxy object or NULL (see errno). ENOSYS if uHTTP was built
+ * without UHTTP_FEATURE_PROXY.
+ * @remarks
+ * Pass it as the user pointer of uhttp_proxy_handler routes. A proxy is used
+ * by the polling thread of one server and destroyed after it.
+ */
+UHTTP_EXTERN uhttp_proxy_t* uhttp_proxy_create(const uhttp_addr_t* upstream, int idle, int timeout);
+
+/**
+ * Destroy a reverse proxy, closing its idle connections.
+ * @param proxy Proxy object.
+ */
+UHTTP_EXTERN void uhttp_proxy_destroy(uhttp_proxy_t* proxy);
+
+/**
+ * Route handler forwarding requests to the upstream of a proxy.
+ * @param request Request object.
+ * @param user Pointer to a uhttp_proxy_t.
+ * @remarks
+ * Request bodies are forwarded as they arrive and response bodies as the
+ * client takes them, through a kernel pipe where available. Connection
+ * fields are not forwarded. Answers 502 when the upstream fails and 504
+ * when it times out.
+ */
+UHTTP_EXTERN void uhttp_proxy_handler(uhttp_request_t* request, void* user);
+
+/* UHTTP ACCESS LOG */
+
+/**
+ * Flags of uhttp_access_log.
+ */
+typedef enum uhttp_access_log_flags_t {
+    /* Wait for the writer when its ring is full instead of dropping records. */
+    UHTTP_ACCESS_LOG_BLOCK = 1,
+    /* Install a SIGHUP handler calling uhttp_access_log_reopen. */
+    UHTTP_ACCESS_LOG_SIGHUP = 2
+} uhttp_access_log_flags_t;
+
+/**
+ * Log every response of a server to a file, in the Common Log Format.
+ * @param sv Server object.
+ * @param path File to append to, NULL to stop logging.
+ * @param flags uhttp_access_log_flags_t.
+ * @return Zero when successful, see errno otherwise.
+ * @remarks
+ * Responses are recorded into a ring without locks or system calls, and a
+ * background thread formats them and appends them to the file in batches.
+ * Records that find the ring full are dropped and counted in the file,
+ * unless UHTTP_ACCESS_LOG_BLOCK is set. Call from the thread polling the
+ * server. Stopping writes the records left first.
+ */
+UHTTP_EXTERN int uhttp_access_log(uhttp_server_t* sv, const char* path, int flags);
+
+/**
+ * Reopen the files of every access log, after they have been rotated.
+ * @remarks
+ * Safe to call from a signal handler and any thread.
+ */
+UHTTP_EXTERN void uhttp_access_log_reopen(void);
+
+/* UHTTP COROUTINES */
+
+/* Size of the locals of a coroutine handler. */
+#define UHTTP_AWAIT_LOCALS_SIZE 64
+
+/**
+ * Start of a coroutine handler, a handler that can suspend itself without
+ * blocking the polling thread:
+ *
+ *     void handler(uhttp_request_t* request, void* user)
+ *     {
+ *         UHTTP_AWAIT_BEGIN(request);
+ *         UHTTP_AWAIT(request, uhttp_await_timer(request, 100));
+ *         uhttp_respond(request, 200, NULL, "late\n", 5);
+ *         UHTTP_AWAIT_END(request);
+ *     }
+ *
+ * A suspended handler returns and is invoked again by uhttp_pollevents once
+ * the wait ends, continuing after the UHTTP_AWAIT it suspended at. Local
+ * variables do not survive a suspension, keep state in uhttp_await_locals.
+ * Only one UHTTP_AWAIT fits on a line and it may not be used in a switch
+ * inside the handler.
+ *
+ * When the client goes away, or the server is stopped or destroyed, a
+ * suspended handler is invoked a last time with UHTTP_EVENT_HANGUP. It must
+ * free whatever its locals hold then. Waiting again fails with ECANCELED and
+ * an answer is discarded, the request is over once the handler returns.
+ */
+#define UHTTP_AWAIT_BEGIN(request) switch (*uhttp_await_point(request)) { case 0:
+
+/**
+ * Suspend the handler if an await function armed a wait.
+ * @param request Request object.
+ * @param wait Call of an await function.
+ */
+#define UHTTP_AWAIT(request, wait) \
+    do { if (wait) { *uhttp_await_point(request) = __LINE__; return; case __LINE__:; } } while (0)
+
+/**
+ * End of a coroutine handler.
+ */
+#define UHTTP_AWAIT_END(request) }
+
+/**
+ * Get the resume point of a coroutine handler, used by the macros above.
+ */
+UHTTP_EXTERN int* uhttp_await_point(uhttp_request_t* request);
+
+/**
+ * Get the locals of a coroutine handler, UHTTP_AWAIT_LOCALS_SIZE bytes kept
+ * with the request and aligned for any type. They are not initialized.
+ */
+UHTTP_EXTERN void* uhttp_await_locals(uhttp_request_t* request);
+
+/**
+ * Wait for time to pass.
+ * @param request Request object of the handler.
+ * @param timeout Milliseconds, zero to resume in the next poll.
+ * @return Non-zero when the wait is armed, zero for failure (see errno),
+ * ECANCELED once the wait of the handler was cancelled.
+ */
+UHTTP_EXTERN int uhttp_await_timer(uhttp_request_t* request, int timeout);
+
+/**
+ * Wait for a socket, an upstream connection for example.
+ * @param request Request object of the handler.
+ * @param sock Socket to poll.
+ * @param events Events to wait for.
+ * @param timeout Milliseconds until the wait ends anyway, -1 for no limit.
+ * @return Non-zero when the wait is armed, zero for failure (see errno),
+ * ECANCELED once the wait of the handler was cancelled.
+ */
+UHTTP_EXTERN int uhttp_await_socket(uhttp_request_t* request, uhttp_socket_t sock, uhttp_event_t events, int timeout);
+
+/**
+ * Wait for more of the request body.
+ * @param request Request object of the handler.
+ * @param timeout Milliseconds until the wait ends anyway, -1 for no limit.
+ * @return Non-zero when the wait is armed, zero if uhttp_request_read has
+ * something to return already.
+ */
+UHTTP_EXTERN int uhttp_await_body(uhttp_request_t* request, int timeout);
+
+/**
+ * Get the events that ended the last wait.
+ * @param request Request object of the handler.
+ * @return Events of the socket, UHTTP_EVENT_RECEIVE when body arrived,
+ * UHTTP_EVENT_HANGUP alone when the wait was cancelled, zero if the wait
+ * timed out.
+ */
+UHTTP_EXTERN uhttp_event_t uhttp_await_events(const uhttp_request_t* request);
+
+/* UHTTP MEMORY */
+
+/**
+ * Allocation counters of one call site.
+ * @see uhttp_alloc_stats
+ */
+typedef struct uhttp_alloc_stats_t
+{
+    /* Source location of the call site, NULL for sites beyond
+       UHTTP_ALLOC_SITES. */
+    const char* file;
+    int line;
+    /* Blocks allocated and freed, resizes count as both. */
+    uint64_t allocs;
+    uint64_t frees;
+    /* Bytes allocated in total. */
+    uint64_t bytes;
+    /* Blocks and bytes still allocated. */
+    int64_t live;
+    int64_t live_bytes;
+} uhttp_alloc_stats_t;
+
+/**
+ * Read the allocation counters of every call site that allocated.
+ * @param stats Receives the counters.
+ * @param max Capacity of stats.
+ * @return Number of call sites, which may be more than max, or -1 (see
+ * errno). ENOSYS if uHTTP was built without UHTTP_ALLOC_STATS.
+ * @remarks
+ * Counters are updated with relaxed atomics, a read while other threads
+ * allocate is not a consistent snapshot.
+ */
+UHTTP_EXTERN int uhttp_alloc_stats(uhttp_alloc_stats_t* stats, int max);
+
+/* UHTTP TRACING */
+
+/**
+ * Write the trace records of every thread to a file.
+ * @param path File to write, convert it with uhttp-tracedump.
+ * @return Zero when successful, see errno otherwise. ENOSYS if uHTTP was
+ * built without UHTTP_TRACE.
+ * @remarks
+ * Each thread keeps its latest UHTTP_TRACE_RECORDS trace points. Records
+ * written during the dump may be torn.
+ */
+UHTTP_EXTERN int uhttp_trace_dump(const char* path);
+
 #endif
@@ -0,0 +1,310 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "accesslog.h"
+#include "request.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if !_WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+/* Reopen requests, counted from uhttp_access_log_reopen and SIGHUP. */
+static atomic_uint uhttp_access_log_reopens;
+
+UHTTP_EXTERN void uhttp_access_log_reopen(void)
+{
+    // Safe to call from a signal handler.
+    atomic_fetch_add(&uhttp_access_log_reopens, 1);
+}
+
+size_t uhttp_access_log_format(const uhttp_access_record_t* record, char* buffer)
+{
+    static const char months[12][4] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+
+    char host[64] = "-";
+#if !_WIN32
+    if (record->domain == UHTTP_SOCKET_DOMAIN_INET4 || record->domain == UHTTP_SOCKET_DOMAIN_INET6)
+    {
+        int family = (record->domain == UHTTP_SOCKET_DOMAIN_INET4) ? AF_INET : AF_INET6;
+        if (inet_ntop(family, record->address, host, sizeof(host)) == NULL) strcpy(host, "-");
+    }
+#endif
+
+    time_t seconds = (time_t)record->time;
+    struct tm tm;
+#if _WIN32
+    gmtime_s(&tm, &seconds);
+#else
+    gmtime_r(&seconds, &tm);
+#endif
+
+    int len;
+    if (record->methodlen)
+    {
+        len = snprintf(buffer, UHTTP_ACCESS_LOG_LINE_MAX,
+            "%s - - [%02d/%s/%04d:%02d:%02d:%02d +0000] \"%.*s %.*s HTTP/1.%d\" %d %lld\n",
+            host, tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec,
+            (int)record->methodlen, record->method, (int)record->targetlen, record->target, (int)record->version,
+            (int)record->status, (long long)record->bytes);
+    }
+    else
+    {
+        len = snprintf(buffer, UHTTP_ACCESS_LOG_LINE_MAX,
+            "%s - - [%02d/%s/%04d:%02d:%02d:%02d +0000] \"-\" %d %lld\n",
+            host, tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec,
+            (int)record->status, (long long)record->bytes);
+    }
+
+    return (len > 0 && len < UHTTP_ACCESS_LOG_LINE_MAX) ? (size_t)len : 0;
+}
+
+void uhttp_access_log_push(uhttp_access_log_t* log, const uhttp_addr_t* src, const uhttp_request_t* request, int status, int64_t bytes)
+{
+    size_t tail = atomic_load_explicit(&log->tail, memory_order_relaxed);
+
+    while (tail - atomic_load_explicit(&log->head, memory_order_acquire) > log->mask)
+    {
+        if (!log->block)
+        {
+            atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+            return;
+        }
+
+#if _WIN32
+        return;
+#else
+        // Give the writer a moment, the loop stalls as it would on a write.
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+#endif
+    }
+
+    uhttp_access_record_t* record = &log->records[tail & log->mask];
+    record->time = (int64_t)time(NULL);
+    record->bytes = bytes;
+    record->domain = src->domain;
+    memcpy(record->address, src->address, sizeof(record->address));
+    record->status = (uint16_t)status;
+    record->version = 0;
+    record->methodlen = 0;
+    record->targetlen = 0;
+
+    if (request)
+    {
+        size_t methodlen = request->method.len < sizeof(record->method) ? request->method.len : sizeof(record->method);
+        size_t targetlen = request->target.len < sizeof(record->target) ? request->target.len : sizeof(record->target);
+        memcpy(record->method, request->method.ptr, methodlen);
+        memcpy(record->target, request->target.ptr, targetlen);
+        record->methodlen = (uint8_t)methodlen;
+        record->targetlen = (uint16_t)targetlen;
+        record->version = (uint8_t)request->version;
+    }
+
+    atomic_store_explicit(&log->tail, tail + 1, memory_order_release);
+}
+
+#if _WIN32
+
+uhttp_access_log_t* uhttp_access_log_open(const char* path, int flags)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+void uhttp_access_log_close(uhttp_access_log_t* log)
+{
+}
+
+#else
+
+static void uhttp_access_log_sighup(int signal)
+{
+    uhttp_access_log_reopen();
+}
+
+/**
+ * Write all of a buffer, lines that do not fit the file are lost.
+ */
+static void uhttp_access_log_write(uhttp_access_log_t* log, const char* data, size_t len)
+{
+    while (len)
+    {
+        ssize_t written = write(log->fd, data, len);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return;
+        }
+
+        data += written;
+        len -= written;
+    }
+}
+
+/**
+ * Writer thread, batches the records of the ring into large writes.
+ */
+static void* uhttp_access_log_main(void* arg)
+{
+    uhttp_access_log_t* log = arg;
+
+    for (;;)
+    {
+        // Rotated files are replaced between batches.
+        unsigned reopens = atomic_load(&uhttp_access_log_reopens);
+        if (reopens != log->reopens)
+        {
+            log->reopens = reopens;
+            int fd = open(log->path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            if (fd >= 0)
+            {
+                close(log->fd);
+                log->fd = fd;
+            }
+        }
+
+        size_t head = atomic_load_explicit(&log->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&log->tail, memory_order_acquire);
+        size_t dropped = atomic_exchange_explicit(&log->dropped, 0, memory_order_relaxed);
+        size_t len = 0;
+
+        if (head == tail && dropped == 0)
+        {
+            if (!atomic_load(&log->running)) break;
+
+            struct timespec pause = { 0, UHTTP_ACCESS_LOG_INTERVAL * 1000000L };
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        if (dropped)
+        {
+            len += snprintf(log->batch, UHTTP_ACCESS_LOG_LINE_MAX, "# %zu records dropped\n", dropped);
+        }
+
+        while (head != tail && len + UHTTP_ACCESS_LOG_LINE_MAX <= UHTTP_ACCESS_LOG_BATCH)
+        {
+            len += uhttp_access_log_format(&log->records[head & log->mask], log->batch + len);
+            head++;
+        }
+
+        // Hand the records back before the write, which may take a while.
+        atomic_store_explicit(&log->head, head, memory_order_release);
+        uhttp_access_log_write(log, log->batch, len);
+    }
+
+    return NULL;
+}
+
+uhttp_access_log_t* uhttp_access_log_open(const char* path, int flags)
+{
+    uhttp_access_log_t* log = calloc(1, sizeof(uhttp_access_log_t));
+    if (log == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t pathlen = strlen(path) + 1;
+    log->records = malloc(UHTTP_ACCESS_LOG_RECORDS * sizeof(uhttp_access_record_t));
+    log->batch = malloc(UHTTP_ACCESS_LOG_BATCH);
+    log->path = malloc(pathlen);
+    log->thread = malloc(sizeof(pthread_t));
+    if (log->records == NULL || log->batch == NULL || log->path == NULL || log->thread == NULL)
+    {
+        errno = ENOMEM;
+        goto fail;
+    }
+    memcpy(log->path, path, pathlen);
+
+    log->mask = UHTTP_ACCESS_LOG_RECORDS - 1;
+    log->block = (flags & UHTTP_ACCESS_LOG_BLOCK) != 0;
+    atomic_init(&log->head, 0);
+    atomic_init(&log->tail, 0);
+    atomic_init(&log->dropped, 0);
+    atomic_init(&log->running, 1);
+    log->reopens = atomic_load(&uhttp_access_log_reopens);
+
+    if ((log->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0)
+    {
+        goto fail;
+    }
+
+    if (flags & UHTTP_ACCESS_LOG_SIGHUP)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = uhttp_access_log_sighup;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGHUP, &action, NULL);
+    }
+
+    int created = pthread_create(log->thread, NULL, uhttp_access_log_main, log);
+    if (created != 0)
+    {
+        close(log->fd);
+        errno = created;
+        goto fail;
+    }
+
+    return log;
+
+fail:
+    {
+        int error = errno;
+        free(log->records);
+        free(log->batch);
+        free(log->path);
+        free(log->thread);
+        free(log);
+        errno = error;
+        return NULL;
+    }
+}
+
+void uhttp_access_log_close(uhttp_access_log_t* log)
+{
+    atomic_store(&log->running, 0);
+    pthread_join(*(pthread_t*)log->thread, NULL);
+
+    close(log->fd);
+    free(log->records);
+    free(log->batch);
+    free(log->path);
+    free(log->thread);
+    free(log);
+}
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_ACCESSLOG_H_
+#define _UHTTP_INTERNAL_ACCESSLOG_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "uhttp.h"
+#include "debug.h"
+
+/* Records the ring holds, a power of two. */
+#ifndef UHTTP_ACCESS_LOG_RECORDS
+#if UHTTP_STATIC_MEMORY
+#define UHTTP_ACCESS_LOG_RECORDS 32
+#else
+#define UHTTP_ACCESS_LOG_RECORDS 1024
+#endif
+#endif
+
+/* Bytes of a request target kept in a record, longer ones are cut. */
+#ifndef UHTTP_ACCESS_LOG_TARGET
+#define UHTTP_ACCESS_LOG_TARGET 192
+#endif
+
+/* Bytes the writer gathers before writing them at once. */
+#ifndef UHTTP_ACCESS_LOG_BATCH
+#define UHTTP_ACCESS_LOG_BATCH (64 * 1024)
+#endif
+
+/* Milliseconds the writer sleeps while the ring is empty. */
+#ifndef UHTTP_ACCESS_LOG_INTERVAL
+#define UHTTP_ACCESS_LOG_INTERVAL 20
+#endif
+
+/* Longest line a record formats to. */
+#define UHTTP_ACCESS_LOG_LINE_MAX (UHTTP_ACCESS_LOG_TARGET + 128)
+
+/* Bytes between fields written by different threads. */
+#define UHTTP_ACCESS_LOG_PAD 64
+
+/**
+ * A response as logged, formatted by the writer thread.
+ */
+typedef struct uhttp_access_record_t
+{
+    /* Seconds since the epoch. */
+    int64_t time;
+    /* Bytes of the response body. */
+    int64_t bytes;
+    /* Source address, domain zero if there is none. */
+    uhttp_socket_domain_t domain;
+    uint8_t address[16];
+    /* Status code, minor HTTP version. */
+    uint16_t status;
+    uint8_t version;
+    /* Lengths of the method and target in text, zero method for responses to
+       requests that could not be parsed. */
+    uint8_t methodlen;
+    uint16_t targetlen;
+    char method[16];
+    char target[UHTTP_ACCESS_LOG_TARGET];
+} uhttp_access_record_t;
+
+/**
+ * Ring of records with one producer, the polling thread, and a writer
+ * thread appending them to a file in batches.
+ */
+typedef struct uhttp_access_log_t
+{
+    uhttp_access_record_t* records;
+    size_t mask;
+    /* Non-zero to wait for the writer instead of dropping records. */
+    int block;
+
+    char pad0[UHTTP_ACCESS_LOG_PAD];
+    /* Next record to write, owned by the writer. */
+    atomic_size_t head;
+
+    char pad1[UHTTP_ACCESS_LOG_PAD];
+    /* Next record to fill, owned by the producer. */
+    atomic_size_t tail;
+    /* Records dropped while the ring was full. */
+    atomic_size_t dropped;
+    /* Cleared to stop the writer once the ring is empty. */
+    atomic_int running;
+
+    /* Log file, path to reopen it from and reopen requests seen. */
+    int fd;
+    char* path;
+    unsigned reopens;
+    /* Lines gathered by the writer. */
+    char* batch;
+    /* Writer thread, a pthread_t. */
+    void* thread;
+} uhttp_access_log_t;
+
+/**
+ * Open a log file and start its writer thread.
+ * @param path Path of the file, appended to.
+ * @param flags uhttp_access_log_flags_t.
+ * @return Log object or NULL for failure (see errno).
+ */
+extern uhttp_access_log_t* uhttp_access_log_open(const char* path, int flags);
+
+/**
+ * Write every record left, stop the writer thread and close the file.
+ * @param log Log object.
+ */
+extern void uhttp_access_log_close(uhttp_access_log_t* log);
+
+/**
+ * Log a response, called from the polling thread only.
+ * @param log Log object.
+ * @param src Source address.
+ * @param request Request answered, NULL if it could not be parsed.
+ * @param status Status code.
+ * @param bytes Bytes of the response body.
+ */
+extern void uhttp_access_log_push(uhttp_access_log_t* log, const uhttp_addr_t* src, const uhttp_request_t* request, int status, int64_t bytes);
+
+/**
+ * Format a record as a line of the Common Log Format.
+ * @param record Record.
+ * @param buffer Buffer of at least UHTTP_ACCESS_LOG_LINE_MAX bytes.
+ * @return Length of the line, including the line feed.
+ */
+extern size_t uhttp_access_log_format(const uhttp_access_record_t* record, char* buffer);
+
+#endif
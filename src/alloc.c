@@ -0,0 +1,360 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "alloc.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if UHTTP_ALLOC_STATS
+#include <stdatomic.h>
+#endif
+
+#if UHTTP_STATIC_MEMORY
+// Static memory builds never touch the heap, memory comes from the block of
+// uhttp_create_static or an allocator set by the application.
+static void* uhttp_alloc_default_malloc(void* context, size_t size)
+{
+    errno = ENOMEM;
+    return NULL;
+}
+
+static void* uhttp_alloc_default_realloc(void* context, void* ptr, size_t size)
+{
+    errno = ENOMEM;
+    return NULL;
+}
+
+static void uhttp_alloc_default_free(void* context, void* ptr)
+{
+}
+#else
+static void* uhttp_alloc_default_malloc(void* context, size_t size)
+{
+    return malloc(size);
+}
+
+static void* uhttp_alloc_default_realloc(void* context, void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void uhttp_alloc_default_free(void* context, void* ptr)
+{
+    free(ptr);
+}
+#endif
+
+static const uhttp_allocator_t uhttp_alloc_default = {
+    uhttp_alloc_default_malloc,
+    uhttp_alloc_default_realloc,
+    uhttp_alloc_default_free,
+    NULL
+};
+
+/* Allocator of every block, only replaced while no server exists. */
+static uhttp_allocator_t uhttp_allocator = {
+    uhttp_alloc_default_malloc,
+    uhttp_alloc_default_realloc,
+    uhttp_alloc_default_free,
+    NULL
+};
+
+void uhttp_alloc_set(const uhttp_allocator_t* allocator)
+{
+    if (allocator->malloc_func && allocator->realloc_func && allocator->free_func)
+        uhttp_allocator = *allocator;
+    else
+        uhttp_allocator = uhttp_alloc_default;
+}
+
+void uhttp_alloc_get(uhttp_allocator_t* allocator)
+{
+    *allocator = uhttp_allocator;
+}
+
+#if UHTTP_ALLOC_STATS
+typedef struct uhttp_alloc_site_t
+{
+    /* Zero while free, one while being claimed and two once file and line
+       are set. */
+    atomic_int state;
+    const char* file;
+    int line;
+
+    atomic_uint_fast64_t allocs;
+    atomic_uint_fast64_t frees;
+    atomic_uint_fast64_t bytes;
+    atomic_int_fast64_t live;
+    atomic_int_fast64_t live_bytes;
+} uhttp_alloc_site_t;
+
+/**
+ * Prefix of every block, keeping the alignment of malloc.
+ */
+typedef union uhttp_alloc_header_t
+{
+    struct
+    {
+        size_t size;
+        size_t site;
+    } info;
+    max_align_t align;
+} uhttp_alloc_header_t;
+
+/* Sites by hash, the last entry counts the sites that did not fit. */
+static uhttp_alloc_site_t uhttp_alloc_sites[UHTTP_ALLOC_SITES + 1];
+
+/**
+ * Find or claim the entry of a call site.
+ * @return Index of the entry.
+ */
+static size_t uhttp_alloc_site(const char* file, int line)
+{
+    size_t hash = ((size_t)(uintptr_t)file * 31 + (size_t)line) * (size_t)0x9E3779B97F4A7C15ull;
+    size_t index = (hash >> 16) % UHTTP_ALLOC_SITES;
+
+    for (size_t probe = 0; probe < UHTTP_ALLOC_SITES; probe++)
+    {
+        uhttp_alloc_site_t* site = &uhttp_alloc_sites[index];
+        int state = atomic_load_explicit(&site->state, memory_order_acquire);
+
+        if (state == 0)
+        {
+            if (atomic_compare_exchange_strong(&site->state, &state, 1))
+            {
+                site->file = file;
+                site->line = line;
+                atomic_store_explicit(&site->state, 2, memory_order_release);
+                return index;
+            }
+        }
+
+        // Another thread is claiming the entry, it may be for this site.
+        while (state == 1)
+        {
+            state = atomic_load_explicit(&site->state, memory_order_acquire);
+        }
+
+        if (site->line == line && site->file == file)
+        {
+            return index;
+        }
+
+        index = (index + 1) % UHTTP_ALLOC_SITES;
+    }
+
+    return UHTTP_ALLOC_SITES;
+}
+
+/**
+ * Count a block and return the memory past its header.
+ */
+static void* uhttp_alloc_count(uhttp_alloc_header_t* header, size_t sz, size_t index)
+{
+    uhttp_alloc_site_t* site = &uhttp_alloc_sites[index];
+
+    header->info.size = sz;
+    header->info.site = index;
+    atomic_fetch_add_explicit(&site->allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->bytes, sz, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->live, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&site->live_bytes, (int_fast64_t)sz, memory_order_relaxed);
+
+    uhttp_trace(ALLOC, header + 1, sz);
+    return header + 1;
+}
+
+/**
+ * Uncount a block.
+ */
+static void uhttp_alloc_uncount(uhttp_alloc_header_t* header)
+{
+    uhttp_alloc_site_t* site = &uhttp_alloc_sites[header->info.site];
+
+    atomic_fetch_add_explicit(&site->frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&site->live, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&site->live_bytes, (int_fast64_t)header->info.size, memory_order_relaxed);
+
+    uhttp_trace(FREE, header + 1, header->info.size);
+}
+
+void* uhttp_alloc_malloc(size_t sz, const char* file, int line)
+{
+    if (sz > (size_t)-1 - sizeof(uhttp_alloc_header_t))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    uhttp_alloc_header_t* header = uhttp_allocator.malloc_func(uhttp_allocator.context, sizeof(uhttp_alloc_header_t) + sz);
+    if (header == NULL)
+    {
+        return NULL;
+    }
+
+    return uhttp_alloc_count(header, sz, uhttp_alloc_site(file, line));
+}
+
+void* uhttp_alloc_calloc(size_t nmemb, size_t nsz, const char* file, int line)
+{
+    if (nsz && nmemb > ((size_t)-1 - sizeof(uhttp_alloc_header_t)) / nsz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void* ptr = uhttp_alloc_malloc(nmemb * nsz, file, line);
+    if (ptr)
+    {
+        memset(ptr, 0, nmemb * nsz);
+    }
+
+    return ptr;
+}
+
+void* uhttp_alloc_realloc(void* ptr, size_t sz, const char* file, int line)
+{
+    if (ptr == NULL)
+    {
+        return uhttp_alloc_malloc(sz, file, line);
+    }
+
+    if (sz > (size_t)-1 - sizeof(uhttp_alloc_header_t))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // The old block is uncounted only once it is gone.
+    uhttp_alloc_header_t* header = (uhttp_alloc_header_t*)ptr - 1;
+    uhttp_alloc_header_t old = *header;
+    uhttp_alloc_header_t* xheader = uhttp_allocator.realloc_func(uhttp_allocator.context, header, sizeof(uhttp_alloc_header_t) + sz);
+    if (xheader == NULL)
+    {
+        return NULL;
+    }
+
+    uhttp_alloc_uncount(&old);
+    return uhttp_alloc_count(xheader, sz, uhttp_alloc_site(file, line));
+}
+
+void uhttp_alloc_free(void* ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    uhttp_alloc_header_t* header = (uhttp_alloc_header_t*)ptr - 1;
+    uhttp_alloc_uncount(header);
+    uhttp_allocator.free_func(uhttp_allocator.context, header);
+}
+
+UHTTP_EXTERN int uhttp_alloc_stats(uhttp_alloc_stats_t* stats, int max)
+{
+    if (stats == NULL && max)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int n = 0;
+    for (size_t i = 0; i <= UHTTP_ALLOC_SITES; i++)
+    {
+        uhttp_alloc_site_t* site = &uhttp_alloc_sites[i];
+        uint64_t allocs = atomic_load_explicit(&site->allocs, memory_order_relaxed);
+        if (allocs == 0)
+        {
+            continue;
+        }
+
+        if (n < max)
+        {
+            int ready = i == UHTTP_ALLOC_SITES || atomic_load_explicit(&site->state, memory_order_acquire) == 2;
+            stats[n].file = ready ? site->file : NULL;
+            stats[n].line = ready ? site->line : 0;
+            stats[n].allocs = allocs;
+            stats[n].frees = atomic_load_explicit(&site->frees, memory_order_relaxed);
+            stats[n].bytes = atomic_load_explicit(&site->bytes, memory_order_relaxed);
+            stats[n].live = atomic_load_explicit(&site->live, memory_order_relaxed);
+            stats[n].live_bytes = atomic_load_explicit(&site->live_bytes, memory_order_relaxed);
+        }
+        n++;
+    }
+
+    return n;
+}
+#else
+void* uhttp_alloc_malloc(size_t sz, const char* file, int line)
+{
+    void* ptr = uhttp_allocator.malloc_func(uhttp_allocator.context, sz);
+    uhttp_trace(ALLOC, ptr, sz);
+    return ptr;
+}
+
+void* uhttp_alloc_calloc(size_t nmemb, size_t nsz, const char* file, int line)
+{
+    if (nsz && nmemb > (size_t)-1 / nsz)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void* ptr = uhttp_alloc_malloc(nmemb * nsz, file, line);
+    if (ptr)
+    {
+        memset(ptr, 0, nmemb * nsz);
+    }
+
+    return ptr;
+}
+
+void* uhttp_alloc_realloc(void* ptr, size_t sz, const char* file, int line)
+{
+    void* xptr = uhttp_allocator.realloc_func(uhttp_allocator.context, ptr, sz);
+    if (xptr)
+    {
+        uhttp_trace(FREE, ptr, 0);
+        uhttp_trace(ALLOC, xptr, sz);
+    }
+    return xptr;
+}
+
+void uhttp_alloc_free(void* ptr)
+{
+    if (ptr)
+    {
+        uhttp_trace(FREE, ptr, 0);
+        uhttp_allocator.free_func(uhttp_allocator.context, ptr);
+    }
+}
+
+UHTTP_EXTERN int uhttp_alloc_stats(uhttp_alloc_stats_t* stats, int max)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
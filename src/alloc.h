@@ -0,0 +1,76 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_ALLOC_H_
+#define _UHTTP_INTERNAL_ALLOC_H_
+
+#include <stddef.h>
+#include "uhttp.h"
+
+/* Call sites counted separately, others share one entry. */
+#ifndef UHTTP_ALLOC_SITES
+#define UHTTP_ALLOC_SITES 256
+#endif
+
+/**
+ * Replace the allocator of every block.
+ * @param allocator Allocator, the C library one if any function is NULL.
+ * @remarks Only while no block is allocated.
+ */
+extern void uhttp_alloc_set(const uhttp_allocator_t* allocator);
+
+/**
+ * Get the allocator of every block.
+ * @param allocator Receives the allocator.
+ */
+extern void uhttp_alloc_get(uhttp_allocator_t* allocator);
+
+/**
+ * Allocate memory with the current allocator, counting it for the call site
+ * if UHTTP_ALLOC_STATS is set.
+ * @param sz Size of the block.
+ * @param file Source file of the call site, a string literal.
+ * @param line Source line of the call site.
+ * @return Block, NULL if out of memory.
+ */
+extern void* uhttp_alloc_malloc(size_t sz, const char* file, int line);
+
+/**
+ * Allocate zeroed memory, counting it for the call site.
+ */
+extern void* uhttp_alloc_calloc(size_t nmemb, size_t nsz, const char* file, int line);
+
+/**
+ * Resize memory, counted as freeing the block and allocating at the call
+ * site.
+ */
+extern void* uhttp_alloc_realloc(void* ptr, size_t sz, const char* file, int line);
+
+/**
+ * Free memory allocated by one of the functions above.
+ */
+extern void uhttp_alloc_free(void* ptr);
+
+#endif
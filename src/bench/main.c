@@ -0,0 +1,565 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * uhttp-bench: HTTP/1.1 load generator.
+ *
+ * Opens a number of keep-alive connections over loopback and keeps up to
+ * `depth` requests in flight on each one. The server is either a separate
+ * process (e.g. uhttp-cli) or, with -s, a uHTTP server driven from the same
+ * loop as the load generator.
+ */
+#define _POSIX_C_SOURCE 200809L
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
+
+#define BENCH_RX_SIZE 8192
+#define BENCH_MAX_DEPTH 256
+
+#if UHTTP_STATIC_MEMORY
+/* Room for the in-process server and eight connections, see the README. */
+static _Alignas(16) char memory[74 * 1024];
+#endif
+
+typedef struct bench_config_t
+{
+    const char* host;
+    int port;
+    const char* unix_path;
+    int connections;
+    int depth;
+    double duration;
+    long requests;
+    const char* path;
+    int inprocess;
+    uhttp_tcp_profile_t profile;
+} bench_config_t;
+
+typedef struct bench_conn_t
+{
+    int fd;
+
+    /* Send times of the requests in flight, oldest first. */
+    uint64_t sent[BENCH_MAX_DEPTH];
+    int head;
+    int inflight;
+
+    /* Bytes of the current request already written. */
+    size_t txoff;
+
+    char rx[BENCH_RX_SIZE];
+    size_t rxlen;
+} bench_conn_t;
+
+typedef struct bench_stats_t
+{
+    uint64_t* latency;
+    size_t nlatency;
+    size_t capacity;
+
+    long issued;
+    long errors;
+} bench_stats_t;
+
+static uint64_t bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static double bench_cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return
+        usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void bench_usage(const char* argv0)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -a addr   IPv4 address of the server (127.0.0.1)\n"
+        "  -p port   Port of the server (8080)\n"
+        "  -U path   Unix domain socket of the server instead of addr:port\n"
+        "  -c n      Number of connections (16)\n"
+        "  -d n      Requests in flight per connection, 1 for plain keep-alive (1)\n"
+        "  -t sec    Duration of the run (5)\n"
+        "  -n n      Stop after n requests instead of a duration\n"
+        "  -u path   Request target (/)\n"
+        "  -s        Run a uHTTP server in-process on addr:port\n"
+        "  -P name   TCP profile of the in-process server: default, latency or bulk\n",
+        argv0);
+}
+
+static int bench_connect(const bench_config_t* config)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    memset(&addr, 0, sizeof(addr));
+
+    if (config->unix_path)
+    {
+        struct sockaddr_un* un = (struct sockaddr_un*)&addr;
+        size_t len = strlen(config->unix_path);
+        if (len >= sizeof(un->sun_path))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, config->unix_path, len);
+        addrlen = sizeof(*un);
+
+        // Abstract namespace.
+        if (un->sun_path[0] == '@')
+        {
+            un->sun_path[0] = '\0';
+            addrlen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+        }
+    }
+    else
+    {
+        struct sockaddr_in* in = (struct sockaddr_in*)&addr;
+        in->sin_family = AF_INET;
+        in->sin_port = htons((uint16_t)config->port);
+        if (inet_pton(AF_INET, config->host, &in->sin_addr) != 1)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        addrlen = sizeof(*in);
+    }
+
+    int fd = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (!config->unix_path)
+    {
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+
+    // Connect non-blocking so an in-process server can accept in the meantime.
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(fd, (struct sockaddr*)&addr, addrlen) && errno != EINPROGRESS && errno != EAGAIN)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int bench_record(bench_stats_t* stats, uint64_t latency)
+{
+    if (stats->nlatency == stats->capacity)
+    {
+        size_t capacity = stats->capacity ? stats->capacity * 2 : 65536;
+        uint64_t* xlatency = realloc(stats->latency, capacity * sizeof(uint64_t));
+        if (xlatency == NULL)
+        {
+            return -1;
+        }
+
+        stats->latency = xlatency;
+        stats->capacity = capacity;
+    }
+
+    stats->latency[stats->nlatency++] = latency;
+    return 0;
+}
+
+/**
+ * Consume one complete response from the connection buffer.
+ * @return Length of the response, zero if incomplete, -1 if malformed.
+ */
+static long bench_response_length(const bench_conn_t* conn)
+{
+    const char* rx = conn->rx;
+    size_t head = 0;
+
+    for (size_t i = 3; i < conn->rxlen; i++)
+    {
+        if (rx[i] == '\n' && rx[i - 1] == '\r' && rx[i - 2] == '\n' && rx[i - 3] == '\r')
+        {
+            head = i + 1;
+            break;
+        }
+    }
+
+    if (head == 0)
+    {
+        return conn->rxlen == BENCH_RX_SIZE ? -1 : 0;
+    }
+
+    if (head < 12 || strncmp(rx, "HTTP/1.", 7))
+    {
+        return -1;
+    }
+
+    // Find Content-Length, assume an empty body without one.
+    size_t body = 0;
+    for (size_t i = 0; i < head; i++)
+    {
+        if (rx[i] == '\n' && head - i > 16 && strncasecmp(rx + i + 1, "content-length:", 15) == 0)
+        {
+            body = strtoul(rx + i + 16, NULL, 10);
+            break;
+        }
+    }
+
+    if (head + body > BENCH_RX_SIZE)
+    {
+        return -1;
+    }
+
+    return head + body <= conn->rxlen ? (long)(head + body) : 0;
+}
+
+static int bench_compare(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double bench_percentile(const bench_stats_t* stats, double p)
+{
+    if (stats->nlatency == 0)
+    {
+        return 0;
+    }
+
+    size_t index = (size_t)(p / 100.0 * (stats->nlatency - 1) + 0.5);
+    return stats->latency[index] / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    bench_config_t config = {
+        .host = "127.0.0.1",
+        .port = 8080,
+        .unix_path = NULL,
+        .connections = 16,
+        .depth = 1,
+        .duration = 5,
+        .requests = 0,
+        .path = "/",
+        .inprocess = 0,
+        .profile = UHTTP_TCP_PROFILE_DEFAULT
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:U:c:d:t:n:u:sP:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a': config.host = optarg; break;
+        case 'p': config.port = atoi(optarg); break;
+        case 'U': config.unix_path = optarg; break;
+        case 'c': config.connections = atoi(optarg); break;
+        case 'd': config.depth = atoi(optarg); break;
+        case 't': config.duration = atof(optarg); break;
+        case 'n': config.requests = atol(optarg); break;
+        case 'u': config.path = optarg; break;
+        case 's': config.inprocess = 1; break;
+        case 'P':
+            if (strcmp(optarg, "default") == 0) config.profile = UHTTP_TCP_PROFILE_DEFAULT;
+            else if (strcmp(optarg, "latency") == 0) config.profile = UHTTP_TCP_PROFILE_LATENCY;
+            else if (strcmp(optarg, "bulk") == 0) config.profile = UHTTP_TCP_PROFILE_BULK;
+            else
+            {
+                bench_usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.connections < 1 || config.depth < 1 || config.depth > BENCH_MAX_DEPTH || config.port <= 0 || config.port > 65535)
+    {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    char request[1024];
+    int reqlen = snprintf(request, sizeof(request),
+        "GET %s HTTP/1.1\r\nHost: %s:%d\r\nUser-Agent: uhttp-bench\r\n\r\n",
+        config.path, config.host, config.port);
+    if (reqlen < 0 || reqlen >= (int)sizeof(request))
+    {
+        fprintf(stderr, "bench: request target too long.\n");
+        return 1;
+    }
+
+    uhttp_socket_init();
+
+    uhttp_server_t* server = NULL;
+    if (config.inprocess)
+    {
+#if UHTTP_STATIC_MEMORY
+        server = uhttp_create_static(memory, sizeof(memory));
+#else
+        server = uhttp_create();
+#endif
+        if (server == NULL)
+        {
+            fprintf(stderr, "bench: could not create server: %s\n", strerror(errno));
+            return 1;
+        }
+
+        uhttp_option_arg_t arg;
+        memset(&arg, 0, sizeof(arg));
+        if (config.unix_path)
+        {
+            arg.addr.domain = UHTTP_SOCKET_DOMAIN_UNIX;
+            strncpy(arg.addr.path, config.unix_path, sizeof(arg.addr.path) - 1);
+        }
+        else
+        {
+            arg.addr.domain = UHTTP_SOCKET_DOMAIN_INET4;
+            arg.addr.port = (uint16_t)config.port;
+            inet_pton(AF_INET, config.host, arg.addr.address);
+        }
+        uhttp_setoption(server, UHTTP_OPTION_BIND_ADDR, &arg);
+
+        arg.integer = config.connections;
+        uhttp_setoption(server, UHTTP_OPTION_BACKLOG, &arg);
+
+        arg.integer = config.profile;
+        uhttp_setoption(server, UHTTP_OPTION_TCP_PROFILE, &arg);
+
+        if (uhttp_start(server))
+        {
+            fprintf(stderr, "bench: could not start server: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    bench_conn_t* conns = calloc(config.connections, sizeof(bench_conn_t));
+    struct pollfd* pollfds = calloc(config.connections, sizeof(struct pollfd));
+    bench_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+
+    if (conns == NULL || pollfds == NULL)
+    {
+        fprintf(stderr, "bench: out of memory.\n");
+        return 1;
+    }
+
+    for (int i = 0; i < config.connections; i++)
+    {
+        conns[i].fd = bench_connect(&config);
+        if (conns[i].fd < 0)
+        {
+            fprintf(stderr, "bench: could not connect: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    double cpu_start = bench_cpu_seconds();
+    uint64_t start = bench_now();
+    uint64_t deadline = start + (uint64_t)(config.duration * 1e9);
+    int open = config.connections;
+
+    while (open > 0)
+    {
+        uint64_t now = bench_now();
+        int issuing = config.requests ? stats.issued < config.requests : now < deadline;
+
+        int inflight = 0;
+        for (int i = 0; i < config.connections; i++)
+        {
+            bench_conn_t* conn = &conns[i];
+            pollfds[i].fd = conn->fd;
+            pollfds[i].events = 0;
+            pollfds[i].revents = 0;
+
+            if (conn->fd < 0) continue;
+
+            inflight += conn->inflight;
+            if (conn->inflight) pollfds[i].events |= POLLIN;
+            if (conn->txoff || (issuing && conn->inflight < config.depth)) pollfds[i].events |= POLLOUT;
+        }
+
+        if (!issuing && inflight == 0)
+        {
+            break;
+        }
+
+        if (server)
+        {
+            uhttp_pollevents(server);
+        }
+
+        if (poll(pollfds, config.connections, server ? 0 : 100) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < config.connections; i++)
+        {
+            bench_conn_t* conn = &conns[i];
+            short revents = pollfds[i].revents;
+
+            if (conn->fd < 0 || revents == 0) continue;
+
+            if (revents & (POLLERR | POLLNVAL))
+            {
+                goto drop;
+            }
+
+            // Write as many requests as the pipeline depth allows.
+            while ((revents & POLLOUT) && (conn->txoff || (issuing && conn->inflight < config.depth)))
+            {
+                if (conn->txoff == 0)
+                {
+                    int tail = (conn->head + conn->inflight) % BENCH_MAX_DEPTH;
+                    conn->sent[tail] = bench_now();
+                    conn->inflight++;
+                    stats.issued++;
+                }
+
+                ssize_t len = send(conn->fd, request + conn->txoff, reqlen - conn->txoff, MSG_NOSIGNAL);
+                if (len < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                    goto drop;
+                }
+
+                conn->txoff += len;
+                if (conn->txoff == (size_t)reqlen) conn->txoff = 0;
+                else break;
+
+                if (config.requests && stats.issued >= config.requests) issuing = 0;
+            }
+
+            if (revents & (POLLIN | POLLHUP))
+            {
+                ssize_t len = recv(conn->fd, conn->rx + conn->rxlen, BENCH_RX_SIZE - conn->rxlen, 0);
+                if (len <= 0)
+                {
+                    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+                    goto drop;
+                }
+                conn->rxlen += len;
+
+                long resplen;
+                while ((resplen = bench_response_length(conn)) > 0)
+                {
+                    if (conn->inflight == 0)
+                    {
+                        goto drop;
+                    }
+
+                    bench_record(&stats, bench_now() - conn->sent[conn->head]);
+                    conn->head = (conn->head + 1) % BENCH_MAX_DEPTH;
+                    conn->inflight--;
+
+                    conn->rxlen -= resplen;
+                    memmove(conn->rx, conn->rx + resplen, conn->rxlen);
+                }
+
+                if (resplen < 0)
+                {
+                    goto drop;
+                }
+            }
+
+            continue;
+
+        drop:
+            stats.errors += conn->inflight ? conn->inflight : 1;
+            close(conn->fd);
+            conn->fd = -1;
+            conn->inflight = 0;
+            open--;
+        }
+    }
+
+    uint64_t end = bench_now();
+    double cpu = bench_cpu_seconds() - cpu_start;
+    double elapsed = (end - start) / 1e9;
+
+    for (int i = 0; i < config.connections; i++)
+    {
+        if (conns[i].fd >= 0) close(conns[i].fd);
+    }
+
+    if (server)
+    {
+        uhttp_stop(server);
+        uhttp_destroy(server);
+    }
+    uhttp_socket_deinit();
+
+    qsort(stats.latency, stats.nlatency, sizeof(uint64_t), bench_compare);
+
+    if (config.unix_path)
+        printf("uhttp-bench: unix:%s %s", config.unix_path, config.path);
+    else
+        printf("uhttp-bench: %s:%d%s", config.host, config.port, config.path);
+    printf(", %d connections, depth %d%s\n", config.connections, config.depth,
+        config.inprocess ? ", in-process server" : "");
+    printf("  requests:   %zu completed, %ld errors in %.3f s\n", stats.nlatency, stats.errors, elapsed);
+    printf("  throughput: %.1f req/s\n", elapsed > 0 ? stats.nlatency / elapsed : 0.0);
+    printf("  latency:    p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+        bench_percentile(&stats, 50), bench_percentile(&stats, 90), bench_percentile(&stats, 99),
+        bench_percentile(&stats, 99.9), bench_percentile(&stats, 100));
+    printf("  cpu:        %.3f s, %.2f us/req%s\n",
+        cpu, stats.nlatency ? cpu * 1e6 / stats.nlatency : 0.0,
+        config.inprocess ? " (client and server)" : " (client only)");
+
+    free(stats.latency);
+    free(pollfds);
+    free(conns);
+
+    return stats.errors != 0;
+}
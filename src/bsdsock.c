@@ -0,0 +1,813 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#if !_WIN32
+#define _GNU_SOURCE
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+
+#include "config.h"
+#include "debug.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#if __linux__
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#endif
+
+UHTTP_EXTERN int uhttp_socket_init()
+{
+    return 0;
+}
+
+UHTTP_EXTERN void uhttp_socket_deinit()
+{
+}
+
+UHTTP_EXTERN uhttp_socket_t uhttp_socket_create(uhttp_socket_domain_t domain)
+{
+    switch (domain)
+    {
+#if UHTTP_FEATURE_UNIX
+    case UHTTP_SOCKET_DOMAIN_UNIX:
+        return socket(AF_UNIX, SOCK_STREAM, 0);
+#endif
+    case UHTTP_SOCKET_DOMAIN_INET4:
+        return socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#if UHTTP_FEATURE_IPV6
+    case UHTTP_SOCKET_DOMAIN_INET6:
+        return socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+#endif
+    default:
+        errno = EINVAL;
+        return UHTTP_INVALID_SOCKET;
+    }
+}
+
+#if UHTTP_FEATURE_UNIX
+/**
+ * Convert a Unix domain address.
+ * @return Length of the socket address, zero if the path is invalid.
+ */
+static socklen_t uhttp_sockaddr_un(const uhttp_addr_t* addr, struct sockaddr_un* sckaddr)
+{
+    size_t len = strnlen(addr->path, sizeof(addr->path));
+
+    if (len == 0 || len >= sizeof(addr->path) || len >= sizeof(sckaddr->sun_path))
+    {
+        return 0;
+    }
+
+    memset(sckaddr, 0, sizeof(*sckaddr));
+    sckaddr->sun_family = AF_UNIX;
+    memcpy(sckaddr->sun_path, addr->path, len);
+
+    if (addr->path[0] == '@')
+    {
+#if defined(__linux__)
+        // Abstract names start with a null byte and are not terminated.
+        sckaddr->sun_path[0] = '\0';
+        return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + len);
+#else
+        return 0;
+#endif
+    }
+
+    return (socklen_t)sizeof(*sckaddr);
+}
+
+/**
+ * Check whether a server is listening on a Unix domain socket file.
+ */
+static int uhttp_unix_listening(const struct sockaddr_un* sckaddr, socklen_t len)
+{
+    int sck = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sck < 0)
+    {
+        return 1;
+    }
+
+    int listening = connect(sck, (const struct sockaddr*)sckaddr, len) == 0 || errno != ECONNREFUSED;
+    close(sck);
+
+    return listening;
+}
+#endif
+
+/**
+ * Convert an IPv4 or IPv6 address.
+ * @return Length of the socket address, zero for other domains.
+ */
+static socklen_t uhttp_sockaddr_in(const uhttp_addr_t* addr, struct sockaddr_storage* sckaddr)
+{
+    memset(sckaddr, 0, sizeof(*sckaddr));
+
+    switch (addr->domain)
+    {
+    case UHTTP_SOCKET_DOMAIN_INET4:
+    {
+        struct sockaddr_in* in = (struct sockaddr_in*)sckaddr;
+        in->sin_family = AF_INET;
+        in->sin_port = htons(addr->port);
+        memcpy(&in->sin_addr.s_addr, addr->address, 4);
+        return sizeof(*in);
+    }
+#if UHTTP_FEATURE_IPV6
+    case UHTTP_SOCKET_DOMAIN_INET6:
+    {
+        struct sockaddr_in6* in6 = (struct sockaddr_in6*)sckaddr;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(addr->port);
+        memcpy(in6->sin6_addr.s6_addr, addr->address, 16);
+        return sizeof(*in6);
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+UHTTP_EXTERN int uhttp_bind(uhttp_socket_t sock, uhttp_addr_t* addr)
+{
+    return uhttp_bind_mode(sock, addr, 0);
+}
+
+#if UHTTP_FEATURE_UNIX
+/**
+ * Bind a Unix domain socket, creating its file with permissions.
+ * @param sock Socket object.
+ * @param sckaddr Socket address.
+ * @param len Length of the socket address.
+ * @param mode Permission bits of the file, zero for the umask default.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_bind_un(uhttp_socket_t sock, const struct sockaddr_un* sckaddr, socklen_t len, int mode)
+{
+    // The file never exists with wider permissions, not even until a chmod.
+    mode_t mask = mode ? umask(~(mode_t)mode & 0777) : 0;
+    int result = bind(sock, (const struct sockaddr*)sckaddr, len);
+    int error = errno;
+
+    if (mode) umask(mask);
+
+    errno = error;
+    return result;
+}
+#endif
+
+UHTTP_EXTERN int uhttp_bind_mode(uhttp_socket_t sock, uhttp_addr_t* addr, int mode)
+{
+    if (addr == NULL) goto invalid;
+
+    switch (addr->domain)
+    {
+#if UHTTP_FEATURE_UNIX
+    case UHTTP_SOCKET_DOMAIN_UNIX:
+    {
+        struct sockaddr_un sckaddr;
+        socklen_t len = uhttp_sockaddr_un(addr, &sckaddr);
+        if (len == 0) goto invalid;
+
+        if (uhttp_bind_un(sock, &sckaddr, len, mode) == 0)
+        {
+            return 0;
+        }
+
+        // Only a socket file nobody listens on anymore is replaced, any
+        // other failure is reported as it is.
+        if (errno != EADDRINUSE)
+        {
+            return -1;
+        }
+
+        struct stat st;
+        if (addr->path[0] == '@' ||
+            lstat(addr->path, &st) || !S_ISSOCK(st.st_mode) ||
+            uhttp_unix_listening(&sckaddr, len))
+        {
+            errno = EADDRINUSE;
+            return -1;
+        }
+
+        uhttp_log("bind: removing stale socket %s", addr->path);
+        unlink(addr->path);
+
+        return uhttp_bind_un(sock, &sckaddr, len, mode);
+    }
+#endif
+    default:
+    {
+        struct sockaddr_storage sckaddr;
+        socklen_t len = uhttp_sockaddr_in(addr, &sckaddr);
+        if (len == 0) goto invalid;
+
+        return bind(sock, (struct sockaddr*)&sckaddr, len);
+    }
+    }
+
+invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+UHTTP_EXTERN int uhttp_connect(uhttp_socket_t sock, const uhttp_addr_t* addr)
+{
+    struct sockaddr_storage sckaddr;
+    socklen_t len = 0;
+
+    if (addr == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+#if UHTTP_FEATURE_UNIX
+    if (addr->domain == UHTTP_SOCKET_DOMAIN_UNIX)
+        len = uhttp_sockaddr_un(addr, (struct sockaddr_un*)&sckaddr);
+    else
+#endif
+        len = uhttp_sockaddr_in(addr, &sckaddr);
+
+    if (len == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // A connection started earlier may have failed meanwhile.
+    int error = 0;
+    socklen_t errorlen = sizeof(error);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &errorlen) == 0 && error)
+    {
+        errno = error;
+        return -1;
+    }
+
+    if (connect(sock, (struct sockaddr*)&sckaddr, len) == 0 || errno == EISCONN)
+    {
+        return 0;
+    }
+
+    if (errno == EALREADY || errno == EINTR) errno = EINPROGRESS;
+    return -1;
+}
+
+UHTTP_EXTERN uhttp_socket_t uhttp_socket(uhttp_addr_t* addr)
+{
+    if (addr == NULL)
+    {
+        errno = EINVAL;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    uhttp_socket_t sck = uhttp_socket_create(addr->domain);
+    if (sck == UHTTP_INVALID_SOCKET)
+    {
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    if (uhttp_bind(sck, addr))
+    {
+        int error = errno;
+        close(sck);
+        errno = error;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    return sck;
+}
+
+UHTTP_EXTERN void uhttp_unlink(const uhttp_addr_t* addr)
+{
+#if UHTTP_FEATURE_UNIX
+    if (addr && addr->domain == UHTTP_SOCKET_DOMAIN_UNIX && addr->path[0] != '@' && addr->path[0] != '\0')
+    {
+        unlink(addr->path);
+    }
+#endif
+}
+
+UHTTP_EXTERN int uhttp_chmod(const uhttp_addr_t* addr, int mode)
+{
+#if UHTTP_FEATURE_UNIX
+    if (addr == NULL || addr->domain != UHTTP_SOCKET_DOMAIN_UNIX || addr->path[0] == '\0')
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Abstract sockets have no file to protect.
+    if (addr->path[0] == '@')
+    {
+        return 0;
+    }
+
+    return chmod(addr->path, (mode_t)mode);
+#else
+    errno = EINVAL;
+    return -1;
+#endif
+}
+
+UHTTP_EXTERN int uhttp_setsockopt(uhttp_socket_t sock, uhttp_sockopt_t name, int value)
+{
+    int level, option;
+
+    switch (name)
+    {
+    case UHTTP_SOCKOPT_NODELAY:
+        level = IPPROTO_TCP;
+        option = TCP_NODELAY;
+        value = !!value;
+        break;
+    case UHTTP_SOCKOPT_CORK:
+#if defined(TCP_CORK)
+        level = IPPROTO_TCP;
+        option = TCP_CORK;
+#elif defined(TCP_NOPUSH)
+        level = IPPROTO_TCP;
+        option = TCP_NOPUSH;
+#else
+        errno = ENOPROTOOPT;
+        return -1;
+#endif
+        value = !!value;
+        break;
+    case UHTTP_SOCKOPT_DEFER_ACCEPT:
+#if defined(TCP_DEFER_ACCEPT)
+        level = IPPROTO_TCP;
+        option = TCP_DEFER_ACCEPT;
+        break;
+#else
+        errno = ENOPROTOOPT;
+        return -1;
+#endif
+    case UHTTP_SOCKOPT_FASTOPEN:
+#if defined(TCP_FASTOPEN)
+        level = IPPROTO_TCP;
+        option = TCP_FASTOPEN;
+        break;
+#else
+        errno = ENOPROTOOPT;
+        return -1;
+#endif
+    case UHTTP_SOCKOPT_RCVBUF:
+        level = SOL_SOCKET;
+        option = SO_RCVBUF;
+        break;
+    case UHTTP_SOCKOPT_SNDBUF:
+        level = SOL_SOCKET;
+        option = SO_SNDBUF;
+        break;
+    case UHTTP_SOCKOPT_REUSEADDR:
+        level = SOL_SOCKET;
+        option = SO_REUSEADDR;
+        value = !!value;
+        break;
+    case UHTTP_SOCKOPT_REUSEPORT:
+#if defined(SO_REUSEPORT)
+        level = SOL_SOCKET;
+        option = SO_REUSEPORT;
+        value = !!value;
+        break;
+#else
+        errno = ENOPROTOOPT;
+        return -1;
+#endif
+    case UHTTP_SOCKOPT_INCOMING_CPU:
+#if defined(SO_INCOMING_CPU)
+        level = SOL_SOCKET;
+        option = SO_INCOMING_CPU;
+        break;
+#else
+        errno = ENOPROTOOPT;
+        return -1;
+#endif
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    return setsockopt(sock, level, option, &value, sizeof(value));
+}
+
+UHTTP_EXTERN int uhttp_listen(uhttp_socket_t sock, int backlog)
+{
+    return listen(sock, backlog);
+}
+
+UHTTP_EXTERN int uhttp_async(uhttp_socket_t sock, int flag)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags == -1)
+    {
+        return -1;
+    }
+
+    flags = flag ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(sock, F_SETFL, flags);
+}
+
+UHTTP_EXTERN uhttp_socket_t uhttp_accept(uhttp_socket_t sock, uhttp_addr_t* addr)
+{
+    struct sockaddr_storage xaddr;
+    socklen_t len = sizeof(xaddr);
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    // Accept straight into a non-blocking socket.
+    uhttp_socket_t xsck = accept4(sock, (struct sockaddr*)&xaddr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (xsck == UHTTP_INVALID_SOCKET)
+    {
+        return UHTTP_INVALID_SOCKET;
+    }
+#else
+    uhttp_socket_t xsck = accept(sock, (struct sockaddr*)&xaddr, &len);
+
+    if (xsck == UHTTP_INVALID_SOCKET)
+    {
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    fcntl(xsck, F_SETFD, FD_CLOEXEC);
+    if (uhttp_async(xsck, 1))
+    {
+        close(xsck);
+        return UHTTP_INVALID_SOCKET;
+    }
+#endif
+
+    if (addr)
+    {
+        memset(addr, 0, sizeof(*addr));
+
+        if (xaddr.ss_family == AF_INET)
+        {
+            struct sockaddr_in* in = (struct sockaddr_in*)&xaddr;
+            addr->domain = UHTTP_SOCKET_DOMAIN_INET4;
+            addr->port = ntohs(in->sin_port);
+            memcpy(addr->address, &in->sin_addr.s_addr, 4);
+        }
+#if UHTTP_FEATURE_IPV6
+        else if (xaddr.ss_family == AF_INET6)
+        {
+            struct sockaddr_in6* in6 = (struct sockaddr_in6*)&xaddr;
+            addr->domain = UHTTP_SOCKET_DOMAIN_INET6;
+            addr->port = ntohs(in6->sin6_port);
+            memcpy(addr->address, in6->sin6_addr.s6_addr, 16);
+        }
+#endif
+#if UHTTP_FEATURE_UNIX
+        else if (xaddr.ss_family == AF_UNIX)
+        {
+            // Peers are usually unnamed.
+            addr->domain = UHTTP_SOCKET_DOMAIN_UNIX;
+        }
+#endif
+    }
+
+    return xsck;
+}
+
+UHTTP_EXTERN int uhttp_poll(uhttp_socket_t sock, uhttp_event_t* events)
+{
+    struct pollfd pollfd;
+
+    pollfd.fd = sock;
+    pollfd.events = POLLIN | POLLPRI | POLLOUT;
+    pollfd.revents = 0;
+
+    if (poll(&pollfd, 1, 0) < 0)
+    {
+        return -1;
+    }
+
+    *events = 0;
+    if (pollfd.revents & POLLHUP) *events |= UHTTP_EVENT_HANGUP;
+    if (pollfd.revents & (POLLERR | POLLNVAL)) *events |= UHTTP_EVENT_ERROR;
+    if (pollfd.revents & POLLIN) *events |= UHTTP_EVENT_RECEIVE;
+    if (pollfd.revents & POLLOUT) *events |= UHTTP_EVENT_SEND;
+
+    return 0;
+}
+
+#define UHTTP_POLLV_STACK 64
+
+UHTTP_EXTERN int uhttp_pollv(uhttp_pollfd_t* fds, size_t nfds, int timeout)
+{
+    struct pollfd stack[UHTTP_POLLV_STACK];
+    struct pollfd* pollfds = stack;
+
+    if (nfds > UHTTP_POLLV_STACK && (pollfds = malloc(nfds * sizeof(struct pollfd))) == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < nfds; i++)
+    {
+        pollfds[i].fd = fds[i].sock;
+        pollfds[i].events = 0;
+        pollfds[i].revents = 0;
+        if (fds[i].events & UHTTP_EVENT_RECEIVE) pollfds[i].events |= POLLIN;
+        if (fds[i].events & UHTTP_EVENT_SEND) pollfds[i].events |= POLLOUT;
+    }
+
+    int n = poll(pollfds, (nfds_t)nfds, timeout);
+
+    for (size_t i = 0; i < nfds; i++)
+    {
+        short revents = n > 0 ? pollfds[i].revents : 0;
+
+        fds[i].revents = 0;
+        if (revents & POLLHUP) fds[i].revents |= UHTTP_EVENT_HANGUP;
+        if (revents & (POLLERR | POLLNVAL)) fds[i].revents |= UHTTP_EVENT_ERROR;
+        if (revents & POLLIN) fds[i].revents |= UHTTP_EVENT_RECEIVE;
+        if (revents & POLLOUT) fds[i].revents |= UHTTP_EVENT_SEND;
+    }
+
+    if (pollfds != stack)
+    {
+        int error = errno;
+        free(pollfds);
+        errno = error;
+    }
+
+    return n;
+}
+
+UHTTP_EXTERN ssize_t uhttp_recv(uhttp_socket_t sock, void* buffer, size_t len)
+{
+    ssize_t xlen = recv(sock, buffer, len, 0);
+
+    if (xlen < 0 && errno == EWOULDBLOCK) errno = EAGAIN;
+    return xlen;
+}
+
+UHTTP_EXTERN ssize_t uhttp_send(uhttp_socket_t sock, const void* buffer, size_t len)
+{
+#ifdef MSG_NOSIGNAL
+    ssize_t xlen = send(sock, buffer, len, MSG_NOSIGNAL);
+#else
+    ssize_t xlen = send(sock, buffer, len, 0);
+#endif
+
+    if (xlen < 0 && errno == EWOULDBLOCK) errno = EAGAIN;
+    return xlen;
+}
+
+#define UHTTP_SENDV_PARTS 16
+
+UHTTP_EXTERN ssize_t uhttp_sendv(uhttp_socket_t sock, const uhttp_str_t* parts, size_t nparts)
+{
+    struct iovec iov[UHTTP_SENDV_PARTS];
+    struct msghdr msg;
+
+    // Anything beyond the first parts is left for the next call.
+    if (nparts > UHTTP_SENDV_PARTS) nparts = UHTTP_SENDV_PARTS;
+
+    for (size_t i = 0; i < nparts; i++)
+    {
+        iov[i].iov_base = (void*)parts[i].ptr;
+        iov[i].iov_len = parts[i].len;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nparts;
+
+#ifdef MSG_NOSIGNAL
+    ssize_t xlen = sendmsg(sock, &msg, MSG_NOSIGNAL);
+#else
+    ssize_t xlen = sendmsg(sock, &msg, 0);
+#endif
+
+    if (xlen < 0 && errno == EWOULDBLOCK) errno = EAGAIN;
+    return xlen;
+}
+
+#define UHTTP_SENDFILE_CHUNK 16384
+
+UHTTP_EXTERN ssize_t uhttp_sendfile(uhttp_socket_t sock, int fd, int64_t offset, size_t len)
+{
+#if __linux__
+    off_t off = offset;
+    ssize_t xlen = sendfile(sock, fd, &off, len);
+
+    if (xlen < 0 && errno == EWOULDBLOCK) errno = EAGAIN;
+    return xlen;
+#else
+    // Bounce through a buffer, data the socket does not take is read again.
+    char buffer[UHTTP_SENDFILE_CHUNK];
+    ssize_t xlen = pread(fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer), offset);
+
+    if (xlen <= 0)
+    {
+        return xlen;
+    }
+
+    return uhttp_send(sock, buffer, xlen);
+#endif
+}
+
+/* Most bytes moved into a pipe at once, its default capacity. */
+#define UHTTP_SPLICE_CHUNK 65536
+
+UHTTP_EXTERN int uhttp_splice_open(uhttp_splice_t* pipe)
+{
+#if __linux__
+    if (pipe2(pipe->fds, O_NONBLOCK | O_CLOEXEC))
+    {
+        return -1;
+    }
+
+    pipe->len = 0;
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+UHTTP_EXTERN ssize_t uhttp_splice_in(uhttp_splice_t* pipe, uhttp_socket_t sock, size_t len)
+{
+#if __linux__
+    if (len > UHTTP_SPLICE_CHUNK) len = UHTTP_SPLICE_CHUNK;
+
+    ssize_t xlen = splice(sock, NULL, pipe->fds[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (xlen < 0 && errno == EWOULDBLOCK) errno = EAGAIN;
+    if (xlen > 0) pipe->len += xlen;
+    return xlen;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+UHTTP_EXTERN ssize_t uhttp_splice_out(uhttp_splice_t* pipe, uhttp_socket_t sock)
+{
+#if __linux__
+    // Splice has no MSG_NOSIGNAL, the SIGPIPE of a closed peer is blocked
+    // and consumed instead.
+    sigset_t sigpipe, previous;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &previous);
+
+    sigset_t pending;
+    sigpending(&pending);
+    int was_pending = sigismember(&pending, SIGPIPE);
+
+    ssize_t xlen = splice(pipe->fds[0], NULL, sock, NULL, pipe->len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (xlen < 0 && errno == EPIPE && !was_pending)
+    {
+        struct timespec zero = { 0, 0 };
+        while (sigtimedwait(&sigpipe, NULL, &zero) < 0 && errno == EINTR);
+        errno = EPIPE;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (xlen < 0 && errno == EWOULDBLOCK) errno = EAGAIN;
+    if (xlen > 0) pipe->len -= xlen;
+    return xlen;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+UHTTP_EXTERN void uhttp_splice_close(uhttp_splice_t* pipe)
+{
+#if __linux__
+    close(pipe->fds[0]);
+    close(pipe->fds[1]);
+    pipe->len = 0;
+#endif
+}
+
+UHTTP_EXTERN void uhttp_close(uhttp_socket_t sock)
+{
+    close(sock);
+}
+
+UHTTP_EXTERN int uhttp_wakeup_open(uhttp_wakeup_t* wakeup)
+{
+#if __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    wakeup->sock = wakeup->signal = fd;
+#else
+    int fds[2];
+    if (pipe(fds))
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    wakeup->sock = fds[0];
+    wakeup->signal = fds[1];
+#endif
+
+    return 0;
+}
+
+UHTTP_EXTERN void uhttp_wakeup_signal(uhttp_wakeup_t* wakeup)
+{
+    // A full pipe or counter is already readable, nothing is lost.
+    uint64_t one = 1;
+    ssize_t xlen = write(wakeup->signal, &one, sizeof(one));
+    (void)xlen;
+}
+
+UHTTP_EXTERN void uhttp_wakeup_drain(uhttp_wakeup_t* wakeup)
+{
+    uint64_t buffer[8];
+    while (read(wakeup->sock, buffer, sizeof(buffer)) > 0)
+    {
+    }
+}
+
+UHTTP_EXTERN void uhttp_wakeup_close(uhttp_wakeup_t* wakeup)
+{
+    if (wakeup->signal != wakeup->sock)
+    {
+        close(wakeup->signal);
+    }
+    close(wakeup->sock);
+    wakeup->sock = wakeup->signal = UHTTP_INVALID_SOCKET;
+}
+
+UHTTP_EXTERN int uhttp_thread_affinity(int cpu, int count)
+{
+    if (cpu < 0 || count < 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+#if __linux__
+    if (cpu >= CPU_SETSIZE || count > CPU_SETSIZE - cpu)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = cpu; i < cpu + count; i++)
+    {
+        CPU_SET(i, &set);
+    }
+
+    // Thread zero is the calling thread, not the process.
+    return sched_setaffinity(0, sizeof(set), &set);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "cache.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * FNV-1a hash of a key.
+ */
+static size_t uhttp_cache_hash(const char* key, size_t keylen)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < keylen; i++)
+    {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Bytes an entry counts against the budget.
+ */
+static size_t uhttp_cache_entry_size(const uhttp_cache_entry_t* entry)
+{
+    return sizeof(*entry) + entry->keylen + entry->len;
+}
+
+static void uhttp_cache_unlink_use(uhttp_cache_t* cache, uhttp_cache_entry_t* entry)
+{
+    if (entry->newer) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+
+    if (entry->older) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+
+    entry->newer = entry->older = NULL;
+}
+
+static void uhttp_cache_link_use(uhttp_cache_t* cache, uhttp_cache_entry_t* entry)
+{
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest) cache->newest->newer = entry;
+    else cache->oldest = entry;
+
+    cache->newest = entry;
+}
+
+void uhttp_cache_create(uhttp_cache_t* cache, size_t budget)
+{
+    memset(cache->buckets, 0, sizeof(cache->buckets));
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    cache->size = 0;
+    cache->budget = budget;
+}
+
+void uhttp_cache_clear(uhttp_cache_t* cache)
+{
+    while (cache->newest)
+    {
+        uhttp_cache_remove(cache, cache->newest);
+    }
+}
+
+uhttp_cache_entry_t* uhttp_cache_get(uhttp_cache_t* cache, const char* key, size_t keylen, uint64_t now)
+{
+    size_t hash = uhttp_cache_hash(key, keylen);
+    uhttp_cache_entry_t* entry = cache->buckets[hash % UHTTP_CACHE_BUCKETS];
+
+    while (entry && !(entry->hash == hash && entry->keylen == keylen && memcmp(entry->key, key, keylen) == 0))
+    {
+        entry = entry->next;
+    }
+
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    if (!entry->pending && entry->expires <= now)
+    {
+        uhttp_cache_remove(cache, entry);
+        return NULL;
+    }
+
+    uhttp_cache_unlink_use(cache, entry);
+    uhttp_cache_link_use(cache, entry);
+    return entry;
+}
+
+uhttp_cache_entry_t* uhttp_cache_begin(uhttp_cache_t* cache, const char* key, size_t keylen)
+{
+    uhttp_cache_entry_t* entry = malloc(sizeof(uhttp_cache_entry_t));
+    if (entry == NULL || (entry->key = malloc(keylen)) == NULL)
+    {
+        free(entry);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memcpy(entry->key, key, keylen);
+    entry->keylen = keylen;
+    entry->hash = uhttp_cache_hash(key, keylen);
+    entry->data = NULL;
+    entry->len = 0;
+    entry->headlen = 0;
+    entry->expires = 0;
+    entry->status = 0;
+    memset(&entry->validators, 0, sizeof(entry->validators));
+    entry->refs = 2;
+    entry->pending = 1;
+    entry->cached = 1;
+    uhttp_list_create(&entry->waiters, sizeof(void*));
+
+    size_t bucket = entry->hash % UHTTP_CACHE_BUCKETS;
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    uhttp_cache_link_use(cache, entry);
+    cache->size += uhttp_cache_entry_size(entry);
+
+    return entry;
+}
+
+void uhttp_cache_fill(uhttp_cache_t* cache, uhttp_cache_entry_t* entry, char* data, size_t len, size_t headlen, uint64_t expires, uint64_t now)
+{
+    if (entry->cached)
+    {
+        cache->size -= uhttp_cache_entry_size(entry);
+    }
+
+    entry->data = data;
+    entry->len = len;
+    entry->headlen = headlen;
+    entry->expires = expires;
+    entry->pending = 0;
+
+    if (!entry->cached)
+    {
+        return;
+    }
+
+    size_t size = uhttp_cache_entry_size(entry);
+    cache->size += size;
+
+    if (expires <= now || size > cache->budget)
+    {
+        uhttp_cache_remove(cache, entry);
+        return;
+    }
+
+    // Evict from the old end, skipping responses still being generated.
+    uhttp_cache_entry_t* victim = cache->oldest;
+    while (victim && cache->size > cache->budget)
+    {
+        uhttp_cache_entry_t* newer = victim->newer;
+        if (!victim->pending && victim != entry)
+        {
+            uhttp_cache_remove(cache, victim);
+        }
+        victim = newer;
+    }
+
+    // Pending entries may hold the space, drop this one rather than exceed.
+    if (cache->size > cache->budget)
+    {
+        uhttp_cache_remove(cache, entry);
+    }
+}
+
+void uhttp_cache_remove(uhttp_cache_t* cache, uhttp_cache_entry_t* entry)
+{
+    if (!entry->cached)
+    {
+        return;
+    }
+
+    uhttp_cache_entry_t** link = &cache->buckets[entry->hash % UHTTP_CACHE_BUCKETS];
+    while (*link != entry)
+    {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    uhttp_cache_unlink_use(cache, entry);
+    cache->size -= uhttp_cache_entry_size(entry);
+    entry->cached = 0;
+
+    uhttp_cache_release(entry);
+}
+
+void uhttp_cache_release(uhttp_cache_entry_t* entry)
+{
+    if (--entry->refs > 0)
+    {
+        return;
+    }
+
+    uhttp_list_destroy(&entry->waiters);
+    free(entry->key);
+    free(entry->data);
+    free(entry);
+}
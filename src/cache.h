@@ -0,0 +1,154 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_CACHE_H_
+#define _UHTTP_INTERNAL_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "uhttp.h"
+#include "debug.h"
+#include "list.h"
+#include "conditional.h"
+
+/* Number of hash buckets in a response cache. */
+#ifndef UHTTP_CACHE_BUCKETS
+#define UHTTP_CACHE_BUCKETS 256
+#endif
+
+/**
+ * A cached response, shared by every request with the same key.
+ */
+typedef struct uhttp_cache_entry_t
+{
+    /* Next entry in the hash bucket. */
+    struct uhttp_cache_entry_t* next;
+    /* Neighbours in use order, most recently used first. */
+    struct uhttp_cache_entry_t* newer;
+    struct uhttp_cache_entry_t* older;
+
+    size_t hash;
+    char* key;
+    size_t keylen;
+
+    /* Rendered response. The head without its blank line comes first, so
+       per-connection fields can be inserted at headlen. */
+    char* data;
+    size_t len;
+    size_t headlen;
+
+    /* Status code and validators of the response. */
+    int status;
+    uhttp_validators_t validators;
+
+    /* Clock time in milliseconds the response goes stale. */
+    uint64_t expires;
+
+    /* References, one of them held by the cache while the entry is in it. */
+    int refs;
+    /* Non-zero while the response is being generated. */
+    int pending;
+    /* Non-zero while the entry can be found in the cache. */
+    int cached;
+
+    /* Opaque pointers of the requests waiting for the response. */
+    uhttp_list_t waiters;
+} uhttp_cache_entry_t;
+
+typedef struct uhttp_cache_t
+{
+    uhttp_cache_entry_t* buckets[UHTTP_CACHE_BUCKETS];
+
+    /* Most and least recently used entries. */
+    uhttp_cache_entry_t* newest;
+    uhttp_cache_entry_t* oldest;
+
+    /* Bytes held by cached entries. */
+    size_t size;
+    /* Upper bound of size. */
+    size_t budget;
+} uhttp_cache_t;
+
+/**
+ * Create a response cache.
+ * @param cache Cache object.
+ * @param budget Maximum number of bytes held by entries.
+ */
+extern void uhttp_cache_create(uhttp_cache_t* cache, size_t budget);
+
+/**
+ * Remove every entry from the cache.
+ * @param cache Cache object.
+ */
+extern void uhttp_cache_clear(uhttp_cache_t* cache);
+
+/**
+ * Find a fresh or pending entry, dropping it if it is stale.
+ * @param cache Cache object.
+ * @param key Cache key.
+ * @param keylen Length of the key.
+ * @param now Current clock time in milliseconds.
+ * @return Entry or NULL if there is none. The entry is not referenced.
+ */
+extern uhttp_cache_entry_t* uhttp_cache_get(uhttp_cache_t* cache, const char* key, size_t keylen, uint64_t now);
+
+/**
+ * Insert a pending entry for a response about to be generated.
+ * @param cache Cache object.
+ * @param key Cache key, must not be in the cache.
+ * @param keylen Length of the key.
+ * @return Entry referenced for the caller or NULL for failure (see errno).
+ */
+extern uhttp_cache_entry_t* uhttp_cache_begin(uhttp_cache_t* cache, const char* key, size_t keylen);
+
+/**
+ * Complete a pending entry with its response.
+ * @param cache Cache object.
+ * @param entry Pending entry.
+ * @param data Rendered response allocated with malloc, owned by the entry.
+ * @param len Length of the response.
+ * @param headlen Length of the head without its blank line.
+ * @param expires Clock time the response goes stale. Responses that are
+ * already stale or larger than the budget are removed from the cache.
+ * @param now Current clock time in milliseconds.
+ * @remarks
+ * Least recently used entries are evicted to stay within the budget.
+ */
+extern void uhttp_cache_fill(uhttp_cache_t* cache, uhttp_cache_entry_t* entry, char* data, size_t len, size_t headlen, uint64_t expires, uint64_t now);
+
+/**
+ * Remove an entry from the cache, leaving other references valid.
+ * @param cache Cache object.
+ * @param entry Entry object.
+ */
+extern void uhttp_cache_remove(uhttp_cache_t* cache, uhttp_cache_entry_t* entry);
+
+/**
+ * Drop a reference to an entry, destroying it with the last one.
+ * @param entry Entry object.
+ */
+extern void uhttp_cache_release(uhttp_cache_entry_t* entry);
+
+#endif
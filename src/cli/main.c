@@ -8,21 +8,44 @@
 uhttp_server_t* server;
 int spin = 1;
 
+#if UHTTP_STATIC_MEMORY
+/* Room for the server and eight connections, see the README. */
+static _Alignas(16) char memory[74 * 1024];
+#endif
+
 int main(int argc, char** argv)
 {
     uhttp_socket_init();
 
+#if UHTTP_STATIC_MEMORY
+    server = uhttp_create_static(memory, sizeof(memory));
+#else
     server = uhttp_create();
+#endif
 
     uhttp_option_arg_t arg;
-    arg.addr.domain = UHTTP_SOCKET_DOMAIN_INET4;
-    arg.addr.port = 8080;
-    arg.addr.address[0] = 127;
-    arg.addr.address[1] = 0;
-    arg.addr.address[2] = 0;
-    arg.addr.address[3] = 1;
+    memset(&arg, 0, sizeof(arg));
+    if (argc > 1)
+    {
+        // Listen on a Unix domain socket path instead.
+        arg.addr.domain = UHTTP_SOCKET_DOMAIN_UNIX;
+        strncpy(arg.addr.path, argv[1], sizeof(arg.addr.path) - 1);
+    }
+    else
+    {
+        arg.addr.domain = UHTTP_SOCKET_DOMAIN_INET4;
+        arg.addr.port = 8080;
+        arg.addr.address[0] = 127;
+        arg.addr.address[1] = 0;
+        arg.addr.address[2] = 0;
+        arg.addr.address[3] = 1;
+    }
     uhttp_setoption(server, UHTTP_OPTION_BIND_ADDR, &arg);
 
+    // Block in the poll until there is something to do.
+    arg.integer = -1;
+    uhttp_setoption(server, UHTTP_OPTION_POLL_TIMEOUT, &arg);
+
     uhttp_start(server);
 
     while (spin)
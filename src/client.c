@@ -21,34 +21,2067 @@
  */
 #define _UHTTP_INTERNAL_
 #include "client.h"
+#include "request.h"
+#include "clock.h"
+#include "transport.h"
+#include "conditional.h"
+#include "range.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if _WIN32
+#include <io.h>
+#define close _close
+#else
+#include <unistd.h>
+#endif
+
+#define UHTTP_RESPONSE(status) \
+    "HTTP/1.1 " status "\r\n" \
+    "Content-Length: 0\r\n" \
+    "\r\n"
+
+#define UHTTP_RESPONSE_CLOSE(status) \
+    "HTTP/1.1 " status "\r\n" \
+    "Content-Length: 0\r\n" \
+    "Connection: close\r\n" \
+    "\r\n"
+
+static const char uhttp_response_not_found[] = UHTTP_RESPONSE("404 Not Found");
+static const char uhttp_response_not_found_close[] = UHTTP_RESPONSE_CLOSE("404 Not Found");
+static const char uhttp_response_bad_request[] = UHTTP_RESPONSE_CLOSE("400 Bad Request");
+static const char uhttp_response_too_large[] = UHTTP_RESPONSE_CLOSE("431 Request Header Fields Too Large");
+static const char uhttp_response_uri_too_long[] = UHTTP_RESPONSE_CLOSE("414 URI Too Long");
+static const char uhttp_response_not_implemented[] = UHTTP_RESPONSE_CLOSE("501 Not Implemented");
+#if UHTTP_FEATURE_RATELIMIT
+static const char uhttp_response_rate_limited[] = UHTTP_RESPONSE_CLOSE("429 Too Many Requests");
+#endif
+
+#if UHTTP_FEATURE_CONDITIONAL
+static const char uhttp_header_close[] = "Connection: close\r\n";
+static const char uhttp_status_not_modified[] = "HTTP/1.1 304 Not Modified\r\n";
+#endif
+
+/* Size of the stack buffer response heads are rendered into. */
+#define UHTTP_CLIENT_HEAD_SIZE 512
+
+#if UHTTP_FEATURE_FILES
+/* Most bytes sent from a file per call, so one download cannot starve the
+   other clients. */
+#define UHTTP_CLIENT_FILE_CHUNK (256 * 1024)
+
+static void uhttp_client_close_file(uhttp_client_t* client);
+static void uhttp_client_abort_file(uhttp_client_t* client);
+#endif
+
+#if UHTTP_FEATURE_PROXY
+/* Most bytes relayed from an upstream per call. */
+#define UHTTP_CLIENT_RELAY_CHUNK (256 * 1024)
+
+static void uhttp_client_close_relay(uhttp_client_t* client, int reusable);
+static void uhttp_client_abort_relay(uhttp_client_t* client);
+#endif
+
+#if UHTTP_FEATURE_AWAIT
+static void uhttp_client_cancel(uhttp_client_t* client);
+#endif
+
+#if UHTTP_FEATURE_CACHE
+#define uhttp_client_filling(client) ((client)->filling)
+#else
+#define uhttp_client_filling(client) 0
+#endif
 
 int uhttp_client_create(uhttp_client_t* client)
 {
     client->events = 0;
+    client->rxlen = 0;
+    client->rxpos = 0;
+    client->rxskip = 0;
+    client->tx = NULL;
+    client->txlen = 0;
+    client->txcap = 0;
+    client->txresponses = 0;
+    client->throttled = 0;
+    client->txsince = 0;
+    client->txsent = 0;
+    client->limits = NULL;
+    client->transport = NULL;
+#if UHTTP_FEATURE_FILES
+    client->file = NULL;
+#endif
+#if UHTTP_FEATURE_PROXY
+    client->relay = NULL;
+#endif
+    client->closing = 0;
+    client->cork = 0;
+    client->pending = 0;
+    client->dispatching = 0;
+    client->resume = 0;
+#if UHTTP_FEATURE_RATELIMIT
+    // Admitted along with the connection.
+    client->admitted = 1;
+#endif
+#if UHTTP_FEATURE_CACHE
+    client->entry = NULL;
+    client->filling = 0;
+    client->redispatch = 0;
+    client->uncached = 0;
+    client->cache_ttl = 0;
+#endif
+#if UHTTP_FEATURE_AWAIT
+    client->await.point = 0;
+    client->await.wait = 0;
+#endif
+    client->request.client = NULL;
+    client->request.method.len = 0;
+    client->rx = malloc(UHTTP_CLIENT_RX_SIZE);
+
+    if (client->rx == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
     return 0;
 }
 
+/**
+ * Discard the transmit buffer.
+ * @param client Client object.
+ */
+static void uhttp_client_drop(uhttp_client_t* client)
+{
+    if (client->txlen || client->txresponses)
+    {
+        uhttp_server_account(client->sv, -(ssize_t)client->txlen, -client->txresponses);
+    }
+
+    client->txlen = 0;
+    client->txresponses = 0;
+    client->throttled = 0;
+
+#if UHTTP_FEATURE_FILES
+    if (client->file)
+    {
+        uhttp_client_abort_file(client);
+    }
+#endif
+#if UHTTP_FEATURE_PROXY
+    if (client->relay)
+    {
+        uhttp_client_abort_relay(client);
+    }
+#endif
+}
+
+#if UHTTP_FEATURE_CACHE
+/**
+ * Give up the cache entry the request of a client was to fill, it is not
+ * answered through the cache. Waiting requests go to their route again.
+ * @param client Client object.
+ * @param uncached Non-zero if the response is never cached, the waiting
+ * requests then bypass the cache instead of waiting for each other again.
+ */
+static void uhttp_client_abandon(uhttp_client_t* client, int uncached)
+{
+    uhttp_cache_entry_t* entry = client->entry;
+
+    // Later requests for the key generate it again.
+    uhttp_cache_remove(uhttp_server_cache(client->sv), entry);
+
+    for (size_t i = 0; i < entry->waiters.nlen; i++)
+    {
+        uhttp_client_t* waiter = uhttp_list_index(&entry->waiters, uhttp_client_t*, i);
+        waiter->entry = NULL;
+        waiter->redispatch = 1;
+        waiter->uncached = uncached;
+        waiter->resume = 1;
+        uhttp_cache_release(entry);
+    }
+    uhttp_list_clear(&entry->waiters);
+
+    client->entry = NULL;
+    client->filling = 0;
+    uhttp_cache_release(entry);
+}
+
+/**
+ * Stop waiting for a cache entry.
+ * @param client Client object.
+ */
+static void uhttp_client_unwait(uhttp_client_t* client)
+{
+    uhttp_cache_entry_t* entry = client->entry;
+
+    for (size_t i = 0; i < entry->waiters.nlen; i++)
+    {
+        if (uhttp_list_index(&entry->waiters, uhttp_client_t*, i) == client)
+        {
+            uhttp_list_remove(&entry->waiters, (int)i);
+            break;
+        }
+    }
+
+    client->entry = NULL;
+    uhttp_cache_release(entry);
+}
+#endif
+
 void uhttp_client_destroy(uhttp_client_t* client)
 {
-    uhttp_close(client->sck);
+#if UHTTP_FEATURE_AWAIT
+    // Suspended handlers free what they hold before the request goes.
+    uhttp_client_cancel(client);
+#endif
+#if UHTTP_FEATURE_FILES
+    if (client->file)
+    {
+        uhttp_client_close_file(client);
+    }
+#endif
+#if UHTTP_FEATURE_PROXY
+    if (client->relay)
+    {
+        uhttp_client_close_relay(client, 0);
+    }
+#endif
+    // An unanswered request no longer counts against the server.
+    if (client->pending)
+    {
+        uhttp_server_account(client->sv, 0, -1);
+        client->pending = 0;
+    }
+    uhttp_client_drop(client);
+    if (client->sck != UHTTP_INVALID_SOCKET)
+    {
+        uhttp_transport_close(client->transport, client->sck);
+    }
+#if UHTTP_FEATURE_CACHE
+    if (client->filling)
+    {
+        uhttp_client_abandon(client, 0);
+    }
+    else if (client->entry)
+    {
+        uhttp_client_unwait(client);
+    }
+#endif
+    free(client->rx);
+    free(client->tx);
+    client->rx = NULL;
+    client->tx = NULL;
 }
 
-int uhttp_client_event(uhttp_client_t* client)
+/**
+ * Append data to the transmit buffer.
+ * @param client Client object.
+ * @param data Data to queue.
+ * @param len Length of data.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_client_queue(uhttp_client_t* client, const char* data, size_t len)
+{
+    if (client->txlen + len > client->txcap)
+    {
+        size_t cap = client->txcap ? client->txcap * 2 : 1024;
+        while (cap < client->txlen + len) cap *= 2;
+
+#ifdef UHTTP_CLIENT_TX_MAX
+        if (client->txlen + len > UHTTP_CLIENT_TX_MAX)
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+        if (cap > UHTTP_CLIENT_TX_MAX) cap = UHTTP_CLIENT_TX_MAX;
+#endif
+
+        char* xtx = realloc(client->tx, cap);
+        if (xtx == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        client->tx = xtx;
+        client->txcap = cap;
+    }
+
+    // The drain rate is measured from when output starts to back up.
+    if (client->txlen == 0)
+    {
+        client->txsince = uhttp_clock_ms();
+        client->txsent = 0;
+    }
+
+    memcpy(client->tx + client->txlen, data, len);
+    client->txlen += len;
+    uhttp_server_account(client->sv, len, 0);
+
+    return 0;
+}
+
+/**
+ * Write data to the client, queueing whatever the socket does not take.
+ * @param client Client object.
+ * @param parts Data to write in order.
+ * @param nparts Number of parts.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_client_writev(uhttp_client_t* client, const uhttp_str_t* parts, size_t nparts)
+{
+    size_t sent = 0;
+
+    // Only write directly if that keeps the data in order.
+    if (client->txlen == 0)
+    {
+        ssize_t xsent = (nparts == 1) ?
+            uhttp_transport_send(client->transport, client->sck, parts[0].ptr, parts[0].len) :
+            uhttp_transport_sendv(client->transport, client->sck, parts, nparts);
+
+        if (xsent < 0)
+        {
+            if (errno != EAGAIN) return -1;
+            xsent = 0;
+        }
+
+        uhttp_trace(SEND, client, xsent);
+        sent = xsent;
+    }
+
+    for (size_t i = 0; i < nparts; i++)
+    {
+        if (sent >= parts[i].len)
+        {
+            sent -= parts[i].len;
+            continue;
+        }
+
+        if (uhttp_client_queue(client, parts[i].ptr + sent, parts[i].len - sent))
+        {
+            return -1;
+        }
+        sent = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * Write as much of the transmit buffer as the socket takes.
+ * @param client Client object.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_client_flush(uhttp_client_t* client)
+{
+    size_t pos = 0;
+
+    while (pos < client->txlen)
+    {
+        ssize_t sent = uhttp_transport_send(client->transport, client->sck, client->tx + pos, client->txlen - pos);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN) break;
+            return -1;
+        }
+
+        uhttp_trace(SEND, client, sent);
+        pos += sent;
+    }
+
+    client->txlen -= pos;
+    client->txsent += pos;
+    memmove(client->tx, client->tx + pos, client->txlen);
+    uhttp_server_account(client->sv, -(ssize_t)pos, 0);
+
+    // Drained enough, dispatch the requests held back in the next poll.
+    if (client->throttled && client->txlen <= client->limits->tx_low)
+    {
+        client->throttled = 0;
+        client->resume = 1;
+    }
+
+    // Every queued response has been sent once the buffer is empty.
+    if (client->txlen == 0)
+    {
+        uhttp_server_account(client->sv, 0, -client->txresponses);
+        client->txresponses = 0;
+    }
+
+    return 0;
+}
+
+#if UHTTP_FEATURE_ACCESS_LOG
+/**
+ * Log a response with the request it answers.
+ * @param client Client object.
+ * @param log Log object.
+ * @param head Start of the response, the status line and header fields.
+ */
+static void uhttp_client_log(uhttp_client_t* client, uhttp_access_log_t* log, const uhttp_str_t* head)
+{
+    static const char field[] = "\r\nContent-Length: ";
+    const char* pos = head->ptr;
+    const char* end = head->ptr + head->len;
+    int status = 0;
+    int64_t bytes = 0;
+
+    // "HTTP/1.1 200 ..." as rendered by this file.
+    if (head->len > 12)
+    {
+        status = (pos[9] - '0') * 100 + (pos[10] - '0') * 10 + (pos[11] - '0');
+    }
+
+    while ((pos = memchr(pos, '\r', end - pos)) != NULL)
+    {
+        if ((size_t)(end - pos) > sizeof(field) - 1 && memcmp(pos, field, sizeof(field) - 1) == 0)
+        {
+            for (pos += sizeof(field) - 1; pos < end && *pos >= '0' && *pos <= '9'; pos++)
+            {
+                bytes = bytes * 10 + (*pos - '0');
+            }
+            break;
+        }
+        pos++;
+    }
+
+    const uhttp_request_t* request = client->request.method.len ? &client->request : NULL;
+    uhttp_access_log_push(log, &client->src, request, status, bytes);
+}
+#endif
+
+/**
+ * Send a complete response to the client.
+ * @param client Client object.
+ * @param parts Response data in order.
+ * @param nparts Number of parts.
+ * @param keep_alive Zero to close the client after sending.
+ */
+static void uhttp_client_respondv(uhttp_client_t* client, const uhttp_str_t* parts, size_t nparts, int keep_alive)
+{
+    // A client that is already closing takes no more responses.
+    if (client->closing)
+    {
+        return;
+    }
+
+#if UHTTP_FEATURE_ACCESS_LOG
+    uhttp_access_log_t* log = uhttp_server_access_log(client->sv);
+    if (log)
+    {
+        uhttp_client_log(client, log, &parts[0]);
+    }
+#endif
+
+    size_t txlen = client->txlen;
+
+    if (uhttp_client_writev(client, parts, nparts))
+    {
+        // Broken connection, nothing more can be sent.
+        client->closing = 1;
+        uhttp_client_drop(client);
+        return;
+    }
+
+    if (client->txlen > txlen)
+    {
+        client->txresponses++;
+        uhttp_server_account(client->sv, 0, 1);
+    }
+
+    // Hold back the pipelined requests of a client over its high watermark,
+    // or one adding to buffers past the budget of all clients, until its
+    // own buffer drains. The minimum send rate evicts those that do not.
+    if ((client->limits->tx_high && client->txlen > client->limits->tx_high) ||
+        (client->limits->tx_budget && client->txlen && uhttp_server_queued(client->sv) > client->limits->tx_budget))
+    {
+        client->throttled = 1;
+    }
+
+    if (!keep_alive)
+    {
+        client->closing = 1;
+    }
+}
+
+/**
+ * Send a complete response to the client.
+ * @param client Client object.
+ * @param response Response string.
+ * @param len Length of the response.
+ * @param keep_alive Zero to close the client after sending.
+ */
+static void uhttp_client_respond(uhttp_client_t* client, const char* response, size_t len, int keep_alive)
+{
+    uhttp_str_t part = { response, len };
+    uhttp_client_respondv(client, &part, 1, keep_alive);
+}
+
+#if UHTTP_FEATURE_CACHE
+/**
+ * Send a cached response, inserting the close header if needed.
+ * @param client Client object.
+ * @param entry Filled cache entry.
+ * @param keep_alive Zero to close the client after sending.
+ */
+static void uhttp_client_serve(uhttp_client_t* client, const uhttp_cache_entry_t* entry, int keep_alive)
+{
+    if (keep_alive)
+    {
+        uhttp_client_respond(client, entry->data, entry->len, 1);
+        return;
+    }
+
+    uhttp_str_t parts[3] = {
+        { entry->data, entry->headlen },
+        { uhttp_header_close, sizeof(uhttp_header_close) - 1 },
+        { entry->data + entry->headlen, entry->len - entry->headlen }
+    };
+    uhttp_client_respondv(client, parts, 3, 0);
+}
+#endif
+
+#if UHTTP_FEATURE_CONDITIONAL
+/**
+ * Send 304 Not Modified, repeating the validators of the representation.
+ * @param client Client object.
+ * @param validators Validators of the current representation.
+ * @param keep_alive Zero to close the client after sending.
+ */
+static void uhttp_client_not_modified(uhttp_client_t* client, const uhttp_validators_t* validators, int keep_alive)
+{
+    uhttp_str_t parts[5];
+    size_t nparts = 0;
+
+    parts[nparts].ptr = uhttp_status_not_modified;
+    parts[nparts++].len = sizeof(uhttp_status_not_modified) - 1;
+    if (validators->etag_line.len)
+    {
+        parts[nparts++] = validators->etag_line;
+    }
+    if (validators->modified_line.len)
+    {
+        parts[nparts++] = validators->modified_line;
+    }
+    if (!keep_alive)
+    {
+        parts[nparts].ptr = uhttp_header_close;
+        parts[nparts++].len = sizeof(uhttp_header_close) - 1;
+    }
+    parts[nparts].ptr = "\r\n";
+    parts[nparts++].len = 2;
+
+    uhttp_client_respondv(client, parts, nparts, keep_alive);
+}
+#endif
+
+static const char* uhttp_status_reason(int status)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 303: return "See Other";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 410: return "Gone";
+    case 412: return "Precondition Failed";
+    case 413: return "Content Too Large";
+    case 416: return "Range Not Satisfiable";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: break;
+    }
+
+    switch (status / 100)
+    {
+    case 1: return "Informational";
+    case 2: return "Success";
+    case 3: return "Redirection";
+    case 4: return "Client Error";
+    default: return "Server Error";
+    }
+}
+
+/**
+ * Render a response head.
+ * @param buffer Buffer to render into, may be NULL if cap is zero.
+ * @param cap Size of the buffer.
+ * @param extra Text appended after the header lines.
+ * @return Length of the head, larger than cap if it did not fit.
+ */
+static int uhttp_render_head(char* buffer, size_t cap, int status, const char* headers, size_t len, const char* extra)
+{
+    return snprintf(buffer, cap,
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Length: %zu\r\n"
+        "%s%s",
+        status, uhttp_status_reason(status), len, headers ? headers : "", extra);
+}
+
+#if UHTTP_FEATURE_CACHE
+/**
+ * Render a response for the cache, head first without its blank line.
+ * @return Allocated response or NULL for failure (see errno).
+ */
+static char* uhttp_render_response(int status, const char* headers, const void* body, size_t len, int omit_body, size_t* total, size_t* headlen)
+{
+    int head = uhttp_render_head(NULL, 0, status, headers, len, "");
+    if (head < 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t bodylen = omit_body ? 0 : len;
+    char* data = malloc((size_t)head + 1 + 2 + bodylen);
+    if (data == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    uhttp_render_head(data, (size_t)head + 1, status, headers, len, "");
+    memcpy(data + head, "\r\n", 2);
+    memcpy(data + head + 2, body, bodylen);
+
+    *headlen = head;
+    *total = head + 2 + bodylen;
+    return data;
+}
+#endif
+
+static int uhttp_request_method_is(const uhttp_request_t* request, const char* method)
+{
+    size_t len = strlen(method);
+    return request->method.len == len && memcmp(request->method.ptr, method, len) == 0;
+}
+
+#if UHTTP_FEATURE_CACHE
+/**
+ * Append to a cache key.
+ * @return Zero when successful, -1 if the key is full.
+ */
+static int uhttp_cache_key_append(char* key, size_t* keylen, size_t cap, const char* data, size_t len)
+{
+    if (cap - *keylen < len)
+    {
+        return -1;
+    }
+
+    memcpy(key + *keylen, data, len);
+    *keylen += len;
+    return 0;
+}
+
+/**
+ * Build the cache key of a request, its method, target and varying fields.
+ * @return Length of the key, zero if it does not fit.
+ */
+static size_t uhttp_client_cache_key(const uhttp_request_t* request, const uhttp_server_route_t* route, char* key, size_t cap)
+{
+    size_t keylen = 0;
+
+    if (uhttp_cache_key_append(key, &keylen, cap, request->method.ptr, request->method.len) ||
+        uhttp_cache_key_append(key, &keylen, cap, " ", 1) ||
+        uhttp_cache_key_append(key, &keylen, cap, request->target.ptr, request->target.len))
+    {
+        return 0;
+    }
+
+    for (const char* name = route->vary; *name; name += strlen(name) + 1)
+    {
+        const uhttp_str_t* value = uhttp_request_header(request, name);
+
+        if (uhttp_cache_key_append(key, &keylen, cap, "\n", 1) ||
+            (value && uhttp_cache_key_append(key, &keylen, cap, value->ptr, value->len)))
+        {
+            return 0;
+        }
+    }
+
+    return keylen;
+}
+#endif
+
+/**
+ * Mark the request of a client as answered.
+ * @param client Client object.
+ */
+static void uhttp_client_complete(uhttp_client_t* client)
 {
-    if (client->events & UHTTP_EVENT_HANGUP)
+    uhttp_trace(RESPOND, client, 0);
+    if (client->pending)
+    {
+        uhttp_server_account(client->sv, 0, -1);
+    }
+    client->pending = 0;
+#if UHTTP_FEATURE_CACHE
+    // Answered without filling the entry it was to fill.
+    if (client->filling)
+    {
+        uhttp_client_abandon(client, 0);
+    }
+#endif
+#if UHTTP_FEATURE_AWAIT
+    client->await.wait = 0;
+#endif
+    client->request.client = NULL;
+
+    // Answered outside of dispatch, continue with pipelined requests later.
+    if (!client->dispatching)
     {
-        uhttp_server_close_client(client);
+        client->resume = 1;
     }
+}
+
+#if UHTTP_FEATURE_FILES
+/**
+ * Close the file of a file response.
+ * @param client Client object.
+ */
+static void uhttp_client_close_file(uhttp_client_t* client)
+{
+    close(client->file->fd);
+    free(client->file);
+    client->file = NULL;
+}
+
+/**
+ * Give up on a file response, the connection cannot continue.
+ * @param client Client object.
+ */
+static void uhttp_client_abort_file(uhttp_client_t* client)
+{
+    uhttp_client_close_file(client);
+    client->closing = 1;
+    uhttp_client_complete(client);
+}
+
+/**
+ * Send as much of the file response as the socket takes.
+ * @param client Client object.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_client_send_file(uhttp_client_t* client)
+{
+    uhttp_client_file_t* file = client->file;
+    size_t budget = UHTTP_CLIENT_FILE_CHUNK;
 
-    if (client->events & UHTTP_EVENT_ERROR)
+    for (;;)
     {
-        // TODO:
+        uhttp_str_t* part = &file->parts[file->index];
+        while (part->len)
+        {
+            ssize_t sent = uhttp_transport_send(client->transport, client->sck, part->ptr, part->len);
+            if (sent < 0)
+            {
+                return errno == EAGAIN ? 0 : -1;
+            }
+            uhttp_trace(SEND, client, sent);
+
+            part->ptr += sent;
+            part->len -= sent;
+        }
+
+        if (file->index == file->nranges)
+        {
+            break;
+        }
+
+        const uhttp_range_t* range = &file->ranges[file->index];
+        while (file->offset <= range->last)
+        {
+            // Yield to the other clients, the socket is still writable.
+            if (budget == 0)
+            {
+                return 0;
+            }
+
+            int64_t left = range->last - file->offset + 1;
+            size_t len = (size_t)left < budget ? (size_t)left : budget;
+            ssize_t sent = uhttp_transport_sendfile(client->transport, client->sck, file->fd, file->offset, len);
+            if (sent < 0)
+            {
+                return errno == EAGAIN ? 0 : -1;
+            }
+            else if (sent == 0)
+            {
+                // The file shrank, the promised length cannot be sent.
+                errno = EIO;
+                return -1;
+            }
+
+            uhttp_trace(SEND, client, sent);
+            file->offset += sent;
+            budget -= sent;
+        }
+
+        if (++file->index < file->nranges)
+        {
+            file->offset = file->ranges[file->index].first;
+        }
     }
 
-    if (client->events & UHTTP_EVENT_RECEIVE)
+    if (!file->keep_alive)
     {
-        // TODO:
+        client->closing = 1;
     }
 
+    uhttp_client_close_file(client);
+    uhttp_client_complete(client);
+    return 0;
+}
+#endif
+
+#if UHTTP_FEATURE_PROXY
+/**
+ * Release the relay of a relayed response.
+ * @param client Client object.
+ * @param reusable Non-zero if the upstream connection can be reused.
+ */
+static void uhttp_client_close_relay(uhttp_client_t* client, int reusable)
+{
+    uhttp_client_relay_t* relay = client->relay;
+    client->relay = NULL;
+    relay->release(relay, reusable);
+}
+
+/**
+ * Give up on a relayed response, the connection cannot continue.
+ * @param client Client object.
+ */
+static void uhttp_client_abort_relay(uhttp_client_t* client)
+{
+    uhttp_client_close_relay(client, 0);
+    client->closing = 1;
+    uhttp_client_complete(client);
+}
+
+/**
+ * Complete a relayed response after the whole body was relayed.
+ * @param client Client object.
+ */
+static void uhttp_client_end_relay(uhttp_client_t* client)
+{
+    uhttp_client_relay_t* relay = client->relay;
+    if (!relay->keep_alive)
+    {
+        client->closing = 1;
+    }
+
+    uhttp_client_close_relay(client, relay->reusable);
+    uhttp_client_complete(client);
+}
+
+/**
+ * Relay as much of the response body as the upstream has and the socket
+ * takes.
+ * @param client Client object.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_client_send_relay(uhttp_client_t* client)
+{
+    uhttp_client_relay_t* relay = client->relay;
+    size_t budget = UHTTP_CLIENT_RELAY_CHUNK;
+
+    relay->starved = 0;
+    for (;;)
+    {
+        // Bytes already read go out first.
+        while (relay->spliced ? relay->splice.len != 0 : relay->bufpos < relay->buflen)
+        {
+            ssize_t sent = relay->spliced ?
+                uhttp_splice_out(&relay->splice, client->sck) :
+                uhttp_transport_send(client->transport, client->sck, relay->buffer + relay->bufpos, relay->buflen - relay->bufpos);
+            if (sent < 0)
+            {
+                return errno == EAGAIN ? 0 : -1;
+            }
+            uhttp_trace(SEND, client, sent);
+
+            if (!relay->spliced)
+            {
+                relay->bufpos += sent;
+            }
+        }
+
+        if (relay->ended)
+        {
+            break;
+        }
+        else if (budget == 0)
+        {
+            // Yield to the other clients, the socket is still writable.
+            return 0;
+        }
+
+        size_t len = relay->spliced ? budget : relay->bufcap;
+        if (relay->framing == UHTTP_PROXY_LENGTH && (uint64_t)relay->left < len)
+        {
+            len = (size_t)relay->left;
+        }
+
+        ssize_t received;
+        if (relay->spliced)
+        {
+            received = uhttp_splice_in(&relay->splice, relay->sock, len);
+        }
+        else
+        {
+            received = uhttp_recv(relay->sock, relay->buffer, len);
+            relay->bufpos = 0;
+            relay->buflen = received > 0 ? (size_t)received : 0;
+        }
+
+        if (received < 0)
+        {
+            if (errno != EAGAIN)
+            {
+                return -1;
+            }
+
+            // The server polls the upstream until it has more.
+            relay->starved = 1;
+            return 0;
+        }
+        else if (received == 0)
+        {
+            // Only a body delimited by the connection closing ends here.
+            if (relay->framing != UHTTP_PROXY_CLOSE)
+            {
+                errno = EPIPE;
+                return -1;
+            }
+
+            relay->ended = 1;
+            continue;
+        }
+
+        budget -= (size_t)received < budget ? (size_t)received : budget;
+        if (relay->framing == UHTTP_PROXY_LENGTH)
+        {
+            relay->left -= received;
+            relay->ended = relay->left == 0;
+        }
+        else if (relay->framing == UHTTP_PROXY_CHUNKED)
+        {
+            ssize_t body = uhttp_chunked_scan(&relay->chunked, relay->buffer, relay->buflen);
+            if (body < 0)
+            {
+                return -1;
+            }
+
+            // Bytes after the last chunk are not part of the response.
+            if ((size_t)body < relay->buflen)
+            {
+                relay->buflen = body;
+                relay->reusable = 0;
+            }
+            relay->ended = uhttp_chunked_done(&relay->chunked);
+        }
+    }
+
+    uhttp_client_end_relay(client);
+    return 0;
+}
+
+void uhttp_client_respond_relay(uhttp_client_t* client, const uhttp_str_t* parts, size_t nparts, uhttp_client_relay_t* relay)
+{
+#if UHTTP_FEATURE_CACHE
+    // Relayed responses are not cached.
+    if (client->filling)
+    {
+        uhttp_client_abandon(client, 0);
+    }
+#endif
+    uhttp_client_respondv(client, parts, nparts, 1);
+    client->request.client = NULL;
+    client->relay = relay;
+
+    if (client->closing)
+    {
+        uhttp_client_abort_relay(client);
+    }
+    else if (relay->ended)
+    {
+        uhttp_client_end_relay(client);
+    }
+    else if (client->txlen == 0 && uhttp_client_send_relay(client))
+    {
+        client->closing = 1;
+        uhttp_client_drop(client);
+    }
+}
+
+void uhttp_client_relay(uhttp_client_t* client)
+{
+    if (client->relay && client->txlen == 0 && uhttp_client_send_relay(client))
+    {
+        client->closing = 1;
+        uhttp_client_drop(client);
+    }
+}
+#endif
+
+/**
+ * Send the transmit buffer, then the file or relayed body following it.
+ * @param client Client object.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_client_send(uhttp_client_t* client)
+{
+    if (client->txlen && uhttp_client_flush(client))
+    {
+        return -1;
+    }
+    else if (client->txlen)
+    {
+        return 0;
+    }
+#if UHTTP_FEATURE_FILES
+    if (client->file)
+    {
+        return uhttp_client_send_file(client);
+    }
+#endif
+#if UHTTP_FEATURE_PROXY
+    if (client->relay)
+    {
+        return uhttp_client_send_relay(client);
+    }
+#endif
+    return 0;
+}
+
+#if UHTTP_FEATURE_CACHE
+/**
+ * Answer the request of a client from its cache entry, releasing the entry.
+ * @param client Client object.
+ */
+static void uhttp_client_answer(uhttp_client_t* client)
+{
+    uhttp_cache_entry_t* entry = client->entry;
+
+    if (entry->data && entry->status == 200 &&
+        uhttp_not_modified(&client->request, &entry->validators.etag, entry->validators.modified))
+    {
+        uhttp_client_not_modified(client, &entry->validators, client->request.keep_alive);
+    }
+    else if (entry->data)
+    {
+        uhttp_client_serve(client, entry, client->request.keep_alive);
+    }
+    else
+    {
+        // The response could not be rendered, there is nothing to send.
+        client->closing = 1;
+    }
+
+    client->entry = NULL;
+    uhttp_cache_release(entry);
+    uhttp_client_complete(client);
+}
+#endif
+
+/**
+ * Hand the parsed request to its route, or answer it from the cache.
+ * @param client Client object.
+ */
+static void uhttp_client_dispatch(uhttp_client_t* client)
+{
+    uhttp_request_t* request = &client->request;
+    const uhttp_server_route_t* route = uhttp_server_route(client->sv, request);
+#if UHTTP_FEATURE_CACHE
+    int uncached = client->uncached;
+    client->uncached = 0;
+#endif
+
+    if (route == NULL)
+    {
+        if (request->keep_alive)
+            uhttp_client_respond(client, uhttp_response_not_found, sizeof(uhttp_response_not_found) - 1, 1);
+        else
+            uhttp_client_respond(client, uhttp_response_not_found_close, sizeof(uhttp_response_not_found_close) - 1, 0);
+        return;
+    }
+
+    request->client = client;
+    client->pending = 1;
+    uhttp_server_account(client->sv, 0, 1);
+
+#if UHTTP_FEATURE_CACHE
+    uhttp_cache_t* cache = uhttp_server_cache(client->sv);
+    if (!uncached && route->route.cache_ttl && cache->budget &&
+        (uhttp_request_method_is(request, "GET") || uhttp_request_method_is(request, "HEAD")))
+    {
+        char key[UHTTP_CLIENT_RX_SIZE];
+        size_t keylen = uhttp_client_cache_key(request, route, key, sizeof(key));
+        uhttp_cache_entry_t* entry = keylen ? uhttp_cache_get(cache, key, keylen, uhttp_clock_ms()) : NULL;
+        void* waiter = client;
+
+        if (entry && entry->pending)
+        {
+            // Coalesce with the request generating the response.
+            if (uhttp_list_append(&entry->waiters, &waiter) == 0)
+            {
+                entry->refs++;
+                client->entry = entry;
+                return;
+            }
+        }
+        else if (entry)
+        {
+            entry->refs++;
+            client->entry = entry;
+            uhttp_client_answer(client);
+            return;
+        }
+        else if (keylen && (entry = uhttp_cache_begin(cache, key, keylen)) != NULL)
+        {
+            client->entry = entry;
+            client->filling = 1;
+            client->cache_ttl = route->route.cache_ttl;
+        }
+    }
+#endif
+
+#if UHTTP_FEATURE_AWAIT
+    client->await.point = 0;
+    client->await.wait = 0;
+    client->await.handler = route->route.handler;
+    client->await.user = route->route.user;
+#endif
+
+    uhttp_trace(DISPATCH_BEGIN, client, 0);
+    route->route.handler(request, route->route.user);
+    uhttp_trace(DISPATCH_END, client, 0);
+}
+
+#if UHTTP_FEATURE_AWAIT
+void uhttp_client_continue(uhttp_client_t* client, uhttp_event_t revents)
+{
+    client->await.wait = 0;
+    client->await.revents = revents;
+
+    uhttp_trace(DISPATCH_BEGIN, client, 0);
+    client->await.handler(&client->request, client->await.user);
+    uhttp_trace(DISPATCH_END, client, 0);
+}
+
+/**
+ * Invoke a suspended handler a last time with UHTTP_EVENT_HANGUP, its client
+ * is going away. The handler cannot wait again and its answer is discarded.
+ * @param client Client object.
+ */
+static void uhttp_client_cancel(uhttp_client_t* client)
+{
+    if (!client->pending || client->await.wait == 0)
+    {
+        return;
+    }
+
+    client->closing = 1;
+    uhttp_client_continue(client, UHTTP_EVENT_HANGUP);
+
+    // A handler that did not answer is done with the request all the same.
+    if (client->pending)
+    {
+        uhttp_client_complete(client);
+    }
+}
+
+/**
+ * Read more of the body a suspended handler waits for.
+ * @param client Client object.
+ */
+static void uhttp_client_receive_body(uhttp_client_t* client)
+{
+    // The head of the request fills the buffer, the body never fits.
+    if (client->rxlen == UHTTP_CLIENT_RX_SIZE)
+    {
+        uhttp_client_continue(client, UHTTP_EVENT_ERROR);
+        return;
+    }
+
+    ssize_t len = uhttp_transport_recv(client->transport, client->sck, client->rx + client->rxlen, UHTTP_CLIENT_RX_SIZE - client->rxlen);
+
+    if (len == 0)
+    {
+        client->closing = 1;
+        return;
+    }
+    else if (len < 0)
+    {
+        if (errno != EAGAIN)
+        {
+            client->closing = 1;
+            uhttp_client_drop(client);
+        }
+        return;
+    }
+
+    uhttp_trace(RECEIVE, client, len);
+    client->rxlen += len;
+    uhttp_client_continue(client, UHTTP_EVENT_RECEIVE);
+}
+#endif
+
+/**
+ * Answer every complete request in the receive buffer, until one of them is
+ * deferred by its handler.
+ * @param client Client object.
+ */
+static void uhttp_client_process(uhttp_client_t* client)
+{
+    size_t pos = client->rxpos;
+    int corked = 0;
+
+    client->dispatching = 1;
+    while (!client->closing && !client->pending && !client->throttled)
+    {
+        // Drop request bodies, there is nothing to consume them yet.
+        if (client->rxskip)
+        {
+            size_t skip = client->rxlen - pos < client->rxskip ? client->rxlen - pos : client->rxskip;
+            client->rxskip -= skip;
+            pos += skip;
+            if (client->rxskip) break;
+        }
+
+#if UHTTP_FEATURE_RATELIMIT
+        // Refused before parsing, so a flood costs one lookup per request.
+        if (!client->admitted && pos < client->rxlen)
+        {
+            if (!uhttp_server_admit(client->sv, &client->src))
+            {
+                client->request.method.len = 0;
+                uhttp_client_respond(client, uhttp_response_rate_limited, sizeof(uhttp_response_rate_limited) - 1, 0);
+                break;
+            }
+            client->admitted = 1;
+        }
+#endif
+
+        ssize_t head = uhttp_request_parse(&client->request, client->rx + pos, client->rxlen - pos);
+
+        if (head < 0)
+        {
+            client->request.method.len = 0;
+            if (errno == E2BIG)
+                uhttp_client_respond(client, uhttp_response_too_large, sizeof(uhttp_response_too_large) - 1, 0);
+            else if (errno == ENAMETOOLONG)
+                uhttp_client_respond(client, uhttp_response_uri_too_long, sizeof(uhttp_response_uri_too_long) - 1, 0);
+            else
+                uhttp_client_respond(client, uhttp_response_bad_request, sizeof(uhttp_response_bad_request) - 1, 0);
+            break;
+        }
+        else if (head == 0)
+        {
+            break;
+        }
+
+        uhttp_trace(PARSE, client, head);
+        pos += head;
+#if UHTTP_FEATURE_RATELIMIT
+        client->admitted = 0;
+#endif
+
+        // Coalesce the responses to every request in this read.
+        if (client->cork && !corked)
+        {
+            uhttp_setsockopt(client->sck, UHTTP_SOCKOPT_CORK, 1);
+            corked = 1;
+        }
+
+        if (client->request.chunked)
+        {
+            uhttp_client_respond(client, uhttp_response_not_implemented, sizeof(uhttp_response_not_implemented) - 1, 0);
+            break;
+        }
+
+        client->rxskip = client->request.content_length;
+        client->rxpos = pos;
+
+        uhttp_client_dispatch(client);
+    }
+    client->dispatching = 0;
+
+    if (corked)
+    {
+        uhttp_setsockopt(client->sck, UHTTP_SOCKOPT_CORK, 0);
+    }
+
+    // The slices of a pending request point into the buffer.
+    if (client->pending)
+    {
+        client->rxpos = pos;
+        return;
+    }
+
+    client->rxlen -= pos;
+    client->rxpos = 0;
+    memmove(client->rx, client->rx + pos, client->rxlen);
+
+    if (!client->closing && !client->throttled && client->rxlen == UHTTP_CLIENT_RX_SIZE)
+    {
+        client->request.method.len = 0;
+        uhttp_client_respond(client, uhttp_response_too_large, sizeof(uhttp_response_too_large) - 1, 0);
+    }
+}
+
+/**
+ * Read from client and answer the requests received.
+ * @param client Client object.
+ */
+static void uhttp_client_receive(uhttp_client_t* client)
+{
+    ssize_t len = uhttp_transport_recv(client->transport, client->sck, client->rx + client->rxlen, UHTTP_CLIENT_RX_SIZE - client->rxlen);
+
+    if (len == 0)
+    {
+        // Orderly shutdown, finish sending what is queued.
+        client->closing = 1;
+        return;
+    }
+    else if (len < 0)
+    {
+        if (errno != EAGAIN)
+        {
+            client->closing = 1;
+            uhttp_client_drop(client);
+        }
+        return;
+    }
+
+    uhttp_trace(RECEIVE, client, len);
+    client->rxlen += len;
+    uhttp_client_process(client);
+}
+
+void uhttp_client_resume(uhttp_client_t* client)
+{
+    client->resume = 0;
+
+#if UHTTP_FEATURE_CACHE
+    if (client->redispatch)
+    {
+        client->redispatch = 0;
+        uhttp_client_dispatch(client);
+        return;
+    }
+#endif
+
+    if (!client->closing && !client->pending && !client->throttled)
+    {
+        uhttp_client_process(client);
+    }
+}
+
+/**
+ * Close the socket of a client that is done, unless it still has to send.
+ * @param client Client object.
+ */
+static void uhttp_client_finish(uhttp_client_t* client)
+{
+    if (client->closing && client->txlen == 0)
+    {
+        if (client->pending)
+        {
+            // Keep the client until its handler answers, but not the socket.
+            uhttp_transport_close(client->transport, client->sck);
+            client->sck = UHTTP_INVALID_SOCKET;
+#if UHTTP_FEATURE_CACHE
+            // Nobody gets the response, waiting requests should not wait
+            // for it.
+            if (client->filling)
+            {
+                uhttp_client_abandon(client, 0);
+            }
+#endif
+#if UHTTP_FEATURE_AWAIT
+            // Nor should a suspended handler wait for anything else.
+            uhttp_client_cancel(client);
+#endif
+        }
+        else
+        {
+            uhttp_server_close_client(client);
+        }
+    }
+}
+
+uint64_t uhttp_client_check_rate(uhttp_client_t* client, uint64_t now)
+{
+    size_t rate = client->limits->min_send_rate;
+    if (rate == 0 || client->txlen == 0 || client->closing)
+    {
+        return 0;
+    }
+
+    uint64_t elapsed = now - client->txsince;
+    if (elapsed < UHTTP_CLIENT_RATE_WINDOW)
+    {
+        return client->txsince + UHTTP_CLIENT_RATE_WINDOW;
+    }
+
+    if ((uint64_t)client->txsent * 1000 < (uint64_t)rate * elapsed)
+    {
+        // Too slow a reader, give up on its output to free the buffer. The
+        // server closes the client unless its request is pending.
+        client->closing = 1;
+        uhttp_client_drop(client);
+        if (client->pending) uhttp_client_finish(client);
+        return 0;
+    }
+
+    client->txsince = now;
+    client->txsent = 0;
+    return now + UHTTP_CLIENT_RATE_WINDOW;
+}
+
+int uhttp_client_event(uhttp_client_t* client)
+{
+    if ((client->events & UHTTP_EVENT_SEND) && uhttp_client_sending(client) && uhttp_client_send(client))
+    {
+        client->closing = 1;
+        uhttp_client_drop(client);
+    }
+
+    // A closing client is only waiting for its transmit buffer to drain, a
+    // pending one for its request to be answered.
+    if ((client->events & UHTTP_EVENT_RECEIVE) && !client->closing && !client->pending)
+    {
+        uhttp_client_receive(client);
+    }
+#if UHTTP_FEATURE_AWAIT
+    else if ((client->events & UHTTP_EVENT_RECEIVE) && !client->closing && (client->await.wait & UHTTP_AWAIT_BODY))
+    {
+        uhttp_client_receive_body(client);
+    }
+#endif
+
+    if (client->events & (UHTTP_EVENT_HANGUP | UHTTP_EVENT_ERROR))
+    {
+        client->closing = 1;
+        uhttp_client_drop(client);
+    }
+
+    uhttp_client_finish(client);
+
+    return 0;
+}
+
+UHTTP_EXTERN int uhttp_request_tag(const uhttp_request_t* request)
+{
+    return request->client->tag;
+}
+
+UHTTP_EXTERN const uhttp_addr_t* uhttp_request_source(const uhttp_request_t* request)
+{
+    return &request->client->src;
+}
+
+UHTTP_EXTERN ssize_t uhttp_request_read(uhttp_request_t* request, void* buffer, size_t len)
+{
+    uhttp_client_t* client = request ? request->client : NULL;
+
+    if (client == NULL || (buffer == NULL && len))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // The body follows the head, bytes past it belong to the next request.
+    size_t avail = client->rxlen - client->rxpos;
+    if (avail > client->rxskip) avail = client->rxskip;
+    if (avail > len) avail = len;
+
+    if (avail == 0 && client->rxskip && len)
+    {
+        errno = (client->closing || client->sck == UHTTP_INVALID_SOCKET) ? ECONNRESET : EAGAIN;
+        return -1;
+    }
+
+    char* body = client->rx + client->rxpos;
+    memcpy(buffer, body, avail);
+    memmove(body, body + avail, client->rxlen - client->rxpos - avail);
+    client->rxlen -= avail;
+    client->rxskip -= avail;
+
+    return avail;
+}
+
+#if UHTTP_FEATURE_MULTIPART
+UHTTP_EXTERN ssize_t uhttp_request_multipart(uhttp_request_t* request, uhttp_multipart_t* multipart)
+{
+    uhttp_client_t* client = request ? request->client : NULL;
+
+    if (client == NULL || multipart == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t avail = client->rxlen - client->rxpos;
+    if (avail > client->rxskip) avail = client->rxskip;
+
+    if (avail == 0)
+    {
+        if (client->rxskip)
+        {
+            errno = (client->closing || client->sck == UHTTP_INVALID_SOCKET) ? ECONNRESET : EAGAIN;
+            return -1;
+        }
+
+        // A body cut short of its closing delimiter lost parts.
+        int done = uhttp_multipart_feed(multipart, NULL, 0);
+        if (done == 0) errno = EBADMSG;
+        return done > 0 ? 0 : -1;
+    }
+
+    // Parts are handed out of the receive buffer, then dropped from it.
+    char* body = client->rx + client->rxpos;
+    int done = uhttp_multipart_feed(multipart, body, avail);
+    memmove(body, body + avail, client->rxlen - client->rxpos - avail);
+    client->rxlen -= avail;
+    client->rxskip -= avail;
+
+    return done < 0 ? -1 : (ssize_t)avail;
+}
+#else
+UHTTP_EXTERN ssize_t uhttp_request_multipart(uhttp_request_t* request, uhttp_multipart_t* multipart)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+UHTTP_EXTERN int uhttp_respond(uhttp_request_t* request, int status, const char* headers, const void* body, size_t len)
+{
+    uhttp_client_t* client = request ? request->client : NULL;
+
+    if (client == NULL || status < 100 || status > 999 || (body == NULL && len))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int omit_body = uhttp_request_method_is(request, "HEAD");
+
+#if UHTTP_FEATURE_CACHE
+    if (client->filling)
+    {
+        uhttp_cache_entry_t* entry = client->entry;
+        uint64_t now = uhttp_clock_ms();
+        size_t total = 0;
+        size_t headlen = 0;
+        char* data = uhttp_render_response(status, headers, body, len, omit_body, &total, &headlen);
+        int error = errno;
+
+        // Only successful responses are kept, but waiting requests get any.
+        uint64_t expires = (data && status == 200) ? now + client->cache_ttl : now;
+        uhttp_cache_fill(uhttp_server_cache(client->sv), entry, data, total, headlen, expires, now);
+
+        entry->status = status;
+        if (data && status == 200)
+        {
+            uhttp_validators_find(&entry->validators, data, headlen);
+        }
+
+        for (size_t i = 0; i < entry->waiters.nlen; i++)
+        {
+            uhttp_client_answer(uhttp_list_index(&entry->waiters, uhttp_client_t*, i));
+        }
+        uhttp_list_clear(&entry->waiters);
+
+        client->filling = 0;
+        uhttp_client_answer(client);
+
+        if (data == NULL)
+        {
+            errno = error;
+            return -1;
+        }
+        return 0;
+    }
+#endif
+
+#if UHTTP_FEATURE_CONDITIONAL
+    // Answer conditional requests from the validators among the headers.
+    uhttp_validators_t validators;
+    if (status == 200 && headers &&
+        (uhttp_request_header(request, "If-None-Match") || uhttp_request_header(request, "If-Modified-Since")) &&
+        uhttp_validators_find(&validators, headers, strlen(headers)) &&
+        uhttp_not_modified(request, &validators.etag, validators.modified))
+    {
+        uhttp_client_not_modified(client, &validators, request->keep_alive);
+        uhttp_client_complete(client);
+        return 0;
+    }
+#endif
+
+    // Render the head on the stack unless the headers are very long.
+    char stack[UHTTP_CLIENT_HEAD_SIZE];
+    char* head = stack;
+    const char* extra = request->keep_alive ? "\r\n" : "Connection: close\r\n\r\n";
+    int headlen = uhttp_render_head(stack, sizeof(stack), status, headers, len, extra);
+
+    if (headlen < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ((size_t)headlen >= sizeof(stack))
+    {
+        if ((head = malloc((size_t)headlen + 1)) == NULL)
+        {
+            // Without a response the connection cannot continue.
+            client->closing = 1;
+            uhttp_client_complete(client);
+            errno = ENOMEM;
+            return -1;
+        }
+        uhttp_render_head(head, (size_t)headlen + 1, status, headers, len, extra);
+    }
+
+    uhttp_str_t parts[2] = {
+        { head, (size_t)headlen },
+        { body, omit_body ? 0 : len }
+    };
+    uhttp_client_respondv(client, parts, 2, request->keep_alive);
+
+    if (head != stack)
+    {
+        free(head);
+    }
+
+    uhttp_client_complete(client);
+    return 0;
+}
+
+#if UHTTP_FEATURE_CONDITIONAL
+UHTTP_EXTERN int uhttp_respond_unmodified(uhttp_request_t* request, const char* etag, int64_t last_modified)
+{
+    uhttp_client_t* client = request ? request->client : NULL;
+
+    // The response of a cached route is generated for every waiting request.
+    if (client == NULL || uhttp_client_filling(client))
+    {
+        return 0;
+    }
+
+    uhttp_str_t xetag = { etag, etag ? strlen(etag) : 0 };
+    if (!uhttp_not_modified(request, &xetag, last_modified))
+    {
+        return 0;
+    }
+
+    // Render the validator lines, an oversized tag is left out.
+    char buffer[UHTTP_CLIENT_HEAD_SIZE];
+    uhttp_validators_t validators;
+    size_t len = 0;
+
+    memset(&validators, 0, sizeof(validators));
+    if (xetag.len && xetag.len + 8 <= sizeof(buffer) - (UHTTP_DATE_LEN + 17))
+    {
+        memcpy(buffer, "ETag: ", 6);
+        memcpy(buffer + 6, etag, xetag.len);
+        memcpy(buffer + 6 + xetag.len, "\r\n", 2);
+        validators.etag_line.ptr = buffer;
+        validators.etag_line.len = len = xetag.len + 8;
+    }
+    if (last_modified > 0)
+    {
+        memcpy(buffer + len, "Last-Modified: ", 15);
+        uhttp_date_format(buffer + len + 15, last_modified);
+        memcpy(buffer + len + 15 + UHTTP_DATE_LEN, "\r\n", 2);
+        validators.modified_line.ptr = buffer + len;
+        validators.modified_line.len = 15 + UHTTP_DATE_LEN + 2;
+    }
+
+    uhttp_client_not_modified(client, &validators, request->keep_alive);
+    uhttp_client_complete(client);
+    return 1;
+}
+#else
+UHTTP_EXTERN int uhttp_respond_unmodified(uhttp_request_t* request, const char* etag, int64_t last_modified)
+{
+    // Every request gets the full representation.
+    return 0;
+}
+#endif
+
+#if UHTTP_FEATURE_FILES
+/**
+ * Render the parts around the ranges of a multipart/byteranges body.
+ * @param file File response with its ranges set, parts are rendered into
+ * text when not NULL.
+ * @return Length of all parts.
+ */
+static size_t uhttp_render_byteranges(uhttp_client_file_t* file, char* text, const char* boundary, const uhttp_str_t* type, int64_t size)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i <= file->nranges; i++)
+    {
+        char* pos = text ? text + len : NULL;
+        size_t cap = text ? (size_t)-1 : 0;
+        int n;
+
+        if (i < file->nranges)
+        {
+            n = snprintf(pos, cap,
+                "\r\n--%s\r\n"
+                "%.*s"
+                "Content-Range: bytes %lld-%lld/%lld\r\n"
+                "\r\n",
+                boundary, (int)type->len, type->ptr,
+                (long long)file->ranges[i].first, (long long)file->ranges[i].last, (long long)size);
+        }
+        else
+        {
+            n = snprintf(pos, cap, "\r\n--%s--\r\n", boundary);
+        }
+
+        if (text)
+        {
+            file->parts[i].ptr = pos;
+            file->parts[i].len = n;
+        }
+        len += n;
+    }
+
+    return len;
+}
+
+UHTTP_EXTERN int uhttp_respond_file(uhttp_request_t* request, const char* headers, int fd, int64_t size)
+{
+    uhttp_client_t* client = request ? request->client : NULL;
+
+#if UHTTP_FEATURE_CACHE
+    // Files are not cached, reading one would block the polling thread and
+    // sendfile sends it without copies anyway. Each request gets its own
+    // answer, conditional or ranged.
+    if (client && client->filling)
+    {
+        uhttp_client_abandon(client, 1);
+    }
+#endif
+
+    if (client == NULL || fd < 0 || size < 0)
+    {
+        if (fd >= 0) close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    int keep_alive = request->keep_alive;
+    size_t headerslen = headers ? strlen(headers) : 0;
+    uhttp_validators_t validators;
+    uhttp_validators_find(&validators, headers ? headers : "", headerslen);
+
+    // Nothing is read from a file the client has already.
+    if (uhttp_not_modified(request, &validators.etag, validators.modified))
+    {
+        close(fd);
+        uhttp_client_not_modified(client, &validators, keep_alive);
+        uhttp_client_complete(client);
+        return 0;
+    }
+
+    uhttp_range_t ranges[UHTTP_RANGE_MAX];
+    int nranges = 0;
+    const uhttp_str_t* range = uhttp_request_header(request, "Range");
+    if (range && uhttp_request_method_is(request, "GET") && uhttp_if_range(request, &validators))
+    {
+        nranges = uhttp_range_parse(range, size, ranges, UHTTP_RANGE_MAX);
+    }
+
+    if (nranges < 0)
+    {
+        char unsatisfiable[64];
+        close(fd);
+        snprintf(unsatisfiable, sizeof(unsatisfiable), "Content-Range: bytes */%lld\r\n", (long long)size);
+        return uhttp_respond(request, 416, unsatisfiable, NULL, 0);
+    }
+
+    int status = nranges ? 206 : 200;
+    if (nranges == 0)
+    {
+        ranges[0].first = 0;
+        ranges[0].last = size - 1;
+        nranges = 1;
+    }
+
+    // Several ranges become parts of a multipart body, each carrying the
+    // content type of the file. The parts are sent between the ranges.
+    char boundary[32];
+    uhttp_str_t type = { "", 0 };
+    uhttp_str_t before = { headers ? headers : "", headerslen };
+    uhttp_str_t after = { "", 0 };
+    uhttp_str_t type_value;
+    if (nranges > 1)
+    {
+        static unsigned int sequence;
+        snprintf(boundary, sizeof(boundary), "uhttp-%08x%08x", (unsigned int)uhttp_clock_ms(), ++sequence);
+
+        if (headers && uhttp_head_field(headers, headerslen, "Content-Type", &type, &type_value))
+        {
+            before.len = type.ptr - headers;
+            after.ptr = type.ptr + type.len;
+            after.len = headerslen - before.len - type.len;
+        }
+    }
+
+    uhttp_client_file_t probe;
+    probe.nranges = nranges;
+    probe.ranges = ranges;
+    size_t textlen = nranges > 1 ? uhttp_render_byteranges(&probe, NULL, boundary, &type, size) : 0;
+
+    uhttp_client_file_t* file = malloc(sizeof(uhttp_client_file_t) + nranges * sizeof(uhttp_range_t) +
+        (nranges + 1) * sizeof(uhttp_str_t) + textlen + 1);
+    if (file == NULL)
+    {
+        close(fd);
+        client->closing = 1;
+        uhttp_client_complete(client);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    file->fd = fd;
+    file->nranges = nranges;
+    file->ranges = (uhttp_range_t*)(file + 1);
+    file->parts = (uhttp_str_t*)(file->ranges + nranges);
+    file->index = 0;
+    file->offset = ranges[0].first;
+    file->keep_alive = keep_alive;
+    memcpy(file->ranges, ranges, nranges * sizeof(uhttp_range_t));
+    memset(file->parts, 0, (nranges + 1) * sizeof(uhttp_str_t));
+
+    int64_t len = 0;
+    for (int i = 0; i < nranges; i++)
+    {
+        len += ranges[i].last - ranges[i].first + 1;
+    }
+
+    char extra[128];
+    if (nranges > 1)
+    {
+        len += uhttp_render_byteranges(file, (char*)(file->parts + nranges + 1), boundary, &type, size);
+        snprintf(extra, sizeof(extra), "Content-Type: multipart/byteranges; boundary=%s\r\n", boundary);
+    }
+    else if (status == 206)
+    {
+        snprintf(extra, sizeof(extra), "Content-Range: bytes %lld-%lld/%lld\r\n",
+            (long long)ranges[0].first, (long long)ranges[0].last, (long long)size);
+    }
+    else
+    {
+        snprintf(extra, sizeof(extra), "Accept-Ranges: bytes\r\n");
+    }
+
+    // Render the head on the stack unless the headers are very long.
+    char stack[UHTTP_CLIENT_HEAD_SIZE];
+    char* head = stack;
+    const char* format =
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Length: %lld\r\n"
+        "%.*s%.*s%s%s\r\n";
+    const char* close_header = keep_alive ? "" : uhttp_header_close;
+    int headlen = snprintf(stack, sizeof(stack), format, status, uhttp_status_reason(status), (long long)len,
+        (int)before.len, before.ptr, (int)after.len, after.ptr, extra, close_header);
+
+    if (headlen >= 0 && (size_t)headlen >= sizeof(stack) && (head = malloc((size_t)headlen + 1)) != NULL)
+    {
+        snprintf(head, (size_t)headlen + 1, format, status, uhttp_status_reason(status), (long long)len,
+            (int)before.len, before.ptr, (int)after.len, after.ptr, extra, close_header);
+    }
+
+    // The client closes once the file is sent, not after the head.
+    if (headlen >= 0 && head != NULL)
+    {
+        uhttp_client_respond(client, head, headlen, 1);
+    }
+    else
+    {
+        client->closing = 1;
+    }
+
+    if (head != stack)
+    {
+        free(head);
+    }
+
+    request->client = NULL;
+    client->file = file;
+
+    if (client->closing || uhttp_request_method_is(request, "HEAD"))
+    {
+        uhttp_client_close_file(client);
+        if (!keep_alive) client->closing = 1;
+        uhttp_client_complete(client);
+    }
+    else if (client->txlen == 0 && uhttp_client_send_file(client))
+    {
+        client->closing = 1;
+        uhttp_client_drop(client);
+    }
+
+    return 0;
+}
+#else
+UHTTP_EXTERN int uhttp_respond_file(uhttp_request_t* request, const char* headers, int fd, int64_t size)
+{
+    if (fd >= 0) close(fd);
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+#if UHTTP_FEATURE_AWAIT
+/**
+ * Get the client of a request a handler may suspend on.
+ * @return Client object or NULL if the request was answered (see errno).
+ */
+static uhttp_client_t* uhttp_await_client(uhttp_request_t* request, int timeout)
+{
+    uhttp_client_t* client = request ? request->client : NULL;
+
+    if (client == NULL)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Cancelled, the client is going away.
+    if (client->closing)
+    {
+        errno = ECANCELED;
+        return NULL;
+    }
+
+    client->await.wait = 0;
+    if (timeout >= 0)
+    {
+        client->await.wait = UHTTP_AWAIT_TIMER;
+        client->await.deadline = uhttp_clock_ms() + timeout;
+    }
+
+    return client;
+}
+
+UHTTP_EXTERN int* uhttp_await_point(uhttp_request_t* request)
+{
+    // Also valid once the request was answered and request->client cleared.
+    uhttp_client_t* client = (uhttp_client_t*)((char*)request - offsetof(uhttp_client_t, request));
+    return &client->await.point;
+}
+
+UHTTP_EXTERN void* uhttp_await_locals(uhttp_request_t* request)
+{
+    uhttp_client_t* client = (uhttp_client_t*)((char*)request - offsetof(uhttp_client_t, request));
+    return client->await.locals.data;
+}
+
+UHTTP_EXTERN int uhttp_await_timer(uhttp_request_t* request, int timeout)
+{
+    return uhttp_await_client(request, timeout < 0 ? 0 : timeout) != NULL;
+}
+
+UHTTP_EXTERN int uhttp_await_socket(uhttp_request_t* request, uhttp_socket_t sock, uhttp_event_t events, int timeout)
+{
+    if (sock == UHTTP_INVALID_SOCKET)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+
+    uhttp_client_t* client = uhttp_await_client(request, timeout);
+    if (client == NULL) return 0;
+
+    client->await.wait |= UHTTP_AWAIT_SOCKET;
+    client->await.sock = sock;
+    client->await.events = events;
+    return 1;
+}
+
+UHTTP_EXTERN int uhttp_await_body(uhttp_request_t* request, int timeout)
+{
+    uhttp_client_t* client = request ? request->client : NULL;
+
+    // Nothing to wait for when the body is here, complete or cut off.
+    if (client == NULL || client->rxskip == 0 || client->rxlen > client->rxpos ||
+        client->closing || client->sck == UHTTP_INVALID_SOCKET)
+    {
+        return 0;
+    }
+
+    uhttp_await_client(request, timeout);
+    client->await.wait |= UHTTP_AWAIT_BODY;
+    return 1;
+}
+
+UHTTP_EXTERN uhttp_event_t uhttp_await_events(const uhttp_request_t* request)
+{
+    const uhttp_client_t* client = (const uhttp_client_t*)((const char*)request - offsetof(uhttp_client_t, request));
+    return client->await.revents;
+}
+#else
+UHTTP_EXTERN int* uhttp_await_point(uhttp_request_t* request)
+{
+    // Handlers never suspend, so the point is never written.
+    static int point = 0;
+    return &point;
+}
+
+UHTTP_EXTERN void* uhttp_await_locals(uhttp_request_t* request)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+UHTTP_EXTERN int uhttp_await_timer(uhttp_request_t* request, int timeout)
+{
+    errno = ENOSYS;
+    return 0;
+}
+
+UHTTP_EXTERN int uhttp_await_socket(uhttp_request_t* request, uhttp_socket_t sock, uhttp_event_t events, int timeout)
+{
+    errno = ENOSYS;
+    return 0;
+}
+
+UHTTP_EXTERN int uhttp_await_body(uhttp_request_t* request, int timeout)
+{
+    errno = ENOSYS;
+    return 0;
+}
+
+UHTTP_EXTERN uhttp_event_t uhttp_await_events(const uhttp_request_t* request)
+{
     return 0;
 }
+#endif
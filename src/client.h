@@ -27,7 +27,137 @@
 #define _UHTTP_INTERNAL_CLIENT_H_
 
 #include "uhttp.h"
+#include "config.h"
 #include "debug.h"
+#include "request.h"
+#include "cache.h"
+#if UHTTP_FEATURE_ACCESS_LOG
+#include "accesslog.h"
+#endif
+#include "range.h"
+#if UHTTP_FEATURE_PROXY
+#include "proxy.h"
+#endif
+
+#include <stddef.h>
+
+/* Size of the client receive buffer, bounds the size of a request head. */
+#ifndef UHTTP_CLIENT_RX_SIZE
+#define UHTTP_CLIENT_RX_SIZE 2048
+#endif
+
+/* Largest transmit buffer of static memory builds. */
+#if UHTTP_STATIC_MEMORY && !defined(UHTTP_CLIENT_TX_MAX)
+#define UHTTP_CLIENT_TX_MAX 4096
+#endif
+
+/* Milliseconds over which the drain rate of a client is measured. */
+#ifndef UHTTP_CLIENT_RATE_WINDOW
+#define UHTTP_CLIENT_RATE_WINDOW 5000
+#endif
+
+/**
+ * Output limits of clients, set by server options. Zero for no limit.
+ */
+typedef struct uhttp_client_limits_t
+{
+    /* Transmit buffer bytes above which no more requests are dispatched. */
+    size_t tx_high;
+    /* Transmit buffer bytes at or below which dispatching resumes. */
+    size_t tx_low;
+    /* Bytes in the transmit buffers of all clients above which the clients
+       adding to them are throttled. */
+    size_t tx_budget;
+    /* Bytes per second a client must drain its transmit buffer at. */
+    size_t min_send_rate;
+} uhttp_client_limits_t;
+
+#if UHTTP_FEATURE_FILES
+/**
+ * A file response sent once the transmit buffer is empty.
+ */
+typedef struct uhttp_client_file_t
+{
+    int fd;
+    /* Ranges to send, each preceded by a part, then a closing part. Parts
+       are advanced as they are sent. */
+    uhttp_range_t* ranges;
+    uhttp_str_t* parts;
+    size_t nranges;
+    /* Current range and offset of its next byte. */
+    size_t index;
+    int64_t offset;
+    /* Zero to close the client once the file is sent. */
+    int keep_alive;
+} uhttp_client_file_t;
+#endif
+
+#if UHTTP_FEATURE_PROXY
+/**
+ * A response body relayed from an upstream socket once the transmit buffer
+ * is empty.
+ */
+typedef struct uhttp_client_relay_t
+{
+    uhttp_socket_t sock;
+    uhttp_proxy_framing_t framing;
+    /* Body bytes left to read with UHTTP_PROXY_LENGTH. */
+    int64_t left;
+    /* Position in the body with UHTTP_PROXY_CHUNKED. */
+    uhttp_chunked_t chunked;
+    /* Pipe the body is spliced through when spliced is non-zero. */
+    uhttp_splice_t splice;
+    int spliced;
+    /* Buffer the body is copied through otherwise, and its unsent bytes. */
+    char* buffer;
+    size_t bufcap;
+    size_t bufpos;
+    size_t buflen;
+    /* Non-zero while the upstream has nothing to read. */
+    int starved;
+    /* Non-zero once the whole body was read. */
+    int ended;
+    /* Non-zero while the upstream connection can serve another request. */
+    int reusable;
+    /* Zero to close the client once the body is relayed. */
+    int keep_alive;
+    /* Hands the upstream socket back and frees the relay. */
+    void (*release)(struct uhttp_client_relay_t* relay, int reusable);
+} uhttp_client_relay_t;
+#endif
+
+#if UHTTP_FEATURE_AWAIT
+/* What a suspended coroutine handler waits for. */
+#define UHTTP_AWAIT_TIMER  1
+#define UHTTP_AWAIT_SOCKET 2
+#define UHTTP_AWAIT_BODY   4
+
+/**
+ * State of the coroutine handler of a request.
+ */
+typedef struct uhttp_client_await_t
+{
+    /* Line the handler continues at, zero to start over. */
+    int point;
+    /* UHTTP_AWAIT_* flags, zero while the handler is not suspended. */
+    int wait;
+    /* Clock milliseconds the wait ends at with UHTTP_AWAIT_TIMER. */
+    uint64_t deadline;
+    /* Socket and events of UHTTP_AWAIT_SOCKET. */
+    uhttp_socket_t sock;
+    uhttp_event_t events;
+    /* Events that ended the last wait. */
+    uhttp_event_t revents;
+    /* Route handler to invoke again. */
+    uhttp_handler_func_t handler;
+    void* user;
+    union
+    {
+        max_align_t align;
+        char data[UHTTP_AWAIT_LOCALS_SIZE];
+    } locals;
+} uhttp_client_await_t;
+#endif
 
 typedef struct uhttp_client_t
 {
@@ -36,6 +166,83 @@ typedef struct uhttp_client_t
     uhttp_socket_t sck;
     uhttp_event_t events;
     uhttp_addr_t src;
+    /* Tag of the listener the connection arrived on. */
+    int tag;
+
+    /* Receive buffer. */
+    char* rx;
+    /* Number of bytes in the receive buffer. */
+    size_t rxlen;
+    /* Bytes of the receive buffer already processed. */
+    size_t rxpos;
+    /* Request body bytes still to be discarded. */
+    size_t rxskip;
+
+    /* Transmit buffer, data the socket did not take yet. */
+    char* tx;
+    /* Number of bytes in the transmit buffer. */
+    size_t txlen;
+    /* Capacity of the transmit buffer. */
+    size_t txcap;
+    /* Responses with data in the transmit buffer. */
+    int txresponses;
+    /* Non-zero while the transmit buffer is above the high watermark. */
+    int throttled;
+    /* Clock milliseconds the drain rate is measured from, and the bytes sent
+       since. */
+    uint64_t txsince;
+    size_t txsent;
+    /* Output limits of the server. */
+    const uhttp_client_limits_t* limits;
+    /* Socket functions of the server, NULL for kernel sockets. */
+    uhttp_transport_t* transport;
+#if UHTTP_FEATURE_FILES
+    /* File response following the transmit buffer, NULL if none. */
+    uhttp_client_file_t* file;
+#endif
+#if UHTTP_FEATURE_PROXY
+    /* Relayed response following the transmit buffer, NULL if none. */
+    uhttp_client_relay_t* relay;
+#endif
+
+    /* Non-zero when the client closes once the transmit buffer drains. */
+    int closing;
+
+    /* Non-zero to cork the socket while responses are written. */
+    int cork;
+
+    /* Request being handled, its slices point into the receive buffer. */
+    uhttp_request_t request;
+    /* Non-zero until the request is answered. */
+    int pending;
+    /* Non-zero while requests are dispatched from the receive buffer. */
+    int dispatching;
+    /* Non-zero when pipelined requests wait for the next poll. */
+    int resume;
+#if UHTTP_FEATURE_RATELIMIT
+    /* Non-zero when the next request already has its token. */
+    int admitted;
+#endif
+
+#if UHTTP_FEATURE_CACHE
+    /* Cache entry the request waits for or generates, NULL if none. */
+    uhttp_cache_entry_t* entry;
+    /* Non-zero when the response of the request fills the entry. */
+    int filling;
+    /* Non-zero when the request goes to its route again, the entry it
+       waited for was abandoned. */
+    int redispatch;
+    /* Non-zero when the redispatched request bypasses the cache, the entry
+       was abandoned for a response that is not cached. */
+    int uncached;
+    /* Milliseconds the response stays in the cache. */
+    int cache_ttl;
+#endif
+
+#if UHTTP_FEATURE_AWAIT
+    /* Coroutine state of the pending request. */
+    uhttp_client_await_t await;
+#endif
 
 } uhttp_client_t;
 
@@ -51,6 +258,171 @@ extern int uhttp_client_create(uhttp_client_t* client);
  */
 extern void uhttp_client_destroy(uhttp_client_t* client);
 
+/**
+ * Mark a client closing that drains its transmit buffer below the minimum
+ * rate, dropping the buffer.
+ * @param client Client object.
+ * @param now Current clock time in milliseconds.
+ * @return Clock time to check the client again at, zero if there is no need.
+ */
+extern uint64_t uhttp_client_check_rate(uhttp_client_t* client, uint64_t now);
+
+/**
+ * Process requests left in the receive buffer after a deferred response.
+ * @param client Client object.
+ */
+extern void uhttp_client_resume(uhttp_client_t* client);
+
+/**
+ * A route with its strings owned by the server.
+ */
+typedef struct uhttp_server_route_t
+{
+    uhttp_route_t route;
+    /* Length of the path without a trailing '*'. */
+    size_t pathlen;
+    /* Non-zero when the path matches any suffix. */
+    int prefix;
+    /* Header names of the cache key, each null terminated, followed by an
+       empty name. */
+    const char* vary;
+} uhttp_server_route_t;
+
+/**
+ * Find the route of a request.
+ * @param sv Server object.
+ * @param request Parsed request.
+ * @return Route or NULL if none matches.
+ */
+extern const uhttp_server_route_t* uhttp_server_route(uhttp_server_t* sv, const uhttp_request_t* request);
+
+#if UHTTP_FEATURE_CACHE
+/**
+ * Get the response cache of a server.
+ * @param sv Server object.
+ * @return Cache object, its budget is zero when caching is disabled.
+ */
+extern uhttp_cache_t* uhttp_server_cache(uhttp_server_t* sv);
+#endif
+
+/**
+ * Check if a client has responses left to send.
+ * @param client Client object.
+ * @return Non-zero while the socket needs to be polled for sending.
+ */
+static inline int uhttp_client_sending(const uhttp_client_t* client)
+{
+#if UHTTP_FEATURE_FILES
+    if (client->file)
+    {
+        return 1;
+    }
+#endif
+#if UHTTP_FEATURE_PROXY
+    // A starved relay waits for its upstream instead.
+    if (client->relay && !client->relay->starved)
+    {
+        return 1;
+    }
+#endif
+    return client->txlen != 0;
+}
+
+/**
+ * Get the events to poll the socket of a client for.
+ * @param client Client object.
+ * @return Events, zero if the client waits for nothing.
+ */
+static inline uhttp_event_t uhttp_client_poll_events(const uhttp_client_t* client)
+{
+    uhttp_event_t events = uhttp_client_sending(client) ? UHTTP_EVENT_SEND : 0;
+
+    // A closing client is only waiting for its transmit buffer to drain, a
+    // pending one for its request to be answered or its body to arrive.
+#if UHTTP_FEATURE_AWAIT
+    if (!client->closing && ((!client->pending && !client->throttled) || (client->await.wait & UHTTP_AWAIT_BODY)))
+#else
+    if (!client->closing && !client->pending && !client->throttled)
+#endif
+    {
+        events |= UHTTP_EVENT_RECEIVE;
+    }
+
+    return events;
+}
+
+#if UHTTP_FEATURE_AWAIT
+/**
+ * Invoke the suspended handler of a client again.
+ * @param client Client object.
+ * @param revents Events that ended the wait.
+ */
+extern void uhttp_client_continue(uhttp_client_t* client, uhttp_event_t revents);
+#endif
+
+#if UHTTP_FEATURE_PROXY
+/**
+ * Answer the pending request of a client with a head and a body relayed from
+ * an upstream.
+ * @param client Client object.
+ * @param parts Response head and the body bytes already read.
+ * @param nparts Number of parts.
+ * @param relay Relay of the rest of the body, released once it is done.
+ */
+extern void uhttp_client_respond_relay(uhttp_client_t* client, const uhttp_str_t* parts, size_t nparts, uhttp_client_relay_t* relay);
+
+/**
+ * Relay more of a response body once the upstream has data. The client is
+ * not closed here, it is left to the next poll.
+ * @param client Client object.
+ */
+extern void uhttp_client_relay(uhttp_client_t* client);
+#endif
+
+/**
+ * Invoke server to add a client for an accepted socket.
+ * @param sv Server object.
+ * @param sck Accepted socket, closed on failure.
+ * @param addr Source address of the socket.
+ * @param tag Tag of the listener that accepted the socket.
+ * @return Client object or NULL for failure (see errno).
+ */
+extern uhttp_client_t* uhttp_server_add_client(uhttp_server_t* sv, uhttp_socket_t sck, const uhttp_addr_t* addr, int tag);
+
+/**
+ * Update the server-wide load counters.
+ * @param sv Server object.
+ * @param queued Change in bytes queued for transmission.
+ * @param requests Change in requests with responses not yet sent.
+ */
+extern void uhttp_server_account(uhttp_server_t* sv, ssize_t queued, int requests);
+
+/**
+ * Get the bytes queued for transmission by every client of a server.
+ * @param sv Server object.
+ * @return Bytes in client transmit buffers.
+ */
+extern size_t uhttp_server_queued(uhttp_server_t* sv);
+
+#if UHTTP_FEATURE_RATELIMIT
+/**
+ * Take a token from the rate limiter bucket of a source.
+ * @param sv Server object.
+ * @param addr Source address.
+ * @return Non-zero if the source is admitted.
+ */
+extern int uhttp_server_admit(uhttp_server_t* sv, const uhttp_addr_t* addr);
+#endif
+
+#if UHTTP_FEATURE_ACCESS_LOG
+/**
+ * Get the access log of a server.
+ * @param sv Server object.
+ * @return Log object, NULL if responses are not logged.
+ */
+extern uhttp_access_log_t* uhttp_server_access_log(uhttp_server_t* sv);
+#endif
+
 /**
  * Invoke server to close client object.
  * @param Client object.
@@ -0,0 +1,270 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "conditional.h"
+
+#include <string.h>
+
+static const char uhttp_months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+static const char uhttp_weekdays[] = "SunMonTueWedThuFriSat";
+
+/**
+ * Days since the epoch of a date in the proleptic Gregorian calendar.
+ */
+static int64_t uhttp_days_from_civil(int64_t y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/**
+ * Parse a fixed number of digits.
+ * @return Value, -1 if a character is not a digit.
+ */
+static int uhttp_digits(const char* str, int n)
+{
+    int value = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (str[i] < '0' || str[i] > '9') return -1;
+        value = value * 10 + (str[i] - '0');
+    }
+    return value;
+}
+
+int64_t uhttp_date_parse(const uhttp_str_t* str)
+{
+    const char* s = str->ptr;
+
+    if (str->len != UHTTP_DATE_LEN || s[3] != ',' || s[4] != ' ' || s[7] != ' ' || s[11] != ' ' ||
+        s[16] != ' ' || s[19] != ':' || s[22] != ':' || memcmp(s + 25, " GMT", 4))
+    {
+        return -1;
+    }
+
+    int month = 0;
+    while (month < 12 && memcmp(uhttp_months + month * 3, s + 8, 3)) month++;
+
+    int day = uhttp_digits(s + 5, 2);
+    int year = uhttp_digits(s + 12, 4);
+    int hour = uhttp_digits(s + 17, 2);
+    int minute = uhttp_digits(s + 20, 2);
+    int second = uhttp_digits(s + 23, 2);
+
+    if (month == 12 || day < 1 || day > 31 || year < 0 || hour < 0 || hour > 23 ||
+        minute < 0 || minute > 59 || second < 0 || second > 60)
+    {
+        return -1;
+    }
+
+    return uhttp_days_from_civil(year, month + 1, day) * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+void uhttp_date_format(char* buffer, int64_t time)
+{
+    int64_t z = (time >= 0 ? time : time - 86399) / 86400;
+    int64_t secs = time - z * 86400;
+    int weekday = (int)(((z % 7) + 11) % 7);
+
+    // Civil date from days since the epoch.
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    int year = (int)(yoe + era * 400 + (month <= 2));
+
+    memcpy(buffer, uhttp_weekdays + weekday * 3, 3);
+    memcpy(buffer + 3, ", ", 2);
+    buffer[5] = '0' + day / 10;
+    buffer[6] = '0' + day % 10;
+    buffer[7] = ' ';
+    memcpy(buffer + 8, uhttp_months + (month - 1) * 3, 3);
+    buffer[11] = ' ';
+    buffer[12] = '0' + year / 1000 % 10;
+    buffer[13] = '0' + year / 100 % 10;
+    buffer[14] = '0' + year / 10 % 10;
+    buffer[15] = '0' + year % 10;
+    buffer[16] = ' ';
+    buffer[17] = '0' + (int)(secs / 36000);
+    buffer[18] = '0' + (int)(secs / 3600 % 10);
+    buffer[19] = ':';
+    buffer[20] = '0' + (int)(secs / 600 % 6);
+    buffer[21] = '0' + (int)(secs / 60 % 10);
+    buffer[22] = ':';
+    buffer[23] = '0' + (int)(secs / 10 % 6);
+    buffer[24] = '0' + (int)(secs % 10);
+    memcpy(buffer + 25, " GMT", 5);
+}
+
+/**
+ * Strip the weak prefix of an entity tag.
+ */
+static uhttp_str_t uhttp_etag_opaque(uhttp_str_t etag)
+{
+    if (etag.len >= 2 && etag.ptr[0] == 'W' && etag.ptr[1] == '/')
+    {
+        etag.ptr += 2;
+        etag.len -= 2;
+    }
+    return etag;
+}
+
+int uhttp_etag_match(const uhttp_str_t* list, const uhttp_str_t* etag)
+{
+    const char* pos = list->ptr;
+    const char* end = list->ptr + list->len;
+
+    if (list->len == 1 && list->ptr[0] == '*')
+    {
+        return 1;
+    }
+
+    if (etag == NULL || etag->len == 0)
+    {
+        return 0;
+    }
+
+    uhttp_str_t opaque = uhttp_etag_opaque(*etag);
+
+    while (pos < end)
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',')) pos++;
+
+        uhttp_str_t item = { pos, 0 };
+        while (pos < end && *pos != ',') pos++;
+
+        item.len = pos - item.ptr;
+        while (item.len && (item.ptr[item.len - 1] == ' ' || item.ptr[item.len - 1] == '\t')) item.len--;
+
+        item = uhttp_etag_opaque(item);
+        if (item.len && item.len == opaque.len && memcmp(item.ptr, opaque.ptr, item.len) == 0) return 1;
+    }
+
+    return 0;
+}
+
+int uhttp_not_modified(const uhttp_request_t* request, const uhttp_str_t* etag, int64_t modified)
+{
+    // Other methods would need 412 Precondition Failed instead.
+    if (!(request->method.len == 3 && memcmp(request->method.ptr, "GET", 3) == 0) &&
+        !(request->method.len == 4 && memcmp(request->method.ptr, "HEAD", 4) == 0))
+    {
+        return 0;
+    }
+
+    // If-None-Match takes precedence, If-Modified-Since is ignored with it.
+    const uhttp_str_t* value = uhttp_request_header(request, "If-None-Match");
+    if (value)
+    {
+        return uhttp_etag_match(value, etag);
+    }
+
+    value = uhttp_request_header(request, "If-Modified-Since");
+    if (value && modified > 0)
+    {
+        int64_t since = uhttp_date_parse(value);
+        return since >= 0 && modified <= since;
+    }
+
+    return 0;
+}
+
+int uhttp_if_range(const uhttp_request_t* request, const uhttp_validators_t* validators)
+{
+    const uhttp_str_t* value = uhttp_request_header(request, "If-Range");
+    if (value == NULL)
+    {
+        return 1;
+    }
+
+    // Entity tags compare strongly, weak ones never match.
+    if (value->len && (value->ptr[0] == '"' || value->ptr[0] == 'W'))
+    {
+        return
+            value->ptr[0] == '"' &&
+            validators->etag.len == value->len &&
+            memcmp(validators->etag.ptr, value->ptr, value->len) == 0;
+    }
+
+    int64_t date = uhttp_date_parse(value);
+    return date >= 0 && validators->modified > 0 && date == validators->modified;
+}
+
+int uhttp_head_field(const char* head, size_t len, const char* name, uhttp_str_t* line, uhttp_str_t* value)
+{
+    const char* pos = head;
+    const char* end = head + len;
+    size_t namelen = strlen(name);
+
+    while (pos < end)
+    {
+        const char* eol = memchr(pos, '\n', end - pos);
+        const char* next = eol ? eol + 1 : end;
+
+        uhttp_str_t xname = { pos, namelen };
+        if ((size_t)(next - pos) > namelen && pos[namelen] == ':' && uhttp_str_ieq(&xname, name))
+        {
+            const char* vpos = pos + namelen + 1;
+            const char* vend = next;
+            while (vend > vpos && (vend[-1] == '\n' || vend[-1] == '\r' || vend[-1] == ' ' || vend[-1] == '\t')) vend--;
+            while (vpos < vend && (*vpos == ' ' || *vpos == '\t')) vpos++;
+
+            line->ptr = pos;
+            line->len = next - pos;
+            value->ptr = vpos;
+            value->len = vend - vpos;
+            return 1;
+        }
+
+        pos = next;
+    }
+
+    return 0;
+}
+
+int uhttp_validators_find(uhttp_validators_t* validators, const char* head, size_t len)
+{
+    uhttp_str_t value;
+
+    memset(validators, 0, sizeof(*validators));
+
+    uhttp_head_field(head, len, "ETag", &validators->etag_line, &validators->etag);
+
+    if (uhttp_head_field(head, len, "Last-Modified", &validators->modified_line, &value))
+    {
+        int64_t modified = uhttp_date_parse(&value);
+        if (modified > 0)
+            validators->modified = modified;
+        else
+            memset(&validators->modified_line, 0, sizeof(validators->modified_line));
+    }
+
+    return validators->etag.len || validators->modified;
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+/**
+ * Find the ETag and Last-Modified fields in a rendered head.
+ * @param validators Validators object.
+ * @param head Header lines, each terminated by CRLF.
+ * @param len Length of the head.
+ * @return Non-zero if there is any validator.
+ */
+extern int uhttp_validators_find(uhttp_validators_t* validators, const char* head, size_t len);
+
+#endif
+
+#ifndef _UHTTP_INTERNAL_CONDITIONAL_H_
+#define _UHTTP_INTERNAL_CONDITIONAL_H_
+
+#include "uhttp.h"
+#include "debug.h"
+#include "request.h"
+
+/* Length of an HTTP date, without the terminator. */
+#define UHTTP_DATE_LEN 29
+
+/**
+ * Validators of a representation, slices of a rendered head.
+ */
+typedef struct uhttp_validators_t
+{
+    /* Entity tag and its header line including CRLF, empty if none. */
+    uhttp_str_t etag;
+    uhttp_str_t etag_line;
+    /* Modification time in seconds since the epoch, zero if none. */
+    int64_t modified;
+    uhttp_str_t modified_line;
+} uhttp_validators_t;
+
+/**
+ * Parse an HTTP date in the preferred IMF-fixdate format.
+ * @param str Date, "Sun, 06 Nov 1994 08:49:37 GMT".
+ * @return Seconds since the epoch, -1 if the date is not valid.
+ */
+extern int64_t uhttp_date_parse(const uhttp_str_t* str);
+
+/**
+ * Format an HTTP date.
+ * @param buffer Buffer of at least UHTTP_DATE_LEN + 1 bytes.
+ * @param time Seconds since the epoch.
+ */
+extern void uhttp_date_format(char* buffer, int64_t time);
+
+/**
+ * Check an If-None-Match list against an entity tag, weak comparison.
+ * @param list Field value, "*" or a comma separated list of entity tags.
+ * @param etag Entity tag including its quotes and weak prefix.
+ * @return Non-zero if the list matches.
+ */
+extern int uhttp_etag_match(const uhttp_str_t* list, const uhttp_str_t* etag);
+
+/**
+ * Evaluate the preconditions of a GET or HEAD request.
+ * @param request Parsed request.
+ * @param etag Entity tag of the current representation, NULL for none.
+ * @param modified Modification time in seconds since the epoch, zero or
+ * less for none.
+ * @return Non-zero if the client's copy is current and 304 applies.
+ */
+extern int uhttp_not_modified(const uhttp_request_t* request, const uhttp_str_t* etag, int64_t modified);
+
+/**
+ * Evaluate If-Range, ranges only apply to the representation it names.
+ * @param request Parsed request.
+ * @param validators Validators of the current representation.
+ * @return Non-zero if the Range header applies.
+ */
+extern int uhttp_if_range(const uhttp_request_t* request, const uhttp_validators_t* validators);
+
+/**
+ * Find a header field in a rendered head.
+ * @param head Header lines, each terminated by CRLF.
+ * @param len Length of the head.
+ * @param name Header name, case insensitive.
+ * @param line Set to the whole line including its CRLF.
+ * @param value Set to the trimmed field value.
+ * @return Non-zero if found.
+ */
+extern int uhttp_head_field(const char* head, size_t len, const char* name, uhttp_str_t* line, uhttp_str_t* value);
+
+/**
+ * Find the ETag and Last-Modified fields in a rendered head.
+ * @param validators Validators object.
+ * @param head Header lines, each terminated by CRLF.
+ * @param len Length of the head.
+ * @return Non-zero if there is any validator.
+ */
+extern int uhttp_validators_find(uhttp_validators_t* validators, const char* head, size_t len);
+
+#endif
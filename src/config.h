@@ -0,0 +1,106 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_CONFIG_H_
+#define _UHTTP_INTERNAL_CONFIG_H_
+
+/* Features compiled in unless set to zero, see the UHTTP_FEATURE_ options of
+   CMakeLists.txt. A feature set to zero leaves no code behind, its public
+   functions fail with ENOSYS and its options are unknown. */
+
+/* Conditional requests, 304 Not Modified and uhttp_respond_unmodified. */
+#ifndef UHTTP_FEATURE_CONDITIONAL
+#define UHTTP_FEATURE_CONDITIONAL 1
+#endif
+
+/* Response cache of routes with a cache_ttl, UHTTP_OPTION_CACHE_SIZE. */
+#ifndef UHTTP_FEATURE_CACHE
+#define UHTTP_FEATURE_CACHE 1
+#endif
+
+/* File responses, byte ranges and uhttp_static_handler. */
+#ifndef UHTTP_FEATURE_FILES
+#define UHTTP_FEATURE_FILES 1
+#endif
+
+/* uhttp_post and the wakeup in the poll set it needs. */
+#ifndef UHTTP_FEATURE_POST
+#define UHTTP_FEATURE_POST 1
+#endif
+
+/* Coroutine handlers suspended on timers, sockets and request bodies. */
+#ifndef UHTTP_FEATURE_AWAIT
+#define UHTTP_FEATURE_AWAIT 1
+#endif
+
+/* Token buckets per source address, UHTTP_OPTION_RATE_LIMIT. */
+#ifndef UHTTP_FEATURE_RATELIMIT
+#define UHTTP_FEATURE_RATELIMIT 1
+#endif
+
+/* Access log written by a background thread, uhttp_access_log. */
+#ifndef UHTTP_FEATURE_ACCESS_LOG
+#define UHTTP_FEATURE_ACCESS_LOG 1
+#endif
+
+/* Streaming multipart/form-data parser, uhttp_multipart_create. */
+#ifndef UHTTP_FEATURE_MULTIPART
+#define UHTTP_FEATURE_MULTIPART 1
+#endif
+
+/* Reverse proxy handler with pooled upstream connections, uhttp_proxy_create. */
+#ifndef UHTTP_FEATURE_PROXY
+#define UHTTP_FEATURE_PROXY 1
+#endif
+
+/* Transports other than kernel sockets, UHTTP_OPTION_TRANSPORT and the
+   in-memory transport. */
+#ifndef UHTTP_FEATURE_TRANSPORT
+#define UHTTP_FEATURE_TRANSPORT 1
+#endif
+
+/* IPv6 addresses. */
+#ifndef UHTTP_FEATURE_IPV6
+#define UHTTP_FEATURE_IPV6 1
+#endif
+
+/* Unix domain sockets. */
+#ifndef UHTTP_FEATURE_UNIX
+#define UHTTP_FEATURE_UNIX 1
+#endif
+
+#if UHTTP_FEATURE_CACHE && !UHTTP_FEATURE_CONDITIONAL
+#error "The response cache answers conditional requests, enable UHTTP_FEATURE_CONDITIONAL."
+#endif
+
+#if UHTTP_FEATURE_FILES && !UHTTP_FEATURE_CONDITIONAL
+#error "File responses answer If-Range and revalidation, enable UHTTP_FEATURE_CONDITIONAL."
+#endif
+
+#if UHTTP_FEATURE_PROXY && !UHTTP_FEATURE_AWAIT
+#error "The reverse proxy handler is a coroutine, enable UHTTP_FEATURE_AWAIT."
+#endif
+
+#endif
@@ -33,6 +33,7 @@ void uhttp_list_create(uhttp_list_t* list, size_t nsize)
         list->head = NULL;
         list->nlen = 0;
         list->nsize = nsize;
+        list->ncap = 0;
     }
 }
 
@@ -44,6 +45,27 @@ void uhttp_list_destroy(uhttp_list_t* list)
     }
 }
 
+int uhttp_list_reserve(uhttp_list_t* list, size_t ncap)
+{
+    if (list == NULL || ncap == 0 || ncap < list->nlen)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    void* xhead = realloc(list->head, ncap * list->nsize);
+    if (!xhead)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    list->head = xhead;
+    list->ncap = ncap;
+
+    return 0;
+}
+
 int uhttp_list_append(uhttp_list_t* list, const void* element)
 {
     if (list == NULL || element == NULL)
@@ -52,6 +74,18 @@ int uhttp_list_append(uhttp_list_t* list, const void* element)
         return -1;
     }
 
+    if (list->ncap)
+    {
+        if (list->nlen == list->ncap)
+        {
+            errno = ENOSPC;
+            return -1;
+        }
+
+        memcpy((char*)list->head + ((list->nlen++) * list->nsize), element, list->nsize);
+        return 0;
+    }
+
     void* xhead = realloc(list->head, (list->nlen + 1) * list->nsize);
     if (!xhead)
     {
@@ -80,6 +114,13 @@ int uhttp_list_remove(uhttp_list_t* list, int index)
         (list->nlen - index - 1) * list->nsize             // count
     );
 
+    // Reserved lists keep their room.
+    if (list->ncap)
+    {
+        list->nlen--;
+        return 0;
+    }
+
     // Downsize List.
     void* xhead = realloc(list->head, (list->nlen--) * list->nsize);
     if (xhead || list->nlen == 0)
@@ -101,9 +142,12 @@ int uhttp_list_clear(uhttp_list_t* list)
         return -1;
     }
 
-    free(list->head);
-    list->head = NULL;
     list->nlen = 0;
+    if (list->ncap == 0)
+    {
+        free(list->head);
+        list->head = NULL;
+    }
 
     return 0;
 }
@@ -33,6 +33,9 @@ typedef struct uhttp_list_t {
     void* head;
     size_t nsize;
     size_t nlen;
+    /* Fixed capacity set by uhttp_list_reserve, zero while the list is
+       resized on every change. */
+    size_t ncap;
 } uhttp_list_t;
 
 /**
@@ -48,11 +51,21 @@ extern void uhttp_list_create(uhttp_list_t* list, size_t nsize);
  */
 extern void uhttp_list_destroy(uhttp_list_t* list);
 
+/**
+ * Allocate room for a fixed number of elements once, so the list is never
+ * resized again.
+ * @param list List object.
+ * @param ncap Number of elements, at least the current length.
+ * @return Zero when successful, see errno otherwise.
+ */
+extern int uhttp_list_reserve(uhttp_list_t* list, size_t ncap);
+
 /**
  * Append list.
  * @param list List object.
  * @param element Element to append.
- * @return Zero when successful, see errno otherwise.
+ * @return Zero when successful, see errno otherwise. ENOSPC when a reserved
+ * list is full.
  */
 extern int uhttp_list_append(uhttp_list_t* list, const void* element);
 
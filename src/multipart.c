@@ -0,0 +1,355 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "config.h"
+#include "multipart.h"
+#include "request.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if UHTTP_FEATURE_MULTIPART
+int uhttp_multipart_boundary(const uhttp_str_t* content_type, uhttp_str_t* boundary)
+{
+    const char* pos = content_type->ptr;
+    const char* end = content_type->ptr + content_type->len;
+    uhttp_str_t type = { pos, 10 };
+
+    if (content_type->len < type.len || !uhttp_str_ieq(&type, "multipart/")) return -1;
+
+    const char* semi;
+    while ((semi = memchr(pos, ';', end - pos)) != NULL)
+    {
+        pos = semi + 1;
+        while (pos < end && (*pos == ' ' || *pos == '\t')) pos++;
+
+        uhttp_str_t name = { pos, 9 };
+        if (end - pos < 9 || !uhttp_str_ieq(&name, "boundary=")) continue;
+        pos += 9;
+
+        if (pos < end && *pos == '"')
+        {
+            pos++;
+            const char* quote = memchr(pos, '"', end - pos);
+            if (quote == NULL) return -1;
+            boundary->ptr = pos;
+            boundary->len = quote - pos;
+        }
+        else
+        {
+            boundary->ptr = pos;
+            while (pos < end && *pos != ';' && *pos != ' ' && *pos != '\t') pos++;
+            boundary->len = pos - boundary->ptr;
+        }
+
+        // The search relies on CR only starting the delimiter.
+        if (boundary->len == 0 || boundary->len > UHTTP_MULTIPART_BOUNDARY_MAX ||
+            memchr(boundary->ptr, '\r', boundary->len) || memchr(boundary->ptr, '\n', boundary->len))
+            return -1;
+
+        return 0;
+    }
+
+    return -1;
+}
+
+UHTTP_EXTERN uhttp_multipart_t* uhttp_multipart_create(const uhttp_str_t* content_type, const uhttp_multipart_callbacks_t* callbacks, void* user)
+{
+    uhttp_str_t boundary;
+
+    if (content_type == NULL || uhttp_multipart_boundary(content_type, &boundary))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uhttp_multipart_t* multipart = malloc(sizeof(uhttp_multipart_t));
+    if (multipart == NULL)
+    {
+        return NULL;
+    }
+
+    if (callbacks)
+        multipart->callbacks = *callbacks;
+    else
+        memset(&multipart->callbacks, 0, sizeof(multipart->callbacks));
+    multipart->user = user;
+
+    memcpy(multipart->delimiter, "\r\n--", 4);
+    memcpy(multipart->delimiter + 4, boundary.ptr, boundary.len);
+    multipart->delimlen = boundary.len + 4;
+
+    // Horspool shifts, by how far the last byte of a window is from the end
+    // of the delimiter.
+    memset(multipart->shift, (int)multipart->delimlen, sizeof(multipart->shift));
+    for (size_t i = 0; i + 1 < multipart->delimlen; i++)
+    {
+        multipart->shift[(unsigned char)multipart->delimiter[i]] = (unsigned char)(multipart->delimlen - 1 - i);
+    }
+
+    // The first delimiter may start the body without a line break before it.
+    multipart->state = UHTTP_MULTIPART_PREAMBLE;
+    multipart->error = 0;
+    multipart->matched = 2;
+    multipart->linelen = 0;
+
+    return multipart;
+}
+
+UHTTP_EXTERN void uhttp_multipart_destroy(uhttp_multipart_t* multipart)
+{
+    free(multipart);
+}
+
+static const char* uhttp_multipart_fail(uhttp_multipart_t* multipart, int error, const char* end)
+{
+    multipart->state = UHTTP_MULTIPART_ERROR;
+    multipart->error = error;
+    return end;
+}
+
+static int uhttp_multipart_data(uhttp_multipart_t* multipart, const char* data, size_t len)
+{
+    if (multipart->state != UHTTP_MULTIPART_DATA || len == 0 || multipart->callbacks.data == NULL) return 0;
+
+    return multipart->callbacks.data(multipart->user, data, len);
+}
+
+/**
+ * Find the first complete delimiter in a chunk.
+ */
+static const char* uhttp_multipart_search(const uhttp_multipart_t* multipart, const char* pos, const char* end)
+{
+    size_t len = multipart->delimlen;
+    unsigned char last = (unsigned char)multipart->delimiter[len - 1];
+
+    while ((size_t)(end - pos) >= len)
+    {
+        unsigned char c = (unsigned char)pos[len - 1];
+        if (c == last && memcmp(pos, multipart->delimiter, len - 1) == 0) return pos;
+        pos += multipart->shift[c];
+    }
+
+    return NULL;
+}
+
+/**
+ * Pass a delimiter, ending the current part.
+ */
+static const char* uhttp_multipart_delimiter(uhttp_multipart_t* multipart, const char* pos, const char* end)
+{
+    if (multipart->state == UHTTP_MULTIPART_DATA && multipart->callbacks.end &&
+        multipart->callbacks.end(multipart->user))
+        return uhttp_multipart_fail(multipart, ECANCELED, end);
+
+    multipart->state = UHTTP_MULTIPART_DELIMITER;
+    return pos;
+}
+
+/**
+ * Scan preamble or part data for the next delimiter.
+ */
+static const char* uhttp_multipart_scan(uhttp_multipart_t* multipart, const char* pos, const char* end)
+{
+    const char* delimiter = multipart->delimiter;
+    size_t len = multipart->delimlen;
+
+    if (multipart->matched)
+    {
+        size_t matched = multipart->matched;
+        while (matched < len && pos < end && *pos == delimiter[matched])
+        {
+            matched++;
+            pos++;
+        }
+
+        if (matched == len)
+        {
+            multipart->matched = 0;
+            return uhttp_multipart_delimiter(multipart, pos, end);
+        }
+
+        if (pos == end)
+        {
+            multipart->matched = matched;
+            return pos;
+        }
+
+        // Not a delimiter after all. No CR follows the first byte of the
+        // delimiter, so none of the held bytes starts another match.
+        multipart->matched = 0;
+        if (uhttp_multipart_data(multipart, delimiter, matched))
+            return uhttp_multipart_fail(multipart, ECANCELED, end);
+    }
+
+    const char* found = uhttp_multipart_search(multipart, pos, end);
+    if (found)
+    {
+        if (uhttp_multipart_data(multipart, pos, found - pos))
+            return uhttp_multipart_fail(multipart, ECANCELED, end);
+
+        return uhttp_multipart_delimiter(multipart, found + len, end);
+    }
+
+    // Hold back a delimiter cut off by the end of the chunk.
+    const char* tail = (size_t)(end - pos) > len - 1 ? end - (len - 1) : pos;
+    while ((tail = memchr(tail, '\r', end - tail)) != NULL && memcmp(tail, delimiter, end - tail)) tail++;
+
+    const char* stop = tail ? tail : end;
+    if (uhttp_multipart_data(multipart, pos, stop - pos))
+        return uhttp_multipart_fail(multipart, ECANCELED, end);
+
+    multipart->matched = end - stop;
+    return end;
+}
+
+/**
+ * Collect and report the header lines of a part.
+ */
+static const char* uhttp_multipart_headers(uhttp_multipart_t* multipart, const char* pos, const char* end)
+{
+    const char* eol = memchr(pos, '\n', end - pos);
+    const char* stop = eol ? eol : end;
+
+    if ((size_t)(stop - pos) > sizeof(multipart->line) - multipart->linelen)
+        return uhttp_multipart_fail(multipart, E2BIG, end);
+
+    memcpy(multipart->line + multipart->linelen, pos, stop - pos);
+    multipart->linelen += stop - pos;
+    if (eol == NULL) return end;
+
+    const char* line = multipart->line;
+    size_t len = multipart->linelen;
+    if (len && line[len - 1] == '\r') len--;
+    multipart->linelen = 0;
+
+    if (len == 0)
+    {
+        multipart->state = UHTTP_MULTIPART_DATA;
+        if (multipart->callbacks.begin && multipart->callbacks.begin(multipart->user))
+            return uhttp_multipart_fail(multipart, ECANCELED, end);
+
+        return eol + 1;
+    }
+
+    const char* colon = memchr(line, ':', len);
+    if (colon == NULL || colon == line || line[0] == ' ' || line[0] == '\t')
+        return uhttp_multipart_fail(multipart, EBADMSG, end);
+
+    uhttp_str_t name = { line, colon - line };
+    const char* vpos = colon + 1;
+    const char* vend = line + len;
+    while (vpos < vend && (*vpos == ' ' || *vpos == '\t')) vpos++;
+    while (vend > vpos && (vend[-1] == ' ' || vend[-1] == '\t')) vend--;
+    uhttp_str_t value = { vpos, vend - vpos };
+
+    if (multipart->callbacks.header && multipart->callbacks.header(multipart->user, &name, &value))
+        return uhttp_multipart_fail(multipart, ECANCELED, end);
+
+    return eol + 1;
+}
+
+UHTTP_EXTERN int uhttp_multipart_feed(uhttp_multipart_t* multipart, const char* data, size_t len)
+{
+    if (multipart == NULL || (data == NULL && len))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const char* pos = data;
+    const char* end = data + len;
+
+    while (pos < end && multipart->state != UHTTP_MULTIPART_EPILOGUE && multipart->state != UHTTP_MULTIPART_ERROR)
+    {
+        switch (multipart->state)
+        {
+        case UHTTP_MULTIPART_PREAMBLE:
+        case UHTTP_MULTIPART_DATA:
+            pos = uhttp_multipart_scan(multipart, pos, end);
+            break;
+        case UHTTP_MULTIPART_DELIMITER:
+            // "--" closes the body, padding or a line break starts a part.
+            switch (*pos++)
+            {
+            case '-': multipart->state = UHTTP_MULTIPART_CLOSE; break;
+            case ' ': case '\t': multipart->state = UHTTP_MULTIPART_PADDING; break;
+            case '\r': multipart->state = UHTTP_MULTIPART_LF; break;
+            case '\n': multipart->state = UHTTP_MULTIPART_HEADERS; break;
+            default: uhttp_multipart_fail(multipart, EBADMSG, end); break;
+            }
+            break;
+        case UHTTP_MULTIPART_CLOSE:
+            if (*pos++ == '-')
+                multipart->state = UHTTP_MULTIPART_EPILOGUE;
+            else
+                uhttp_multipart_fail(multipart, EBADMSG, end);
+            break;
+        case UHTTP_MULTIPART_PADDING:
+            switch (*pos++)
+            {
+            case ' ': case '\t': break;
+            case '\r': multipart->state = UHTTP_MULTIPART_LF; break;
+            case '\n': multipart->state = UHTTP_MULTIPART_HEADERS; break;
+            default: uhttp_multipart_fail(multipart, EBADMSG, end); break;
+            }
+            break;
+        case UHTTP_MULTIPART_LF:
+            if (*pos++ == '\n')
+                multipart->state = UHTTP_MULTIPART_HEADERS;
+            else
+                uhttp_multipart_fail(multipart, EBADMSG, end);
+            break;
+        case UHTTP_MULTIPART_HEADERS:
+            pos = uhttp_multipart_headers(multipart, pos, end);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (multipart->state == UHTTP_MULTIPART_ERROR)
+    {
+        errno = multipart->error;
+        return -1;
+    }
+
+    return multipart->state == UHTTP_MULTIPART_EPILOGUE;
+}
+#else
+UHTTP_EXTERN uhttp_multipart_t* uhttp_multipart_create(const uhttp_str_t* content_type, const uhttp_multipart_callbacks_t* callbacks, void* user)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+UHTTP_EXTERN void uhttp_multipart_destroy(uhttp_multipart_t* multipart)
+{
+}
+
+UHTTP_EXTERN int uhttp_multipart_feed(uhttp_multipart_t* multipart, const char* data, size_t len)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
@@ -0,0 +1,92 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_MULTIPART_H_
+#define _UHTTP_INTERNAL_MULTIPART_H_
+
+#include <stddef.h>
+#include "uhttp.h"
+#include "debug.h"
+
+/* Longest boundary, RFC 2046 allows 70 characters. */
+#define UHTTP_MULTIPART_BOUNDARY_MAX 70
+
+/* Longest header line of a part. */
+#ifndef UHTTP_MULTIPART_LINE_MAX
+#define UHTTP_MULTIPART_LINE_MAX 1024
+#endif
+
+typedef enum uhttp_multipart_state_t
+{
+    /* Before the first delimiter, data is discarded. */
+    UHTTP_MULTIPART_PREAMBLE,
+    /* After a delimiter, "--" closes the body, CRLF starts a part. */
+    UHTTP_MULTIPART_DELIMITER,
+    UHTTP_MULTIPART_CLOSE,
+    UHTTP_MULTIPART_PADDING,
+    UHTTP_MULTIPART_LF,
+    /* Header lines of a part. */
+    UHTTP_MULTIPART_HEADERS,
+    /* Data of a part up to the next delimiter. */
+    UHTTP_MULTIPART_DATA,
+    /* After the close delimiter, data is discarded. */
+    UHTTP_MULTIPART_EPILOGUE,
+    /* A callback failed or the body was malformed. */
+    UHTTP_MULTIPART_ERROR
+} uhttp_multipart_state_t;
+
+struct uhttp_multipart_t
+{
+    uhttp_multipart_callbacks_t callbacks;
+    void* user;
+
+    uhttp_multipart_state_t state;
+    /* Error of the failed state. */
+    int error;
+
+    /* CRLF "--" boundary, and its Horspool shift table. */
+    char delimiter[UHTTP_MULTIPART_BOUNDARY_MAX + 4];
+    size_t delimlen;
+    unsigned char shift[256];
+
+    /* Bytes of the delimiter matched at the end of the last chunk. They are
+       not kept, a mismatch hands them over from the delimiter itself. */
+    size_t matched;
+
+    /* Header line being assembled. */
+    char line[UHTTP_MULTIPART_LINE_MAX];
+    size_t linelen;
+};
+
+/**
+ * Find the boundary parameter of a Content-Type.
+ * @param content_type Content-Type field value.
+ * @param boundary Receives the boundary, without quotes.
+ * @return Zero when successful, -1 if the type is not multipart or the
+ * boundary is missing or invalid.
+ */
+extern int uhttp_multipart_boundary(const uhttp_str_t* content_type, uhttp_str_t* boundary);
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "pool.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Find the class of a block size.
+ * @return Class index, UHTTP_POOL_CLASSES if the size is too large.
+ */
+static size_t uhttp_pool_class(size_t size)
+{
+    size_t index = 0;
+    while (index < UHTTP_POOL_CLASSES && ((size_t)UHTTP_POOL_MIN << index) < size) index++;
+    return index;
+}
+
+uhttp_pool_t* uhttp_pool_create(void* memory, size_t size)
+{
+    uintptr_t start = (uintptr_t)memory;
+    uintptr_t end = start + size;
+
+    // Pool object first, then the page map, then the pages.
+    uintptr_t map = (start + _Alignof(uhttp_pool_t) - 1) & ~(uintptr_t)(_Alignof(uhttp_pool_t) - 1);
+    if (memory == NULL || map + sizeof(uhttp_pool_t) + UHTTP_POOL_MIN + UHTTP_POOL_PAGE + 1 > end)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    uhttp_pool_t* pool = (uhttp_pool_t*)map;
+    map += sizeof(uhttp_pool_t);
+
+    size_t npages = (end - map - UHTTP_POOL_MIN) / (UHTTP_POOL_PAGE + 1);
+    uintptr_t base = (map + npages + UHTTP_POOL_MIN - 1) & ~(uintptr_t)(UHTTP_POOL_MIN - 1);
+
+    memset(pool->free, 0, sizeof(pool->free));
+    pool->map = (unsigned char*)map;
+    pool->base = (char*)base;
+    pool->npages = npages;
+    pool->carved = 0;
+    pool->used = 0;
+    pool->peak = 0;
+    memset(pool->map, UHTTP_POOL_UNUSED, npages);
+
+    return pool;
+}
+
+/**
+ * Carve unused pages into blocks of a class.
+ * @return Zero when successful, -1 if the region is exhausted.
+ */
+static int uhttp_pool_carve(uhttp_pool_t* pool, size_t index)
+{
+    size_t size = (size_t)UHTTP_POOL_MIN << index;
+    size_t pages = (size + UHTTP_POOL_PAGE - 1) / UHTTP_POOL_PAGE;
+
+    if (pages > pool->npages - pool->carved)
+    {
+        return -1;
+    }
+
+    char* page = pool->base + pool->carved * UHTTP_POOL_PAGE;
+    memset(pool->map + pool->carved, (int)index, pages);
+    pool->carved += pages;
+
+    // Small classes fill the page, the last block ending up first in line.
+    for (size_t offset = 0; offset + size <= pages * UHTTP_POOL_PAGE; offset += size)
+    {
+        void** block = (void**)(page + offset);
+        *block = pool->free[index];
+        pool->free[index] = block;
+    }
+
+    return 0;
+}
+
+void* uhttp_pool_malloc(uhttp_pool_t* pool, size_t size)
+{
+    size_t index = uhttp_pool_class(size);
+
+    if (index == UHTTP_POOL_CLASSES || (pool->free[index] == NULL && uhttp_pool_carve(pool, index)))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void** block = pool->free[index];
+    pool->free[index] = *block;
+
+    pool->used += (size_t)UHTTP_POOL_MIN << index;
+    if (pool->used > pool->peak) pool->peak = pool->used;
+
+    return block;
+}
+
+/**
+ * Find the class of a block handed out by the pool.
+ */
+static size_t uhttp_pool_block_class(uhttp_pool_t* pool, void* ptr)
+{
+    return pool->map[((char*)ptr - pool->base) / UHTTP_POOL_PAGE];
+}
+
+void uhttp_pool_free(uhttp_pool_t* pool, void* ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    size_t index = uhttp_pool_block_class(pool, ptr);
+
+    void** block = ptr;
+    *block = pool->free[index];
+    pool->free[index] = block;
+
+    pool->used -= (size_t)UHTTP_POOL_MIN << index;
+}
+
+void* uhttp_pool_realloc(uhttp_pool_t* pool, void* ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return uhttp_pool_malloc(pool, size);
+    }
+
+    if (size == 0)
+    {
+        uhttp_pool_free(pool, ptr);
+        return NULL;
+    }
+
+    size_t capacity = (size_t)UHTTP_POOL_MIN << uhttp_pool_block_class(pool, ptr);
+    if (size <= capacity && size > capacity / 2)
+    {
+        return ptr;
+    }
+
+    void* xptr = uhttp_pool_malloc(pool, size);
+    if (xptr)
+    {
+        memcpy(xptr, ptr, size < capacity ? size : capacity);
+        uhttp_pool_free(pool, ptr);
+    }
+
+    return xptr;
+}
+
+static void* uhttp_pool_malloc_func(void* context, size_t size)
+{
+    return uhttp_pool_malloc(context, size);
+}
+
+static void* uhttp_pool_realloc_func(void* context, void* ptr, size_t size)
+{
+    return uhttp_pool_realloc(context, ptr, size);
+}
+
+static void uhttp_pool_free_func(void* context, void* ptr)
+{
+    uhttp_pool_free(context, ptr);
+}
+
+void uhttp_pool_allocator(uhttp_pool_t* pool, uhttp_allocator_t* allocator)
+{
+    allocator->malloc_func = uhttp_pool_malloc_func;
+    allocator->realloc_func = uhttp_pool_realloc_func;
+    allocator->free_func = uhttp_pool_free_func;
+    allocator->context = pool;
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_POOL_H_
+#define _UHTTP_INTERNAL_POOL_H_
+
+#include <stddef.h>
+#include "uhttp.h"
+
+/* Bytes per page, a power of two. Blocks smaller than a page share one of
+   their class. */
+#ifndef UHTTP_POOL_PAGE
+#define UHTTP_POOL_PAGE 256
+#endif
+
+/* Smallest block, the alignment of every block. */
+#define UHTTP_POOL_MIN 16
+
+/* Number of size classes, powers of two from UHTTP_POOL_MIN on. */
+#define UHTTP_POOL_CLASSES 28
+
+/* Page map value of pages not carved yet. */
+#define UHTTP_POOL_UNUSED 0xFF
+
+/**
+ * Allocator carving power of two blocks out of one caller supplied region.
+ * Freed blocks are kept for their class, so the region never fragments into
+ * holes too small to use, and blocks carry no header, the page map records
+ * their class.
+ */
+typedef struct uhttp_pool_t
+{
+    /* Free blocks of each class, linked through their first bytes. */
+    void* free[UHTTP_POOL_CLASSES];
+
+    /* Class of the block at the start of each page. */
+    unsigned char* map;
+    /* First page, aligned to UHTTP_POOL_MIN. */
+    char* base;
+    size_t npages;
+    /* Pages carved so far. */
+    size_t carved;
+
+    /* Bytes in blocks handed out, now and at most. */
+    size_t used;
+    size_t peak;
+} uhttp_pool_t;
+
+/**
+ * Create a pool in a region, the pool object taking the start of it.
+ * @param memory Region, kept by the pool until it is no longer used.
+ * @param size Size of the region.
+ * @return Pool object, NULL if the region is too small (see errno).
+ */
+extern uhttp_pool_t* uhttp_pool_create(void* memory, size_t size);
+
+/**
+ * Allocate a block, rounded up to the next power of two.
+ * @param pool Pool object.
+ * @param size Size of the block.
+ * @return Block, NULL if the region is exhausted.
+ */
+extern void* uhttp_pool_malloc(uhttp_pool_t* pool, size_t size);
+
+/**
+ * Resize a block, in place while the size stays within its class.
+ * @return Block, NULL if out of memory or size is zero (the block is freed).
+ */
+extern void* uhttp_pool_realloc(uhttp_pool_t* pool, void* ptr, size_t size);
+
+/**
+ * Return a block to the free list of its class.
+ */
+extern void uhttp_pool_free(uhttp_pool_t* pool, void* ptr);
+
+/**
+ * Get allocator hooks allocating from the pool.
+ * @param pool Pool object.
+ * @param allocator Receives the hooks.
+ */
+extern void uhttp_pool_allocator(uhttp_pool_t* pool, uhttp_allocator_t* allocator);
+
+#endif
@@ -0,0 +1,656 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "config.h"
+#include "client.h"
+#include "clock.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if UHTTP_FEATURE_PROXY
+static const char uhttp_proxy_keep_alive[] = "Connection: keep-alive\r\n\r\n";
+static const char uhttp_proxy_close[] = "Connection: close\r\n";
+
+/**
+ * A request being proxied, kept in the locals of the handler.
+ */
+typedef struct uhttp_proxy_session_t
+{
+    /* Relay of the response body, first so the relay is the session. */
+    uhttp_client_relay_t relay;
+    uhttp_proxy_t* proxy;
+    /* Non-zero for a pooled connection the upstream may have closed. */
+    int reused;
+    /* Bytes of the buffer handled and in use. */
+    size_t pos;
+    size_t len;
+    /* Request head, then the response head and the first body bytes. */
+    char buffer[UHTTP_PROXY_BUFFER_SIZE];
+} uhttp_proxy_session_t;
+
+UHTTP_EXTERN uhttp_proxy_t* uhttp_proxy_create(const uhttp_addr_t* upstream, int idle, int timeout)
+{
+    if (upstream == NULL || idle < 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uhttp_proxy_t* proxy = malloc(sizeof(uhttp_proxy_t) + idle * sizeof(uhttp_proxy_idle_t));
+    if (proxy == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    proxy->upstream = *upstream;
+    proxy->timeout = timeout < 0 ? -1 : timeout;
+    proxy->idle = (uhttp_proxy_idle_t*)(proxy + 1);
+    proxy->nidle = 0;
+    proxy->maxidle = idle;
+    return proxy;
+}
+
+UHTTP_EXTERN void uhttp_proxy_destroy(uhttp_proxy_t* proxy)
+{
+    if (proxy == NULL) return;
+
+    for (size_t i = 0; i < proxy->nidle; i++)
+    {
+        uhttp_close(proxy->idle[i].sock);
+    }
+    free(proxy);
+}
+
+/**
+ * Take the most recently used idle connection that is still open.
+ * @param proxy Proxy object.
+ * @return Connected socket or UHTTP_INVALID_SOCKET if none is idle.
+ */
+static uhttp_socket_t uhttp_proxy_checkout(uhttp_proxy_t* proxy)
+{
+    uint64_t now = uhttp_clock_ms();
+
+    while (proxy->nidle)
+    {
+        uhttp_proxy_idle_t idle = proxy->idle[--proxy->nidle];
+        uhttp_event_t events;
+
+        // An idle connection with anything to read was closed by the
+        // upstream. Older ones expired as well once this one did.
+        if (now - idle.since < UHTTP_PROXY_IDLE_TIMEOUT && uhttp_poll(idle.sock, &events) == 0 &&
+            !(events & (UHTTP_EVENT_RECEIVE | UHTTP_EVENT_HANGUP | UHTTP_EVENT_ERROR)))
+        {
+            return idle.sock;
+        }
+        uhttp_close(idle.sock);
+    }
+
+    return UHTTP_INVALID_SOCKET;
+}
+
+/**
+ * Keep a connection for the next request.
+ * @param proxy Proxy object.
+ * @param sock Connected socket, closed when the pool is full.
+ */
+static void uhttp_proxy_checkin(uhttp_proxy_t* proxy, uhttp_socket_t sock)
+{
+    if (proxy->maxidle == 0)
+    {
+        uhttp_close(sock);
+        return;
+    }
+
+    // Make room by closing the connection idle the longest.
+    if (proxy->nidle == proxy->maxidle)
+    {
+        uhttp_close(proxy->idle[0].sock);
+        memmove(proxy->idle, proxy->idle + 1, --proxy->nidle * sizeof(uhttp_proxy_idle_t));
+    }
+
+    proxy->idle[proxy->nidle].sock = sock;
+    proxy->idle[proxy->nidle].since = uhttp_clock_ms();
+    proxy->nidle++;
+}
+
+/**
+ * Start connecting to the upstream.
+ * @param proxy Proxy object.
+ * @param connecting Receives non-zero if the connection is in progress.
+ * @return Non-blocking socket or UHTTP_INVALID_SOCKET (see errno).
+ */
+static uhttp_socket_t uhttp_proxy_connect(uhttp_proxy_t* proxy, int* connecting)
+{
+    uhttp_socket_t sock = uhttp_socket_create(proxy->upstream.domain);
+    if (sock == UHTTP_INVALID_SOCKET) return sock;
+
+    if (uhttp_async(sock, 1))
+    {
+        uhttp_close(sock);
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    // Request heads are small and sent whole.
+    if (proxy->upstream.domain != UHTTP_SOCKET_DOMAIN_UNIX)
+    {
+        uhttp_setsockopt(sock, UHTTP_SOCKOPT_NODELAY, 1);
+    }
+
+    *connecting = 0;
+    if (uhttp_connect(sock, &proxy->upstream))
+    {
+        if (errno != EINPROGRESS)
+        {
+            uhttp_close(sock);
+            return UHTTP_INVALID_SOCKET;
+        }
+        *connecting = 1;
+    }
+
+    return sock;
+}
+
+/**
+ * Append data to a buffer.
+ * @param buffer Buffer.
+ * @param len Length of data in the buffer, advanced.
+ * @param cap Capacity of the buffer.
+ * @param data Data to append.
+ * @param n Length of data.
+ * @return Zero when successful, -1 if the buffer is full.
+ */
+static int uhttp_proxy_append(char* buffer, size_t* len, size_t cap, const char* data, size_t n)
+{
+    if (cap - *len < n) return -1;
+
+    memcpy(buffer + *len, data, n);
+    *len += n;
+    return 0;
+}
+
+/**
+ * Render the request head sent to the upstream.
+ * @param request Request object.
+ * @param buffer Buffer to render into.
+ * @param cap Capacity of the buffer.
+ * @return Length of the head, zero if it does not fit.
+ */
+static size_t uhttp_proxy_render(const uhttp_request_t* request, char* buffer, size_t cap)
+{
+    static const char version[] = " HTTP/1.0\r\n";
+    size_t len = 0;
+
+    if (uhttp_proxy_append(buffer, &len, cap, request->method.ptr, request->method.len) ||
+        uhttp_proxy_append(buffer, &len, cap, " ", 1) ||
+        uhttp_proxy_append(buffer, &len, cap, request->target.ptr, request->target.len) ||
+        uhttp_proxy_append(buffer, &len, cap, version, sizeof(version) - 1))
+    {
+        return 0;
+    }
+
+    // The version of the client, so the upstream does not chunk bodies for
+    // HTTP/1.0 clients.
+    buffer[len - 3] = '0' + request->version;
+
+    const uhttp_str_t* connection = uhttp_request_header(request, "Connection");
+    for (size_t i = 0; i < request->nheaders; i++)
+    {
+        const uhttp_header_t* header = &request->headers[i];
+
+        // Expect is answered by the server before the body arrives, and the
+        // body is framed as the server read it.
+        if (uhttp_proxy_hop_by_hop(&header->name, connection) || uhttp_str_ieq(&header->name, "Expect") ||
+            uhttp_str_ieq(&header->name, "Content-Length") || uhttp_str_ieq(&header->name, "Transfer-Encoding"))
+            continue;
+
+        if (uhttp_proxy_append(buffer, &len, cap, header->name.ptr, header->name.len) ||
+            uhttp_proxy_append(buffer, &len, cap, ": ", 2) ||
+            uhttp_proxy_append(buffer, &len, cap, header->value.ptr, header->value.len) ||
+            uhttp_proxy_append(buffer, &len, cap, "\r\n", 2))
+        {
+            return 0;
+        }
+    }
+
+    if (uhttp_request_header(request, "Content-Length"))
+    {
+        char length[40];
+        int n = snprintf(length, sizeof(length), "Content-Length: %zu\r\n", request->content_length);
+        if (uhttp_proxy_append(buffer, &len, cap, length, (size_t)n))
+        {
+            return 0;
+        }
+    }
+
+    if (uhttp_proxy_append(buffer, &len, cap, uhttp_proxy_keep_alive, sizeof(uhttp_proxy_keep_alive) - 1))
+    {
+        return 0;
+    }
+
+    return len;
+}
+
+/**
+ * Send request body bytes of the receive buffer to the upstream, without
+ * copying them.
+ * @param client Client object.
+ * @param sock Upstream socket.
+ * @return Bytes sent, -1 on error (see errno).
+ */
+static ssize_t uhttp_proxy_forward(uhttp_client_t* client, uhttp_socket_t sock)
+{
+    size_t avail = client->rxlen - client->rxpos;
+    if (avail > client->rxskip) avail = client->rxskip;
+
+    char* body = client->rx + client->rxpos;
+    ssize_t sent = uhttp_send(sock, body, avail);
+    if (sent <= 0) return sent;
+
+    memmove(body, body + sent, client->rxlen - client->rxpos - sent);
+    client->rxlen -= sent;
+    client->rxskip -= sent;
+    return sent;
+}
+
+/**
+ * Drop the header fields of one connection from a response head in place.
+ * @param response Parsed response head.
+ * @param buffer Buffer holding the head.
+ * @return Length of the status line and the fields kept, without the blank
+ * line.
+ */
+static size_t uhttp_proxy_strip(const uhttp_proxy_response_t* response, char* buffer)
+{
+    char* out = (char*)memchr(buffer, '\n', UHTTP_PROXY_BUFFER_SIZE) + 1;
+
+    // Decided before anything moves, the Connection field may be overwritten.
+    const uhttp_str_t* connection = NULL;
+    unsigned char drop[UHTTP_REQUEST_MAX_HEADERS];
+    for (size_t i = 0; i < response->nheaders; i++)
+    {
+        if (uhttp_str_ieq(&response->headers[i].name, "Connection")) connection = &response->headers[i].value;
+    }
+    for (size_t i = 0; i < response->nheaders; i++)
+    {
+        drop[i] = (unsigned char)uhttp_proxy_hop_by_hop(&response->headers[i].name, connection);
+    }
+
+    // Fields move down over dropped ones, never over fields still to come.
+    for (size_t i = 0; i < response->nheaders; i++)
+    {
+        const uhttp_header_t* header = &response->headers[i];
+        const char* value_end = header->value.ptr + header->value.len;
+        const char* line_end = (const char*)memchr(value_end, '\n', buffer + UHTTP_PROXY_BUFFER_SIZE - value_end) + 1;
+
+        if (drop[i]) continue;
+
+        size_t n = line_end - header->name.ptr;
+        memmove(out, header->name.ptr, n);
+        out += n;
+    }
+
+    return out - buffer;
+}
+
+/**
+ * Give back the upstream connection of a relay and free its session.
+ * @param relay Relay of the session.
+ * @param reusable Non-zero to keep the connection for the next request.
+ */
+static void uhttp_proxy_release(uhttp_client_relay_t* relay, int reusable)
+{
+    uhttp_proxy_session_t* session = (uhttp_proxy_session_t*)relay;
+
+    if (relay->spliced)
+    {
+        uhttp_splice_close(&relay->splice);
+    }
+
+    if (reusable)
+    {
+        uhttp_proxy_checkin(session->proxy, relay->sock);
+    }
+    else
+    {
+        uhttp_close(relay->sock);
+    }
+
+    free(session);
+}
+
+/**
+ * Answer a request with an error and free its session.
+ * @param request Request object.
+ * @param session Session object.
+ * @param status Status code.
+ */
+static void uhttp_proxy_fail(uhttp_request_t* request, uhttp_proxy_session_t* session, int status)
+{
+    if (session->relay.sock != UHTTP_INVALID_SOCKET)
+    {
+        uhttp_close(session->relay.sock);
+    }
+
+    free(session);
+    uhttp_respond(request, status, NULL, NULL, 0);
+}
+
+/**
+ * Answer a request with the response head of the upstream and relay the
+ * body that follows.
+ * @param request Request object.
+ * @param session Session object, owned by the client afterwards.
+ * @param response Parsed response head.
+ * @param head Length of the head in the session buffer.
+ */
+static void uhttp_proxy_respond(uhttp_request_t* request, uhttp_proxy_session_t* session, const uhttp_proxy_response_t* response, size_t head)
+{
+    uhttp_client_relay_t* relay = &session->relay;
+    const char* body = session->buffer + head;
+    size_t extra = session->len - head;
+    uhttp_str_t parts[4];
+    size_t nparts = 0;
+
+    relay->framing = response->framing;
+    relay->left = 0;
+    relay->buffer = session->buffer;
+    relay->bufcap = sizeof(session->buffer);
+    relay->bufpos = 0;
+    relay->buflen = 0;
+    relay->starved = 0;
+    relay->ended = 0;
+    relay->reusable = response->keep_alive;
+    relay->keep_alive = request->keep_alive && response->framing != UHTTP_PROXY_CLOSE;
+    relay->release = uhttp_proxy_release;
+    uhttp_chunked_init(&relay->chunked);
+
+    // Body bytes read along with the head, anything past the body means the
+    // upstream is out of step.
+    if (response->framing == UHTTP_PROXY_LENGTH)
+    {
+        if ((uint64_t)extra > (uint64_t)response->length)
+        {
+            extra = (size_t)response->length;
+            relay->reusable = 0;
+        }
+
+        relay->left = response->length - extra;
+        relay->ended = relay->left == 0;
+    }
+    else if (response->framing == UHTTP_PROXY_CHUNKED)
+    {
+        ssize_t scanned = uhttp_chunked_scan(&relay->chunked, body, extra);
+        if (scanned < 0)
+        {
+            uhttp_proxy_fail(request, session, 502);
+            return;
+        }
+
+        if ((size_t)scanned < extra)
+        {
+            extra = scanned;
+            relay->reusable = 0;
+        }
+        relay->ended = uhttp_chunked_done(&relay->chunked);
+    }
+
+    // The response goes out as HTTP/1.1 whatever the upstream speaks.
+    memcpy(session->buffer, "HTTP/1.1", 8);
+    parts[nparts].ptr = session->buffer;
+    parts[nparts++].len = uhttp_proxy_strip(response, session->buffer);
+    if (!relay->keep_alive)
+    {
+        parts[nparts].ptr = uhttp_proxy_close;
+        parts[nparts++].len = sizeof(uhttp_proxy_close) - 1;
+    }
+    parts[nparts].ptr = "\r\n";
+    parts[nparts++].len = 2;
+    parts[nparts].ptr = body;
+    parts[nparts++].len = extra;
+
+    // Chunked bodies are scanned as they pass, the others can bypass user
+    // space when both ends are kernel sockets.
+    relay->spliced = response->framing != UHTTP_PROXY_CHUNKED && !relay->ended && request->client->transport == NULL && uhttp_splice_open(&relay->splice) == 0;
+
+    uhttp_client_respond_relay(request->client, parts, nparts, relay);
+}
+
+/**
+ * Check how a wait for the upstream socket ended.
+ * @param request Request object.
+ * @return Zero when the socket is ready, otherwise the status to fail the
+ * request with. 504 for a timeout, 502 for a failed socket or a cancelled
+ * wait, the client going away.
+ */
+static int uhttp_proxy_waited(const uhttp_request_t* request)
+{
+    uhttp_event_t events = uhttp_await_events(request);
+
+    if (events == 0)
+    {
+        return 504;
+    }
+
+    return (events & (UHTTP_EVENT_RECEIVE | UHTTP_EVENT_SEND)) ? 0 : 502;
+}
+
+UHTTP_EXTERN void uhttp_proxy_handler(uhttp_request_t* request, void* user)
+{
+    uhttp_proxy_session_t** locals = uhttp_await_locals(request);
+    uhttp_proxy_session_t* session = *locals;
+    uhttp_proxy_t* proxy = user;
+    uhttp_proxy_response_t response;
+    ssize_t len;
+    int connecting, status;
+
+    UHTTP_AWAIT_BEGIN(request);
+
+    if (proxy == NULL || (session = malloc(sizeof(uhttp_proxy_session_t))) == NULL)
+    {
+        uhttp_respond(request, 503, NULL, NULL, 0);
+        return;
+    }
+
+    *locals = session;
+    session->proxy = proxy;
+
+retry:
+    session->relay.sock = uhttp_proxy_checkout(proxy);
+    session->reused = session->relay.sock != UHTTP_INVALID_SOCKET;
+    if (!session->reused)
+    {
+        session->relay.sock = uhttp_proxy_connect(proxy, &connecting);
+        if (session->relay.sock == UHTTP_INVALID_SOCKET)
+        {
+            uhttp_proxy_fail(request, session, 502);
+            return;
+        }
+
+        if (connecting)
+        {
+            UHTTP_AWAIT(request, uhttp_await_socket(request, session->relay.sock, UHTTP_EVENT_SEND, proxy->timeout));
+            if ((status = uhttp_proxy_waited(request)) != 0)
+            {
+                uhttp_proxy_fail(request, session, status);
+                return;
+            }
+            else if (uhttp_connect(session->relay.sock, &proxy->upstream))
+            {
+                uhttp_proxy_fail(request, session, 502);
+                return;
+            }
+        }
+    }
+
+    session->len = uhttp_proxy_render(request, session->buffer, sizeof(session->buffer));
+    if (session->len == 0)
+    {
+        uhttp_proxy_fail(request, session, 431);
+        return;
+    }
+
+    session->pos = 0;
+    while (session->pos < session->len)
+    {
+        len = uhttp_send(session->relay.sock, session->buffer + session->pos, session->len - session->pos);
+        if (len >= 0)
+        {
+            session->pos += len;
+            continue;
+        }
+        else if (errno != EAGAIN)
+        {
+            // A pooled connection the upstream closed meanwhile.
+            if (session->reused)
+            {
+                uhttp_close(session->relay.sock);
+                goto retry;
+            }
+
+            uhttp_proxy_fail(request, session, 502);
+            return;
+        }
+
+        UHTTP_AWAIT(request, uhttp_await_socket(request, session->relay.sock, UHTTP_EVENT_SEND, proxy->timeout));
+        if ((status = uhttp_proxy_waited(request)) != 0)
+        {
+            uhttp_proxy_fail(request, session, status);
+            return;
+        }
+    }
+
+    // The body goes from the receive buffer to the upstream as it arrives.
+    while (request->client->rxskip)
+    {
+        if (request->client->rxlen == request->client->rxpos)
+        {
+            if (request->client->closing || request->client->sck == UHTTP_INVALID_SOCKET)
+            {
+                uhttp_proxy_fail(request, session, 400);
+                return;
+            }
+
+            UHTTP_AWAIT(request, uhttp_await_body(request, proxy->timeout));
+            if (uhttp_await_events(request) == 0)
+            {
+                uhttp_proxy_fail(request, session, 408);
+                return;
+            }
+            continue;
+        }
+
+        len = uhttp_proxy_forward(request->client, session->relay.sock);
+        if (len < 0 && errno == EAGAIN)
+        {
+            UHTTP_AWAIT(request, uhttp_await_socket(request, session->relay.sock, UHTTP_EVENT_SEND, proxy->timeout));
+            if ((status = uhttp_proxy_waited(request)) != 0)
+            {
+                uhttp_proxy_fail(request, session, status);
+                return;
+            }
+        }
+        else if (len < 0)
+        {
+            uhttp_proxy_fail(request, session, 502);
+            return;
+        }
+    }
+
+    // Read up to the final response head, interim ones are dropped.
+    session->len = 0;
+    for (;;)
+    {
+        len = session->len ? uhttp_proxy_parse(&response, session->buffer, session->len, uhttp_str_ieq(&request->method, "HEAD")) : 0;
+        if (len < 0)
+        {
+            uhttp_proxy_fail(request, session, 502);
+            return;
+        }
+        else if (len > 0 && response.status >= 200)
+        {
+            break;
+        }
+        else if (len > 0)
+        {
+            memmove(session->buffer, session->buffer + len, session->len - len);
+            session->len -= len;
+            continue;
+        }
+        else if (session->len == sizeof(session->buffer))
+        {
+            uhttp_proxy_fail(request, session, 502);
+            return;
+        }
+
+        len = uhttp_recv(session->relay.sock, session->buffer + session->len, sizeof(session->buffer) - session->len);
+        if (len > 0)
+        {
+            session->len += len;
+            continue;
+        }
+        else if (len < 0 && errno == EAGAIN)
+        {
+            UHTTP_AWAIT(request, uhttp_await_socket(request, session->relay.sock, UHTTP_EVENT_RECEIVE, proxy->timeout));
+            if ((status = uhttp_proxy_waited(request)) != 0)
+            {
+                uhttp_proxy_fail(request, session, status);
+                return;
+            }
+            continue;
+        }
+
+        // A pooled connection closed before answering is tried again on a
+        // new one, unless the body it took is gone.
+        if (session->reused && session->len == 0 && request->content_length == 0)
+        {
+            uhttp_close(session->relay.sock);
+            goto retry;
+        }
+
+        uhttp_proxy_fail(request, session, 502);
+        return;
+    }
+
+    uhttp_proxy_respond(request, session, &response, len);
+
+    UHTTP_AWAIT_END(request);
+}
+#else
+UHTTP_EXTERN uhttp_proxy_t* uhttp_proxy_create(const uhttp_addr_t* upstream, int idle, int timeout)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+UHTTP_EXTERN void uhttp_proxy_destroy(uhttp_proxy_t* proxy)
+{
+}
+
+UHTTP_EXTERN void uhttp_proxy_handler(uhttp_request_t* request, void* user)
+{
+    uhttp_respond(request, 501, NULL, NULL, 0);
+}
+#endif
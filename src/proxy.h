@@ -0,0 +1,153 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_PROXY_H_
+#define _UHTTP_INTERNAL_PROXY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "uhttp.h"
+#include "debug.h"
+#include "request.h"
+
+/* Buffer of a proxied request, bounds the response head of an upstream. */
+#ifndef UHTTP_PROXY_BUFFER_SIZE
+#if UHTTP_STATIC_MEMORY
+#define UHTTP_PROXY_BUFFER_SIZE 2048
+#else
+#define UHTTP_PROXY_BUFFER_SIZE 16384
+#endif
+#endif
+
+/* Milliseconds an idle upstream connection is reused for. Upstreams close
+   idle connections themselves, often after a few seconds. */
+#ifndef UHTTP_PROXY_IDLE_TIMEOUT
+#define UHTTP_PROXY_IDLE_TIMEOUT 4000
+#endif
+
+/* How the end of a response body is found. */
+typedef enum uhttp_proxy_framing_t
+{
+    UHTTP_PROXY_LENGTH,
+    UHTTP_PROXY_CHUNKED,
+    UHTTP_PROXY_CLOSE
+} uhttp_proxy_framing_t;
+
+/**
+ * Position in a chunked body, to find where it ends.
+ */
+typedef struct uhttp_chunked_t
+{
+    int state;
+    /* Size of the chunk being read, then its bytes left. */
+    uint64_t left;
+    int digits;
+    /* Length of the trailer line being read. */
+    size_t linelen;
+} uhttp_chunked_t;
+
+/**
+ * Parsed response head of an upstream, slices point into the parsed buffer.
+ */
+typedef struct uhttp_proxy_response_t
+{
+    int status;
+    /* Minor HTTP version. */
+    int version;
+    uhttp_header_t headers[UHTTP_REQUEST_MAX_HEADERS];
+    size_t nheaders;
+    /* Body framing and length with UHTTP_PROXY_LENGTH. */
+    uhttp_proxy_framing_t framing;
+    int64_t length;
+    /* Non-zero when the upstream connection persists. */
+    int keep_alive;
+} uhttp_proxy_response_t;
+
+/**
+ * An idle upstream connection.
+ */
+typedef struct uhttp_proxy_idle_t
+{
+    uhttp_socket_t sock;
+    /* Clock milliseconds the connection became idle. */
+    uint64_t since;
+} uhttp_proxy_idle_t;
+
+struct uhttp_proxy_t
+{
+    uhttp_addr_t upstream;
+    /* Milliseconds to wait for the upstream. */
+    int timeout;
+    /* Idle connections, most recently used last. */
+    uhttp_proxy_idle_t* idle;
+    size_t nidle;
+    size_t maxidle;
+};
+
+/**
+ * Start following a chunked body.
+ * @param chunked Chunked state.
+ */
+extern void uhttp_chunked_init(uhttp_chunked_t* chunked);
+
+/**
+ * Follow the next bytes of a chunked body.
+ * @param chunked Chunked state.
+ * @param data Next bytes of the body.
+ * @param len Number of bytes.
+ * @return Bytes belonging to the body, less than len if it ended before
+ * them, -1 for a malformed body (EBADMSG).
+ */
+extern ssize_t uhttp_chunked_scan(uhttp_chunked_t* chunked, const char* data, size_t len);
+
+/**
+ * Check if a chunked body ended.
+ * @param chunked Chunked state.
+ * @return Non-zero after the last chunk and trailer section.
+ */
+extern int uhttp_chunked_done(const uhttp_chunked_t* chunked);
+
+/**
+ * Parse the response head of an upstream.
+ * @param response Response object.
+ * @param buffer Buffer holding the start of the response.
+ * @param len Length of data in the buffer.
+ * @param head Non-zero if the request was a HEAD request.
+ * @return Length of the head including the blank line, zero if the head is
+ * incomplete, -1 on error (see errno). EBADMSG for a malformed head, E2BIG
+ * for too many header fields.
+ */
+extern ssize_t uhttp_proxy_parse(uhttp_proxy_response_t* response, const char* buffer, size_t len, int head);
+
+/**
+ * Check if a header field only concerns one connection.
+ * @param name Field name.
+ * @param connection Value of the Connection field of the message, NULL if
+ * it has none. Fields it names are hop-by-hop too.
+ * @return Non-zero for fields a proxy does not forward.
+ */
+extern int uhttp_proxy_hop_by_hop(const uhttp_str_t* name, const uhttp_str_t* connection);
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "queue.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+int uhttp_queue_create(uhttp_queue_t* queue, size_t capacity)
+{
+    size_t n = 2;
+    while (n < capacity) n *= 2;
+
+    queue->slots = malloc(n * sizeof(uhttp_queue_slot_t));
+    if (queue->slots == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        atomic_init(&queue->slots[i].sequence, i);
+    }
+
+    queue->mask = n - 1;
+    atomic_init(&queue->tail, 0);
+    queue->head = 0;
+    return 0;
+}
+
+void uhttp_queue_destroy(uhttp_queue_t* queue)
+{
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+int uhttp_queue_push(uhttp_queue_t* queue, const uhttp_task_t* task)
+{
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uhttp_queue_slot_t* slot;
+
+    for (;;)
+    {
+        slot = &queue->slots[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(sequence - pos);
+
+        if (diff == 0)
+        {
+            // The slot is free at this position, claim it.
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The consumer has not freed the slot a lap ago.
+            errno = EAGAIN;
+            return -1;
+        }
+        else
+        {
+            // Another producer took the position.
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    slot->task = *task;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return 0;
+}
+
+int uhttp_queue_pop(uhttp_queue_t* queue, uhttp_task_t* task)
+{
+    uhttp_queue_slot_t* slot = &queue->slots[queue->head & queue->mask];
+    size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+    if (sequence != queue->head + 1)
+    {
+        return 0;
+    }
+
+    *task = slot->task;
+    atomic_store_explicit(&slot->sequence, queue->head + queue->mask + 1, memory_order_release);
+    queue->head++;
+    return 1;
+}
@@ -0,0 +1,102 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_QUEUE_H_
+#define _UHTTP_INTERNAL_QUEUE_H_
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "uhttp.h"
+#include "debug.h"
+
+/* Bytes between fields written by different threads. */
+#define UHTTP_QUEUE_PAD 64
+
+/**
+ * A function posted to the polling thread.
+ */
+typedef struct uhttp_task_t
+{
+    uhttp_post_func_t func;
+    void* arg;
+} uhttp_task_t;
+
+typedef struct uhttp_queue_slot_t
+{
+    /* Position the slot is written at next, plus one once it is full. */
+    atomic_size_t sequence;
+    uhttp_task_t task;
+} uhttp_queue_slot_t;
+
+/**
+ * Bounded queue with any number of producers and a single consumer. Pushing
+ * takes one compare and swap, popping none.
+ */
+typedef struct uhttp_queue_t
+{
+    uhttp_queue_slot_t* slots;
+    size_t mask;
+
+    char pad0[UHTTP_QUEUE_PAD];
+    /* Next position to push at, shared by the producers. */
+    atomic_size_t tail;
+
+    char pad1[UHTTP_QUEUE_PAD];
+    /* Next position to pop from, owned by the consumer. */
+    size_t head;
+} uhttp_queue_t;
+
+/**
+ * Create a queue.
+ * @param queue Queue object.
+ * @param capacity Number of tasks the queue holds, rounded up to a power of
+ * two.
+ * @return Zero when successful, see errno otherwise.
+ */
+extern int uhttp_queue_create(uhttp_queue_t* queue, size_t capacity);
+
+/**
+ * Destroy a queue, dropping the tasks in it.
+ * @param queue Queue object.
+ */
+extern void uhttp_queue_destroy(uhttp_queue_t* queue);
+
+/**
+ * Push a task, safe to call from any thread.
+ * @param queue Queue object.
+ * @param task Task to copy into the queue.
+ * @return Zero when successful, -1 with errno EAGAIN if the queue is full.
+ */
+extern int uhttp_queue_push(uhttp_queue_t* queue, const uhttp_task_t* task);
+
+/**
+ * Pop a task, only from the consuming thread.
+ * @param queue Queue object.
+ * @param task Receives the oldest task.
+ * @return Non-zero if a task was popped, zero if the queue is empty.
+ */
+extern int uhttp_queue_pop(uhttp_queue_t* queue, uhttp_task_t* task);
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "range.h"
+
+#include <string.h>
+
+/**
+ * Parse a decimal number.
+ * @return Pointer past the digits, NULL if there are none or it overflows.
+ */
+static const char* uhttp_range_number(const char* pos, const char* end, int64_t* value)
+{
+    const char* start = pos;
+    *value = 0;
+
+    while (pos < end && *pos >= '0' && *pos <= '9')
+    {
+        if (pos - start == 18) return NULL;
+        *value = *value * 10 + (*pos++ - '0');
+    }
+
+    return pos > start ? pos : NULL;
+}
+
+int uhttp_range_parse(const uhttp_str_t* value, int64_t size, uhttp_range_t* ranges, int max)
+{
+    const char* pos = value->ptr;
+    const char* end = value->ptr + value->len;
+    int nranges = 0;
+    int nspecs = 0;
+
+    if (value->len < 6 || memcmp(pos, "bytes=", 6))
+    {
+        return 0;
+    }
+    pos += 6;
+
+    while (pos < end)
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',')) pos++;
+        if (pos == end) break;
+
+        if (++nspecs > max)
+        {
+            return 0;
+        }
+
+        int64_t first = -1;
+        int64_t last = -1;
+
+        if (*pos != '-' && (pos = uhttp_range_number(pos, end, &first)) == NULL)
+        {
+            return 0;
+        }
+
+        if (pos == end || *pos++ != '-')
+        {
+            return 0;
+        }
+
+        if (pos < end && *pos >= '0' && *pos <= '9' && (pos = uhttp_range_number(pos, end, &last)) == NULL)
+        {
+            return 0;
+        }
+
+        while (pos < end && (*pos == ' ' || *pos == '\t')) pos++;
+        if (pos < end && *pos != ',')
+        {
+            return 0;
+        }
+
+        if (first < 0)
+        {
+            // Suffix range, the last bytes of the representation.
+            if (last < 0) return 0;
+            if (last == 0 || size == 0) continue;
+            first = last < size ? size - last : 0;
+            last = size - 1;
+        }
+        else
+        {
+            if (last >= 0 && last < first) return 0;
+            if (first >= size) continue;
+            if (last < 0 || last >= size) last = size - 1;
+        }
+
+        ranges[nranges].first = first;
+        ranges[nranges].last = last;
+        nranges++;
+    }
+
+    if (nspecs == 0)
+    {
+        return 0;
+    }
+
+    return nranges ? nranges : -1;
+}
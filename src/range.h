@@ -0,0 +1,58 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_RANGE_H_
+#define _UHTTP_INTERNAL_RANGE_H_
+
+#include "uhttp.h"
+#include "debug.h"
+
+/* Maximum number of ranges served from one request. */
+#ifndef UHTTP_RANGE_MAX
+#define UHTTP_RANGE_MAX 16
+#endif
+
+/**
+ * A byte range, both ends inclusive.
+ */
+typedef struct uhttp_range_t
+{
+    int64_t first;
+    int64_t last;
+} uhttp_range_t;
+
+/**
+ * Parse the value of a Range header.
+ * @param value Field value, "bytes=0-99,200-,-50".
+ * @param size Size of the representation.
+ * @param ranges Receives the satisfiable ranges in request order.
+ * @param max Capacity of ranges.
+ * @return Number of ranges, zero if the header is to be ignored because it
+ * is malformed, not in bytes or asks for more than max ranges, and -1 if no
+ * range is satisfiable.
+ */
+extern int uhttp_range_parse(const uhttp_str_t* value, int64_t size, uhttp_range_t* ranges, int max);
+
+#endif
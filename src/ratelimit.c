@@ -0,0 +1,180 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "ratelimit.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+void uhttp_ratelimit_create(uhttp_ratelimit_t* limiter)
+{
+    limiter->slots = NULL;
+    limiter->mask = 0;
+    limiter->rate = 0;
+    limiter->burst = 0;
+    limiter->prefix4 = 32;
+    limiter->prefix6 = 64;
+}
+
+int uhttp_ratelimit_set_rate(uhttp_ratelimit_t* limiter, int rate, size_t size)
+{
+    if (rate < 0 || rate > UHTTP_RATELIMIT_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (rate && limiter->slots == NULL)
+    {
+        size_t nslots = 16;
+        while (nslots * 2 * sizeof(uhttp_ratelimit_slot_t) <= size) nslots *= 2;
+
+        limiter->slots = calloc(nslots, sizeof(uhttp_ratelimit_slot_t));
+        if (limiter->slots == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        limiter->mask = nslots - 1;
+    }
+
+    limiter->rate = rate;
+    return 0;
+}
+
+void uhttp_ratelimit_destroy(uhttp_ratelimit_t* limiter)
+{
+    free(limiter->slots);
+    limiter->slots = NULL;
+}
+
+/**
+ * Mask the address of a source to its prefix.
+ * @return Zero if the address is not limited.
+ */
+static int uhttp_ratelimit_key(const uhttp_ratelimit_t* limiter, const uhttp_addr_t* addr, uint8_t* key)
+{
+    int bits;
+
+    memset(key, 0, 16);
+    if (addr->domain == UHTTP_SOCKET_DOMAIN_INET4)
+    {
+        // ::ffff:a.b.c.d, the same source as a mapped IPv6 address.
+        key[10] = key[11] = 0xFF;
+        memcpy(key + 12, addr->address, 4);
+        bits = 96 + limiter->prefix4;
+    }
+    else if (addr->domain == UHTTP_SOCKET_DOMAIN_INET6)
+    {
+        static const uint8_t mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+        memcpy(key, addr->address, 16);
+        bits = memcmp(key, mapped, 12) ? limiter->prefix6 : 96 + limiter->prefix4;
+    }
+    else
+    {
+        return 0;
+    }
+
+    for (int i = bits / 8; i < 16; i++)
+    {
+        key[i] &= (i == bits / 8) ? (uint8_t)(0xFF00 >> (bits % 8)) : 0;
+    }
+
+    return 1;
+}
+
+/**
+ * FNV-1a, never zero.
+ */
+static uint32_t uhttp_ratelimit_hash(const uint8_t* key)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 16; i++)
+    {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+
+    return hash ? hash : 1;
+}
+
+int uhttp_ratelimit_take(uhttp_ratelimit_t* limiter, const uhttp_addr_t* addr, uint64_t now)
+{
+    uint8_t key[16];
+
+    if (limiter->rate <= 0 || limiter->slots == NULL || !uhttp_ratelimit_key(limiter, addr, key))
+    {
+        return 1;
+    }
+
+    uint32_t hash = uhttp_ratelimit_hash(key);
+    uint32_t stamp = (uint32_t)now;
+    uint32_t capacity = (uint32_t)(limiter->burst > 0 ? limiter->burst : limiter->rate) * 1000;
+    uhttp_ratelimit_slot_t* slot = NULL;
+    uhttp_ratelimit_slot_t* victim = NULL;
+
+    // Slots are replaced but never emptied, so a source is always found
+    // before the first empty slot of its window.
+    size_t index = hash & limiter->mask;
+    for (int n = 0; n < UHTTP_RATELIMIT_PROBES; n++, index = (index + 1) & limiter->mask)
+    {
+        uhttp_ratelimit_slot_t* probe = &limiter->slots[index];
+
+        if (probe->hash == 0)
+        {
+            victim = probe;
+            break;
+        }
+        if (probe->hash == hash && memcmp(probe->key, key, 16) == 0)
+        {
+            slot = probe;
+            break;
+        }
+        if (victim == NULL || (uint32_t)(stamp - probe->stamp) > (uint32_t)(stamp - victim->stamp))
+        {
+            victim = probe;
+        }
+    }
+
+    if (slot == NULL)
+    {
+        slot = victim;
+        memcpy(slot->key, key, 16);
+        slot->hash = hash;
+        slot->tokens = capacity;
+        slot->stamp = stamp;
+    }
+
+    // Thousandths of a token per millisecond are tokens per second.
+    uint64_t tokens = slot->tokens + (uint64_t)(uint32_t)(stamp - slot->stamp) * (uint64_t)limiter->rate;
+    if (tokens > capacity) tokens = capacity;
+    slot->stamp = stamp;
+
+    if (tokens < 1000)
+    {
+        slot->tokens = (uint32_t)tokens;
+        return 0;
+    }
+
+    slot->tokens = (uint32_t)(tokens - 1000);
+    return 1;
+}
@@ -0,0 +1,116 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_RATELIMIT_H_
+#define _UHTTP_INTERNAL_RATELIMIT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "uhttp.h"
+#include "debug.h"
+
+/* Bytes of the rate limiter table, sources beyond it evict each other. */
+#ifndef UHTTP_RATELIMIT_SIZE
+#if UHTTP_STATIC_MEMORY
+#define UHTTP_RATELIMIT_SIZE 1024
+#else
+#define UHTTP_RATELIMIT_SIZE (64 * 1024)
+#endif
+#endif
+
+/* Slots probed for a source before the least recently seen one is evicted. */
+#ifndef UHTTP_RATELIMIT_PROBES
+#define UHTTP_RATELIMIT_PROBES 8
+#endif
+
+/**
+ * Token bucket of a source address or prefix.
+ */
+typedef struct uhttp_ratelimit_slot_t
+{
+    /* Masked address, IPv4 mapped into IPv6. */
+    uint8_t key[16];
+    /* Hash of the key, zero for an empty slot. */
+    uint32_t hash;
+    /* Tokens in thousandths. */
+    uint32_t tokens;
+    /* Low bits of the clock in milliseconds the source was last seen. */
+    uint32_t stamp;
+} uhttp_ratelimit_slot_t;
+
+/**
+ * Token buckets per source in an open addressing hash table of fixed size.
+ */
+typedef struct uhttp_ratelimit_t
+{
+    uhttp_ratelimit_slot_t* slots;
+    size_t mask;
+
+    /* Tokens added per second, zero to admit everything. */
+    int rate;
+    /* Tokens a bucket holds, zero for rate. */
+    int burst;
+    /* Leading address bits identifying a source. */
+    int prefix4;
+    int prefix6;
+} uhttp_ratelimit_t;
+
+/* Largest rate and burst, so a bucket of thousandths fits 32 bits. */
+#define UHTTP_RATELIMIT_MAX 1000000
+
+/**
+ * Create a rate limiter admitting everything, without a table.
+ * @param limiter Rate limiter object.
+ */
+extern void uhttp_ratelimit_create(uhttp_ratelimit_t* limiter);
+
+/**
+ * Set the rate, allocating the table the first time it is non-zero.
+ * @param limiter Rate limiter object.
+ * @param rate Tokens per second, zero to admit everything.
+ * @param size Bytes of the table, rounded down to a power of two slots.
+ * @return Zero when successful, see errno otherwise.
+ */
+extern int uhttp_ratelimit_set_rate(uhttp_ratelimit_t* limiter, int rate, size_t size);
+
+/**
+ * Destroy a rate limiter.
+ * @param limiter Rate limiter object.
+ */
+extern void uhttp_ratelimit_destroy(uhttp_ratelimit_t* limiter);
+
+/**
+ * Take a token from the bucket of a source.
+ * @param limiter Rate limiter object.
+ * @param addr Source address, Unix domain sources are not limited.
+ * @param now Current clock time in milliseconds.
+ * @return Non-zero if the source is admitted, zero if its bucket is empty.
+ * @remarks
+ * A source not in the table starts with a full bucket and replaces the least
+ * recently seen of the slots probed for it.
+ */
+extern int uhttp_ratelimit_take(uhttp_ratelimit_t* limiter, const uhttp_addr_t* addr, uint64_t now);
+
+#endif
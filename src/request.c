@@ -0,0 +1,507 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "request.h"
+
+#include <errno.h>
+#include <string.h>
+
+static int uhttp_lower(int c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+int uhttp_str_ieq(const uhttp_str_t* str, const char* cstr)
+{
+    size_t i;
+    for (i = 0; i < str->len; i++)
+    {
+        if (cstr[i] == '\0' || uhttp_lower(str->ptr[i]) != uhttp_lower(cstr[i]))
+            return 0;
+    }
+
+    return cstr[i] == '\0';
+}
+
+int uhttp_str_has_token(const uhttp_str_t* str, const char* token)
+{
+    const char* pos = str->ptr;
+    const char* end = str->ptr + str->len;
+
+    while (pos < end)
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',')) pos++;
+
+        uhttp_str_t item = { pos, 0 };
+        while (pos < end && *pos != ',') pos++;
+
+        item.len = pos - item.ptr;
+        while (item.len && (item.ptr[item.len - 1] == ' ' || item.ptr[item.len - 1] == '\t')) item.len--;
+
+        if (item.len && uhttp_str_ieq(&item, token)) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Split the next line off the buffer.
+ * @return Pointer past the line feed, NULL if there is no complete line.
+ */
+static const char* uhttp_request_line(const char* pos, const char* end, uhttp_str_t* line)
+{
+    const char* eol = memchr(pos, '\n', end - pos);
+    if (eol == NULL)
+    {
+        return NULL;
+    }
+
+    line->ptr = pos;
+    line->len = eol - pos;
+    if (line->len && pos[line->len - 1] == '\r') line->len--;
+
+    return eol + 1;
+}
+
+/**
+ * Parse "METHOD SP target SP HTTP/1.x".
+ */
+static int uhttp_request_parse_start(uhttp_request_t* request, const uhttp_str_t* line)
+{
+    const char* pos = line->ptr;
+    const char* end = line->ptr + line->len;
+
+    const char* sp = memchr(pos, ' ', end - pos);
+    if (sp == NULL || sp == pos) return -1;
+    request->method.ptr = pos;
+    request->method.len = sp - pos;
+
+    pos = sp + 1;
+    sp = memchr(pos, ' ', end - pos);
+    if (sp == NULL || sp == pos) return -1;
+    request->target.ptr = pos;
+    request->target.len = sp - pos;
+
+    pos = sp + 1;
+    if (end - pos != 8 || memcmp(pos, "HTTP/1.", 7) || (pos[7] != '0' && pos[7] != '1')) return -1;
+    request->version = pos[7] - '0';
+
+    for (size_t i = 0; i < request->method.len; i++)
+    {
+        unsigned char c = request->method.ptr[i];
+        if (c <= ' ' || c >= 0x7F) return -1;
+    }
+
+    // A quote is never valid in a URI, it would end the target in logs.
+    for (size_t i = 0; i < request->target.len; i++)
+    {
+        unsigned char c = request->target.ptr[i];
+        if (c <= ' ' || c == 0x7F || c == '"') return -1;
+    }
+
+    return 0;
+}
+
+static int uhttp_request_parse_path(uhttp_request_t* request);
+
+/**
+ * Interpret the header fields the server itself needs.
+ */
+static int uhttp_request_parse_fields(uhttp_request_t* request)
+{
+    const uhttp_str_t* value;
+
+    // Several lengths would let a proxy and its upstream disagree on where
+    // the body ends.
+    size_t lengths = 0;
+    for (size_t i = 0; i < request->nheaders; i++)
+    {
+        lengths += uhttp_str_ieq(&request->headers[i].name, "Content-Length");
+    }
+    if (lengths > 1) return -1;
+
+    request->content_length = 0;
+    if ((value = uhttp_request_header(request, "Content-Length")) != NULL)
+    {
+        if (value->len == 0 || value->len > 18) return -1;
+
+        for (size_t i = 0; i < value->len; i++)
+        {
+            if (value->ptr[i] < '0' || value->ptr[i] > '9') return -1;
+            request->content_length = request->content_length * 10 + (value->ptr[i] - '0');
+        }
+    }
+
+    request->chunked = uhttp_request_header(request, "Transfer-Encoding") != NULL;
+
+    value = uhttp_request_header(request, "Connection");
+    if (request->version == 0)
+    {
+        request->keep_alive = value && uhttp_str_has_token(value, "keep-alive");
+    }
+    else
+    {
+        request->keep_alive = !(value && uhttp_str_has_token(value, "close"));
+    }
+
+    return 0;
+}
+
+int uhttp_parse_fields(const char** buffer, const char* end, uhttp_header_t* headers, size_t* nheaders)
+{
+    const char* pos = *buffer;
+    uhttp_str_t line;
+
+    *nheaders = 0;
+    for (;;)
+    {
+        if ((pos = uhttp_request_line(pos, end, &line)) == NULL) return 0;
+
+        if (line.len == 0) break;
+
+        // Line folding is obsolete and name whitespace is forbidden.
+        const char* colon = memchr(line.ptr, ':', line.len);
+        if (colon == NULL || colon == line.ptr || line.ptr[0] == ' ' || line.ptr[0] == '\t' ||
+            colon[-1] == ' ' || colon[-1] == '\t')
+        {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        if (*nheaders == UHTTP_REQUEST_MAX_HEADERS)
+        {
+            errno = E2BIG;
+            return -1;
+        }
+
+        uhttp_header_t* header = &headers[(*nheaders)++];
+        header->name.ptr = line.ptr;
+        header->name.len = colon - line.ptr;
+
+        const char* vpos = colon + 1;
+        const char* vend = line.ptr + line.len;
+        while (vpos < vend && (*vpos == ' ' || *vpos == '\t')) vpos++;
+        while (vend > vpos && (vend[-1] == ' ' || vend[-1] == '\t')) vend--;
+        header->value.ptr = vpos;
+        header->value.len = vend - vpos;
+    }
+
+    *buffer = pos;
+    return 1;
+}
+
+ssize_t uhttp_request_parse(uhttp_request_t* request, const char* buffer, size_t len)
+{
+    if (request == NULL || buffer == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const char* pos = buffer;
+    const char* end = buffer + len;
+    uhttp_str_t line;
+
+    // Ignore empty lines before the request line.
+    do
+    {
+        if ((pos = uhttp_request_line(pos, end, &line)) == NULL) return 0;
+    } while (line.len == 0);
+
+    if (uhttp_request_parse_start(request, &line))
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    if (uhttp_request_parse_path(request)) return -1;
+
+    int fields = uhttp_parse_fields(&pos, end, request->headers, &request->nheaders);
+    if (fields <= 0) return fields;
+
+    if (uhttp_request_parse_fields(request))
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return pos - buffer;
+}
+
+UHTTP_EXTERN const uhttp_str_t* uhttp_request_header(const uhttp_request_t* request, const char* name)
+{
+    for (size_t i = 0; i < request->nheaders; i++)
+    {
+        if (uhttp_str_ieq(&request->headers[i].name, name))
+        {
+            return &request->headers[i].value;
+        }
+    }
+
+    return NULL;
+}
+
+UHTTP_EXTERN uhttp_str_t uhttp_request_method(const uhttp_request_t* request)
+{
+    return request->method;
+}
+
+UHTTP_EXTERN uhttp_str_t uhttp_request_target(const uhttp_request_t* request)
+{
+    return request->target;
+}
+
+static int uhttp_hex(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+UHTTP_EXTERN size_t uhttp_url_decode(char* buffer, size_t len, int plus)
+{
+    char* end = buffer + len;
+    char* pos;
+
+    if (plus)
+    {
+        for (pos = buffer; (pos = memchr(pos, '+', end - pos)) != NULL; pos++) *pos = ' ';
+    }
+
+    // Copy the runs between escapes down, most targets have none at all.
+    char* out = buffer;
+    char* in = buffer;
+    while ((pos = memchr(in, '%', end - in)) != NULL)
+    {
+        if (out != in) memmove(out, in, pos - in);
+        out += pos - in;
+
+        int hi, lo;
+        if (end - pos >= 3 && (hi = uhttp_hex(pos[1])) >= 0 && (lo = uhttp_hex(pos[2])) >= 0)
+        {
+            *out++ = (char)(hi << 4 | lo);
+            in = pos + 3;
+        }
+        else
+        {
+            // Malformed escapes are kept as they are.
+            *out++ = '%';
+            in = pos + 1;
+        }
+    }
+
+    if (out != in) memmove(out, in, end - in);
+    out += end - in;
+
+    return out - buffer;
+}
+
+/**
+ * Check if a path has a segment starting with a dot.
+ */
+static int uhttp_path_has_dots(const char* path, size_t len)
+{
+    const char* dot = path;
+    while ((dot = memchr(dot, '.', path + len - dot)) != NULL && dot != path && dot[-1] != '/') dot++;
+    return dot != NULL;
+}
+
+size_t uhttp_path_normalize(char* path, size_t len)
+{
+    // Look for a segment starting with a dot before rewriting anything.
+    if (!uhttp_path_has_dots(path, len)) return len;
+
+    size_t out = 0;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        int slash = path[pos] == '/';
+        size_t start = pos + slash;
+        const char* next = memchr(path + start, '/', len - start);
+        size_t end = next ? (size_t)(next - path) : len;
+        size_t seglen = end - start;
+
+        if ((seglen == 1 && path[start] == '.') || (seglen == 2 && path[start] == '.' && path[start + 1] == '.'))
+        {
+            if (seglen == 2)
+            {
+                // Drop the last output segment and its slash.
+                while (out > 0 && path[out - 1] != '/') out--;
+                if (out > 0) out--;
+            }
+
+            // A trailing dot segment still names a directory.
+            if (end == len && slash) path[out++] = '/';
+        }
+        else
+        {
+            if (out != pos) memmove(path + out, path + pos, end - pos);
+            out += end - pos;
+        }
+
+        pos = end;
+    }
+
+    return out;
+}
+
+/**
+ * Split the target of a request into its decoded path and raw query.
+ * @return Zero when successful, -1 on error (see errno).
+ */
+static int uhttp_request_parse_path(uhttp_request_t* request)
+{
+    const char* target = request->target.ptr;
+    const char* end = target + request->target.len;
+    const char* query = memchr(target, '?', request->target.len);
+    const char* stop = query ? query : end;
+    const char* path = target;
+
+    // Absolute form, the path starts after the authority.
+    if (*target != '/' && request->target.len > 3)
+    {
+        const char* scheme = memchr(target, ':', request->target.len);
+        if (scheme && scheme + 3 <= stop && scheme[1] == '/' && scheme[2] == '/')
+        {
+            path = memchr(scheme + 3, '/', stop - (scheme + 3));
+            if (path == NULL) path = stop;
+        }
+    }
+
+    request->query.ptr = query ? query + 1 : end;
+    request->query.len = query ? (size_t)(end - query - 1) : 0;
+    request->path.ptr = path;
+    request->path.len = stop - path;
+
+    // Most paths need neither decoding nor normalizing, and the target stays
+    // raw for logs and upstreams either way.
+    if (!memchr(path, '%', stop - path) && !uhttp_path_has_dots(path, stop - path)) return 0;
+
+    if (request->path.len > sizeof(request->pathbuf))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    size_t len = uhttp_url_decode(memcpy(request->pathbuf, path, request->path.len), request->path.len, 0);
+
+    // Line breaks would split a forwarded or logged path, and zero would cut
+    // it short wherever it is used as a C string.
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = request->pathbuf[i];
+        if (c == '\r' || c == '\n' || c == '\0')
+        {
+            errno = EBADMSG;
+            return -1;
+        }
+    }
+
+    request->path.ptr = request->pathbuf;
+    request->path.len = uhttp_path_normalize(request->pathbuf, len);
+
+    return 0;
+}
+
+UHTTP_EXTERN uhttp_str_t uhttp_request_path(uhttp_request_t* request)
+{
+    return request->path;
+}
+
+UHTTP_EXTERN uhttp_str_t uhttp_request_query(const uhttp_request_t* request)
+{
+    return request->query;
+}
+
+UHTTP_EXTERN void uhttp_query_init(uhttp_query_t* query, uhttp_str_t str)
+{
+    query->pos = str.ptr;
+    query->end = str.ptr + str.len;
+}
+
+UHTTP_EXTERN int uhttp_query_next(uhttp_query_t* query, uhttp_str_t* name, uhttp_str_t* value)
+{
+    while (query->pos < query->end)
+    {
+        const char* amp = memchr(query->pos, '&', query->end - query->pos);
+        const char* stop = amp ? amp : query->end;
+        const char* eq = memchr(query->pos, '=', stop - query->pos);
+
+        name->ptr = query->pos;
+        name->len = (eq ? eq : stop) - query->pos;
+        value->ptr = eq ? eq + 1 : stop;
+        value->len = stop - value->ptr;
+        query->pos = amp ? amp + 1 : query->end;
+
+        // Skip empty pairs like "a=1&&b=2".
+        if (name->len || value->len) return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Compare an encoded query component to a string.
+ */
+static int uhttp_query_eq(const uhttp_str_t* str, const char* cstr)
+{
+    const char* pos = str->ptr;
+    const char* end = str->ptr + str->len;
+    int hi, lo;
+
+    while (pos < end)
+    {
+        int c = *pos++;
+        if (c == '+')
+        {
+            c = ' ';
+        }
+        else if (c == '%' && end - pos >= 2 && (hi = uhttp_hex(pos[0])) >= 0 && (lo = uhttp_hex(pos[1])) >= 0)
+        {
+            c = hi << 4 | lo;
+            pos += 2;
+        }
+
+        if (*cstr == '\0' || (char)c != *cstr++) return 0;
+    }
+
+    return *cstr == '\0';
+}
+
+UHTTP_EXTERN int uhttp_request_param(const uhttp_request_t* request, const char* name, uhttp_str_t* value)
+{
+    uhttp_query_t query;
+    uhttp_str_t pname, pvalue;
+
+    uhttp_query_init(&query, uhttp_request_query(request));
+    while (uhttp_query_next(&query, &pname, &pvalue))
+    {
+        if (uhttp_query_eq(&pname, name))
+        {
+            if (value) *value = pvalue;
+            return 1;
+        }
+    }
+
+    return 0;
+}
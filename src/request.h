@@ -0,0 +1,126 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_REQUEST_H_
+#define _UHTTP_INTERNAL_REQUEST_H_
+
+#include "uhttp.h"
+#include "debug.h"
+
+/* Maximum number of header fields in a request. */
+#ifndef UHTTP_REQUEST_MAX_HEADERS
+#define UHTTP_REQUEST_MAX_HEADERS 32
+#endif
+
+/* Size of the buffer a request path is decoded into, bounds escaped paths. */
+#ifndef UHTTP_REQUEST_PATH_SIZE
+#define UHTTP_REQUEST_PATH_SIZE 1024
+#endif
+
+typedef struct uhttp_header_t
+{
+    uhttp_str_t name;
+    uhttp_str_t value;
+} uhttp_header_t;
+
+/**
+ * Parsed request head. All slices point into the parsed buffer.
+ */
+struct uhttp_request_t
+{
+    uhttp_str_t method;
+    uhttp_str_t target;
+
+    /* Minor HTTP version, 0 for HTTP/1.0 and 1 for HTTP/1.1. */
+    int version;
+
+    uhttp_header_t headers[UHTTP_REQUEST_MAX_HEADERS];
+    size_t nheaders;
+
+    /* Value of Content-Length, zero when absent. */
+    size_t content_length;
+    /* Non-zero when the request has a Transfer-Encoding. */
+    int chunked;
+    /* Non-zero when the connection persists after the response. */
+    int keep_alive;
+
+    /* Decoded and normalized path, and the raw query. Both point into the
+       target unless the path had to be rewritten into pathbuf. */
+    uhttp_str_t path;
+    uhttp_str_t query;
+    char pathbuf[UHTTP_REQUEST_PATH_SIZE];
+
+    /* Client the request arrived on, not touched by the parser. */
+    struct uhttp_client_t* client;
+};
+
+/**
+ * Parse a request head.
+ * @param request Request object.
+ * @param buffer Buffer holding the start of the request.
+ * @param len Length of data in the buffer.
+ * @return Length of the head including the blank line, zero if the head is
+ * incomplete, -1 on error (see errno). EBADMSG for a malformed request, E2BIG
+ * for too many header fields, ENAMETOOLONG for a path that does not fit
+ * UHTTP_REQUEST_PATH_SIZE once decoded.
+ */
+extern ssize_t uhttp_request_parse(uhttp_request_t* request, const char* buffer, size_t len);
+
+/**
+ * Remove dot segments from a decoded path in place, RFC 3986 5.2.4.
+ * @param path Path buffer.
+ * @param len Length of the path.
+ * @return Length of the normalized path.
+ */
+extern size_t uhttp_path_normalize(char* path, size_t len);
+
+/**
+ * Parse header field lines up to and including the blank line.
+ * @param buffer Start of the first line, advanced past the blank line.
+ * @param end End of the data.
+ * @param headers Receives the fields, UHTTP_REQUEST_MAX_HEADERS of them.
+ * @param nheaders Receives the number of fields.
+ * @return One when successful, zero if the blank line is missing, -1 on
+ * error (see errno). EBADMSG for a malformed line, E2BIG for too many fields.
+ */
+extern int uhttp_parse_fields(const char** buffer, const char* end, uhttp_header_t* headers, size_t* nheaders);
+
+/**
+ * Check if a comma separated field value contains a token.
+ * @param str Field value.
+ * @param token Null terminated token, case insensitive.
+ * @return Non-zero if the token is listed.
+ */
+extern int uhttp_str_has_token(const uhttp_str_t* str, const char* token);
+
+/**
+ * Compare a slice to a string, case insensitive.
+ * @param str Slice.
+ * @param cstr Null terminated string.
+ * @return Non-zero if equal.
+ */
+extern int uhttp_str_ieq(const uhttp_str_t* str, const char* cstr);
+
+#endif
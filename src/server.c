@@ -26,33 +26,230 @@
 #include "debug.h"
 #include "list.h"
 #include "client.h"
+#include "clock.h"
+#include "transport.h"
+#if UHTTP_FEATURE_POST
+#include "queue.h"
+#endif
+#if UHTTP_FEATURE_RATELIMIT
+#include "ratelimit.h"
+#endif
+#if UHTTP_FEATURE_ACCESS_LOG
+#include "accesslog.h"
+#endif
+#include "pool.h"
 
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
 #define UHTTP_BACKLOG_DEFAULT 16
+#define UHTTP_ACCEPT_BUDGET_DEFAULT 16
+#define UHTTP_RETRY_AFTER_DEFAULT 1
+#define UHTTP_POLL_TIMEOUT_DEFAULT 0
+
+#if UHTTP_STATIC_MEMORY
+/* Limits of static memory builds, the lists sized by them are allocated
+   once when the server is created. */
+#ifndef UHTTP_STATIC_MAX_CLIENTS
+#define UHTTP_STATIC_MAX_CLIENTS 8
+#endif
+#ifndef UHTTP_STATIC_MAX_LISTENERS
+#define UHTTP_STATIC_MAX_LISTENERS 2
+#endif
+#ifndef UHTTP_STATIC_MAX_ROUTES
+#define UHTTP_STATIC_MAX_ROUTES 16
+#endif
+
+#define UHTTP_CACHE_SIZE_DEFAULT 0
+#define UHTTP_MAX_CLIENTS_DEFAULT UHTTP_STATIC_MAX_CLIENTS
+#else
+#define UHTTP_CACHE_SIZE_DEFAULT (4 * 1024 * 1024)
+#define UHTTP_MAX_CLIENTS_DEFAULT 0
+#endif
+
+#if UHTTP_FEATURE_POST
+/* Poll set entries between the listeners and the clients. */
+#define UHTTP_SERVER_WAKEUPS 1
+#else
+#define UHTTP_SERVER_WAKEUPS 0
+#endif
+
+#if UHTTP_FEATURE_AWAIT
+/* Poll set entries per client, its socket and the one its handler awaits. */
+#define UHTTP_SERVER_CLIENT_POLLS 2
+#else
+#define UHTTP_SERVER_CLIENT_POLLS 1
+#endif
+
+/* Number of posted functions waiting to run before uhttp_post fails. */
+#ifndef UHTTP_POST_QUEUE_SIZE
+#if UHTTP_STATIC_MEMORY
+#define UHTTP_POST_QUEUE_SIZE 16
+#else
+#define UHTTP_POST_QUEUE_SIZE 1024
+#endif
+#endif
+
+/* TCP socket options, zero leaves the system default. */
+typedef struct uhttp_tcp_options_t
+{
+    uhttp_tcp_profile_t profile;
+    int nodelay;
+    int cork;
+    int defer_accept;
+    int fastopen;
+    int rcvbuf;
+    int sndbuf;
+    int reuseaddr;
+    int reuseport;
+} uhttp_tcp_options_t;
+
+static const uhttp_tcp_options_t uhttp_tcp_profiles[] = {
+    [UHTTP_TCP_PROFILE_DEFAULT] = {
+        .profile = UHTTP_TCP_PROFILE_DEFAULT
+    },
+    [UHTTP_TCP_PROFILE_LATENCY] = {
+        .profile = UHTTP_TCP_PROFILE_LATENCY,
+        .nodelay = 1,
+        .defer_accept = 1,
+        .fastopen = 256,
+        .reuseaddr = 1
+    },
+    [UHTTP_TCP_PROFILE_BULK] = {
+        .profile = UHTTP_TCP_PROFILE_BULK,
+        .cork = 1,
+        .sndbuf = 4 * 1024 * 1024,
+        .reuseaddr = 1
+    }
+};
+
+typedef struct uhttp_listener_t
+{
+    /* Listen socket, invalid while the server is stopped. */
+    uhttp_socket_t sck;
+    /* Bound socket address, domain is zero if unset. */
+    uhttp_addr_t addr;
+    /* Tag passed on to accepted clients. */
+    int tag;
+} uhttp_listener_t;
 
 struct uhttp_server_t
 {
-    /* Listen socket */
-    SOCKET sck;
+    /* Listeners, the first one is set by UHTTP_OPTION_BIND_ADDR. */
+    uhttp_list_t listeners;
+    /* Listener to accept from first, rotated for fairness. */
+    size_t next_listener;
+
+    /* Non-zero between start and stop. */
+    int running;
 
     /* Length of socket backlog. */
     int backlog;
 
-    /* Bound socket address. */
-    uhttp_addr_t addr;
+    /* Maximum connections accepted per poll. */
+    int accept_budget;
+
+    /* Milliseconds to wait for events, -1 for no limit. */
+    int poll_timeout;
+
+    /* Poll set of listeners and clients, and the client of each entry
+       past the listeners. */
+    uhttp_pollfd_t* pollfds;
+    uhttp_client_t** pollclients;
+    size_t pollcap;
 
-    /* Clients list. */
+    /* Permissions of a Unix domain socket file, zero for the umask default. */
+    int unix_mode;
+
+    /* Clients list, of pointers so clients stay in place. */
     uhttp_list_t clients;
 
+    /* Routes list. */
+    uhttp_list_t routes;
+
+#if UHTTP_FEATURE_CACHE
+    /* Cache of route responses. */
+    uhttp_cache_t cache;
+#endif
+
     /* Error function. */
     uhttp_error_func_t on_error;
 
+    /* TCP options of listen and client sockets. */
+    uhttp_tcp_options_t tcp;
+
+    /* Watermarks above which new connections are shed, zero for none. */
+    int max_clients;
+    int max_requests;
+    int max_queued;
+
+    /* Output limits of every client. */
+    uhttp_client_limits_t limits;
+
+    /* Socket functions, NULL for kernel sockets. */
+    uhttp_transport_t* transport;
+
+    /* CPUs the polling thread is pinned to, -1 for none. */
+    int cpu;
+    int cpu_count;
+    /* Non-zero once the polling thread is pinned. */
+    int pinned;
+
+    /* Requests dispatched and not yet answered, plus responses not yet sent. */
+    size_t requests;
+    /* Bytes in client transmit buffers. */
+    size_t queued;
+
+    /* Non-zero while new connections are shed. */
+    int shedding;
+    /* Seconds in the Retry-After of shed connections. */
+    int retry_after;
+    /* Pre-rendered response to shed connections. */
+    char shed[128];
+    size_t shedlen;
+
+#if UHTTP_FEATURE_RATELIMIT
+    /* Token buckets of request sources. */
+    uhttp_ratelimit_t ratelimit;
+#endif
+
+#if UHTTP_FEATURE_ACCESS_LOG
+    /* Access log, NULL if responses are not logged. */
+    uhttp_access_log_t* access_log;
+#endif
+
+#if UHTTP_FEATURE_POST
+    /* Functions posted from other threads, and the handle waking the poll
+       for them. Signalled only when wake_pending was clear. */
+    uhttp_queue_t posted;
+    uhttp_wakeup_t wakeup;
+    atomic_int wake_pending;
+#endif
+
+    /* Allocator to restore once a server from uhttp_create_static is gone,
+       unset for other servers. */
+    uhttp_allocator_t restore;
 };
 
+/**
+ * Render the response to shed connections.
+ */
+static void uhttp_server_render_shed(uhttp_server_t* sv)
+{
+    int len = snprintf(sv->shed, sizeof(sv->shed),
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: %d\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        sv->retry_after);
+
+    sv->shedlen = (len > 0 && len < (int)sizeof(sv->shed)) ? (size_t)len : 0;
+}
+
 void uhttp_error_default(int number, const char* description)
 {
 #ifdef _DEBUG
@@ -60,28 +257,172 @@ void uhttp_error_default(int number, const char* description)
 #endif
 }
 
-UHTTP_EXTERN uhttp_server_t* uhttp_create()
+/* Servers in existence, the allocator cannot change while there are any. */
+static atomic_int uhttp_servers;
+
+static int uhttp_server_reserve_pollfds(uhttp_server_t* sv, size_t n);
+
+/**
+ * Create a server, already counted in uhttp_servers.
+ * @return Server object, NULL for failure (see errno), no longer counted.
+ */
+static uhttp_server_t* uhttp_server_create()
 {
     uhttp_server_t* sv = malloc(sizeof(uhttp_server_t));
 
     if (sv)
     {
-        // Initialize sockets list.
-        sv->sck = -1;
+        memset(&sv->restore, 0, sizeof(sv->restore));
+
+        // Initialize listener list with an unset primary listener.
+        uhttp_listener_t primary;
+        memset(&primary, 0, sizeof(primary));
+        primary.sck = UHTTP_INVALID_SOCKET;
+
+        uhttp_list_create(&sv->listeners, sizeof(uhttp_listener_t));
+        if (uhttp_list_append(&sv->listeners, &primary))
+        {
+            free(sv);
+            atomic_fetch_sub(&uhttp_servers, 1);
+            return NULL;
+        }
+        sv->next_listener = 0;
+        sv->running = 0;
 
         // Set backlog to default value.
         sv->backlog = UHTTP_BACKLOG_DEFAULT;
 
-        // Clear bind address.
-        memset(&sv->addr, 0, sizeof(sv->addr));
+        // Set accept budget to default value.
+        sv->accept_budget = UHTTP_ACCEPT_BUDGET_DEFAULT;
+
+        // Return from polls immediately.
+        sv->poll_timeout = UHTTP_POLL_TIMEOUT_DEFAULT;
+        sv->pollfds = NULL;
+        sv->pollclients = NULL;
+        sv->pollcap = 0;
+
+        sv->unix_mode = 0;
 
         // Init client list.
-        uhttp_list_create(&sv->clients, sizeof(uhttp_client_t));
+        uhttp_list_create(&sv->clients, sizeof(uhttp_client_t*));
+
+        // No routes, every request is answered with 404.
+        uhttp_list_create(&sv->routes, sizeof(uhttp_server_route_t));
+#if UHTTP_FEATURE_CACHE
+        uhttp_cache_create(&sv->cache, UHTTP_CACHE_SIZE_DEFAULT);
+#endif
 
         // Set error callback.
         sv->on_error = uhttp_error_default;
+
+        // Leave socket options at system defaults.
+        sv->tcp = uhttp_tcp_profiles[UHTTP_TCP_PROFILE_DEFAULT];
+
+        // No admission control beyond the compile-time limits.
+        sv->max_clients = UHTTP_MAX_CLIENTS_DEFAULT;
+        sv->max_requests = 0;
+        sv->max_queued = 0;
+        memset(&sv->limits, 0, sizeof(sv->limits));
+        sv->transport = NULL;
+        sv->cpu = -1;
+        sv->cpu_count = 1;
+        sv->pinned = 0;
+        sv->requests = 0;
+        sv->queued = 0;
+        sv->shedding = 0;
+        sv->retry_after = UHTTP_RETRY_AFTER_DEFAULT;
+        uhttp_server_render_shed(sv);
+#if UHTTP_FEATURE_RATELIMIT
+        uhttp_ratelimit_create(&sv->ratelimit);
+#endif
+#if UHTTP_FEATURE_ACCESS_LOG
+        sv->access_log = NULL;
+#endif
+
+#if UHTTP_FEATURE_POST
+        // Posting works from creation on, running or not.
+        atomic_init(&sv->wake_pending, 0);
+        if (uhttp_queue_create(&sv->posted, UHTTP_POST_QUEUE_SIZE))
+        {
+            uhttp_list_destroy(&sv->listeners);
+            free(sv);
+            atomic_fetch_sub(&uhttp_servers, 1);
+            return NULL;
+        }
+        if (uhttp_wakeup_open(&sv->wakeup))
+        {
+            int error = errno;
+            uhttp_queue_destroy(&sv->posted);
+            uhttp_list_destroy(&sv->listeners);
+            free(sv);
+            atomic_fetch_sub(&uhttp_servers, 1);
+            errno = error;
+            return NULL;
+        }
+#endif
+
+#if UHTTP_STATIC_MEMORY
+        // Everything that grows with connections is allocated up front.
+        if (uhttp_list_reserve(&sv->listeners, UHTTP_STATIC_MAX_LISTENERS) ||
+            uhttp_list_reserve(&sv->clients, UHTTP_STATIC_MAX_CLIENTS) ||
+            uhttp_list_reserve(&sv->routes, UHTTP_STATIC_MAX_ROUTES) ||
+            uhttp_server_reserve_pollfds(sv, UHTTP_STATIC_MAX_LISTENERS + UHTTP_SERVER_WAKEUPS + UHTTP_STATIC_MAX_CLIENTS * UHTTP_SERVER_CLIENT_POLLS))
+        {
+            uhttp_destroy(sv);
+            errno = ENOMEM;
+            return NULL;
+        }
+#endif
+    }
+    else
+    {
+        atomic_fetch_sub(&uhttp_servers, 1);
+    }
+
+    return sv;
+}
+
+UHTTP_EXTERN uhttp_server_t* uhttp_create()
+{
+    // Counted before the first allocation, so the allocator stays put.
+    atomic_fetch_add(&uhttp_servers, 1);
+    return uhttp_server_create();
+}
+
+UHTTP_EXTERN uhttp_server_t* uhttp_create_static(void* memory, size_t size)
+{
+    // Claim the allocator, no other server may be using it.
+    int none = 0;
+    if (!atomic_compare_exchange_strong(&uhttp_servers, &none, 1))
+    {
+        errno = EBUSY;
+        return NULL;
+    }
+
+    uhttp_pool_t* pool = uhttp_pool_create(memory, size);
+    if (pool == NULL)
+    {
+        atomic_fetch_sub(&uhttp_servers, 1);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    uhttp_allocator_t restore, allocator;
+    uhttp_alloc_get(&restore);
+    uhttp_pool_allocator(pool, &allocator);
+    uhttp_alloc_set(&allocator);
+
+    uhttp_server_t* sv = uhttp_server_create();
+    if (sv == NULL)
+    {
+        // The failed server released every block and its count.
+        int error = errno;
+        uhttp_alloc_set(&restore);
+        errno = error;
+        return NULL;
     }
 
+    sv->restore = restore;
     return sv;
 }
 
@@ -90,15 +431,88 @@ UHTTP_EXTERN void uhttp_destroy(uhttp_server_t* sv)
     if (sv)
     {
         uhttp_stop(sv);
+        uhttp_list_destroy(&sv->listeners);
+        uhttp_list_destroy(&sv->clients);
+        for (size_t i = 0; i < sv->routes.nlen; i++)
+        {
+            free((char*)uhttp_list_index(&sv->routes, uhttp_server_route_t, i).route.path);
+        }
+        uhttp_list_destroy(&sv->routes);
+        free(sv->pollfds);
+        free(sv->pollclients);
+#if UHTTP_FEATURE_RATELIMIT
+        uhttp_ratelimit_destroy(&sv->ratelimit);
+#endif
+#if UHTTP_FEATURE_ACCESS_LOG
+        if (sv->access_log) uhttp_access_log_close(sv->access_log);
+#endif
+#if UHTTP_FEATURE_POST
+        uhttp_queue_destroy(&sv->posted);
+        uhttp_wakeup_close(&sv->wakeup);
+#endif
+
+        // The block of a static server is handed back to the application.
+        uhttp_allocator_t restore = sv->restore;
+        free(sv);
+        if (restore.malloc_func) uhttp_alloc_set(&restore);
+        atomic_fetch_sub(&uhttp_servers, 1);
+    }
+}
+
+/**
+ * Find the TCP option field for an option name.
+ * @return Pointer to the field, NULL if the name is not a TCP option.
+ */
+static int* uhttp_tcp_option(uhttp_server_t* sv, uhttp_option_name_t name)
+{
+    switch (name)
+    {
+    case UHTTP_OPTION_TCP_NODELAY: return &sv->tcp.nodelay;
+    case UHTTP_OPTION_TCP_CORK: return &sv->tcp.cork;
+    case UHTTP_OPTION_TCP_DEFER_ACCEPT: return &sv->tcp.defer_accept;
+    case UHTTP_OPTION_TCP_FASTOPEN: return &sv->tcp.fastopen;
+    case UHTTP_OPTION_RCVBUF: return &sv->tcp.rcvbuf;
+    case UHTTP_OPTION_SNDBUF: return &sv->tcp.sndbuf;
+    case UHTTP_OPTION_REUSEADDR: return &sv->tcp.reuseaddr;
+    case UHTTP_OPTION_REUSEPORT: return &sv->tcp.reuseport;
+    default: return NULL;
     }
+}
 
-    free(sv);
+/**
+ * Set a socket option, reporting but otherwise ignoring failures.
+ */
+static void uhttp_server_sockopt(uhttp_server_t* sv, uhttp_socket_t sck, uhttp_sockopt_t name, int value)
+{
+    if (value && uhttp_setsockopt(sck, name, value))
+    {
+        sv->on_error(errno, "Could not set socket option.");
+    }
 }
 
 UHTTP_EXTERN int uhttp_setoption(uhttp_server_t* sv, uhttp_option_name_t name, const uhttp_option_arg_t* value)
 {
     uhttp_log("uhttp_setoption(%p, %d, %p)", sv, name, value);
 
+    // The allocator is shared by every server, blocks must be freed by the
+    // allocator that made them.
+    if (name == UHTTP_OPTION_ALLOCATOR)
+    {
+        if (sv != NULL || value == NULL)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        if (atomic_load(&uhttp_servers))
+        {
+            errno = EBUSY;
+            return -1;
+        }
+
+        uhttp_alloc_set(&value->allocator);
+        return 0;
+    }
+
     if (sv == NULL)
     {
         errno = EINVAL;
@@ -113,11 +527,120 @@ UHTTP_EXTERN int uhttp_setoption(uhttp_server_t* sv, uhttp_option_name_t name, c
         sv->on_error(EINVAL, "Unknown option (uhttp_setoption)");
         return -1;
     case UHTTP_OPTION_BIND_ADDR:
-        memcpy(&sv->addr, &value->addr, sizeof(sv->addr));
+        memcpy(&uhttp_list_index(&sv->listeners, uhttp_listener_t, 0).addr, &value->addr, sizeof(uhttp_addr_t));
         return 0;
     case UHTTP_OPTION_BACKLOG:
         sv->backlog = (value->integer) ? value->integer : UHTTP_BACKLOG_DEFAULT;
         return 0;
+    case UHTTP_OPTION_ACCEPT_BUDGET:
+        sv->accept_budget = (value->integer > 0) ? value->integer : UHTTP_ACCEPT_BUDGET_DEFAULT;
+        return 0;
+    case UHTTP_OPTION_POLL_TIMEOUT:
+        sv->poll_timeout = (value->integer >= 0) ? value->integer : -1;
+        return 0;
+#if UHTTP_FEATURE_CACHE
+    case UHTTP_OPTION_CACHE_SIZE:
+        if (value->integer < 0)
+        {
+            errno = EINVAL;
+            sv->on_error(EINVAL, "Negative cache size (uhttp_setoption)");
+            return -1;
+        }
+        sv->cache.budget = value->integer;
+        return 0;
+#endif
+    case UHTTP_OPTION_MAX_CLIENTS:
+        sv->max_clients = (value->integer > 0) ? value->integer : 0;
+#if UHTTP_STATIC_MEMORY
+        if (sv->max_clients == 0 || sv->max_clients > UHTTP_STATIC_MAX_CLIENTS)
+            sv->max_clients = UHTTP_STATIC_MAX_CLIENTS;
+#endif
+        return 0;
+    case UHTTP_OPTION_MAX_REQUESTS:
+        sv->max_requests = (value->integer > 0) ? value->integer : 0;
+        return 0;
+    case UHTTP_OPTION_MAX_QUEUED:
+        sv->max_queued = (value->integer > 0) ? value->integer : 0;
+        return 0;
+    case UHTTP_OPTION_TX_HIGH_WATER:
+        sv->limits.tx_high = (value->integer > 0) ? value->integer : 0;
+        return 0;
+    case UHTTP_OPTION_TX_LOW_WATER:
+        sv->limits.tx_low = (value->integer > 0) ? value->integer : 0;
+        return 0;
+    case UHTTP_OPTION_TX_BUDGET:
+        sv->limits.tx_budget = (value->integer > 0) ? value->integer : 0;
+        return 0;
+    case UHTTP_OPTION_MIN_SEND_RATE:
+        sv->limits.min_send_rate = (value->integer > 0) ? value->integer : 0;
+        return 0;
+    case UHTTP_OPTION_RETRY_AFTER:
+        sv->retry_after = (value->integer > 0) ? value->integer : UHTTP_RETRY_AFTER_DEFAULT;
+        uhttp_server_render_shed(sv);
+        return 0;
+#if UHTTP_FEATURE_RATELIMIT
+    case UHTTP_OPTION_RATE_LIMIT:
+        if (uhttp_ratelimit_set_rate(&sv->ratelimit, value->integer, UHTTP_RATELIMIT_SIZE))
+        {
+            sv->on_error(errno, "Could not set rate limit (uhttp_setoption)");
+            return -1;
+        }
+        return 0;
+    case UHTTP_OPTION_RATE_BURST:
+        if (value->integer < 0 || value->integer > UHTTP_RATELIMIT_MAX)
+        {
+            errno = EINVAL;
+            sv->on_error(EINVAL, "Invalid rate limit burst (uhttp_setoption)");
+            return -1;
+        }
+        sv->ratelimit.burst = value->integer;
+        return 0;
+    case UHTTP_OPTION_RATE_PREFIX4:
+    case UHTTP_OPTION_RATE_PREFIX6:
+        if (value->integer < 0 || value->integer > (name == UHTTP_OPTION_RATE_PREFIX4 ? 32 : 128))
+        {
+            errno = EINVAL;
+            sv->on_error(EINVAL, "Invalid rate limit prefix (uhttp_setoption)");
+            return -1;
+        }
+        *(name == UHTTP_OPTION_RATE_PREFIX4 ? &sv->ratelimit.prefix4 : &sv->ratelimit.prefix6) = value->integer;
+        return 0;
+#endif
+    case UHTTP_OPTION_UNIX_MODE:
+        if (value->integer < 0 || value->integer > 07777)
+        {
+            errno = EINVAL;
+            sv->on_error(EINVAL, "Invalid socket file mode (uhttp_setoption)");
+            return -1;
+        }
+        sv->unix_mode = value->integer;
+        return 0;
+#if UHTTP_FEATURE_TRANSPORT
+    case UHTTP_OPTION_TRANSPORT:
+        // Listeners and clients keep the sockets of the transport they have.
+        if (sv->running)
+        {
+            errno = EBUSY;
+            sv->on_error(EBUSY, "Transport set while running (uhttp_setoption)");
+            return -1;
+        }
+        sv->transport = value->transport;
+        return 0;
+#endif
+    case UHTTP_OPTION_CPU:
+    case UHTTP_OPTION_CPU_COUNT:
+        // Listeners are steered to the CPU as they open.
+        if (sv->running)
+        {
+            errno = EBUSY;
+            sv->on_error(EBUSY, "CPU set while running (uhttp_setoption)");
+            return -1;
+        }
+        if (name == UHTTP_OPTION_CPU)
+            sv->cpu = (value->integer >= 0) ? value->integer : -1;
+        else
+            sv->cpu_count = (value->integer > 0) ? value->integer : 1;
+        return 0;
     case UHTTP_OPTION_ERROR_FUNC:
         if (value->error_func == NULL)
         {
@@ -128,6 +651,31 @@ UHTTP_EXTERN int uhttp_setoption(uhttp_server_t* sv, uhttp_option_name_t name, c
             sv->on_error = value->error_func;
         }
         return 0;
+    case UHTTP_OPTION_TCP_NODELAY:
+    case UHTTP_OPTION_TCP_CORK:
+    case UHTTP_OPTION_TCP_DEFER_ACCEPT:
+    case UHTTP_OPTION_TCP_FASTOPEN:
+    case UHTTP_OPTION_RCVBUF:
+    case UHTTP_OPTION_SNDBUF:
+    case UHTTP_OPTION_REUSEADDR:
+    case UHTTP_OPTION_REUSEPORT:
+        if (value->integer < 0)
+        {
+            errno = EINVAL;
+            sv->on_error(EINVAL, "Negative socket option (uhttp_setoption)");
+            return -1;
+        }
+        *uhttp_tcp_option(sv, name) = value->integer;
+        return 0;
+    case UHTTP_OPTION_TCP_PROFILE:
+        if (value->integer < UHTTP_TCP_PROFILE_DEFAULT || value->integer > UHTTP_TCP_PROFILE_BULK)
+        {
+            errno = EINVAL;
+            sv->on_error(EINVAL, "Unknown TCP profile (uhttp_setoption)");
+            return -1;
+        }
+        sv->tcp = uhttp_tcp_profiles[value->integer];
+        return 0;
     }
 }
 
@@ -135,6 +683,12 @@ UHTTP_EXTERN int uhttp_getoption(uhttp_server_t* sv, uhttp_option_name_t name, u
 {
     uhttp_log("uhttp_setoption(%p, %d, %p)", sv, name, value);
 
+    if (name == UHTTP_OPTION_ALLOCATOR && value != NULL)
+    {
+        uhttp_alloc_get(&value->allocator);
+        return 0;
+    }
+
     if (sv == NULL)
     {
         errno = EINVAL;
@@ -149,11 +703,74 @@ UHTTP_EXTERN int uhttp_getoption(uhttp_server_t* sv, uhttp_option_name_t name, u
         sv->on_error(EINVAL, "Unknown option (uhttp_getoption)");
         return -1;
     case UHTTP_OPTION_BIND_ADDR:
-        memcpy(&value->addr, &sv->addr, sizeof(sv->addr));
+        memcpy(&value->addr, &uhttp_list_index(&sv->listeners, uhttp_listener_t, 0).addr, sizeof(uhttp_addr_t));
         return 0;
     case UHTTP_OPTION_BACKLOG:
         value->integer = sv->backlog;
         return 0;
+    case UHTTP_OPTION_ACCEPT_BUDGET:
+        value->integer = sv->accept_budget;
+        return 0;
+    case UHTTP_OPTION_POLL_TIMEOUT:
+        value->integer = sv->poll_timeout;
+        return 0;
+#if UHTTP_FEATURE_CACHE
+    case UHTTP_OPTION_CACHE_SIZE:
+        value->integer = (int)sv->cache.budget;
+        return 0;
+#endif
+    case UHTTP_OPTION_MAX_CLIENTS:
+        value->integer = sv->max_clients;
+        return 0;
+    case UHTTP_OPTION_MAX_REQUESTS:
+        value->integer = sv->max_requests;
+        return 0;
+    case UHTTP_OPTION_MAX_QUEUED:
+        value->integer = sv->max_queued;
+        return 0;
+    case UHTTP_OPTION_TX_HIGH_WATER:
+        value->integer = (int)sv->limits.tx_high;
+        return 0;
+    case UHTTP_OPTION_TX_LOW_WATER:
+        value->integer = (int)sv->limits.tx_low;
+        return 0;
+    case UHTTP_OPTION_TX_BUDGET:
+        value->integer = (int)sv->limits.tx_budget;
+        return 0;
+    case UHTTP_OPTION_MIN_SEND_RATE:
+        value->integer = (int)sv->limits.min_send_rate;
+        return 0;
+    case UHTTP_OPTION_RETRY_AFTER:
+        value->integer = sv->retry_after;
+        return 0;
+#if UHTTP_FEATURE_RATELIMIT
+    case UHTTP_OPTION_RATE_LIMIT:
+        value->integer = sv->ratelimit.rate;
+        return 0;
+    case UHTTP_OPTION_RATE_BURST:
+        value->integer = sv->ratelimit.burst;
+        return 0;
+    case UHTTP_OPTION_RATE_PREFIX4:
+        value->integer = sv->ratelimit.prefix4;
+        return 0;
+    case UHTTP_OPTION_RATE_PREFIX6:
+        value->integer = sv->ratelimit.prefix6;
+        return 0;
+#endif
+    case UHTTP_OPTION_UNIX_MODE:
+        value->integer = sv->unix_mode;
+        return 0;
+#if UHTTP_FEATURE_TRANSPORT
+    case UHTTP_OPTION_TRANSPORT:
+        value->transport = sv->transport;
+        return 0;
+#endif
+    case UHTTP_OPTION_CPU:
+        value->integer = sv->cpu;
+        return 0;
+    case UHTTP_OPTION_CPU_COUNT:
+        value->integer = sv->cpu_count;
+        return 0;
     case UHTTP_OPTION_ERROR_FUNC:
         if (sv->on_error == uhttp_error_default)
         {
@@ -164,42 +781,364 @@ UHTTP_EXTERN int uhttp_getoption(uhttp_server_t* sv, uhttp_option_name_t name, u
             value->error_func = sv->on_error;
         }
         return 0;
+    case UHTTP_OPTION_TCP_NODELAY:
+    case UHTTP_OPTION_TCP_CORK:
+    case UHTTP_OPTION_TCP_DEFER_ACCEPT:
+    case UHTTP_OPTION_TCP_FASTOPEN:
+    case UHTTP_OPTION_RCVBUF:
+    case UHTTP_OPTION_SNDBUF:
+    case UHTTP_OPTION_REUSEADDR:
+    case UHTTP_OPTION_REUSEPORT:
+        value->integer = *uhttp_tcp_option(sv, name);
+        return 0;
+    case UHTTP_OPTION_TCP_PROFILE:
+        value->integer = sv->tcp.profile;
+        return 0;
     }
 }
 
-UHTTP_EXTERN int uhttp_start(uhttp_server_t* sv)
+/**
+ * Open a listen socket.
+ * @param sv Server object.
+ * @param listener Listener with its address set.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_listener_open(uhttp_server_t* sv, uhttp_listener_t* listener)
 {
-    if (sv == NULL)
+#if UHTTP_FEATURE_TRANSPORT
+    // Socket options and files are up to the transport.
+    if (sv->transport)
     {
-        errno = EINVAL;
-        return -1;
+        listener->sck = sv->transport->listen(sv->transport, &listener->addr, sv->backlog);
+        return listener->sck == UHTTP_INVALID_SOCKET ? -1 : 0;
     }
+#endif
 
     // Allocate listen socket.
-    sv->sck = uhttp_socket(&sv->addr);
+    listener->sck = uhttp_socket_create(listener->addr.domain);
 
-    if (sv->sck == UHTTP_INVALID_SOCKET)
+    if (listener->sck == UHTTP_INVALID_SOCKET)
     {
         return -1;
     }
 
+    // TCP options make no sense for Unix domain sockets.
+    int tcp = listener->addr.domain != UHTTP_SOCKET_DOMAIN_UNIX;
+
+    // Options that must precede bind.
+    if (tcp)
+    {
+        uhttp_server_sockopt(sv, listener->sck, UHTTP_SOCKOPT_REUSEADDR, sv->tcp.reuseaddr);
+        uhttp_server_sockopt(sv, listener->sck, UHTTP_SOCKOPT_REUSEPORT, sv->tcp.reuseport);
+
+        // Of the listeners sharing the port, the one of the polling thread
+        // gets the connections whose packets its CPU handles.
+        if (sv->cpu >= 0 && uhttp_setsockopt(listener->sck, UHTTP_SOCKOPT_INCOMING_CPU, sv->cpu))
+        {
+            sv->on_error(errno, "Could not set socket option.");
+        }
+    }
+
+    // The socket file of a Unix domain listener is created with its mode.
+    if (uhttp_bind_mode(listener->sck, &listener->addr, tcp ? 0 : sv->unix_mode))
+    {
+        goto fail;
+    }
+
     uhttp_log("start: socket allocated");
 
+    // Buffer sizes must be set before listen to be inherited by clients.
+    uhttp_server_sockopt(sv, listener->sck, UHTTP_SOCKOPT_RCVBUF, sv->tcp.rcvbuf);
+    uhttp_server_sockopt(sv, listener->sck, UHTTP_SOCKOPT_SNDBUF, sv->tcp.sndbuf);
+    if (tcp)
+    {
+        uhttp_server_sockopt(sv, listener->sck, UHTTP_SOCKOPT_NODELAY, sv->tcp.nodelay);
+        uhttp_server_sockopt(sv, listener->sck, UHTTP_SOCKOPT_FASTOPEN, sv->tcp.fastopen);
+        uhttp_server_sockopt(sv, listener->sck, UHTTP_SOCKOPT_DEFER_ACCEPT, sv->tcp.defer_accept);
+    }
+
     // Listen on socket.
-    if (uhttp_listen(sv->sck, sv->backlog))
+    if (uhttp_listen(listener->sck, sv->backlog))
     {
-        return -1;
+        goto fail_bound;
     }
 
     uhttp_log("start: listening socket.");
 
-    if (uhttp_async(sv->sck, 1))
+    if (uhttp_async(listener->sck, 1))
     {
-        return -1;
+        goto fail_bound;
     }
 
     uhttp_log("start: set socket to async.");
+
+    return 0;
+
+fail_bound:
+    {
+        int error = errno;
+        uhttp_unlink(&listener->addr);
+        errno = error;
+    }
+fail:
+    {
+        int error = errno;
+        uhttp_close(listener->sck);
+        listener->sck = UHTTP_INVALID_SOCKET;
+        errno = error;
+    }
+    return -1;
+}
+
+/**
+ * Close a listen socket, removing its socket file.
+ * @param sv Server object.
+ * @param listener Listener object.
+ */
+static void uhttp_listener_close(uhttp_server_t* sv, uhttp_listener_t* listener)
+{
+    if (listener->sck != UHTTP_INVALID_SOCKET)
+    {
+        uhttp_transport_close(sv->transport, listener->sck);
+        if (sv->transport == NULL) uhttp_unlink(&listener->addr);
+        listener->sck = UHTTP_INVALID_SOCKET;
+    }
+}
+
+UHTTP_EXTERN int uhttp_addlistener(uhttp_server_t* sv, const uhttp_addr_t* addr, int tag)
+{
+    if (sv == NULL || addr == NULL || addr->domain == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uhttp_listener_t listener;
+    listener.sck = UHTTP_INVALID_SOCKET;
+    memcpy(&listener.addr, addr, sizeof(*addr));
+    listener.tag = tag;
+
+    if (sv->running && uhttp_listener_open(sv, &listener))
+    {
+        sv->on_error(errno, "Could not open listener (uhttp_addlistener)");
+        return -1;
+    }
+
+    if (uhttp_list_append(&sv->listeners, &listener))
+    {
+        int error = errno;
+        uhttp_listener_close(sv, &listener);
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+UHTTP_EXTERN int uhttp_start(uhttp_server_t* sv)
+{
+    if (sv == NULL || sv->running)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Open every listener with an address, failing if none has one.
+    int opened = 0;
+    for (size_t i = 0; i < sv->listeners.nlen; i++)
+    {
+        uhttp_listener_t* listener = &uhttp_list_index(&sv->listeners, uhttp_listener_t, i);
+        if (listener->addr.domain == 0) continue;
+
+        if (uhttp_listener_open(sv, listener))
+        {
+            int error = errno;
+            for (size_t j = 0; j < i; j++)
+            {
+                uhttp_listener_close(sv, &uhttp_list_index(&sv->listeners, uhttp_listener_t, j));
+            }
+            errno = error;
+            return -1;
+        }
+        opened++;
+    }
+
+    if (opened == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sv->running = 1;
+    sv->pinned = 0;
+    return 0;
+}
+
+/**
+ * Check the load watermarks, notifying the error callback on transitions.
+ * @param sv Server object.
+ * @return Non-zero if new connections should be shed.
+ */
+static int uhttp_server_overloaded(uhttp_server_t* sv)
+{
+    int overloaded =
+        (sv->max_clients && sv->clients.nlen >= (size_t)sv->max_clients) ||
+        (sv->max_requests && sv->requests >= (size_t)sv->max_requests) ||
+        (sv->max_queued && sv->queued >= (size_t)sv->max_queued);
+
+    if (overloaded != sv->shedding)
+    {
+        sv->shedding = overloaded;
+        if (overloaded)
+            sv->on_error(EBUSY, "Overloaded, shedding new connections.");
+        else
+            sv->on_error(0, "Load below watermarks, accepting new connections.");
+    }
+
+    return overloaded;
+}
+
+/**
+ * Grow the poll set to hold every listener and client.
+ * @return Zero when successful, see errno otherwise.
+ */
+static int uhttp_server_reserve_pollfds(uhttp_server_t* sv, size_t n)
+{
+    if (n <= sv->pollcap) return 0;
+
+    size_t cap = sv->pollcap ? sv->pollcap : 16;
+    while (cap < n) cap *= 2;
+
+    uhttp_pollfd_t* pollfds = realloc(sv->pollfds, cap * sizeof(uhttp_pollfd_t));
+    if (pollfds == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    sv->pollfds = pollfds;
+
+    uhttp_client_t** pollclients = realloc(sv->pollclients, cap * sizeof(uhttp_client_t*));
+    if (pollclients == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    sv->pollclients = pollclients;
+
+    sv->pollcap = cap;
+    return 0;
+}
+
+#if UHTTP_FEATURE_RATELIMIT
+static const char uhttp_response_rate_limited[] =
+    "HTTP/1.1 429 Too Many Requests\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+int uhttp_server_admit(uhttp_server_t* sv, const uhttp_addr_t* addr)
+{
+    return uhttp_ratelimit_take(&sv->ratelimit, addr, uhttp_clock_ms());
+}
+#endif
+
+/**
+ * Accept connections from a listener within the remaining budget.
+ * @return Connections accepted.
+ */
+static int uhttp_server_accept(uhttp_server_t* sv, uhttp_listener_t* listener, int budget)
+{
+    uhttp_addr_t addr;
+    uhttp_socket_t xsck;
+    int overloaded = sv->shedding;
+    int n;
+
+    for (n = 0; n < budget; n++)
+    {
+        if ((xsck = uhttp_transport_accept(sv->transport, listener->sck, &addr)) == UHTTP_INVALID_SOCKET)
+            break;
+
+        if (overloaded)
+        {
+            // Reject without allocating or reading anything.
+            uhttp_transport_send(sv->transport, xsck, sv->shed, sv->shedlen);
+            uhttp_transport_close(sv->transport, xsck);
+            continue;
+        }
+
+#if UHTTP_FEATURE_RATELIMIT
+        // The token of a connection pays for its first request.
+        if (!uhttp_server_admit(sv, &addr))
+        {
+            uhttp_transport_send(sv->transport, xsck, uhttp_response_rate_limited, sizeof(uhttp_response_rate_limited) - 1);
+            uhttp_transport_close(sv->transport, xsck);
+            continue;
+        }
+#endif
+
+        uhttp_server_add_client(sv, xsck, &addr, listener->tag);
+        overloaded = uhttp_server_overloaded(sv);
+    }
+
+    return n;
+}
+
+#if UHTTP_FEATURE_POST
+/**
+ * Run the functions posted so far.
+ * @param sv Server object.
+ */
+static void uhttp_server_run_posted(uhttp_server_t* sv)
+{
+    // Clear the flag before popping, functions posted from here on signal
+    // the wakeup again. No more than a queue length per poll, so posting
+    // threads cannot hold the clients up.
+    atomic_store(&sv->wake_pending, 0);
+
+    uhttp_task_t task;
+    size_t budget = sv->posted.mask + 1;
+    while (budget-- && uhttp_queue_pop(&sv->posted, &task))
+    {
+        uhttp_trace(POSTED, sv, 0);
+        task.func(task.arg);
+    }
+
+    if (budget == (size_t)-1 && !atomic_exchange(&sv->wake_pending, 1))
+    {
+        uhttp_wakeup_signal(&sv->wakeup);
+    }
+}
+
+UHTTP_EXTERN int uhttp_post(uhttp_server_t* sv, uhttp_post_func_t func, void* arg)
+{
+    if (sv == NULL || func == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uhttp_task_t task = { func, arg };
+    if (uhttp_queue_push(&sv->posted, &task))
+    {
+        return -1;
+    }
+
+    // One signal wakes the poll for every function posted until it runs.
+    if (!atomic_exchange(&sv->wake_pending, 1))
+    {
+        uhttp_wakeup_signal(&sv->wakeup);
+    }
+
+    return 0;
 }
+#else
+UHTTP_EXTERN int uhttp_post(uhttp_server_t* sv, uhttp_post_func_t func, void* arg)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
 
 UHTTP_EXTERN int uhttp_pollevents(uhttp_server_t* sv)
 {
@@ -209,59 +1148,296 @@ UHTTP_EXTERN int uhttp_pollevents(uhttp_server_t* sv)
         return -1;
     }
 
-    // Try accepting new sockets.
+    // Pin the polling thread before it allocates for clients, their memory
+    // is then placed on its NUMA node.
+    if (sv->cpu >= 0 && !sv->pinned)
     {
-        uhttp_addr_t addr;
-        uhttp_socket_t xsck;
-        while ((xsck = uhttp_accept(sv->sck, &addr)) != UHTTP_INVALID_SOCKET)
+        sv->pinned = 1;
+        if (uhttp_thread_affinity(sv->cpu, sv->cpu_count))
         {
-            uhttp_log("pollevents: Accepted socket %p.", (void*)xsck);
+            sv->on_error(errno, "Could not pin the polling thread (uhttp_pollevents)");
+        }
+    }
 
-            uhttp_client_t client;
-            if (uhttp_client_create(&client))
-            {
-                sv->on_error(errno, "Could not create client object. (uhttp_poll)");
-                uhttp_close(xsck);
-                continue;
-            }
+    size_t nlisteners = sv->listeners.nlen;
+    size_t nclients = sv->clients.nlen;
+
+    if (uhttp_server_reserve_pollfds(sv, nlisteners + UHTTP_SERVER_WAKEUPS + nclients * UHTTP_SERVER_CLIENT_POLLS))
+    {
+        sv->on_error(errno, "Could not grow poll set (uhttp_pollevents)");
+        return -1;
+    }
 
-            client.sck = xsck;
-            client.sv = sv;
-            memcpy(&client.src, &addr, sizeof(addr));
+    // Listeners first, then clients, in list order.
+    size_t nfds = 0;
+    for (size_t i = 0; i < nlisteners; i++)
+    {
+        uhttp_pollfd_t* fd = &sv->pollfds[nfds++];
+        fd->sock = uhttp_list_index(&sv->listeners, uhttp_listener_t, i).sck;
+        fd->events = (fd->sock != UHTTP_INVALID_SOCKET) ? UHTTP_EVENT_RECEIVE : 0;
+    }
 
+#if UHTTP_FEATURE_POST
+    // Then the wakeup of posted functions.
+    sv->pollfds[nfds].sock = sv->wakeup.sock;
+    sv->pollfds[nfds++].events = UHTTP_EVENT_RECEIVE;
+#endif
 
-            if (uhttp_list_append(&sv->clients, &client))
-            {
-                sv->on_error(errno, "Could not append client to list.");
-                uhttp_client_destroy(&client);
-                continue;
-            }
+    // Continue clients answered since the last poll, then remove the ones
+    // that are done or read too slowly. Backwards, so removing one only
+    // shifts those visited.
+    uint64_t now = uhttp_clock_ms();
+    uint64_t wakeup = 0;
+    int resumed = 0;
+    for (size_t i = nclients; i-- > 0;)
+    {
+        uhttp_client_t* client = uhttp_list_index(&sv->clients, uhttp_client_t*, i);
+
+        if (client->resume)
+        {
+            uhttp_client_resume(client);
+            resumed = 1;
+        }
 
-            uhttp_log("pollevents: client added to list.");
+        uint64_t check = uhttp_client_check_rate(client, now);
+        if (check && (wakeup == 0 || check < wakeup)) wakeup = check;
+
+        if (client->closing && client->txlen == 0 && !client->pending)
+        {
+            uhttp_server_close_client(client);
         }
     }
 
-    // Poll all open sockets.
+    // Clients waiting for a handler after losing their socket are not polled.
+    // The socket a suspended handler awaits goes before that of its client,
+    // so the handler runs before the client can be closed.
+    int timeout = resumed ? 0 : sv->poll_timeout;
+    if (wakeup)
     {
-        for (size_t i = 0; i < sv->clients.nlen; i++)
+        int left = wakeup > now ? (int)(wakeup - now) : 0;
+        if (timeout < 0 || left < timeout) timeout = left;
+    }
+#if UHTTP_FEATURE_AWAIT
+    int timers = 0;
+#endif
+    nclients = 0;
+    for (size_t i = 0; i < sv->clients.nlen; i++)
+    {
+        uhttp_client_t* client = uhttp_list_index(&sv->clients, uhttp_client_t*, i);
+        uhttp_pollfd_t* fd;
+
+#if UHTTP_FEATURE_AWAIT
+        if (client->await.wait & UHTTP_AWAIT_SOCKET)
+        {
+            fd = &sv->pollfds[nfds++];
+            fd->sock = client->await.sock;
+            fd->events = client->await.events;
+            sv->pollclients[nclients++] = client;
+        }
+
+        // Wake up for the nearest deadline.
+        if (client->await.wait & UHTTP_AWAIT_TIMER)
+        {
+            int left = client->await.deadline > now ? (int)(client->await.deadline - now) : 0;
+            if (timeout < 0 || left < timeout) timeout = left;
+            timers = 1;
+        }
+#endif
+#if UHTTP_FEATURE_PROXY
+        // A relayed response waiting for its upstream, never while awaiting.
+        if (client->relay && client->relay->starved && client->txlen == 0)
         {
-            uhttp_client_t* client = &((uhttp_client_t*)sv->clients.head)[i];
+            fd = &sv->pollfds[nfds++];
+            fd->sock = client->relay->sock;
+            fd->events = UHTTP_EVENT_RECEIVE;
+            sv->pollclients[nclients++] = client;
+        }
+#endif
+
+        if (client->sck == UHTTP_INVALID_SOCKET) continue;
+
+        fd = &sv->pollfds[nfds++];
+        fd->sock = client->sck;
+        fd->events = uhttp_client_poll_events(client);
+        sv->pollclients[nclients++] = client;
+    }
+
+    // Resumed handlers may have answered other clients, do not wait on them.
+    uhttp_trace(POLL_BEGIN, sv, nfds);
+    int nready = uhttp_transport_pollv(sv->transport, sv->pollfds, nfds, timeout);
+    uhttp_trace(POLL_END, sv, nready);
+    if (nready < 0)
+    {
+        if (errno == EINTR) return 0;
+
+        sv->on_error(errno, "Could not poll sockets (uhttp_pollevents)");
+        return -1;
+    }
+
+#if UHTTP_FEATURE_POST
+    // Posted functions first, they may answer clients about to be served.
+    if (sv->pollfds[nlisteners].revents)
+    {
+        uhttp_wakeup_drain(&sv->wakeup);
+    }
+    uhttp_server_run_posted(sv);
+#endif
 
-            if (uhttp_poll(client->sck, &client->events) == 0)
+    // Serve clients, closing one leaves the others in place.
+    for (size_t i = 0; i < nclients; i++)
+    {
+        const uhttp_pollfd_t* fd = &sv->pollfds[nlisteners + UHTTP_SERVER_WAKEUPS + i];
+        if (fd->revents == 0) continue;
+
+        uhttp_client_t* client = sv->pollclients[i];
+#if UHTTP_FEATURE_AWAIT
+        if (fd->sock != client->sck)
+        {
+            // Unless a posted function answered the request meanwhile.
+            if (client->await.wait & UHTTP_AWAIT_SOCKET)
             {
-                uhttp_client_event(client);
-                uhttp_log("pollevents: Events processed for client %p.", client);
+                uhttp_client_continue(client, fd->revents);
             }
+#if UHTTP_FEATURE_PROXY
+            // Closing the client is left to its own entry or the next poll.
             else
             {
-                uhttp_server_close_client(client);
+                uhttp_client_relay(client);
+            }
+#endif
+            continue;
+        }
+#endif
+        client->events = fd->revents;
+        uhttp_client_event(client);
+    }
+
+#if UHTTP_FEATURE_AWAIT
+    // Then the handlers whose wait timed out, clients with a suspended
+    // handler are pending and cannot have been closed above.
+    if (timers)
+    {
+        now = uhttp_clock_ms();
+        for (size_t i = 0; i < sv->clients.nlen; i++)
+        {
+            uhttp_client_t* client = uhttp_list_index(&sv->clients, uhttp_client_t*, i);
+            if ((client->await.wait & UHTTP_AWAIT_TIMER) && client->await.deadline <= now)
+            {
+                uhttp_client_continue(client, 0);
             }
         }
     }
+#endif
+
+    // Check the load once per poll, whether or not anyone connects, so the
+    // transitions are noticed as soon as clients are served.
+    uhttp_server_overloaded(sv);
+
+    // Accept new sockets after existing clients were served and no more than
+    // the budget across all listeners, so a connection storm drains over
+    // several polls. The first listener rotates so none starves the others.
+    int budget = sv->accept_budget;
+    for (size_t n = 0; n < nlisteners && budget > 0; n++)
+    {
+        size_t i = (sv->next_listener + n) % nlisteners;
+        if (!(sv->pollfds[i].revents & UHTTP_EVENT_RECEIVE)) continue;
+
+        budget -= uhttp_server_accept(sv, &uhttp_list_index(&sv->listeners, uhttp_listener_t, i), budget);
+    }
+    sv->next_listener = nlisteners ? (sv->next_listener + 1) % nlisteners : 0;
+
+    return 0;
+}
+
+uhttp_client_t* uhttp_server_add_client(uhttp_server_t* sv, uhttp_socket_t sck, const uhttp_addr_t* addr, int tag)
+{
+    uhttp_client_t* client = malloc(sizeof(uhttp_client_t));
+    if (client == NULL || uhttp_client_create(client))
+    {
+        sv->on_error(ENOMEM, "Could not create client object. (uhttp_poll)");
+        free(client);
+        uhttp_transport_close(sv->transport, sck);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    client->sck = sck;
+    client->sv = sv;
+    client->limits = &sv->limits;
+    client->transport = sv->transport;
+    client->tag = tag;
+    memcpy(&client->src, addr, sizeof(*addr));
+
+    // Buffer sizes are inherited from the listen socket.
+    if (addr->domain != UHTTP_SOCKET_DOMAIN_UNIX && sv->transport == NULL)
+    {
+        client->cork = sv->tcp.cork;
+        uhttp_server_sockopt(sv, sck, UHTTP_SOCKOPT_NODELAY, sv->tcp.nodelay);
+    }
+
+    if (uhttp_list_append(&sv->clients, &client))
+    {
+        sv->on_error(errno, "Could not append client to list.");
+        uhttp_client_destroy(client);
+        free(client);
+        return NULL;
+    }
+
+    uhttp_trace(ACCEPT, client, sck);
+
+    return client;
+}
+
+void uhttp_server_account(uhttp_server_t* sv, ssize_t queued, int requests)
+{
+    sv->queued += queued;
+    sv->requests += requests;
+}
+
+size_t uhttp_server_queued(uhttp_server_t* sv)
+{
+    return sv->queued;
+}
+
+#if UHTTP_FEATURE_ACCESS_LOG
+uhttp_access_log_t* uhttp_server_access_log(uhttp_server_t* sv)
+{
+    return sv->access_log;
+}
+
+UHTTP_EXTERN int uhttp_access_log(uhttp_server_t* sv, const char* path, int flags)
+{
+    if (sv == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uhttp_access_log_t* log = NULL;
+    if (path && (log = uhttp_access_log_open(path, flags)) == NULL)
+    {
+        sv->on_error(errno, "Could not open access log (uhttp_access_log)");
+        return -1;
+    }
 
+    if (sv->access_log)
+    {
+        uhttp_access_log_close(sv->access_log);
+    }
+    sv->access_log = log;
     return 0;
 }
+#else
+UHTTP_EXTERN int uhttp_access_log(uhttp_server_t* sv, const char* path, int flags)
+{
+    errno = ENOSYS;
+    return -1;
+}
 
+UHTTP_EXTERN void uhttp_access_log_reopen(void)
+{
+}
+#endif
 
 void uhttp_server_close_client(uhttp_client_t* client)
 {
@@ -271,21 +1447,120 @@ void uhttp_server_close_client(uhttp_client_t* client)
     size_t i = 0;
     for (i = 0; i < sv->clients.nlen; i++)
     {
-        if (((uhttp_client_t*)sv->clients.head)[i].sck == client->sck)
+        if (uhttp_list_index(&sv->clients, uhttp_client_t*, i) == client)
             break;
     }
 
-
     // Return if not found.
     if (i >= sv->clients.nlen) return;
 
     // Close client.
-    uhttp_client_destroy(&((uhttp_client_t*)sv->clients.head)[i]);
+    uhttp_trace(CLOSE, client, 0);
+    uhttp_client_destroy(client);
+    free(client);
 
     // Remove client.
     uhttp_list_remove(&sv->clients, i);
+}
+
+const uhttp_server_route_t* uhttp_server_route(uhttp_server_t* sv, const uhttp_request_t* request)
+{
+    // Routes match the decoded path, so dot segments cannot reach a route
+    // the handler would not see.
+    size_t pathlen = request->path.len;
+
+    for (size_t i = 0; i < sv->routes.nlen; i++)
+    {
+        const uhttp_server_route_t* route = &uhttp_list_index(&sv->routes, uhttp_server_route_t, i);
+
+        if (route->route.method && !(strlen(route->route.method) == request->method.len &&
+            memcmp(route->route.method, request->method.ptr, request->method.len) == 0))
+            continue;
+
+        if (route->prefix ? pathlen < route->pathlen : pathlen != route->pathlen)
+            continue;
+
+        if (memcmp(route->route.path, request->path.ptr, route->pathlen) == 0)
+            return route;
+    }
+
+    return NULL;
+}
+
+#if UHTTP_FEATURE_CACHE
+uhttp_cache_t* uhttp_server_cache(uhttp_server_t* sv)
+{
+    return &sv->cache;
+}
+#endif
 
-    uhttp_log("server: client %p closed and removed from list.", client);
+UHTTP_EXTERN int uhttp_addroute(uhttp_server_t* sv, const uhttp_route_t* route)
+{
+    if (sv == NULL || route == NULL || route->path == NULL || route->handler == NULL || route->cache_ttl < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t pathlen = strlen(route->path);
+    size_t methodlen = route->method ? strlen(route->method) : 0;
+#if UHTTP_FEATURE_CACHE
+    size_t varylen = route->cache_vary ? strlen(route->cache_vary) : 0;
+#else
+    size_t varylen = 0;
+#endif
+
+    // Keep every string in one block, starting with the path.
+    char* strings = malloc(pathlen + 1 + methodlen + 1 + varylen + 2);
+    if (strings == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    uhttp_server_route_t xroute;
+    xroute.route = *route;
+
+    memcpy(strings, route->path, pathlen + 1);
+    xroute.route.path = strings;
+    xroute.prefix = pathlen && strings[pathlen - 1] == '*';
+    xroute.pathlen = xroute.prefix ? pathlen - 1 : pathlen;
+
+    char* method = strings + pathlen + 1;
+    if (route->method)
+    {
+        memcpy(method, route->method, methodlen + 1);
+        xroute.route.method = method;
+    }
+
+    // Split the vary list into null terminated names.
+    char* vary = method + methodlen + 1;
+    char* pos = vary;
+    xroute.vary = vary;
+    for (size_t i = 0; i < varylen;)
+    {
+        while (i < varylen && (route->cache_vary[i] == ' ' || route->cache_vary[i] == ',')) i++;
+
+        size_t start = i;
+        while (i < varylen && route->cache_vary[i] != ' ' && route->cache_vary[i] != ',') i++;
+
+        if (i > start)
+        {
+            memcpy(pos, route->cache_vary + start, i - start);
+            pos += i - start;
+            *pos++ = '\0';
+        }
+    }
+    *pos = '\0';
+    xroute.route.cache_vary = NULL;
+
+    if (uhttp_list_append(&sv->routes, &xroute))
+    {
+        free(strings);
+        return -1;
+    }
+
+    return 0;
 }
 
 UHTTP_EXTERN int uhttp_stop(uhttp_server_t* sv)
@@ -296,16 +1571,24 @@ UHTTP_EXTERN int uhttp_stop(uhttp_server_t* sv)
         return -1;
     }
 
-    // Close main socket.
-    uhttp_close(sv->sck);
+    // Close listen sockets, keeping their addresses for a restart.
+    for (size_t i = 0; i < sv->listeners.nlen; i++)
+    {
+        uhttp_listener_close(sv, &uhttp_list_index(&sv->listeners, uhttp_listener_t, i));
+    }
+    sv->running = 0;
 
-    // Close all clients.
+    // Close all clients, discarding unanswered requests.
     for (size_t i = 0; i < sv->clients.nlen; i++)
     {
-        uhttp_client_t* client = &((uhttp_client_t*)sv->clients.head)[i];
+        uhttp_client_t* client = uhttp_list_index(&sv->clients, uhttp_client_t*, i);
         uhttp_client_destroy(client);
+        free(client);
     }
     uhttp_list_clear(&sv->clients);
+#if UHTTP_FEATURE_CACHE
+    uhttp_cache_clear(&sv->cache);
+#endif
 
     uhttp_log("server: stopped.");
 
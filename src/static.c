@@ -0,0 +1,192 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "config.h"
+#include "conditional.h"
+
+#if UHTTP_FEATURE_FILES
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if _WIN32
+#include <io.h>
+#define open _open
+#define stat _stat64
+#define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
+#ifndef O_BINARY
+#define O_BINARY _O_BINARY
+#endif
+#else
+#include <unistd.h>
+#define O_BINARY 0
+#endif
+
+/* Longest path of a served file. */
+#ifndef UHTTP_STATIC_PATH_MAX
+#define UHTTP_STATIC_PATH_MAX 1024
+#endif
+
+static const struct
+{
+    const char* extension;
+    const char* type;
+} uhttp_static_types[] = {
+    { "html", "text/html; charset=utf-8" },
+    { "htm", "text/html; charset=utf-8" },
+    { "css", "text/css" },
+    { "js", "text/javascript" },
+    { "json", "application/json" },
+    { "txt", "text/plain; charset=utf-8" },
+    { "xml", "application/xml" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif", "image/gif" },
+    { "webp", "image/webp" },
+    { "ico", "image/x-icon" },
+    { "wasm", "application/wasm" },
+    { "pdf", "application/pdf" },
+    { "zip", "application/zip" },
+    { "mp4", "video/mp4" },
+    { "webm", "video/webm" },
+    { "mp3", "audio/mpeg" },
+};
+
+/**
+ * Guess the content type of a file from its extension.
+ */
+static const char* uhttp_static_type(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    if (dot && strchr(dot, '/') == NULL)
+    {
+        for (size_t i = 0; i < sizeof(uhttp_static_types) / sizeof(uhttp_static_types[0]); i++)
+        {
+            const char* a = dot + 1;
+            const char* b = uhttp_static_types[i].extension;
+            while (*a && (*a | 0x20) == *b) a++, b++;
+            if (*a == '\0' && *b == '\0') return uhttp_static_types[i].type;
+        }
+    }
+
+    return "application/octet-stream";
+}
+
+/**
+ * Map a request target to a file path below the root.
+ * @return Zero when successful, -1 if the target cannot name a file.
+ */
+static int uhttp_static_path(const uhttp_static_t* config, uhttp_str_t target, char* path, size_t cap)
+{
+    const char* query = memchr(target.ptr, '?', target.len);
+    if (query)
+    {
+        target.len = query - target.ptr;
+    }
+
+    size_t striplen = config->strip ? strlen(config->strip) : 0;
+    if (striplen)
+    {
+        if (target.len < striplen || memcmp(target.ptr, config->strip, striplen))
+        {
+            return -1;
+        }
+        target.ptr += striplen;
+        target.len -= striplen;
+    }
+
+    // Anything that could leave the root is refused, not normalized.
+    for (size_t i = 0; i < target.len; i++)
+    {
+        unsigned char c = target.ptr[i];
+        if (c < ' ' || c == 0x7F || c == '\\' || c == '%' || c == ':' ||
+            (c == '.' && i + 1 < target.len && target.ptr[i + 1] == '.'))
+        {
+            return -1;
+        }
+    }
+
+    const char* separator = (target.len && target.ptr[0] == '/') ? "" : "/";
+    const char* index = (target.len == 0 || target.ptr[target.len - 1] == '/') ? "index.html" : "";
+    int len = snprintf(path, cap, "%s%s%.*s%s", config->root, separator, (int)target.len, target.ptr, index);
+
+    return (len < 0 || (size_t)len >= cap) ? -1 : 0;
+}
+
+UHTTP_EXTERN void uhttp_static_handler(uhttp_request_t* request, void* user)
+{
+    const uhttp_static_t* config = user;
+    uhttp_str_t method = uhttp_request_method(request);
+
+    if (!(method.len == 3 && memcmp(method.ptr, "GET", 3) == 0) &&
+        !(method.len == 4 && memcmp(method.ptr, "HEAD", 4) == 0))
+    {
+        uhttp_respond(request, 405, "Allow: GET, HEAD\r\n", NULL, 0);
+        return;
+    }
+
+    char path[UHTTP_STATIC_PATH_MAX];
+    struct stat info;
+    if (uhttp_static_path(config, uhttp_request_target(request), path, sizeof(path)) ||
+        stat(path, &info) || !S_ISREG(info.st_mode))
+    {
+        uhttp_respond(request, 404, NULL, NULL, 0);
+        return;
+    }
+
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long)info.st_size, (unsigned long long)info.st_mtime);
+
+    // Revalidation needs no file at all.
+    if (uhttp_respond_unmodified(request, etag, (int64_t)info.st_mtime))
+    {
+        return;
+    }
+
+    int fd = open(path, O_RDONLY | O_BINARY);
+    if (fd < 0)
+    {
+        uhttp_respond(request, 404, NULL, NULL, 0);
+        return;
+    }
+
+    char headers[256];
+    char date[UHTTP_DATE_LEN + 1];
+    uhttp_date_format(date, (int64_t)info.st_mtime);
+    snprintf(headers, sizeof(headers),
+        "Content-Type: %s\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n",
+        uhttp_static_type(path), etag, date);
+
+    uhttp_respond_file(request, headers, fd, (int64_t)info.st_size);
+}
+#else
+UHTTP_EXTERN void uhttp_static_handler(uhttp_request_t* request, void* user)
+{
+    // No files are served.
+    uhttp_respond(request, 404, NULL, NULL, 0);
+}
+#endif
@@ -0,0 +1,183 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "trace.h"
+
+#include <errno.h>
+
+#if UHTTP_TRACE
+#include "clock.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define UHTTP_TRACE_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define UHTTP_TRACE_TSC 1
+#endif
+
+#if _WIN32
+#define UHTTP_THREAD_LOCAL __declspec(thread)
+#else
+#define UHTTP_THREAD_LOCAL _Thread_local
+#endif
+
+#define UHTTP_TRACE_MASK (UHTTP_TRACE_RECORDS - 1)
+
+typedef struct uhttp_trace_ring_t
+{
+    struct uhttp_trace_ring_t* next;
+    uint64_t thread;
+    /* Records written so far, only by the owning thread. */
+    _Atomic uint64_t pos;
+    uhttp_trace_record_t records[UHTTP_TRACE_RECORDS];
+} uhttp_trace_ring_t;
+
+/* Rings of every thread that recorded, kept after the thread exits. */
+static _Atomic(uhttp_trace_ring_t*) uhttp_trace_rings;
+static atomic_uint_fast64_t uhttp_trace_threads;
+
+/* Clock readings at the first record. */
+static atomic_int uhttp_trace_started;
+static uint64_t uhttp_trace_time0;
+static uint64_t uhttp_trace_ns0;
+
+static UHTTP_THREAD_LOCAL uhttp_trace_ring_t* uhttp_trace_ring;
+
+inline static uint64_t uhttp_trace_clock(void)
+{
+#if UHTTP_TRACE_TSC
+    return __rdtsc();
+#else
+    return uhttp_clock_ns();
+#endif
+}
+
+/**
+ * Create the ring of the calling thread.
+ * @return Ring object, NULL if out of memory.
+ */
+static uhttp_trace_ring_t* uhttp_trace_attach(void)
+{
+    if (!atomic_exchange(&uhttp_trace_started, 1))
+    {
+        uhttp_trace_ns0 = uhttp_clock_ns();
+        uhttp_trace_time0 = uhttp_trace_clock();
+    }
+
+    uhttp_trace_ring_t* ring = calloc(1, sizeof(uhttp_trace_ring_t));
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+
+    ring->thread = atomic_fetch_add(&uhttp_trace_threads, 1) + 1;
+    atomic_init(&ring->pos, 0);
+
+    ring->next = atomic_load(&uhttp_trace_rings);
+    while (!atomic_compare_exchange_weak(&uhttp_trace_rings, &ring->next, ring))
+    {
+    }
+
+    uhttp_trace_ring = ring;
+    return ring;
+}
+
+void uhttp_trace_record(uhttp_trace_event_t event, const void* subject, uint64_t value)
+{
+    uhttp_trace_ring_t* ring = uhttp_trace_ring;
+    if (ring == NULL && (ring = uhttp_trace_attach()) == NULL)
+    {
+        return;
+    }
+
+    uint64_t pos = atomic_load_explicit(&ring->pos, memory_order_relaxed);
+    uhttp_trace_record_t* record = &ring->records[pos & UHTTP_TRACE_MASK];
+    record->time = uhttp_trace_clock();
+    record->subject = (uint64_t)(uintptr_t)subject;
+    record->event = event;
+    record->value = (uint32_t)value;
+    atomic_store_explicit(&ring->pos, pos + 1, memory_order_release);
+}
+
+UHTTP_EXTERN int uhttp_trace_dump(const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    uhttp_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, UHTTP_TRACE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(uhttp_trace_record_t);
+    header.time0 = uhttp_trace_time0;
+    header.ns0 = uhttp_trace_ns0;
+    header.ns1 = uhttp_clock_ns();
+    header.time1 = uhttp_trace_clock();
+
+    uhttp_trace_ring_t* rings = atomic_load(&uhttp_trace_rings);
+    for (uhttp_trace_ring_t* ring = rings; ring; ring = ring->next)
+    {
+        header.nrings++;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uhttp_trace_ring_t* ring = rings; ring && ok; ring = ring->next)
+    {
+        uint64_t pos = atomic_load_explicit(&ring->pos, memory_order_acquire);
+        uhttp_trace_ring_header_t ring_header;
+        ring_header.thread = ring->thread;
+        ring_header.count = pos < UHTTP_TRACE_RECORDS ? pos : UHTTP_TRACE_RECORDS;
+
+        // Oldest first, the ring may wrap around once.
+        uint64_t first = pos - ring_header.count;
+        size_t head = (size_t)(first & UHTTP_TRACE_MASK);
+        size_t nhead = (size_t)ring_header.count < UHTTP_TRACE_RECORDS - head ? (size_t)ring_header.count : UHTTP_TRACE_RECORDS - head;
+
+        ok = fwrite(&ring_header, sizeof(ring_header), 1, file) == 1 &&
+            fwrite(&ring->records[head], sizeof(uhttp_trace_record_t), nhead, file) == nhead &&
+            fwrite(ring->records, sizeof(uhttp_trace_record_t), (size_t)ring_header.count - nhead, file) == (size_t)ring_header.count - nhead;
+    }
+
+    if (fclose(file) || !ok)
+    {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+#else
+UHTTP_EXTERN int uhttp_trace_dump(const char* path)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
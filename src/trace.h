@@ -0,0 +1,123 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_TRACE_H_
+#define _UHTTP_INTERNAL_TRACE_H_
+
+#include <stdint.h>
+
+/* Records per thread, a power of two. Older records are overwritten. */
+#ifndef UHTTP_TRACE_RECORDS
+#define UHTTP_TRACE_RECORDS 65536
+#endif
+
+/* File signature of trace dumps. */
+#define UHTTP_TRACE_MAGIC "uhttptr1"
+
+/**
+ * Trace points. The subject of client events is the client pointer.
+ */
+typedef enum uhttp_trace_event_t {
+    /* Poll started, value is the number of sockets. */
+    UHTTP_TRACE_POLL_BEGIN = 1,
+    /* Poll returned, value is the number of sockets with events. */
+    UHTTP_TRACE_POLL_END = 2,
+    /* Connection accepted, value is the socket. */
+    UHTTP_TRACE_ACCEPT = 3,
+    /* Data received, value is its length. */
+    UHTTP_TRACE_RECEIVE = 4,
+    /* Request head parsed, value is its length. */
+    UHTTP_TRACE_PARSE = 5,
+    /* Handler called and returned. */
+    UHTTP_TRACE_DISPATCH_BEGIN = 6,
+    UHTTP_TRACE_DISPATCH_END = 7,
+    /* Request answered. */
+    UHTTP_TRACE_RESPOND = 8,
+    /* Data sent, value is its length. */
+    UHTTP_TRACE_SEND = 9,
+    /* Connection closed. */
+    UHTTP_TRACE_CLOSE = 10,
+    /* Memory allocated and freed, value is the size. */
+    UHTTP_TRACE_ALLOC = 11,
+    UHTTP_TRACE_FREE = 12,
+    /* Posted function run. */
+    UHTTP_TRACE_POSTED = 13
+} uhttp_trace_event_t;
+
+/**
+ * A trace record, fixed size so recording is a few stores.
+ */
+typedef struct uhttp_trace_record_t
+{
+    /* Timestamp counter, see uhttp_trace_header_t for its rate. */
+    uint64_t time;
+    /* Object the event is about. */
+    uint64_t subject;
+    uint32_t event;
+    uint32_t value;
+} uhttp_trace_record_t;
+
+/**
+ * Head of a trace dump, followed by the rings of every thread.
+ */
+typedef struct uhttp_trace_header_t
+{
+    char magic[8];
+    uint32_t record_size;
+    uint32_t nrings;
+    /* Timestamp counter and nanoseconds at the first record and at the dump,
+       to convert timestamps to time. */
+    uint64_t time0;
+    uint64_t ns0;
+    uint64_t time1;
+    uint64_t ns1;
+} uhttp_trace_header_t;
+
+/**
+ * Head of the records of one thread in a trace dump, followed by count
+ * records, oldest first.
+ */
+typedef struct uhttp_trace_ring_header_t
+{
+    uint64_t thread;
+    uint64_t count;
+} uhttp_trace_ring_header_t;
+
+#if UHTTP_TRACE
+
+/**
+ * Record a trace point on the ring of the calling thread.
+ * @param event Trace event.
+ * @param subject Object the event is about.
+ * @param value Event value.
+ */
+extern void uhttp_trace_record(uhttp_trace_event_t event, const void* subject, uint64_t value);
+
+#define uhttp_trace(event, subject, value) uhttp_trace_record(UHTTP_TRACE_##event, (subject), (value))
+#else
+#define uhttp_trace(event, subject, value) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Convert a trace dump to the Chrome trace event format, for chrome://tracing
+// and ui.perfetto.dev.
+
+static const char* uhttp_trace_names[] = {
+    [UHTTP_TRACE_POLL_BEGIN] = "poll",
+    [UHTTP_TRACE_POLL_END] = "poll",
+    [UHTTP_TRACE_ACCEPT] = "accept",
+    [UHTTP_TRACE_RECEIVE] = "receive",
+    [UHTTP_TRACE_PARSE] = "request",
+    [UHTTP_TRACE_DISPATCH_BEGIN] = "dispatch",
+    [UHTTP_TRACE_DISPATCH_END] = "dispatch",
+    [UHTTP_TRACE_RESPOND] = "request",
+    [UHTTP_TRACE_SEND] = "send",
+    [UHTTP_TRACE_CLOSE] = "close",
+    [UHTTP_TRACE_ALLOC] = "alloc",
+    [UHTTP_TRACE_FREE] = "free",
+    [UHTTP_TRACE_POSTED] = "posted"
+};
+
+/**
+ * Phase of an event: durations on the thread, requests as async spans from
+ * parse to response, everything else as instants.
+ */
+static char uhttp_trace_phase(uint32_t event)
+{
+    switch (event)
+    {
+    case UHTTP_TRACE_POLL_BEGIN:
+    case UHTTP_TRACE_DISPATCH_BEGIN:
+        return 'B';
+    case UHTTP_TRACE_POLL_END:
+    case UHTTP_TRACE_DISPATCH_END:
+        return 'E';
+    case UHTTP_TRACE_PARSE:
+        return 'b';
+    case UHTTP_TRACE_RESPOND:
+        return 'e';
+    default:
+        return 'i';
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s trace.bin [trace.json]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (in == NULL || out == NULL)
+    {
+        fprintf(stderr, "%s: cannot open %s\n", argv[0], in == NULL ? argv[1] : argv[2]);
+        return 1;
+    }
+
+    uhttp_trace_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, UHTTP_TRACE_MAGIC, sizeof(header.magic)) ||
+        header.record_size != sizeof(uhttp_trace_record_t))
+    {
+        fprintf(stderr, "%s: %s is not a trace dump of this version\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    // Timestamp counter ticks per microsecond.
+    double rate = (header.time1 > header.time0 && header.ns1 > header.ns0) ?
+        (double)(header.time1 - header.time0) * 1000.0 / (double)(header.ns1 - header.ns0) : 1000.0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    size_t nevents = 0;
+    for (uint32_t i = 0; i < header.nrings; i++)
+    {
+        uhttp_trace_ring_header_t ring;
+        if (fread(&ring, sizeof(ring), 1, in) != 1)
+        {
+            fprintf(stderr, "%s: %s is truncated\n", argv[0], argv[1]);
+            break;
+        }
+
+        fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":\"uhttp %llu\"}}",
+            nevents++ ? ",\n" : "", (unsigned long long)ring.thread, (unsigned long long)ring.thread);
+
+        for (uint64_t j = 0; j < ring.count; j++)
+        {
+            uhttp_trace_record_t record;
+            if (fread(&record, sizeof(record), 1, in) != 1)
+            {
+                break;
+            }
+
+            const char* name = record.event < sizeof(uhttp_trace_names) / sizeof(uhttp_trace_names[0]) ?
+                uhttp_trace_names[record.event] : NULL;
+            if (name == NULL)
+            {
+                continue;
+            }
+
+            char phase = uhttp_trace_phase(record.event);
+            double ts = (double)(int64_t)(record.time - header.time0) / rate;
+
+            fprintf(out, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"uhttp\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f",
+                phase, name, (unsigned long long)ring.thread, ts);
+            if (phase == 'b' || phase == 'e')
+            {
+                fprintf(out, ",\"id\":\"0x%llx\"", (unsigned long long)record.subject);
+            }
+            else if (phase == 'i')
+            {
+                fprintf(out, ",\"s\":\"t\"");
+            }
+            fprintf(out, ",\"args\":{\"subject\":\"0x%llx\",\"value\":%lu}}",
+                (unsigned long long)record.subject, (unsigned long)record.value);
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+    fclose(in);
+    if (out != stdout) fclose(out);
+    return 0;
+}
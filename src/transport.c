@@ -0,0 +1,693 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "config.h"
+#include "transport.h"
+#include "debug.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if UHTTP_FEATURE_TRANSPORT
+#include <stdatomic.h>
+#if !_WIN32
+#include <unistd.h>
+#endif
+
+/* Listen sockets of an in-memory transport. */
+#ifndef UHTTP_MEMORY_LISTENERS
+#define UHTTP_MEMORY_LISTENERS 8
+#endif
+
+/* First socket of an in-memory transport, above any kernel descriptor. */
+#define UHTTP_MEMORY_SOCKET_BASE ((uhttp_socket_t)0x40000000)
+
+/* Bytes between fields written by different threads. */
+#define UHTTP_MEMORY_PAD 64
+
+/* States of a connection. */
+enum
+{
+    UHTTP_MEMORY_FREE,
+    UHTTP_MEMORY_CLAIMED,
+    UHTTP_MEMORY_CONNECTING,
+    UHTTP_MEMORY_OPEN
+};
+
+/**
+ * Bytes from one end of a connection to the other, with one writer and one
+ * reader.
+ */
+typedef struct uhttp_memory_ring_t
+{
+    char* data;
+    size_t mask;
+
+    char pad0[UHTTP_MEMORY_PAD];
+    /* Next byte to read, owned by the reader. */
+    atomic_size_t head;
+
+    char pad1[UHTTP_MEMORY_PAD];
+    /* Next byte to write, owned by the writer. */
+    atomic_size_t tail;
+} uhttp_memory_ring_t;
+
+/**
+ * A connection, end 0 is the server and end 1 the peer. End e reads
+ * rings[e] and writes the other ring.
+ */
+typedef struct uhttp_memory_conn_t
+{
+    atomic_int state;
+    /* Listener connected to. */
+    size_t listener;
+    /* Bit 1 << e once end e is closed. */
+    atomic_int closed;
+    uhttp_memory_ring_t rings[2];
+} uhttp_memory_conn_t;
+
+typedef struct uhttp_memory_listener_t
+{
+    /* Address listened on, domain zero while the slot is free. */
+    uhttp_addr_t addr;
+    /* Connections not accepted yet. */
+    atomic_size_t pending;
+} uhttp_memory_listener_t;
+
+typedef struct uhttp_memory_transport_t
+{
+    uhttp_transport_t transport;
+    uhttp_memory_listener_t listeners[UHTTP_MEMORY_LISTENERS];
+    uhttp_memory_conn_t* conns;
+    size_t nconns;
+    /* Set while a poll sleeps, writers signal the doorbell then. */
+    atomic_int sleeping;
+    uhttp_wakeup_t doorbell;
+    /* Kernel sockets of the poll being made, and the doorbell. */
+    uhttp_pollfd_t* kernel;
+    size_t kernelcap;
+} uhttp_memory_transport_t;
+
+/**
+ * Find the listener of a socket.
+ * @return Listener or NULL if the socket is not a listen socket.
+ */
+static uhttp_memory_listener_t* uhttp_memory_listener(uhttp_memory_transport_t* mt, uhttp_socket_t sock)
+{
+    if (sock < UHTTP_MEMORY_SOCKET_BASE || sock >= UHTTP_MEMORY_SOCKET_BASE + UHTTP_MEMORY_LISTENERS) return NULL;
+
+    uhttp_memory_listener_t* listener = &mt->listeners[sock - UHTTP_MEMORY_SOCKET_BASE];
+    return listener->addr.domain ? listener : NULL;
+}
+
+/**
+ * Find the connection of a socket.
+ * @param end Receives the end of the socket.
+ * @return Connection or NULL if the socket is not a connection.
+ */
+static uhttp_memory_conn_t* uhttp_memory_conn(uhttp_memory_transport_t* mt, uhttp_socket_t sock, int* end)
+{
+    uhttp_socket_t first = UHTTP_MEMORY_SOCKET_BASE + UHTTP_MEMORY_LISTENERS;
+    if (sock < first || sock >= first + (uhttp_socket_t)(mt->nconns * 2)) return NULL;
+
+    size_t index = (size_t)(sock - first);
+    *end = (int)(index & 1);
+    return &mt->conns[index / 2];
+}
+
+/**
+ * Check if a socket belongs to a transport.
+ */
+static int uhttp_memory_owns(uhttp_memory_transport_t* mt, uhttp_socket_t sock)
+{
+    return sock >= UHTTP_MEMORY_SOCKET_BASE &&
+        sock < UHTTP_MEMORY_SOCKET_BASE + UHTTP_MEMORY_LISTENERS + (uhttp_socket_t)(mt->nconns * 2);
+}
+
+/**
+ * Wake up a sleeping poll after a change it may wait for.
+ */
+static void uhttp_memory_notify(uhttp_memory_transport_t* mt)
+{
+    if (atomic_load(&mt->sleeping) && atomic_exchange(&mt->sleeping, 0))
+    {
+        uhttp_wakeup_signal(&mt->doorbell);
+    }
+}
+
+static int uhttp_memory_same_addr(const uhttp_addr_t* a, const uhttp_addr_t* b)
+{
+    if (a->domain != b->domain) return 0;
+    if (a->domain == UHTTP_SOCKET_DOMAIN_UNIX) return strcmp(a->path, b->path) == 0;
+    return a->port == b->port && memcmp(a->address, b->address, a->domain == UHTTP_SOCKET_DOMAIN_INET4 ? 4 : 16) == 0;
+}
+
+static uhttp_socket_t uhttp_memory_listen(uhttp_transport_t* transport, const uhttp_addr_t* addr, int backlog)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    uhttp_memory_listener_t* free_listener = NULL;
+
+    for (size_t i = 0; i < UHTTP_MEMORY_LISTENERS; i++)
+    {
+        uhttp_memory_listener_t* listener = &mt->listeners[i];
+        if (listener->addr.domain == 0)
+        {
+            if (free_listener == NULL) free_listener = listener;
+        }
+        else if (uhttp_memory_same_addr(&listener->addr, addr))
+        {
+            errno = EADDRINUSE;
+            return UHTTP_INVALID_SOCKET;
+        }
+    }
+
+    if (addr->domain == 0 || free_listener == NULL)
+    {
+        errno = addr->domain == 0 ? EINVAL : EMFILE;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    atomic_store(&free_listener->pending, 0);
+    free_listener->addr = *addr;
+    return UHTTP_MEMORY_SOCKET_BASE + (uhttp_socket_t)(free_listener - mt->listeners);
+}
+
+UHTTP_EXTERN uhttp_socket_t uhttp_memory_connect(uhttp_transport_t* transport, const uhttp_addr_t* addr)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    size_t index;
+
+    if (transport == NULL || addr == NULL)
+    {
+        errno = EINVAL;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    for (index = 0; index < UHTTP_MEMORY_LISTENERS; index++)
+    {
+        if (mt->listeners[index].addr.domain && uhttp_memory_same_addr(&mt->listeners[index].addr, addr)) break;
+    }
+
+    if (index == UHTTP_MEMORY_LISTENERS)
+    {
+        errno = ECONNREFUSED;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    for (size_t i = 0; i < mt->nconns; i++)
+    {
+        uhttp_memory_conn_t* conn = &mt->conns[i];
+        int state = UHTTP_MEMORY_FREE;
+        if (!atomic_compare_exchange_strong(&conn->state, &state, UHTTP_MEMORY_CLAIMED)) continue;
+
+        // Claimed, nobody else touches the connection until it is published.
+        for (int end = 0; end < 2; end++)
+        {
+            atomic_store(&conn->rings[end].head, 0);
+            atomic_store(&conn->rings[end].tail, 0);
+        }
+        atomic_store(&conn->closed, 0);
+        conn->listener = index;
+        atomic_store(&conn->state, UHTTP_MEMORY_CONNECTING);
+        atomic_fetch_add(&mt->listeners[index].pending, 1);
+
+        uhttp_memory_notify(mt);
+        return UHTTP_MEMORY_SOCKET_BASE + UHTTP_MEMORY_LISTENERS + (uhttp_socket_t)(i * 2 + 1);
+    }
+
+    errno = EMFILE;
+    return UHTTP_INVALID_SOCKET;
+}
+
+static uhttp_socket_t uhttp_memory_accept(uhttp_transport_t* transport, uhttp_socket_t sock, uhttp_addr_t* addr)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    uhttp_memory_listener_t* listener = uhttp_memory_listener(mt, sock);
+
+    if (listener == NULL)
+    {
+        errno = EBADF;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    if (atomic_load(&listener->pending) == 0)
+    {
+        errno = EAGAIN;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    size_t index = listener - mt->listeners;
+    for (size_t i = 0; i < mt->nconns; i++)
+    {
+        uhttp_memory_conn_t* conn = &mt->conns[i];
+        int state = UHTTP_MEMORY_CONNECTING;
+        if (atomic_load(&conn->state) != state || conn->listener != index ||
+            !atomic_compare_exchange_strong(&conn->state, &state, UHTTP_MEMORY_OPEN))
+        {
+            continue;
+        }
+
+        atomic_fetch_sub(&listener->pending, 1);
+
+        // Peers appear to come from the loopback address.
+        if (addr)
+        {
+            memset(addr, 0, sizeof(*addr));
+            addr->domain = listener->addr.domain;
+            if (addr->domain == UHTTP_SOCKET_DOMAIN_INET4)
+            {
+                addr->address[0] = 127;
+                addr->address[3] = 1;
+            }
+            else if (addr->domain == UHTTP_SOCKET_DOMAIN_INET6)
+            {
+                addr->address[15] = 1;
+            }
+        }
+
+        return UHTTP_MEMORY_SOCKET_BASE + UHTTP_MEMORY_LISTENERS + (uhttp_socket_t)(i * 2);
+    }
+
+    errno = EAGAIN;
+    return UHTTP_INVALID_SOCKET;
+}
+
+static ssize_t uhttp_memory_recv(uhttp_transport_t* transport, uhttp_socket_t sock, void* buffer, size_t len)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    int end;
+    uhttp_memory_conn_t* conn = uhttp_memory_conn(mt, sock, &end);
+
+    if (conn == NULL)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    uhttp_memory_ring_t* ring = &conn->rings[end];
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t avail = atomic_load_explicit(&ring->tail, memory_order_acquire) - head;
+
+    if (avail == 0)
+    {
+        // Drained, the end of the stream once the other end is closed.
+        if (atomic_load(&conn->closed) & (1 << (end ^ 1))) return 0;
+
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (len > avail) len = avail;
+
+    size_t pos = head & ring->mask;
+    size_t first = ring->mask + 1 - pos < len ? ring->mask + 1 - pos : len;
+    memcpy(buffer, ring->data + pos, first);
+    memcpy((char*)buffer + first, ring->data, len - first);
+
+    // Sequentially consistent, so the notify below cannot pass a poll that
+    // just found the ring full.
+    atomic_store(&ring->head, head + len);
+    uhttp_memory_notify(mt);
+    return len;
+}
+
+/**
+ * Get the ring an end writes to, if the other end still reads it.
+ * @return Ring or NULL (see errno).
+ */
+static uhttp_memory_ring_t* uhttp_memory_writable(uhttp_memory_transport_t* mt, uhttp_socket_t sock)
+{
+    int end;
+    uhttp_memory_conn_t* conn = uhttp_memory_conn(mt, sock, &end);
+
+    if (conn == NULL)
+    {
+        errno = EBADF;
+        return NULL;
+    }
+
+    if (atomic_load(&conn->closed) & (1 << (end ^ 1)))
+    {
+        errno = EPIPE;
+        return NULL;
+    }
+
+    return &conn->rings[end ^ 1];
+}
+
+#if !_WIN32
+/**
+ * Get the free bytes of a ring a writer can fill without wrapping.
+ * @param tail Receives the tail of the ring.
+ * @return Contiguous free bytes, -1 if the ring is full (EAGAIN).
+ */
+static ssize_t uhttp_memory_space(uhttp_memory_ring_t* ring, size_t* tail)
+{
+    *tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t space = ring->mask + 1 - (*tail - atomic_load_explicit(&ring->head, memory_order_acquire));
+
+    if (space == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    size_t pos = *tail & ring->mask;
+    return ring->mask + 1 - pos < space ? ring->mask + 1 - pos : space;
+}
+#endif
+
+static ssize_t uhttp_memory_sendv(uhttp_transport_t* transport, uhttp_socket_t sock, const uhttp_str_t* parts, size_t nparts)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    uhttp_memory_ring_t* ring = uhttp_memory_writable(mt, sock);
+
+    if (ring == NULL) return -1;
+
+    size_t start = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t tail = start;
+    size_t space = ring->mask + 1 - (tail - atomic_load_explicit(&ring->head, memory_order_acquire));
+
+    for (size_t i = 0; i < nparts && space; i++)
+    {
+        const char* data = parts[i].ptr;
+        size_t len = parts[i].len < space ? parts[i].len : space;
+        space -= len;
+
+        while (len)
+        {
+            size_t pos = tail & ring->mask;
+            size_t n = ring->mask + 1 - pos < len ? ring->mask + 1 - pos : len;
+            memcpy(ring->data + pos, data, n);
+            data += n;
+            tail += n;
+            len -= n;
+        }
+    }
+
+    if (tail == start)
+    {
+        // Nothing to send is not a full ring.
+        for (size_t i = 0; i < nparts; i++)
+        {
+            if (parts[i].len)
+            {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    atomic_store(&ring->tail, tail);
+    uhttp_memory_notify(mt);
+    return tail - start;
+}
+
+static ssize_t uhttp_memory_send(uhttp_transport_t* transport, uhttp_socket_t sock, const void* buffer, size_t len)
+{
+    uhttp_str_t part = { buffer, len };
+    return uhttp_memory_sendv(transport, sock, &part, 1);
+}
+
+static ssize_t uhttp_memory_sendfile(uhttp_transport_t* transport, uhttp_socket_t sock, int fd, int64_t offset, size_t len)
+{
+#if _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    uhttp_memory_ring_t* ring = uhttp_memory_writable(mt, sock);
+    size_t tail;
+
+    if (ring == NULL) return -1;
+
+    // Read straight into the ring.
+    ssize_t space = uhttp_memory_space(ring, &tail);
+    if (space < 0) return -1;
+
+    ssize_t n = pread(fd, ring->data + (tail & ring->mask), len < (size_t)space ? len : (size_t)space, offset);
+    if (n <= 0) return n;
+
+    atomic_store(&ring->tail, tail + n);
+    uhttp_memory_notify(mt);
+    return n;
+#endif
+}
+
+static void uhttp_memory_close(uhttp_transport_t* transport, uhttp_socket_t sock)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    uhttp_memory_listener_t* listener = uhttp_memory_listener(mt, sock);
+    int end;
+    uhttp_memory_conn_t* conn = uhttp_memory_conn(mt, sock, &end);
+
+    if (listener)
+    {
+        listener->addr.domain = 0;
+    }
+    else if (conn)
+    {
+        // The last end to close frees the connection.
+        if (atomic_fetch_or(&conn->closed, 1 << end) == (1 << (end ^ 1)))
+        {
+            atomic_store(&conn->state, UHTTP_MEMORY_FREE);
+        }
+        uhttp_memory_notify(mt);
+    }
+}
+
+/**
+ * Get the events of the in-memory sockets of a poll.
+ * @param mt Transport object.
+ * @param fds Sockets, revents of in-memory ones is set.
+ * @param nfds Number of sockets.
+ * @return Number of in-memory sockets with events.
+ */
+static int uhttp_memory_ready(uhttp_memory_transport_t* mt, uhttp_pollfd_t* fds, size_t nfds)
+{
+    int ready = 0;
+
+    for (size_t i = 0; i < nfds; i++)
+    {
+        uhttp_pollfd_t* fd = &fds[i];
+        uhttp_memory_listener_t* listener;
+        uhttp_memory_conn_t* conn;
+        int end;
+
+        if (!uhttp_memory_owns(mt, fd->sock)) continue;
+
+        fd->revents = 0;
+        if ((listener = uhttp_memory_listener(mt, fd->sock)))
+        {
+            if (atomic_load(&listener->pending)) fd->revents = fd->events & UHTTP_EVENT_RECEIVE;
+        }
+        else if ((conn = uhttp_memory_conn(mt, fd->sock, &end)) && atomic_load(&conn->state) != UHTTP_MEMORY_FREE)
+        {
+            const uhttp_memory_ring_t* in = &conn->rings[end];
+            const uhttp_memory_ring_t* out = &conn->rings[end ^ 1];
+
+            if (atomic_load(&conn->closed) & (1 << (end ^ 1)))
+            {
+                // As a reset TCP connection, readable to the end of stream.
+                fd->revents = UHTTP_EVENT_HANGUP | (fd->events & UHTTP_EVENT_RECEIVE);
+            }
+            else
+            {
+                if (atomic_load(&in->tail) != atomic_load(&in->head)) fd->revents |= fd->events & UHTTP_EVENT_RECEIVE;
+                if (atomic_load(&out->tail) - atomic_load(&out->head) <= out->mask) fd->revents |= fd->events & UHTTP_EVENT_SEND;
+            }
+        }
+        else
+        {
+            fd->revents = UHTTP_EVENT_ERROR;
+        }
+
+        if (fd->revents) ready++;
+    }
+
+    return ready;
+}
+
+static int uhttp_memory_pollv(uhttp_transport_t* transport, uhttp_pollfd_t* fds, size_t nfds, int timeout)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+    size_t nkernel = 0;
+
+    for (size_t i = 0; i < nfds; i++)
+    {
+        if (!uhttp_memory_owns(mt, fds[i].sock)) nkernel++;
+    }
+
+    if (nkernel + 1 > mt->kernelcap)
+    {
+        uhttp_pollfd_t* kernel = realloc(mt->kernel, (nkernel + 1) * sizeof(uhttp_pollfd_t));
+        if (kernel == NULL)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        mt->kernel = kernel;
+        mt->kernelcap = nkernel + 1;
+    }
+
+    nkernel = 0;
+    for (size_t i = 0; i < nfds; i++)
+    {
+        if (!uhttp_memory_owns(mt, fds[i].sock)) mt->kernel[nkernel++] = fds[i];
+    }
+
+    int ready = uhttp_memory_ready(mt, fds, nfds);
+
+    // Announce the sleep before looking again, so a writer either sees it or
+    // its bytes are seen.
+    int wait = ready ? 0 : timeout;
+    if (wait)
+    {
+        atomic_store(&mt->sleeping, 1);
+        if ((ready = uhttp_memory_ready(mt, fds, nfds))) wait = 0;
+    }
+
+    int nready = 0;
+    if (nkernel || wait)
+    {
+        size_t npoll = nkernel;
+        if (wait)
+        {
+            mt->kernel[npoll].sock = mt->doorbell.sock;
+            mt->kernel[npoll++].events = UHTTP_EVENT_RECEIVE;
+        }
+
+        nready = uhttp_pollv(mt->kernel, npoll, wait);
+        atomic_store(&mt->sleeping, 0);
+        if (nready < 0) return -1;
+
+        if (wait && mt->kernel[nkernel].revents)
+        {
+            nready--;
+            uhttp_wakeup_drain(&mt->doorbell);
+            ready = uhttp_memory_ready(mt, fds, nfds);
+        }
+
+        nkernel = 0;
+        for (size_t i = 0; i < nfds; i++)
+        {
+            if (!uhttp_memory_owns(mt, fds[i].sock)) fds[i].revents = mt->kernel[nkernel++].revents;
+        }
+    }
+    atomic_store(&mt->sleeping, 0);
+
+    return ready + nready;
+}
+
+UHTTP_EXTERN uhttp_transport_t* uhttp_memory_transport_create(size_t connections, size_t capacity)
+{
+    if (connections == 0 || capacity == 0 || capacity > SIZE_MAX / 4)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    uhttp_memory_transport_t* mt = calloc(1, sizeof(uhttp_memory_transport_t));
+    if (mt == NULL || (mt->conns = calloc(connections, sizeof(uhttp_memory_conn_t))) == NULL)
+    {
+        free(mt);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mt->nconns = connections;
+    for (size_t i = 0; i < connections; i++)
+    {
+        for (int end = 0; end < 2; end++)
+        {
+            uhttp_memory_ring_t* ring = &mt->conns[i].rings[end];
+            ring->mask = size - 1;
+            if ((ring->data = malloc(size)) == NULL)
+            {
+                uhttp_memory_transport_destroy(&mt->transport);
+                errno = ENOMEM;
+                return NULL;
+            }
+        }
+    }
+
+    if (uhttp_wakeup_open(&mt->doorbell))
+    {
+        int error = errno;
+        uhttp_memory_transport_destroy(&mt->transport);
+        errno = error;
+        return NULL;
+    }
+
+    mt->transport.listen = uhttp_memory_listen;
+    mt->transport.accept = uhttp_memory_accept;
+    mt->transport.recv = uhttp_memory_recv;
+    mt->transport.send = uhttp_memory_send;
+    mt->transport.sendv = uhttp_memory_sendv;
+    mt->transport.sendfile = uhttp_memory_sendfile;
+    mt->transport.pollv = uhttp_memory_pollv;
+    mt->transport.close = uhttp_memory_close;
+    return &mt->transport;
+}
+
+UHTTP_EXTERN void uhttp_memory_transport_destroy(uhttp_transport_t* transport)
+{
+    uhttp_memory_transport_t* mt = (uhttp_memory_transport_t*)transport;
+
+    if (mt == NULL) return;
+
+    for (size_t i = 0; i < mt->nconns; i++)
+    {
+        free(mt->conns[i].rings[0].data);
+        free(mt->conns[i].rings[1].data);
+    }
+
+    // Only set once the doorbell is open.
+    if (mt->transport.close) uhttp_wakeup_close(&mt->doorbell);
+
+    free(mt->conns);
+    free(mt->kernel);
+    free(mt);
+}
+#else
+UHTTP_EXTERN uhttp_transport_t* uhttp_memory_transport_create(size_t connections, size_t capacity)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+UHTTP_EXTERN void uhttp_memory_transport_destroy(uhttp_transport_t* transport)
+{
+}
+
+UHTTP_EXTERN uhttp_socket_t uhttp_memory_connect(uhttp_transport_t* transport, const uhttp_addr_t* addr)
+{
+    errno = ENOSYS;
+    return UHTTP_INVALID_SOCKET;
+}
+#endif
@@ -0,0 +1,97 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef _UHTTP_INTERNAL_
+#error "This is a uHTTP internal header, don't include this file."
+#endif
+
+#ifndef _UHTTP_INTERNAL_TRANSPORT_H_
+#define _UHTTP_INTERNAL_TRANSPORT_H_
+
+#include "uhttp.h"
+#include "config.h"
+
+/*
+ * Socket calls of servers and clients, through the transport if there is one
+ * and straight to the kernel otherwise.
+ */
+
+static inline uhttp_socket_t uhttp_transport_accept(uhttp_transport_t* transport, uhttp_socket_t sock, uhttp_addr_t* addr)
+{
+#if UHTTP_FEATURE_TRANSPORT
+    if (transport) return transport->accept(transport, sock, addr);
+#endif
+    return uhttp_accept(sock, addr);
+}
+
+static inline ssize_t uhttp_transport_recv(uhttp_transport_t* transport, uhttp_socket_t sock, void* buffer, size_t len)
+{
+#if UHTTP_FEATURE_TRANSPORT
+    if (transport) return transport->recv(transport, sock, buffer, len);
+#endif
+    return uhttp_recv(sock, buffer, len);
+}
+
+static inline ssize_t uhttp_transport_send(uhttp_transport_t* transport, uhttp_socket_t sock, const void* buffer, size_t len)
+{
+#if UHTTP_FEATURE_TRANSPORT
+    if (transport) return transport->send(transport, sock, buffer, len);
+#endif
+    return uhttp_send(sock, buffer, len);
+}
+
+static inline ssize_t uhttp_transport_sendv(uhttp_transport_t* transport, uhttp_socket_t sock, const uhttp_str_t* parts, size_t nparts)
+{
+#if UHTTP_FEATURE_TRANSPORT
+    if (transport) return transport->sendv(transport, sock, parts, nparts);
+#endif
+    return uhttp_sendv(sock, parts, nparts);
+}
+
+static inline ssize_t uhttp_transport_sendfile(uhttp_transport_t* transport, uhttp_socket_t sock, int fd, int64_t offset, size_t len)
+{
+#if UHTTP_FEATURE_TRANSPORT
+    if (transport) return transport->sendfile(transport, sock, fd, offset, len);
+#endif
+    return uhttp_sendfile(sock, fd, offset, len);
+}
+
+static inline int uhttp_transport_pollv(uhttp_transport_t* transport, uhttp_pollfd_t* fds, size_t nfds, int timeout)
+{
+#if UHTTP_FEATURE_TRANSPORT
+    if (transport) return transport->pollv(transport, fds, nfds, timeout);
+#endif
+    return uhttp_pollv(fds, nfds, timeout);
+}
+
+static inline void uhttp_transport_close(uhttp_transport_t* transport, uhttp_socket_t sock)
+{
+#if UHTTP_FEATURE_TRANSPORT
+    if (transport)
+    {
+        transport->close(transport, sock);
+        return;
+    }
+#endif
+    uhttp_close(sock);
+}
+
+#endif
@@ -0,0 +1,332 @@
+/**
+ * Copyright 2021 H. Utku Maden
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#define _UHTTP_INTERNAL_
+#include "config.h"
+#include "proxy.h"
+#include "request.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+
+/* States of a chunked body. */
+enum
+{
+    UHTTP_CHUNKED_SIZE,
+    UHTTP_CHUNKED_EXT,
+    UHTTP_CHUNKED_DATA,
+    UHTTP_CHUNKED_DATA_CR,
+    UHTTP_CHUNKED_DATA_LF,
+    UHTTP_CHUNKED_TRAILER,
+    UHTTP_CHUNKED_DONE
+};
+
+/* Fields of one connection, RFC 9110 7.6.1. Transfer-Encoding is kept as
+   chunked bodies are relayed unchanged. */
+static const char* const uhttp_hop_by_hop[] =
+{
+    "Connection",
+    "Keep-Alive",
+    "Proxy-Connection",
+    "Proxy-Authenticate",
+    "Proxy-Authorization",
+    "TE",
+    "Upgrade",
+    NULL
+};
+
+void uhttp_chunked_init(uhttp_chunked_t* chunked)
+{
+    chunked->state = UHTTP_CHUNKED_SIZE;
+    chunked->left = 0;
+    chunked->digits = 0;
+    chunked->linelen = 0;
+}
+
+int uhttp_chunked_done(const uhttp_chunked_t* chunked)
+{
+    return chunked->state == UHTTP_CHUNKED_DONE;
+}
+
+/**
+ * Get the value of a hexadecimal digit.
+ * @param c Character.
+ * @return Value of the digit, -1 if it is not one.
+ */
+static int uhttp_chunked_digit(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+ssize_t uhttp_chunked_scan(uhttp_chunked_t* chunked, const char* data, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len && chunked->state != UHTTP_CHUNKED_DONE)
+    {
+        char c = data[pos];
+        switch (chunked->state)
+        {
+        case UHTTP_CHUNKED_SIZE:
+        {
+            int digit = uhttp_chunked_digit(c);
+            if (digit < 0)
+            {
+                // The size is followed by extensions or the line end.
+                if (chunked->digits == 0) goto malformed;
+                chunked->state = UHTTP_CHUNKED_EXT;
+                break;
+            }
+
+            if (++chunked->digits > 15) goto malformed;
+            chunked->left = chunked->left * 16 + digit;
+            pos++;
+            break;
+        }
+        case UHTTP_CHUNKED_EXT:
+        {
+            // Extensions are skipped up to the line feed.
+            const char* lf = memchr(data + pos, '\n', len - pos);
+            if (lf == NULL)
+            {
+                pos = len;
+                break;
+            }
+
+            pos = lf - data + 1;
+            chunked->state = chunked->left ? UHTTP_CHUNKED_DATA : UHTTP_CHUNKED_TRAILER;
+            break;
+        }
+        case UHTTP_CHUNKED_DATA:
+        {
+            size_t n = (uint64_t)(len - pos) < chunked->left ? len - pos : (size_t)chunked->left;
+            pos += n;
+            chunked->left -= n;
+            if (chunked->left == 0) chunked->state = UHTTP_CHUNKED_DATA_CR;
+            break;
+        }
+        case UHTTP_CHUNKED_DATA_CR:
+        case UHTTP_CHUNKED_DATA_LF:
+            // Data ends with CRLF, a bare LF is tolerated.
+            if (c == '\r' && chunked->state == UHTTP_CHUNKED_DATA_CR)
+            {
+                chunked->state = UHTTP_CHUNKED_DATA_LF;
+            }
+            else if (c == '\n')
+            {
+                chunked->state = UHTTP_CHUNKED_SIZE;
+                chunked->digits = 0;
+            }
+            else
+            {
+                goto malformed;
+            }
+            pos++;
+            break;
+        case UHTTP_CHUNKED_TRAILER:
+            // Trailer fields up to an empty line.
+            if (c == '\n')
+            {
+                if (chunked->linelen == 0) chunked->state = UHTTP_CHUNKED_DONE;
+                chunked->linelen = 0;
+            }
+            else if (c != '\r')
+            {
+                chunked->linelen++;
+            }
+            pos++;
+            break;
+        }
+    }
+
+    return pos;
+
+malformed:
+    errno = EBADMSG;
+    return -1;
+}
+
+/**
+ * Find a header field of an upstream response.
+ * @param response Response object.
+ * @param name Field name, case insensitive.
+ * @return Field value or NULL if absent.
+ */
+static const uhttp_str_t* uhttp_proxy_header(const uhttp_proxy_response_t* response, const char* name)
+{
+    for (size_t i = 0; i < response->nheaders; i++)
+    {
+        if (uhttp_str_ieq(&response->headers[i].name, name))
+        {
+            return &response->headers[i].value;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Check if the last transfer coding of a field value is chunked.
+ * @param value Transfer-Encoding value.
+ * @return Non-zero if the body is chunked last.
+ */
+static int uhttp_proxy_chunked_last(const uhttp_str_t* value)
+{
+    uhttp_str_t coding = *value;
+
+    for (size_t i = value->len; i > 0; i--)
+    {
+        if (value->ptr[i - 1] == ',')
+        {
+            coding.ptr = value->ptr + i;
+            coding.len = value->len - i;
+            break;
+        }
+    }
+
+    while (coding.len && (coding.ptr[0] == ' ' || coding.ptr[0] == '\t'))
+    {
+        coding.ptr++;
+        coding.len--;
+    }
+    while (coding.len && (coding.ptr[coding.len - 1] == ' ' || coding.ptr[coding.len - 1] == '\t'))
+    {
+        coding.len--;
+    }
+
+    return uhttp_str_ieq(&coding, "chunked");
+}
+
+ssize_t uhttp_proxy_parse(uhttp_proxy_response_t* response, const char* buffer, size_t len, int head)
+{
+    const char* pos = buffer;
+    const char* end = buffer + len;
+    const char* eol = memchr(pos, '\n', len);
+
+    if (eol == NULL) return 0;
+
+    // "HTTP/1.x NNN reason"
+    size_t linelen = eol - pos;
+    if (linelen && pos[linelen - 1] == '\r') linelen--;
+
+    if (linelen < 12 || memcmp(pos, "HTTP/1.", 7) || (pos[7] != '0' && pos[7] != '1') || pos[8] != ' ' ||
+        pos[9] < '1' || pos[9] > '5' || pos[10] < '0' || pos[10] > '9' || pos[11] < '0' || pos[11] > '9' ||
+        (linelen > 12 && pos[12] != ' '))
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    response->version = pos[7] - '0';
+    response->status = (pos[9] - '0') * 100 + (pos[10] - '0') * 10 + (pos[11] - '0');
+    pos = eol + 1;
+
+    int fields = uhttp_parse_fields(&pos, end, response->headers, &response->nheaders);
+    if (fields <= 0) return fields;
+
+    const uhttp_str_t* connection = uhttp_proxy_header(response, "Connection");
+    if (response->version == 0)
+    {
+        response->keep_alive = connection && uhttp_str_has_token(connection, "keep-alive");
+    }
+    else
+    {
+        response->keep_alive = !connection || !uhttp_str_has_token(connection, "close");
+    }
+
+    // Message body length, RFC 9112 6.3.
+    const uhttp_str_t* value;
+    response->framing = UHTTP_PROXY_LENGTH;
+    response->length = 0;
+    if (head || response->status < 200 || response->status == 204 || response->status == 304)
+    {
+        // No body whatever the fields say.
+    }
+    else if ((value = uhttp_proxy_header(response, "Transfer-Encoding")))
+    {
+        response->framing = uhttp_proxy_chunked_last(value) ? UHTTP_PROXY_CHUNKED : UHTTP_PROXY_CLOSE;
+    }
+    else if ((value = uhttp_proxy_header(response, "Content-Length")))
+    {
+        if (value->len == 0 || value->len > 18)
+        {
+            errno = EBADMSG;
+            return -1;
+        }
+
+        for (size_t i = 0; i < value->len; i++)
+        {
+            if (value->ptr[i] < '0' || value->ptr[i] > '9')
+            {
+                errno = EBADMSG;
+                return -1;
+            }
+            response->length = response->length * 10 + (value->ptr[i] - '0');
+        }
+    }
+    else
+    {
+        response->framing = UHTTP_PROXY_CLOSE;
+    }
+
+    // A body read until the connection closes leaves nothing to reuse.
+    if (response->framing == UHTTP_PROXY_CLOSE)
+    {
+        response->keep_alive = 0;
+    }
+
+    return pos - buffer;
+}
+
+int uhttp_proxy_hop_by_hop(const uhttp_str_t* name, const uhttp_str_t* connection)
+{
+    for (const char* const* field = uhttp_hop_by_hop; *field; field++)
+    {
+        if (uhttp_str_ieq(name, *field)) return 1;
+    }
+
+    // Connection options, RFC 9110 7.6.1.
+    const char* pos = connection ? connection->ptr : NULL;
+    const char* end = connection ? connection->ptr + connection->len : NULL;
+    while (pos < end)
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ',')) pos++;
+
+        const char* item = pos;
+        while (pos < end && *pos != ',') pos++;
+
+        size_t len = pos - item;
+        while (len && (item[len - 1] == ' ' || item[len - 1] == '\t')) len--;
+
+        if (len && len == name->len)
+        {
+            size_t i = 0;
+            while (i < len && tolower((unsigned char)item[i]) == tolower((unsigned char)name->ptr[i])) i++;
+            if (i == len) return 1;
+        }
+    }
+
+    return 0;
+}
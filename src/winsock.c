@@ -6,6 +6,8 @@
 
 #include <errno.h>
 #include <malloc.h>
+#include <io.h>
+#include <string.h>
 
 UHTTP_EXTERN int uhttp_socket_init()
 {
@@ -26,11 +28,9 @@ UHTTP_EXTERN void uhttp_socket_deinit()
     WSACleanup();
 }
 
-UHTTP_EXTERN uhttp_socket_t uhttp_socket(uhttp_addr_t* addr)
+UHTTP_EXTERN uhttp_socket_t uhttp_socket_create(uhttp_socket_domain_t domain)
 {
-    if (addr == NULL) goto invalid;
-
-    switch (addr->domain)
+    switch (domain)
     {
     case UHTTP_SOCKET_DOMAIN_INET4:
     {
@@ -41,34 +41,153 @@ UHTTP_EXTERN uhttp_socket_t uhttp_socket(uhttp_addr_t* addr)
             return UHTTP_INVALID_SOCKET;
         }
 
-        struct sockaddr_in sckaddr;
-        sckaddr.sin_family = AF_INET;
-        sckaddr.sin_port = htons(addr->port);
-        sckaddr.sin_addr.S_un.S_un_b.s_b1 = addr->address[0];
-        sckaddr.sin_addr.S_un.S_un_b.s_b2 = addr->address[1];
-        sckaddr.sin_addr.S_un.S_un_b.s_b3 = addr->address[2];
-        sckaddr.sin_addr.S_un.S_un_b.s_b4 = addr->address[3];
-        
-        if (bind(sck, &sckaddr, sizeof(struct sockaddr_in)))
-        {
-            errno = EADDRINUSE;
-            return UHTTP_INVALID_SOCKET;
-        }
-
         return sck;
     }
     case UHTTP_SOCKET_DOMAIN_INET6:
+    case UHTTP_SOCKET_DOMAIN_UNIX:
     {
         errno = EAFNOSUPPORT;
         return UHTTP_INVALID_SOCKET;
     }
     default:
-        goto invalid;
+        errno = EINVAL;
+        return UHTTP_INVALID_SOCKET;
+    }
+}
+
+UHTTP_EXTERN int uhttp_bind(uhttp_socket_t sock, uhttp_addr_t* addr)
+{
+    if (addr == NULL || addr->domain != UHTTP_SOCKET_DOMAIN_INET4)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct sockaddr_in sckaddr;
+    sckaddr.sin_family = AF_INET;
+    sckaddr.sin_port = htons(addr->port);
+    sckaddr.sin_addr.S_un.S_un_b.s_b1 = addr->address[0];
+    sckaddr.sin_addr.S_un.S_un_b.s_b2 = addr->address[1];
+    sckaddr.sin_addr.S_un.S_un_b.s_b3 = addr->address[2];
+    sckaddr.sin_addr.S_un.S_un_b.s_b4 = addr->address[3];
+
+    if (bind(sock, &sckaddr, sizeof(struct sockaddr_in)))
+    {
+        errno = EADDRINUSE;
+        return -1;
+    }
+
+    return 0;
+}
+
+UHTTP_EXTERN int uhttp_bind_mode(uhttp_socket_t sock, uhttp_addr_t* addr, int mode)
+{
+    return uhttp_bind(sock, addr);
+}
+
+UHTTP_EXTERN int uhttp_connect(uhttp_socket_t sock, const uhttp_addr_t* addr)
+{
+    if (addr == NULL || addr->domain != UHTTP_SOCKET_DOMAIN_INET4)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct sockaddr_in sckaddr;
+    sckaddr.sin_family = AF_INET;
+    sckaddr.sin_port = htons(addr->port);
+    sckaddr.sin_addr.S_un.S_un_b.s_b1 = addr->address[0];
+    sckaddr.sin_addr.S_un.S_un_b.s_b2 = addr->address[1];
+    sckaddr.sin_addr.S_un.S_un_b.s_b3 = addr->address[2];
+    sckaddr.sin_addr.S_un.S_un_b.s_b4 = addr->address[3];
+
+    if (connect(sock, (struct sockaddr*)&sckaddr, sizeof(sckaddr)) == 0)
+    {
+        return 0;
+    }
+
+    switch (WSAGetLastError())
+    {
+    case WSAEISCONN:
+        return 0;
+    case WSAEWOULDBLOCK:
+    case WSAEALREADY:
+    case WSAEINVAL:
+        errno = EINPROGRESS;
+        return -1;
+    default:
+        errno = ECONNREFUSED;
+        return -1;
+    }
+}
+
+UHTTP_EXTERN uhttp_socket_t uhttp_socket(uhttp_addr_t* addr)
+{
+    if (addr == NULL)
+    {
+        errno = EINVAL;
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    uhttp_socket_t sck = uhttp_socket_create(addr->domain);
+    if (sck == UHTTP_INVALID_SOCKET)
+    {
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    if (uhttp_bind(sck, addr))
+    {
+        closesocket(sck);
+        return UHTTP_INVALID_SOCKET;
+    }
+
+    return sck;
+}
+
+UHTTP_EXTERN void uhttp_unlink(const uhttp_addr_t* addr)
+{
+}
+
+UHTTP_EXTERN int uhttp_chmod(const uhttp_addr_t* addr, int mode)
+{
+    errno = EAFNOSUPPORT;
+    return -1;
+}
+
+UHTTP_EXTERN int uhttp_setsockopt(uhttp_socket_t sock, uhttp_sockopt_t name, int value)
+{
+    int level, option;
+
+    switch (name)
+    {
+    case UHTTP_SOCKOPT_NODELAY:
+        level = IPPROTO_TCP;
+        option = TCP_NODELAY;
+        value = !!value;
+        break;
+    case UHTTP_SOCKOPT_RCVBUF:
+        level = SOL_SOCKET;
+        option = SO_RCVBUF;
+        break;
+    case UHTTP_SOCKOPT_SNDBUF:
+        level = SOL_SOCKET;
+        option = SO_SNDBUF;
+        break;
+    case UHTTP_SOCKOPT_CORK:
+    case UHTTP_SOCKOPT_DEFER_ACCEPT:
+    case UHTTP_SOCKOPT_FASTOPEN:
+    case UHTTP_SOCKOPT_REUSEADDR:
+    case UHTTP_SOCKOPT_REUSEPORT:
+    case UHTTP_SOCKOPT_INCOMING_CPU:
+        // Not available, or with different semantics, on WinSock.
+        errno = ENOPROTOOPT;
+        return -1;
+    default:
+        errno = EINVAL;
+        return -1;
     }
 
-invalid:
-    errno = EINVAL;
-    return UHTTP_INVALID_SOCKET;
+    return setsockopt(sock, level, option, (const char*)&value, sizeof(value)) ? -1 : 0;
 }
 
 UHTTP_EXTERN int uhttp_listen(uhttp_socket_t sock, int backlog)
@@ -87,6 +206,7 @@ UHTTP_EXTERN uhttp_socket_t uhttp_accept(uhttp_socket_t sock, uhttp_addr_t* addr
     struct sockaddr xaddr;
     int len = sizeof(xaddr);
 
+    // Accepted sockets inherit non-blocking mode from the listen socket.
     uhttp_socket_t xsck = accept(sock, &xaddr, &len);
 
     if (xsck == INVALID_SOCKET)
@@ -124,10 +244,9 @@ UHTTP_EXTERN int uhttp_poll(uhttp_socket_t sock, uhttp_event_t* events)
 
     error = WSAPoll(&pollfd, 1, 0);
 
-    uhttp_log("%d", WSAGetLastError());
-
-    if (error)
+    if (error == SOCKET_ERROR)
     {
+        uhttp_log("%d", WSAGetLastError());
         return -1;
     }
 
@@ -135,18 +254,160 @@ UHTTP_EXTERN int uhttp_poll(uhttp_socket_t sock, uhttp_event_t* events)
     if (pollfd.revents & POLLHUP) *events |= UHTTP_EVENT_HANGUP;
     if (pollfd.revents & POLLERR) *events |= UHTTP_EVENT_ERROR;
     if (pollfd.revents & POLLIN) *events |= UHTTP_EVENT_RECEIVE;
+    if (pollfd.revents & POLLWRNORM) *events |= UHTTP_EVENT_SEND;
 
     return 0;
 }
 
+UHTTP_EXTERN int uhttp_pollv(uhttp_pollfd_t* fds, size_t nfds, int timeout)
+{
+    WSAPOLLFD* pollfds = malloc(nfds * sizeof(WSAPOLLFD));
+
+    if (nfds && pollfds == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (size_t i = 0; i < nfds; i++)
+    {
+        pollfds[i].fd = fds[i].sock;
+        pollfds[i].events = 0;
+        pollfds[i].revents = 0;
+        if (fds[i].events & UHTTP_EVENT_RECEIVE) pollfds[i].events |= POLLRDNORM;
+        if (fds[i].events & UHTTP_EVENT_SEND) pollfds[i].events |= POLLWRNORM;
+    }
+
+    int n = WSAPoll(pollfds, (ULONG)nfds, timeout);
+
+    for (size_t i = 0; i < nfds; i++)
+    {
+        SHORT revents = n > 0 ? pollfds[i].revents : 0;
+
+        fds[i].revents = 0;
+        if (revents & POLLHUP) fds[i].revents |= UHTTP_EVENT_HANGUP;
+        if (revents & (POLLERR | POLLNVAL)) fds[i].revents |= UHTTP_EVENT_ERROR;
+        if (revents & POLLRDNORM) fds[i].revents |= UHTTP_EVENT_RECEIVE;
+        if (revents & POLLWRNORM) fds[i].revents |= UHTTP_EVENT_SEND;
+    }
+
+    free(pollfds);
+
+    if (n == SOCKET_ERROR)
+    {
+        errno = EIO;
+        return -1;
+    }
+
+    return n;
+}
+
 UHTTP_EXTERN ssize_t uhttp_recv(uhttp_socket_t sock, void* buffer, size_t len)
 {
-    return recv(sock, buffer, len, 0);
+    int xlen = recv(sock, buffer, (int)len, 0);
+
+    if (xlen == SOCKET_ERROR)
+    {
+        errno = (WSAGetLastError() == WSAEWOULDBLOCK) ? EAGAIN : EIO;
+        return -1;
+    }
+
+    return xlen;
 }
 
 UHTTP_EXTERN ssize_t uhttp_send(uhttp_socket_t sock, const void* buffer, size_t len)
 {
-    return send(sock, buffer, len, 0);
+    int xlen = send(sock, buffer, (int)len, 0);
+
+    if (xlen == SOCKET_ERROR)
+    {
+        errno = (WSAGetLastError() == WSAEWOULDBLOCK) ? EAGAIN : EIO;
+        return -1;
+    }
+
+    return xlen;
+}
+
+#define UHTTP_SENDV_PARTS 16
+
+UHTTP_EXTERN ssize_t uhttp_sendv(uhttp_socket_t sock, const uhttp_str_t* parts, size_t nparts)
+{
+    WSABUF bufs[UHTTP_SENDV_PARTS];
+    DWORD xlen;
+
+    // Anything beyond the first parts is left for the next call.
+    if (nparts > UHTTP_SENDV_PARTS) nparts = UHTTP_SENDV_PARTS;
+
+    for (size_t i = 0; i < nparts; i++)
+    {
+        bufs[i].buf = (CHAR*)parts[i].ptr;
+        bufs[i].len = (ULONG)parts[i].len;
+    }
+
+    if (WSASend(sock, bufs, (DWORD)nparts, &xlen, 0, NULL, NULL) == SOCKET_ERROR)
+    {
+        errno = (WSAGetLastError() == WSAEWOULDBLOCK) ? EAGAIN : EIO;
+        return -1;
+    }
+
+    return xlen;
+}
+
+#define UHTTP_SENDFILE_CHUNK 16384
+
+UHTTP_EXTERN ssize_t uhttp_sendfile(uhttp_socket_t sock, int fd, int64_t offset, size_t len)
+{
+    // Bounce through a buffer, data the socket does not take is read again.
+    char buffer[UHTTP_SENDFILE_CHUNK];
+    HANDLE file = (HANDLE)_get_osfhandle(fd);
+    OVERLAPPED at;
+    DWORD xlen;
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    memset(&at, 0, sizeof(at));
+    at.Offset = (DWORD)offset;
+    at.OffsetHigh = (DWORD)(offset >> 32);
+
+    if (!ReadFile(file, buffer, (DWORD)(len < sizeof(buffer) ? len : sizeof(buffer)), &xlen, &at))
+    {
+        if (GetLastError() == ERROR_HANDLE_EOF) return 0;
+        errno = EIO;
+        return -1;
+    }
+
+    if (xlen == 0)
+    {
+        return 0;
+    }
+
+    return uhttp_send(sock, buffer, xlen);
+}
+
+UHTTP_EXTERN int uhttp_splice_open(uhttp_splice_t* pipe)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+UHTTP_EXTERN ssize_t uhttp_splice_in(uhttp_splice_t* pipe, uhttp_socket_t sock, size_t len)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+UHTTP_EXTERN ssize_t uhttp_splice_out(uhttp_splice_t* pipe, uhttp_socket_t sock)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+UHTTP_EXTERN void uhttp_splice_close(uhttp_splice_t* pipe)
+{
 }
 
 UHTTP_EXTERN void uhttp_close(uhttp_socket_t sock)
@@ -154,4 +415,76 @@ UHTTP_EXTERN void uhttp_close(uhttp_socket_t sock)
     closesocket(sock);
 }
 
+UHTTP_EXTERN int uhttp_wakeup_open(uhttp_wakeup_t* wakeup)
+{
+    // Winsock polls nothing but sockets, use a datagram socket talking to
+    // itself over loopback.
+    struct sockaddr_in addr;
+    int addrlen = sizeof(addr);
+    u_long nonblocking = 1;
+    uhttp_socket_t sck = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (sck == INVALID_SOCKET)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(sck, (struct sockaddr*)&addr, sizeof(addr)) ||
+        getsockname(sck, (struct sockaddr*)&addr, &addrlen) ||
+        connect(sck, (struct sockaddr*)&addr, sizeof(addr)) ||
+        ioctlsocket(sck, FIONBIO, &nonblocking))
+    {
+        closesocket(sck);
+        errno = EIO;
+        return -1;
+    }
+
+    wakeup->sock = wakeup->signal = sck;
+    return 0;
+}
+
+UHTTP_EXTERN void uhttp_wakeup_signal(uhttp_wakeup_t* wakeup)
+{
+    char one = 1;
+    send(wakeup->signal, &one, 1, 0);
+}
+
+UHTTP_EXTERN void uhttp_wakeup_drain(uhttp_wakeup_t* wakeup)
+{
+    char buffer[64];
+    while (recv(wakeup->sock, buffer, sizeof(buffer), 0) > 0)
+    {
+    }
+}
+
+UHTTP_EXTERN void uhttp_wakeup_close(uhttp_wakeup_t* wakeup)
+{
+    closesocket(wakeup->sock);
+    wakeup->sock = wakeup->signal = UHTTP_INVALID_SOCKET;
+}
+
+UHTTP_EXTERN int uhttp_thread_affinity(int cpu, int count)
+{
+    // Only the processor group of the thread can be selected.
+    int bits = (int)sizeof(DWORD_PTR) * 8;
+    if (cpu < 0 || count < 1 || cpu >= bits || count > bits - cpu)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    DWORD_PTR mask = (count == bits) ? ~(DWORD_PTR)0 : (((DWORD_PTR)1 << count) - 1) << cpu;
+    if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
 #endif
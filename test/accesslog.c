@@ -0,0 +1,207 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/accesslog.h"
+#include "../src/request.h"
+#include "test_common.h"
+
+#include <stdio.h>
+#include <string.h>
+#if !_WIN32
+#include <unistd.h>
+#endif
+
+static const char* uhttp_test_path = "uhttp_test_access.log";
+static const char* uhttp_test_rotated = "uhttp_test_access.log.1";
+
+/**
+ * Read a whole file into a buffer, null terminated.
+ */
+static size_t uhttp_test_read(const char* path, char* buffer, size_t cap)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return 0;
+
+    size_t len = fread(buffer, 1, cap - 1, file);
+    buffer[len] = '\0';
+    fclose(file);
+    return len;
+}
+
+static size_t uhttp_test_count_lines(const char* text)
+{
+    size_t n = 0;
+    for (; *text; text++) n += *text == '\n';
+    return n;
+}
+
+static void uhttp_test_request(uhttp_request_t* request)
+{
+    memset(request, 0, sizeof(*request));
+    request->method.ptr = "GET";
+    request->method.len = 3;
+    request->target.ptr = "/index.html";
+    request->target.len = 11;
+    request->version = 1;
+}
+
+// 1
+int uhttp_test_access_log_format()
+{
+    // Format records of an IPv4 and an IPv6 source, and of a request that
+    // could not be parsed.
+    // Assert:
+    //  Common Log Format lines, "-" in place of the request line.
+
+    uhttp_access_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.time = 1000000000;
+    record.bytes = 1234;
+    record.domain = UHTTP_SOCKET_DOMAIN_INET4;
+    record.address[0] = 192;
+    record.address[1] = 168;
+    record.address[2] = 0;
+    record.address[3] = 7;
+    record.status = 200;
+    record.version = 1;
+    record.methodlen = 3;
+    memcpy(record.method, "GET", 3);
+    record.targetlen = 2;
+    memcpy(record.target, "/a", 2);
+
+    char line[UHTTP_ACCESS_LOG_LINE_MAX];
+    size_t len = uhttp_access_log_format(&record, line);
+    int passed = len == strlen(line) &&
+        strcmp(line, "192.168.0.7 - - [09/Sep/2001:01:46:40 +0000] \"GET /a HTTP/1.1\" 200 1234\n") == 0;
+
+    record.domain = UHTTP_SOCKET_DOMAIN_INET6;
+    memset(record.address, 0, sizeof(record.address));
+    record.address[15] = 1;
+    record.status = 400;
+    record.bytes = 0;
+    record.methodlen = 0;
+    len = uhttp_access_log_format(&record, line);
+
+    return passed && len == strlen(line) &&
+        strcmp(line, "::1 - - [09/Sep/2001:01:46:40 +0000] \"-\" 400 0\n") == 0;
+}
+
+// 2
+int uhttp_test_access_log_drop()
+{
+    // Log more responses than the ring holds while the writer sleeps, then
+    // close the log.
+    // Assert:
+    //  The ring is written and the rest counted as dropped.
+
+    remove(uhttp_test_path);
+    uhttp_access_log_t* log = uhttp_access_log_open(uhttp_test_path, 0);
+    if (log == NULL) return 0;
+
+    uhttp_addr_t src;
+    memset(&src, 0, sizeof(src));
+    uhttp_request_t request;
+    uhttp_test_request(&request);
+
+    for (int i = 0; i < UHTTP_ACCESS_LOG_RECORDS + 3; i++)
+    {
+        uhttp_access_log_push(log, &src, &request, 200, i);
+    }
+    uhttp_access_log_close(log);
+
+    char text[4096];
+    uhttp_test_read(uhttp_test_path, text, sizeof(text));
+    remove(uhttp_test_path);
+
+    return strncmp(text, "# 3 records dropped\n", 20) == 0 &&
+        uhttp_test_count_lines(text) == UHTTP_ACCESS_LOG_RECORDS + 1 &&
+        strstr(text, "\"GET /index.html HTTP/1.1\" 200 0\n") != NULL;
+}
+
+// 3
+int uhttp_test_access_log_block()
+{
+    // Log more responses than the ring holds with the blocking policy.
+    // Assert:
+    //  Every response is written, in order.
+
+    remove(uhttp_test_path);
+    uhttp_access_log_t* log = uhttp_access_log_open(uhttp_test_path, UHTTP_ACCESS_LOG_BLOCK);
+    if (log == NULL) return 0;
+
+    uhttp_addr_t src;
+    memset(&src, 0, sizeof(src));
+    uhttp_request_t request;
+    uhttp_test_request(&request);
+
+    for (int i = 0; i < UHTTP_ACCESS_LOG_RECORDS * 3; i++)
+    {
+        uhttp_access_log_push(log, &src, &request, 200, i);
+    }
+    uhttp_access_log_close(log);
+
+    char text[8192];
+    uhttp_test_read(uhttp_test_path, text, sizeof(text));
+    remove(uhttp_test_path);
+
+    char last[32];
+    snprintf(last, sizeof(last), " 200 %d\n", UHTTP_ACCESS_LOG_RECORDS * 3 - 1);
+
+    return uhttp_test_count_lines(text) == UHTTP_ACCESS_LOG_RECORDS * 3 &&
+        strstr(text, " 200 0\n") == strchr(text, '\n') - 6 &&
+        strcmp(text + strlen(text) - strlen(last), last) == 0;
+}
+
+// 4
+int uhttp_test_access_log_reopen()
+{
+    // Move the log file away, request a reopen and log a response.
+    // Assert:
+    //  The response goes to a new file at the original path.
+
+    remove(uhttp_test_path);
+    remove(uhttp_test_rotated);
+    uhttp_access_log_t* log = uhttp_access_log_open(uhttp_test_path, 0);
+    if (log == NULL) return 0;
+
+    uhttp_addr_t src;
+    memset(&src, 0, sizeof(src));
+    uhttp_request_t request;
+    uhttp_test_request(&request);
+
+    uhttp_access_log_push(log, &src, &request, 200, 1);
+#if !_WIN32
+    usleep(3 * UHTTP_ACCESS_LOG_INTERVAL * 1000);
+#endif
+    rename(uhttp_test_path, uhttp_test_rotated);
+    uhttp_access_log_reopen();
+#if !_WIN32
+    usleep(3 * UHTTP_ACCESS_LOG_INTERVAL * 1000);
+#endif
+    uhttp_access_log_push(log, &src, &request, 404, 2);
+    uhttp_access_log_close(log);
+
+    char rotated[1024], text[1024];
+    uhttp_test_read(uhttp_test_rotated, rotated, sizeof(rotated));
+    uhttp_test_read(uhttp_test_path, text, sizeof(text));
+    remove(uhttp_test_path);
+    remove(uhttp_test_rotated);
+
+    return uhttp_test_count_lines(rotated) == 1 && strstr(rotated, " 200 1\n") &&
+        uhttp_test_count_lines(text) == 1 && strstr(text, " 404 2\n");
+}
+
+const test_t uhttp_test_access_log[] = {
+    { .name = "Format records.", .func = uhttp_test_access_log_format },
+    { .name = "Drop records while the ring is full.", .func = uhttp_test_access_log_drop },
+    { .name = "Wait for the writer while the ring is full.", .func = uhttp_test_access_log_block },
+    { .name = "Reopen rotated files.", .func = uhttp_test_access_log_reopen },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_access_log);
+}
+#endif
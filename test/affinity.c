@@ -0,0 +1,58 @@
+#define _GNU_SOURCE
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "test_common.h"
+
+#include <errno.h>
+#if __linux__
+#include <sched.h>
+#endif
+
+// 1
+int uhttp_test_affinity_invalid()
+{
+    // Pin to negative, empty and out of range CPU sets.
+    // Assert:
+    //  retval == -1, errno == EINVAL
+
+    int cases[][2] = { { -1, 1 }, { 0, 0 }, { 0, -4 }, { 1 << 20, 1 } };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        if (uhttp_thread_affinity(cases[i][0], cases[i][1]) != -1 || errno != EINVAL) return 0;
+    }
+
+    return 1;
+}
+
+// 2
+int uhttp_test_affinity_pin()
+{
+    // Pin to the CPU the thread runs on.
+    // Assert:
+    //  retval == 0 and the thread stays on that CPU, or ENOSYS where
+    //  threads cannot be pinned.
+
+#if __linux__
+    int cpu = sched_getcpu();
+    if (cpu < 0) return 0;
+
+    return uhttp_thread_affinity(cpu, 1) == 0 && sched_getcpu() == cpu;
+#else
+    return uhttp_thread_affinity(0, 1) == 0 || errno == ENOSYS;
+#endif
+}
+
+const test_t uhttp_test_affinity[] = {
+    { .name = "Reject invalid CPU sets.", .func = uhttp_test_affinity_invalid },
+    { .name = "Pin the calling thread.", .func = uhttp_test_affinity_pin },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_affinity);
+}
+#endif
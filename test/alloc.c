@@ -0,0 +1,178 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/alloc.h"
+#include "test_common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char site_a[] = "a.c";
+static const char site_b[] = "b.c";
+
+static uhttp_alloc_stats_t stats[UHTTP_ALLOC_SITES + 1];
+
+/**
+ * Find the counters of a call site.
+ */
+static const uhttp_alloc_stats_t* uhttp_test_site(const char* file, int line)
+{
+    int n = uhttp_alloc_stats(stats, UHTTP_ALLOC_SITES + 1);
+    for (int i = 0; i < n; i++)
+    {
+        if (stats[i].file == file && stats[i].line == line) return &stats[i];
+    }
+
+    return NULL;
+}
+
+// 1
+int uhttp_test_alloc_count()
+{
+    // Allocate and free blocks at two call sites.
+    // Assert:
+    //  Counts, bytes and live objects are kept per site, blocks are aligned.
+
+    void* a1 = uhttp_alloc_malloc(100, site_a, 1);
+    void* a2 = uhttp_alloc_calloc(10, 4, site_a, 1);
+    void* b1 = uhttp_alloc_malloc(7, site_b, 1);
+
+    int ok =
+        a1 && a2 && b1 &&
+        (uintptr_t)a1 % sizeof(void*) == 0 &&
+        memcmp(a2, "\0\0\0\0\0\0\0\0", 8) == 0;
+
+    uhttp_alloc_free(a1);
+    uhttp_alloc_free(NULL);
+
+    const uhttp_alloc_stats_t* a = uhttp_test_site(site_a, 1);
+    ok = ok && a &&
+        a->allocs == 2 && a->frees == 1 && a->bytes == 140 &&
+        a->live == 1 && a->live_bytes == 40;
+
+    const uhttp_alloc_stats_t* b = uhttp_test_site(site_b, 1);
+    ok = ok && b &&
+        b->allocs == 1 && b->frees == 0 && b->live == 1 && b->live_bytes == 7;
+
+    uhttp_alloc_free(a2);
+    uhttp_alloc_free(b1);
+    return ok;
+}
+
+// 2
+int uhttp_test_alloc_realloc()
+{
+    // Grow a block from another call site.
+    // Assert:
+    //  The block moves to the resizing site, its contents are kept.
+
+    char* ptr = uhttp_alloc_realloc(NULL, 4, site_a, 2);
+    if (ptr == NULL) return 0;
+    memcpy(ptr, "abc", 4);
+
+    char* xptr = uhttp_alloc_realloc(ptr, 4096, site_b, 2);
+    if (xptr == NULL) return 0;
+
+    const uhttp_alloc_stats_t* a = uhttp_test_site(site_a, 2);
+    int ok = strcmp(xptr, "abc") == 0 && a && a->allocs == 1 && a->frees == 1 && a->live == 0;
+
+    const uhttp_alloc_stats_t* b = uhttp_test_site(site_b, 2);
+    ok = ok && b && b->allocs == 1 && b->live == 1 && b->live_bytes == 4096;
+
+    uhttp_alloc_free(xptr);
+    b = uhttp_test_site(site_b, 2);
+    return ok && b && b->live == 0 && b->live_bytes == 0;
+}
+
+// 3
+int uhttp_test_alloc_overflow()
+{
+    // Allocate from more call sites than there are entries.
+    // Assert:
+    //  Extra sites share an entry without a location, nothing is lost.
+
+    for (int line = 100; line < 100 + UHTTP_ALLOC_SITES; line++)
+    {
+        uhttp_alloc_free(uhttp_alloc_malloc(1, site_a, line));
+    }
+
+    uint64_t allocs = 0;
+    int anonymous = 0;
+    int n = uhttp_alloc_stats(stats, UHTTP_ALLOC_SITES + 1);
+    for (int i = 0; i < n; i++)
+    {
+        if (stats[i].file == site_a && stats[i].line >= 100) allocs += stats[i].allocs;
+        if (stats[i].file == NULL)
+        {
+            allocs += stats[i].allocs;
+            anonymous = 1;
+        }
+    }
+
+    return n == UHTTP_ALLOC_SITES + 1 && anonymous && allocs == UHTTP_ALLOC_SITES &&
+        uhttp_alloc_stats(NULL, 0) == n;
+}
+
+static int hooked;
+
+static void* uhttp_test_malloc(void* context, size_t size)
+{
+    (*(int*)context)++;
+    return malloc(size);
+}
+
+static void* uhttp_test_realloc(void* context, void* ptr, size_t size)
+{
+    (*(int*)context)++;
+    return realloc(ptr, size);
+}
+
+static void uhttp_test_free(void* context, void* ptr)
+{
+    (*(int*)context)++;
+    free(ptr);
+}
+
+// 4
+int uhttp_test_alloc_hooks()
+{
+    // Replace the allocator, then restore the default.
+    // Assert:
+    //  Every call goes through the hooks with their context, incomplete
+    //  hooks select the default.
+
+    uhttp_allocator_t allocator = { uhttp_test_malloc, uhttp_test_realloc, uhttp_test_free, &hooked };
+    uhttp_allocator_t current;
+
+    uhttp_alloc_set(&allocator);
+    uhttp_alloc_get(&current);
+    int ok = current.context == &hooked;
+
+    void* ptr = uhttp_alloc_calloc(2, 8, site_a, 3);
+    ptr = uhttp_alloc_realloc(ptr, 32, site_a, 3);
+    uhttp_alloc_free(ptr);
+    ok = ok && ptr && hooked == 3;
+
+    allocator.free_func = NULL;
+    uhttp_alloc_set(&allocator);
+    uhttp_alloc_get(&current);
+    uhttp_alloc_free(uhttp_alloc_malloc(8, site_a, 3));
+
+    return ok && hooked == 3 && current.context == NULL && current.malloc_func != uhttp_test_malloc;
+}
+
+const test_t uhttp_test_alloc[] = {
+    { .name = "Count allocations per call site.", .func = uhttp_test_alloc_count },
+    { .name = "Count resized blocks.", .func = uhttp_test_alloc_realloc },
+    { .name = "Share an entry beyond the site limit.", .func = uhttp_test_alloc_overflow },
+    { .name = "Allocate through hooks.", .func = uhttp_test_alloc_hooks },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_alloc);
+}
+#endif
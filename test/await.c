@@ -0,0 +1,460 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "clock.h"
+#include "test_common.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uhttp_addr_t server_addr;
+static uhttp_transport_t* test_transport;
+
+/**
+ * Create a server on an in-memory transport, its polls sleep up to a second
+ * unless a wait ends earlier.
+ */
+static uhttp_server_t* uhttp_test_server(uhttp_transport_t* transport)
+{
+    uhttp_server_t* sv = uhttp_create();
+    if (sv == NULL) return NULL;
+
+    uhttp_option_arg_t arg;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.domain = UHTTP_SOCKET_DOMAIN_INET4;
+    server_addr.port = 8080;
+    server_addr.address[0] = 127;
+    server_addr.address[3] = 1;
+    arg.addr = server_addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+    arg.integer = 1000;
+    uhttp_setoption(sv, UHTTP_OPTION_POLL_TIMEOUT, &arg);
+
+    return sv;
+}
+
+/**
+ * Connect a pair of in-memory sockets for handlers to wait on.
+ */
+static int uhttp_test_pair(uhttp_transport_t* transport, uhttp_socket_t pair[2])
+{
+    uhttp_addr_t addr = server_addr, src;
+    addr.port = 9090;
+
+    uhttp_socket_t listener = transport->listen(transport, &addr, 1);
+    if (listener == UHTTP_INVALID_SOCKET) return -1;
+
+    pair[1] = uhttp_memory_connect(transport, &addr);
+    pair[0] = transport->accept(transport, listener, &src);
+    transport->close(transport, listener);
+
+    return (pair[0] == UHTTP_INVALID_SOCKET || pair[1] == UHTTP_INVALID_SOCKET) ? -1 : 0;
+}
+
+/**
+ * Poll until a response of a length arrived or the polls run out, return
+ * the bytes received.
+ */
+static size_t uhttp_test_wait(uhttp_server_t* sv, uhttp_transport_t* transport, uhttp_socket_t sock,
+    char* response, size_t len, int polls)
+{
+    size_t received = 0;
+    for (int i = 0; i < polls && received < len; i++)
+    {
+        uhttp_pollevents(sv);
+        ssize_t n = transport->recv(transport, sock, response + received, len - received);
+        if (n > 0) received += n;
+    }
+    return received;
+}
+
+static uhttp_event_t test_events[4];
+static int test_resumed;
+
+static void uhttp_test_timer_handler(uhttp_request_t* request, void* user)
+{
+    int* steps = uhttp_await_locals(request);
+
+    UHTTP_AWAIT_BEGIN(request);
+    *steps = 0;
+
+    UHTTP_AWAIT(request, uhttp_await_timer(request, 30));
+    test_events[(*steps)++] = uhttp_await_events(request);
+    test_resumed++;
+
+    UHTTP_AWAIT(request, uhttp_await_timer(request, 0));
+    test_events[(*steps)++] = uhttp_await_events(request);
+    test_resumed++;
+
+    char body = '0' + *steps;
+    uhttp_respond(request, 200, NULL, &body, 1);
+    UHTTP_AWAIT_END(request);
+}
+
+// 1
+int uhttp_test_await_timer()
+{
+    // Suspend a handler on a timer twice, keeping a count in its locals.
+    // Assert:
+    //  Nothing is answered before the first deadline, the poll sleeps until
+    //  it, then the handler continues after each wait in turn.
+    //  Timed out waits report no events and the locals survive.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(2, 256);
+    uhttp_server_t* sv = uhttp_test_server(transport);
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_route_t route = { .path = "/", .handler = uhttp_test_timer_handler };
+    uhttp_addroute(sv, &route);
+
+    static const char expect[] = "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\n2";
+    char response[sizeof(expect)];
+    int ok = 0;
+
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (sock = uhttp_memory_connect(transport, &server_addr)) == UHTTP_INVALID_SOCKET) goto done;
+
+    test_resumed = 0;
+    memset(test_events, 0xFF, sizeof(test_events));
+    transport->send(transport, sock, "GET / HTTP/1.1\r\n\r\n", 18);
+
+    uint64_t start = uhttp_clock_ms();
+    uhttp_pollevents(sv);
+    uhttp_pollevents(sv);
+    if (test_resumed != 0 || transport->recv(transport, sock, response, sizeof(response)) != -1) goto done;
+
+    size_t len = uhttp_test_wait(sv, transport, sock, response, sizeof(expect) - 1, 10);
+    ok = len == sizeof(expect) - 1 && memcmp(response, expect, len) == 0 &&
+        uhttp_clock_ms() - start >= 30 && test_resumed == 2 && test_events[0] == 0 && test_events[1] == 0;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+static void uhttp_test_socket_handler(uhttp_request_t* request, void* user)
+{
+    uhttp_socket_t sock = *(uhttp_socket_t*)user;
+    char byte;
+
+    UHTTP_AWAIT_BEGIN(request);
+    UHTTP_AWAIT(request, uhttp_await_socket(request, sock, UHTTP_EVENT_RECEIVE, -1));
+    test_events[0] = uhttp_await_events(request);
+    test_resumed++;
+
+    if (test_transport->recv(test_transport, sock, &byte, 1) != 1) byte = '-';
+    uhttp_respond(request, 200, NULL, &byte, 1);
+    UHTTP_AWAIT_END(request);
+}
+
+// 2
+int uhttp_test_await_socket()
+{
+    // Suspend a handler on a socket without a timeout, then make the socket
+    // readable.
+    // Assert:
+    //  The handler waits as long as the socket has nothing to read, then
+    //  continues with UHTTP_EVENT_RECEIVE and answers with the byte read.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(2, 256);
+    uhttp_server_t* sv = uhttp_test_server(transport);
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_socket_t pair[2] = { UHTTP_INVALID_SOCKET, UHTTP_INVALID_SOCKET };
+    uhttp_route_t route = { .path = "/", .handler = uhttp_test_socket_handler, .user = &pair[0] };
+    uhttp_addroute(sv, &route);
+
+    static const char expect[] = "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nx";
+    char response[sizeof(expect)];
+    int ok = 0;
+
+    // Polls return at once while the handler waits, only the timeout ends
+    // them otherwise.
+    uhttp_option_arg_t arg = { .integer = 0 };
+    uhttp_setoption(sv, UHTTP_OPTION_POLL_TIMEOUT, &arg);
+
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || uhttp_test_pair(transport, pair) ||
+        (sock = uhttp_memory_connect(transport, &server_addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    test_transport = transport;
+    test_resumed = 0;
+    transport->send(transport, sock, "GET / HTTP/1.1\r\n\r\n", 18);
+
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+    if (test_resumed != 0 || transport->recv(transport, sock, response, sizeof(response)) != -1) goto done;
+
+    transport->send(transport, pair[1], "x", 1);
+    size_t len = uhttp_test_wait(sv, transport, sock, response, sizeof(expect) - 1, 10);
+    ok = len == sizeof(expect) - 1 && memcmp(response, expect, len) == 0 &&
+        test_resumed == 1 && test_events[0] == UHTTP_EVENT_RECEIVE;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    uhttp_destroy(sv);
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (pair[i] != UHTTP_INVALID_SOCKET) transport->close(transport, pair[i]);
+    }
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+static void uhttp_test_body_handler(uhttp_request_t* request, void* user)
+{
+    size_t* len = uhttp_await_locals(request);
+    char* body = (char*)(len + 1);
+    ssize_t n;
+
+    UHTTP_AWAIT_BEGIN(request);
+    *len = 0;
+
+    while ((n = uhttp_request_read(request, body + *len, 16 - *len)) != 0)
+    {
+        if (n > 0)
+        {
+            *len += n;
+            continue;
+        }
+        else if (errno != EAGAIN)
+        {
+            uhttp_respond(request, 400, NULL, NULL, 0);
+            return;
+        }
+
+        UHTTP_AWAIT(request, uhttp_await_body(request, -1));
+        test_events[0] = uhttp_await_events(request);
+        test_resumed++;
+    }
+
+    uhttp_respond(request, 200, NULL, body, *len);
+    UHTTP_AWAIT_END(request);
+}
+
+// 3
+int uhttp_test_await_body()
+{
+    // Send the head of a request and half of its body, then the rest.
+    // Assert:
+    //  The handler reads the first half and suspends, continues with
+    //  UHTTP_EVENT_RECEIVE once the rest arrives and echoes the whole body.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(2, 256);
+    uhttp_server_t* sv = uhttp_test_server(transport);
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_route_t route = { .path = "/", .handler = uhttp_test_body_handler };
+    uhttp_addroute(sv, &route);
+
+    static const char head[] = "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n01234";
+    static const char expect[] = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n0123456789";
+    char response[sizeof(expect)];
+    int ok = 0;
+
+    uhttp_option_arg_t arg = { .integer = 0 };
+    uhttp_setoption(sv, UHTTP_OPTION_POLL_TIMEOUT, &arg);
+
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (sock = uhttp_memory_connect(transport, &server_addr)) == UHTTP_INVALID_SOCKET) goto done;
+
+    test_resumed = 0;
+    transport->send(transport, sock, head, sizeof(head) - 1);
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+    if (test_resumed != 0 || transport->recv(transport, sock, response, sizeof(response)) != -1) goto done;
+
+    transport->send(transport, sock, "56789", 5);
+    size_t len = uhttp_test_wait(sv, transport, sock, response, sizeof(expect) - 1, 10);
+    ok = len == sizeof(expect) - 1 && memcmp(response, expect, len) == 0 &&
+        test_resumed == 1 && test_events[0] == UHTTP_EVENT_RECEIVE;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+static int test_order[3];
+
+static void uhttp_test_order_handler(uhttp_request_t* request, void* user)
+{
+    UHTTP_AWAIT_BEGIN(request);
+    UHTTP_AWAIT(request, uhttp_await_timer(request, (int)(intptr_t)user));
+    test_order[test_resumed++] = (int)(intptr_t)user;
+    uhttp_respond(request, 204, NULL, NULL, 0);
+    UHTTP_AWAIT_END(request);
+}
+
+// 4
+int uhttp_test_await_order()
+{
+    // Suspend three handlers on timers of 40, 10 and 0 milliseconds, in that
+    // order.
+    // Assert:
+    //  They continue by deadline, not by the order they suspended in.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 256);
+    uhttp_server_t* sv = uhttp_test_server(transport);
+    if (transport == NULL || sv == NULL) return 0;
+
+    static const int timeouts[3] = { 40, 10, 0 };
+    static const char* paths[3] = { "/40", "/10", "/0" };
+    uhttp_socket_t socks[3] = { UHTTP_INVALID_SOCKET, UHTTP_INVALID_SOCKET, UHTTP_INVALID_SOCKET };
+    int ok = 0;
+
+    for (size_t i = 0; i < 3; i++)
+    {
+        uhttp_route_t route = { .path = paths[i], .handler = uhttp_test_order_handler, .user = (void*)(intptr_t)timeouts[i] };
+        uhttp_addroute(sv, &route);
+    }
+
+    if (uhttp_start(sv)) goto done;
+
+    test_resumed = 0;
+    for (size_t i = 0; i < 3; i++)
+    {
+        char request[64];
+        int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\n\r\n", paths[i]);
+        if ((socks[i] = uhttp_memory_connect(transport, &server_addr)) == UHTTP_INVALID_SOCKET) goto done;
+        transport->send(transport, socks[i], request, len);
+    }
+
+    for (int i = 0; i < 20 && test_resumed < 3; i++) uhttp_pollevents(sv);
+
+    ok = test_resumed == 3 && test_order[0] == 0 && test_order[1] == 10 && test_order[2] == 40;
+
+done:
+    for (size_t i = 0; i < 3; i++)
+    {
+        if (socks[i] != UHTTP_INVALID_SOCKET) transport->close(transport, socks[i]);
+    }
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+static int test_allocated;
+static int test_again;
+
+static void uhttp_test_cancel_handler(uhttp_request_t* request, void* user)
+{
+    char** buffer = uhttp_await_locals(request);
+
+    UHTTP_AWAIT_BEGIN(request);
+    if ((*buffer = malloc(64)) == NULL)
+    {
+        uhttp_respond(request, 503, NULL, NULL, 0);
+        return;
+    }
+    test_allocated++;
+
+    UHTTP_AWAIT(request, uhttp_await_socket(request, *(uhttp_socket_t*)user, UHTTP_EVENT_RECEIVE, -1));
+    test_events[0] = uhttp_await_events(request);
+    test_resumed++;
+
+    // Cancelled, it cannot wait again.
+    test_again = uhttp_await_timer(request, 0) == 0 && errno == ECANCELED;
+
+    free(*buffer);
+    test_allocated--;
+    uhttp_respond(request, 200, NULL, NULL, 0);
+    UHTTP_AWAIT_END(request);
+}
+
+/**
+ * Suspend the cancel handler and end its wait one of three ways: closing the
+ * connection, stopping the server or destroying it.
+ * @return Non-zero if the handler was cancelled once and freed its buffer.
+ */
+static int uhttp_test_cancel(int how)
+{
+    uhttp_transport_t* transport = uhttp_memory_transport_create(2, 256);
+    uhttp_server_t* sv = uhttp_test_server(transport);
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_socket_t pair[2] = { UHTTP_INVALID_SOCKET, UHTTP_INVALID_SOCKET };
+    uhttp_route_t route = { .path = "/", .handler = uhttp_test_cancel_handler, .user = &pair[0] };
+    uhttp_addroute(sv, &route);
+
+    uhttp_option_arg_t arg = { .integer = 0 };
+    uhttp_setoption(sv, UHTTP_OPTION_POLL_TIMEOUT, &arg);
+
+    int ok = 0;
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || uhttp_test_pair(transport, pair) ||
+        (sock = uhttp_memory_connect(transport, &server_addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    test_allocated = 0;
+    test_resumed = 0;
+    test_again = 0;
+    transport->send(transport, sock, "GET / HTTP/1.1\r\n\r\n", 18);
+    for (int i = 0; i < 5; i++) uhttp_pollevents(sv);
+    if (test_allocated != 1 || test_resumed != 0) goto done;
+
+    if (how == 0)
+    {
+        // The connection is the only one, it has to be free again too.
+        transport->close(transport, sock);
+        sock = UHTTP_INVALID_SOCKET;
+        for (int i = 0; i < 5; i++) uhttp_pollevents(sv);
+        if ((sock = uhttp_memory_connect(transport, &server_addr)) == UHTTP_INVALID_SOCKET) goto done;
+    }
+    else if (how == 1)
+    {
+        uhttp_stop(sv);
+    }
+    else
+    {
+        uhttp_destroy(sv);
+        sv = NULL;
+    }
+
+    ok = test_resumed == 1 && test_allocated == 0 && test_events[0] == UHTTP_EVENT_HANGUP && test_again;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    if (sv) uhttp_destroy(sv);
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (pair[i] != UHTTP_INVALID_SOCKET) transport->close(transport, pair[i]);
+    }
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+// 5
+int uhttp_test_await_cancel()
+{
+    // Suspend a handler on a socket that never becomes ready and without a
+    // timeout, then close its connection, stop the server or destroy it.
+    // Assert:
+    //  Each time the handler continues once with UHTTP_EVENT_HANGUP, cannot
+    //  wait again and frees its buffer. A closed connection frees its slot.
+
+    return uhttp_test_cancel(0) && uhttp_test_cancel(1) && uhttp_test_cancel(2);
+}
+
+const test_t uhttp_test_await[] = {
+    { .name = "Continue after timers.", .func = uhttp_test_await_timer },
+    { .name = "Continue when a socket is ready.", .func = uhttp_test_await_socket },
+    { .name = "Continue when more body arrives.", .func = uhttp_test_await_body },
+    { .name = "Continue timers by deadline.", .func = uhttp_test_await_order },
+    { .name = "Cancel suspended handlers.", .func = uhttp_test_await_cancel },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_await);
+}
+#endif
@@ -0,0 +1,223 @@
+#define _UHTTP_INTERNAL_
+#include "../src/cache.h"
+#include "test_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uhttp_cache_t cache;
+
+#define KEY(str) (str), sizeof(str) - 1
+
+static char* response(size_t len)
+{
+    char* data = malloc(len);
+    memset(data, 'x', len);
+    return data;
+}
+
+// 1
+int uhttp_test_cache_miss()
+{
+    // Look up a key in an empty cache.
+    // Assert:
+    //  retval == NULL
+
+    uhttp_cache_create(&cache, 4096);
+
+    return uhttp_cache_get(&cache, KEY("GET /"), 0) == NULL;
+}
+
+// 2
+int uhttp_test_cache_pending()
+{
+    // Begin an entry and look it up before it is filled.
+    // Assert:
+    //  The same entry is found, pending and referenced twice.
+
+    uhttp_cache_create(&cache, 4096);
+    uhttp_cache_entry_t* entry = uhttp_cache_begin(&cache, KEY("GET /"));
+
+    int ok =
+        entry != NULL &&
+        uhttp_cache_get(&cache, KEY("GET /"), 1000) == entry &&
+        entry->pending == 1 &&
+        entry->refs == 2;
+
+    uhttp_cache_release(entry);
+    uhttp_cache_clear(&cache);
+
+    return ok && cache.size == 0 && cache.newest == NULL;
+}
+
+// 3
+int uhttp_test_cache_fill()
+{
+    // Fill an entry and look it up before and after it expires.
+    // Assert:
+    //  Found with its data while fresh, not found once stale.
+
+    uhttp_cache_create(&cache, 4096);
+    uhttp_cache_entry_t* entry = uhttp_cache_begin(&cache, KEY("GET /"));
+    uhttp_cache_fill(&cache, entry, response(100), 100, 40, 1100, 1000);
+    uhttp_cache_release(entry);
+
+    int ok =
+        entry->pending == 0 &&
+        uhttp_cache_get(&cache, KEY("GET /"), 1099) == entry &&
+        entry->len == 100 && entry->headlen == 40 &&
+        uhttp_cache_get(&cache, KEY("GET /x"), 1099) == NULL;
+
+    return
+        ok &&
+        uhttp_cache_get(&cache, KEY("GET /"), 1100) == NULL &&
+        cache.size == 0;
+}
+
+// 4
+int uhttp_test_cache_not_retained()
+{
+    // Fill entries that are stale already or larger than the budget.
+    // Assert:
+    //  Neither stays in the cache, the references stay valid.
+
+    uhttp_cache_create(&cache, 1024);
+    uhttp_cache_entry_t* stale = uhttp_cache_begin(&cache, KEY("GET /a"));
+    uhttp_cache_entry_t* large = uhttp_cache_begin(&cache, KEY("GET /b"));
+    uhttp_cache_fill(&cache, stale, response(10), 10, 5, 1000, 1000);
+    uhttp_cache_fill(&cache, large, response(2048), 2048, 5, 2000, 1000);
+
+    int ok =
+        uhttp_cache_get(&cache, KEY("GET /a"), 1000) == NULL &&
+        uhttp_cache_get(&cache, KEY("GET /b"), 1000) == NULL &&
+        stale->cached == 0 && stale->len == 10 &&
+        large->cached == 0 && large->len == 2048 &&
+        cache.size == 0;
+
+    uhttp_cache_release(stale);
+    uhttp_cache_release(large);
+
+    return ok;
+}
+
+// 5
+int uhttp_test_cache_evict()
+{
+    // Fill three entries where only two fit, after using the oldest.
+    // Assert:
+    //  The least recently used entry is evicted.
+
+    size_t budget = 2 * (sizeof(uhttp_cache_entry_t) + 6 + 256) + 128;
+    uhttp_cache_create(&cache, budget);
+
+    uhttp_cache_entry_t* a = uhttp_cache_begin(&cache, KEY("GET /a"));
+    uhttp_cache_fill(&cache, a, response(256), 256, 10, 5000, 1000);
+    uhttp_cache_release(a);
+
+    uhttp_cache_entry_t* b = uhttp_cache_begin(&cache, KEY("GET /b"));
+    uhttp_cache_fill(&cache, b, response(256), 256, 10, 5000, 1000);
+    uhttp_cache_release(b);
+
+    uhttp_cache_get(&cache, KEY("GET /a"), 1000);
+
+    uhttp_cache_entry_t* c = uhttp_cache_begin(&cache, KEY("GET /c"));
+    uhttp_cache_fill(&cache, c, response(256), 256, 10, 5000, 1000);
+    uhttp_cache_release(c);
+
+    int ok =
+        uhttp_cache_get(&cache, KEY("GET /a"), 1000) != NULL &&
+        uhttp_cache_get(&cache, KEY("GET /b"), 1000) == NULL &&
+        uhttp_cache_get(&cache, KEY("GET /c"), 1000) != NULL &&
+        cache.size <= budget;
+
+    uhttp_cache_clear(&cache);
+
+    return ok && cache.size == 0;
+}
+
+// 6
+int uhttp_test_cache_evict_skips_pending()
+{
+    // Fill an entry that needs the space of a pending one.
+    // Assert:
+    //  The pending entry stays, the new one is not retained.
+
+    size_t budget = sizeof(uhttp_cache_entry_t) * 2 + 64;
+    uhttp_cache_create(&cache, budget);
+
+    uhttp_cache_entry_t* pending = uhttp_cache_begin(&cache, KEY("GET /a"));
+    uhttp_cache_entry_t* filled = uhttp_cache_begin(&cache, KEY("GET /b"));
+    uhttp_cache_fill(&cache, filled, response(60), 60, 10, 5000, 1000);
+
+    int ok =
+        uhttp_cache_get(&cache, KEY("GET /a"), 1000) == pending &&
+        pending->pending == 1 &&
+        cache.size <= budget;
+
+    uhttp_cache_release(filled);
+    uhttp_cache_release(pending);
+    uhttp_cache_clear(&cache);
+
+    return ok && cache.size == 0;
+}
+
+// 7
+int uhttp_test_cache_abandon()
+{
+    // Begin an entry that a request waits for, then remove it while pending
+    // as when its handler never answers.
+    // Assert:
+    //  The key misses and can be begun again, the abandoned entry stays
+    //  valid for its references and its waiters.
+
+    uhttp_cache_create(&cache, 4096);
+    uhttp_cache_entry_t* abandoned = uhttp_cache_begin(&cache, KEY("GET /"));
+    if (abandoned == NULL) return 0;
+
+    void* waiter = &cache;
+    uhttp_list_append(&abandoned->waiters, &waiter);
+    abandoned->refs++;
+
+    uhttp_cache_remove(&cache, abandoned);
+
+    int ok =
+        uhttp_cache_get(&cache, KEY("GET /"), 1000) == NULL &&
+        abandoned->cached == 0 &&
+        abandoned->refs == 2 &&
+        abandoned->waiters.nlen == 1 &&
+        cache.size == 0;
+
+    uhttp_cache_entry_t* entry = uhttp_cache_begin(&cache, KEY("GET /"));
+    ok = ok && entry != NULL && entry != abandoned;
+    if (entry)
+    {
+        uhttp_cache_fill(&cache, entry, response(10), 10, 5, 2000, 1000);
+        ok = ok && uhttp_cache_get(&cache, KEY("GET /"), 1000) == entry;
+        uhttp_cache_release(entry);
+    }
+
+    uhttp_cache_release(abandoned);
+    uhttp_cache_release(abandoned);
+    uhttp_cache_clear(&cache);
+
+    return ok && cache.size == 0 && cache.newest == NULL;
+}
+
+const test_t uhttp_test_cache[] = {
+    { .name = "Get from empty cache misses.", .func = uhttp_test_cache_miss },
+    { .name = "Get finds pending entry.", .func = uhttp_test_cache_pending },
+    { .name = "Get finds filled entry until it expires.", .func = uhttp_test_cache_fill },
+    { .name = "Fill does not retain stale or oversized responses.", .func = uhttp_test_cache_not_retained },
+    { .name = "Fill evicts least recently used entry.", .func = uhttp_test_cache_evict },
+    { .name = "Fill does not evict pending entries.", .func = uhttp_test_cache_evict_skips_pending },
+    { .name = "Remove abandons a pending entry.", .func = uhttp_test_cache_abandon },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_cache);
+}
+#endif
@@ -0,0 +1,188 @@
+#define _UHTTP_INTERNAL_
+#include "../src/conditional.h"
+#include "test_common.h"
+
+#include <string.h>
+
+uhttp_request_t request;
+
+#define STR(str) { (str), sizeof(str) - 1 }
+#define PARSE(str) uhttp_request_parse(&request, (str), sizeof(str) - 1)
+
+// 1
+int uhttp_test_date_parse()
+{
+    // Parse IMF-fixdates and malformed dates.
+    // Assert:
+    //  Valid dates give seconds since the epoch, others -1.
+
+    uhttp_str_t epoch = STR("Thu, 01 Jan 1970 00:00:00 GMT");
+    uhttp_str_t rfc = STR("Sun, 06 Nov 1994 08:49:37 GMT");
+    uhttp_str_t leap = STR("Thu, 29 Feb 2024 23:59:59 GMT");
+    uhttp_str_t rfc850 = STR("Sunday, 06-Nov-94 08:49:37 GMT");
+    uhttp_str_t month = STR("Sun, 06 Foo 1994 08:49:37 GMT");
+    uhttp_str_t hour = STR("Sun, 06 Nov 1994 24:49:37 GMT");
+
+    return
+        uhttp_date_parse(&epoch) == 0 &&
+        uhttp_date_parse(&rfc) == 784111777 &&
+        uhttp_date_parse(&leap) == 1709251199 &&
+        uhttp_date_parse(&rfc850) == -1 &&
+        uhttp_date_parse(&month) == -1 &&
+        uhttp_date_parse(&hour) == -1;
+}
+
+// 2
+int uhttp_test_date_format()
+{
+    // Format dates, including the weekday.
+    // Assert:
+    //  Output matches the IMF-fixdate.
+
+    char buffer[UHTTP_DATE_LEN + 1];
+
+    uhttp_date_format(buffer, 784111777);
+    if (strcmp(buffer, "Sun, 06 Nov 1994 08:49:37 GMT")) return 0;
+
+    uhttp_date_format(buffer, 1709251199);
+    if (strcmp(buffer, "Thu, 29 Feb 2024 23:59:59 GMT")) return 0;
+
+    uhttp_date_format(buffer, 0);
+    return strcmp(buffer, "Thu, 01 Jan 1970 00:00:00 GMT") == 0;
+}
+
+// 3
+int uhttp_test_etag_match()
+{
+    // Match If-None-Match lists against entity tags.
+    // Assert:
+    //  Weak comparison, "*" matches anything.
+
+    uhttp_str_t etag = STR("\"abc\"");
+    uhttp_str_t weak = STR("W/\"abc\"");
+    uhttp_str_t list = STR("\"xyz\", W/\"abc\"");
+    uhttp_str_t other = STR("\"xyz\" , \"ab\"");
+    uhttp_str_t any = STR("*");
+
+    return
+        uhttp_etag_match(&list, &etag) &&
+        uhttp_etag_match(&list, &weak) &&
+        !uhttp_etag_match(&other, &etag) &&
+        uhttp_etag_match(&any, &etag) &&
+        uhttp_etag_match(&any, NULL) &&
+        !uhttp_etag_match(&list, NULL);
+}
+
+// 4
+int uhttp_test_not_modified()
+{
+    // Evaluate preconditions of parsed requests.
+    // Assert:
+    //  If-None-Match takes precedence over If-Modified-Since, only GET and
+    //  HEAD are answered with 304.
+
+    uhttp_str_t etag = STR("\"v1\"");
+
+    if (PARSE("GET / HTTP/1.1\r\nIf-None-Match: \"v1\"\r\n\r\n") <= 0 ||
+        !uhttp_not_modified(&request, &etag, 0)) return 0;
+
+    if (PARSE("GET / HTTP/1.1\r\nIf-None-Match: \"v0\"\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n") <= 0 ||
+        uhttp_not_modified(&request, &etag, 784111777)) return 0;
+
+    if (PARSE("HEAD / HTTP/1.1\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n") <= 0 ||
+        !uhttp_not_modified(&request, NULL, 784111777) ||
+        uhttp_not_modified(&request, NULL, 784111778) ||
+        uhttp_not_modified(&request, NULL, 0)) return 0;
+
+    if (PARSE("POST / HTTP/1.1\r\nIf-None-Match: \"v1\"\r\n\r\n") <= 0 ||
+        uhttp_not_modified(&request, &etag, 0)) return 0;
+
+    return
+        PARSE("GET / HTTP/1.1\r\n\r\n") > 0 &&
+        !uhttp_not_modified(&request, &etag, 784111777);
+}
+
+// 5
+int uhttp_test_validators_find()
+{
+    // Find validators in rendered header lines.
+    // Assert:
+    //  Field values and lines are sliced, invalid dates are ignored.
+
+    static const char head[] =
+        "Content-Type: text/plain\r\n"
+        "etag:  \"v1\" \r\n"
+        "Last-Modified: Sun, 06 Nov 1994 08:49:37 GMT\r\n";
+    static const char bad[] =
+        "Last-Modified: yesterday\r\n";
+
+    uhttp_validators_t validators;
+
+    if (!uhttp_validators_find(&validators, head, sizeof(head) - 1)) return 0;
+
+    int ok =
+        validators.etag.len == 4 && memcmp(validators.etag.ptr, "\"v1\"", 4) == 0 &&
+        validators.etag_line.ptr == head + 26 && validators.etag_line.len == 14 &&
+        validators.modified == 784111777 &&
+        validators.modified_line.len == 46;
+
+    return
+        ok &&
+        !uhttp_validators_find(&validators, bad, sizeof(bad) - 1) &&
+        validators.modified_line.len == 0;
+}
+
+// 6
+int uhttp_test_if_range()
+{
+    // Evaluate If-Range against the current validators.
+    // Assert:
+    //  Only a strong matching tag or the exact date keeps the range.
+
+    static const char head[] =
+        "ETag: \"v1\"\r\n"
+        "Last-Modified: Sun, 06 Nov 1994 08:49:37 GMT\r\n";
+    static const char weak[] =
+        "ETag: W/\"v1\"\r\n";
+
+    uhttp_validators_t validators;
+    uhttp_validators_find(&validators, head, sizeof(head) - 1);
+
+    if (PARSE("GET / HTTP/1.1\r\nRange: bytes=0-1\r\n\r\n") <= 0 ||
+        !uhttp_if_range(&request, &validators)) return 0;
+
+    if (PARSE("GET / HTTP/1.1\r\nIf-Range: \"v1\"\r\n\r\n") <= 0 ||
+        !uhttp_if_range(&request, &validators)) return 0;
+
+    if (PARSE("GET / HTTP/1.1\r\nIf-Range: \"v2\"\r\n\r\n") <= 0 ||
+        uhttp_if_range(&request, &validators)) return 0;
+
+    if (PARSE("GET / HTTP/1.1\r\nIf-Range: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n") <= 0 ||
+        !uhttp_if_range(&request, &validators)) return 0;
+
+    if (PARSE("GET / HTTP/1.1\r\nIf-Range: Sun, 06 Nov 1994 08:49:38 GMT\r\n\r\n") <= 0 ||
+        uhttp_if_range(&request, &validators)) return 0;
+
+    uhttp_validators_find(&validators, weak, sizeof(weak) - 1);
+    return
+        PARSE("GET / HTTP/1.1\r\nIf-Range: W/\"v1\"\r\n\r\n") > 0 &&
+        !uhttp_if_range(&request, &validators);
+}
+
+const test_t uhttp_test_conditional[] = {
+    { .name = "Parse HTTP dates.", .func = uhttp_test_date_parse },
+    { .name = "Format HTTP dates.", .func = uhttp_test_date_format },
+    { .name = "Match entity tags.", .func = uhttp_test_etag_match },
+    { .name = "Evaluate request preconditions.", .func = uhttp_test_not_modified },
+    { .name = "Find validators in header lines.", .func = uhttp_test_validators_find },
+    { .name = "Evaluate If-Range.", .func = uhttp_test_if_range },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_conditional);
+}
+#endif
@@ -259,6 +259,32 @@ int uhttp_test_list_destroy_good()
     return 1;
 }
 
+// 17
+int uhttp_test_list_reserve()
+{
+    // Reserve room for 4 elements, fill it and remove from it.
+    // Assert:
+    //  Head never moves, a fifth append fails with ENOSPC.
+
+    uhttp_list_t fixed;
+    uhttp_list_create(&fixed, sizeof(int));
+    if (uhttp_list_reserve(&fixed, 4)) return 0;
+
+    void* head = fixed.head;
+    int ok = 1;
+    for (int i = 0; i < 4; i++) ok = ok && uhttp_list_append(&fixed, &i) == 0;
+
+    int value = 4;
+    ok = ok &&
+        uhttp_list_append(&fixed, &value) == -1 && errno == ENOSPC &&
+        uhttp_list_remove(&fixed, 0) == 0 && uhttp_list_append(&fixed, &value) == 0 &&
+        uhttp_list_clear(&fixed) == 0 && fixed.nlen == 0 && uhttp_list_append(&fixed, &value) == 0 &&
+        fixed.head == head && uhttp_list_index(&fixed, int, 0) == 4;
+
+    uhttp_list_destroy(&fixed);
+    return ok;
+}
+
 const test_t uhttp_test_list[] = {
     { .name = "Create list with null pointer doesn't crash.", .func = uhttp_test_list_create_bad },
     { .name = "Create list with valid pointer succeeds.", .func = uhttp_test_list_create_good },
@@ -277,6 +303,7 @@ const test_t uhttp_test_list[] = {
     { .name = "Append doesn't fail after clear.", .func = uhttp_test_list_add_after_clear},
     { .name = "Destroy null doesn't crash.", .func = uhttp_test_list_destroy_null },
     { .name = "Destroy doesn't leak (always passes???)", .func = uhttp_test_list_destroy_good},
+    { .name = "Reserved list never moves.", .func = uhttp_test_list_reserve },
 
     { .name = NULL, .func = NULL }
 };
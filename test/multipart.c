@@ -0,0 +1,231 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/multipart.h"
+#include "test_common.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define CONTENT_TYPE "multipart/form-data; boundary=\"b0und\""
+
+/* Two parts, the second holding bytes that almost form a delimiter. */
+static const char body[] =
+    "preamble\r\n"
+    "--b0und\r\n"
+    "Content-Disposition: form-data; name=\"a\"\r\n"
+    "\r\n"
+    "hello\r\n"
+    "--b0und  \r\n"
+    "Content-Disposition: form-data; name=\"f\"; filename=\"x.bin\"\r\n"
+    "Content-Type:application/octet-stream \r\n"
+    "\r\n"
+    "\r\n--b0un\r\r\n-b0und--\r\n"
+    "--b0und--\r\n"
+    "epilogue";
+
+static const char events[] =
+    "H[Content-Disposition][form-data; name=\"a\"]B(hello)E"
+    "H[Content-Disposition][form-data; name=\"f\"; filename=\"x.bin\"]"
+    "H[Content-Type][application/octet-stream]B(\r\n--b0un\r\r\n-b0und--)E";
+
+/* Callbacks record what they see as text, data runs are merged. */
+typedef struct uhttp_test_record_t
+{
+    char text[512];
+    size_t len;
+    int indata;
+    int stop;
+} uhttp_test_record_t;
+
+static void uhttp_test_append(uhttp_test_record_t* record, const char* data, size_t len)
+{
+    if (record->len + len < sizeof(record->text))
+    {
+        memcpy(record->text + record->len, data, len);
+        record->len += len;
+    }
+}
+
+static int uhttp_test_header(void* user, const uhttp_str_t* name, const uhttp_str_t* value)
+{
+    uhttp_test_record_t* record = user;
+    uhttp_test_append(record, "H[", 2);
+    uhttp_test_append(record, name->ptr, name->len);
+    uhttp_test_append(record, "][", 2);
+    uhttp_test_append(record, value->ptr, value->len);
+    uhttp_test_append(record, "]", 1);
+    return 0;
+}
+
+static int uhttp_test_begin(void* user)
+{
+    uhttp_test_record_t* record = user;
+    uhttp_test_append(record, "B(", 2);
+    return 0;
+}
+
+static int uhttp_test_data(void* user, const char* data, size_t len)
+{
+    uhttp_test_record_t* record = user;
+    uhttp_test_append(record, data, len);
+    return record->stop;
+}
+
+static int uhttp_test_end(void* user)
+{
+    uhttp_test_record_t* record = user;
+    uhttp_test_append(record, ")E", 2);
+    return 0;
+}
+
+static const uhttp_multipart_callbacks_t callbacks = {
+    uhttp_test_header, uhttp_test_begin, uhttp_test_data, uhttp_test_end
+};
+
+static uhttp_multipart_t* uhttp_test_create(uhttp_test_record_t* record)
+{
+    uhttp_str_t type = { CONTENT_TYPE, sizeof(CONTENT_TYPE) - 1 };
+    memset(record, 0, sizeof(*record));
+    return uhttp_multipart_create(&type, &callbacks, record);
+}
+
+// 1
+int uhttp_test_multipart_boundary()
+{
+    // Find boundaries of content types.
+    // Assert:
+    //  Quoted and token boundaries are found among other parameters.
+    //  Other types, missing, empty and long boundaries fail.
+
+    static const char* valid[][2] = {
+        { "multipart/form-data; boundary=abc", "abc" },
+        { "Multipart/Mixed;charset=utf-8;  BOUNDARY=\"a b\"", "a b" },
+        { "multipart/form-data; boundary=x; charset=utf-8", "x" },
+    };
+    static const char* invalid[] = {
+        "text/plain; boundary=abc",
+        "multipart/form-data",
+        "multipart/form-data; boundary=",
+        "multipart/form-data; boundary=\"abc",
+        "multipart/form-data; boundary=0123456789012345678901234567890123456789012345678901234567890123456789x",
+    };
+
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+    {
+        uhttp_str_t type = { valid[i][0], strlen(valid[i][0]) };
+        uhttp_str_t boundary;
+        if (uhttp_multipart_boundary(&type, &boundary) ||
+            boundary.len != strlen(valid[i][1]) || memcmp(boundary.ptr, valid[i][1], boundary.len))
+            return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        uhttp_str_t type = { invalid[i], strlen(invalid[i]) };
+        uhttp_str_t boundary;
+        if (uhttp_multipart_boundary(&type, &boundary) == 0) return 0;
+    }
+
+    uhttp_str_t text = { "text/plain", 10 };
+    return uhttp_multipart_create(&text, NULL, NULL) == NULL && errno == EINVAL;
+}
+
+// 2
+int uhttp_test_multipart_whole()
+{
+    // Feed a body at once.
+    // Assert:
+    //  retval == 1
+    //  Headers and data of both parts are reported, preamble and epilogue
+    //  are not.
+
+    uhttp_test_record_t record;
+    uhttp_multipart_t* multipart = uhttp_test_create(&record);
+    if (multipart == NULL) return 0;
+
+    int done = uhttp_multipart_feed(multipart, body, sizeof(body) - 1);
+    uhttp_multipart_destroy(multipart);
+
+    return done == 1 && record.len == sizeof(events) - 1 && memcmp(record.text, events, record.len) == 0;
+}
+
+// 3
+int uhttp_test_multipart_split()
+{
+    // Feed a body in chunks of every size from one byte up.
+    // Assert:
+    //  The same events as when fed at once.
+
+    for (size_t chunk = 1; chunk < sizeof(body); chunk++)
+    {
+        uhttp_test_record_t record;
+        uhttp_multipart_t* multipart = uhttp_test_create(&record);
+        if (multipart == NULL) return 0;
+
+        int done = 0;
+        for (size_t pos = 0; pos < sizeof(body) - 1 && done == 0; pos += chunk)
+        {
+            size_t len = sizeof(body) - 1 - pos < chunk ? sizeof(body) - 1 - pos : chunk;
+            done = uhttp_multipart_feed(multipart, body + pos, len);
+        }
+        uhttp_multipart_destroy(multipart);
+
+        if (done != 1 || record.len != sizeof(events) - 1 || memcmp(record.text, events, record.len)) return 0;
+    }
+
+    return 1;
+}
+
+// 4
+int uhttp_test_multipart_errors()
+{
+    // Feed malformed bodies, stop in a callback and end early.
+    // Assert:
+    //  EBADMSG for a bad delimiter line or header, ECANCELED when stopped.
+    //  Errors persist, a truncated body is not done.
+
+    static const char baddelim[] = "--b0und!\r\n";
+    static const char badheader[] = "--b0und\r\nno colon\r\n\r\n";
+    static const char truncated[] = "--b0und\r\n\r\ndata";
+
+    uhttp_test_record_t record;
+    uhttp_multipart_t* multipart;
+    int passed = 1;
+
+    multipart = uhttp_test_create(&record);
+    passed = passed && uhttp_multipart_feed(multipart, baddelim, sizeof(baddelim) - 1) == -1 && errno == EBADMSG &&
+        uhttp_multipart_feed(multipart, body, sizeof(body) - 1) == -1 && errno == EBADMSG;
+    uhttp_multipart_destroy(multipart);
+
+    multipart = uhttp_test_create(&record);
+    passed = passed && uhttp_multipart_feed(multipart, badheader, sizeof(badheader) - 1) == -1 && errno == EBADMSG;
+    uhttp_multipart_destroy(multipart);
+
+    multipart = uhttp_test_create(&record);
+    record.stop = 1;
+    passed = passed && uhttp_multipart_feed(multipart, body, sizeof(body) - 1) == -1 && errno == ECANCELED;
+    uhttp_multipart_destroy(multipart);
+
+    multipart = uhttp_test_create(&record);
+    passed = passed && uhttp_multipart_feed(multipart, truncated, sizeof(truncated) - 1) == 0 &&
+        uhttp_multipart_feed(multipart, NULL, 0) == 0;
+    uhttp_multipart_destroy(multipart);
+
+    return passed;
+}
+
+const test_t uhttp_test_multipart[] = {
+    { .name = "Find boundaries of content types.", .func = uhttp_test_multipart_boundary },
+    { .name = "Parse a body fed at once.", .func = uhttp_test_multipart_whole },
+    { .name = "Parse a body fed in chunks.", .func = uhttp_test_multipart_split },
+    { .name = "Report malformed and stopped bodies.", .func = uhttp_test_multipart_errors },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_multipart);
+}
+#endif
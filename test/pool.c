@@ -0,0 +1,134 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/pool.h"
+#include "test_common.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static _Alignas(16) char memory[64 * 1024];
+
+// 1
+int uhttp_test_pool_small()
+{
+    // Create a pool over a region too small to hold a page.
+    // Assert:
+    //  NULL, the region is left alone.
+
+    return uhttp_pool_create(memory, sizeof(uhttp_pool_t)) == NULL &&
+        uhttp_pool_create(NULL, sizeof(memory)) == NULL;
+}
+
+// 2
+int uhttp_test_pool_classes()
+{
+    // Allocate blocks of several sizes.
+    // Assert:
+    //  Blocks lie in the region, are aligned to 16 and are counted at their
+    //  power of two size.
+
+    uhttp_pool_t* pool = uhttp_pool_create(memory, sizeof(memory));
+    if (pool == NULL) return 0;
+
+    char* a = uhttp_pool_malloc(pool, 1);
+    char* b = uhttp_pool_malloc(pool, 100);
+    char* c = uhttp_pool_malloc(pool, 2048);
+    if (a == NULL || b == NULL || c == NULL) return 0;
+
+    return
+        a >= memory && c + 2048 <= memory + sizeof(memory) &&
+        ((uintptr_t)a | (uintptr_t)b | (uintptr_t)c) % 16 == 0 &&
+        pool->used == 16 + 128 + 2048 && pool->peak == pool->used;
+}
+
+// 3
+int uhttp_test_pool_reuse()
+{
+    // Free blocks and allocate the same sizes again.
+    // Assert:
+    //  The freed blocks come back and no further pages are carved.
+
+    uhttp_pool_t* pool = uhttp_pool_create(memory, sizeof(memory));
+    if (pool == NULL) return 0;
+
+    void* a = uhttp_pool_malloc(pool, 40);
+    void* b = uhttp_pool_malloc(pool, 1000);
+    size_t carved = pool->carved;
+
+    uhttp_pool_free(pool, a);
+    uhttp_pool_free(pool, b);
+    if (pool->used != 0) return 0;
+
+    void* xb = uhttp_pool_malloc(pool, 1024);
+    void* xa = uhttp_pool_malloc(pool, 64);
+
+    return xa == a && xb == b && pool->carved == carved;
+}
+
+// 4
+int uhttp_test_pool_realloc()
+{
+    // Grow and shrink a block.
+    // Assert:
+    //  In place within the class, moved with its contents otherwise, freed
+    //  at size zero.
+
+    uhttp_pool_t* pool = uhttp_pool_create(memory, sizeof(memory));
+    if (pool == NULL) return 0;
+
+    char* a = uhttp_pool_realloc(pool, NULL, 100);
+    if (a == NULL) return 0;
+    memset(a, 'x', 100);
+
+    if (uhttp_pool_realloc(pool, a, 128) != a) return 0;
+
+    char* b = uhttp_pool_realloc(pool, a, 1000);
+    if (b == NULL || b == a || b[0] != 'x' || b[99] != 'x') return 0;
+
+    char* c = uhttp_pool_realloc(pool, b, 10);
+    if (c == NULL || c[9] != 'x' || pool->used != 16) return 0;
+
+    return uhttp_pool_realloc(pool, c, 0) == NULL && pool->used == 0;
+}
+
+// 5
+int uhttp_test_pool_exhausted()
+{
+    // Allocate until the region runs out, then free everything.
+    // Assert:
+    //  NULL once out of pages, and all blocks can be allocated again.
+
+    uhttp_pool_t* pool = uhttp_pool_create(memory, sizeof(memory));
+    if (pool == NULL) return 0;
+
+    void* blocks[64];
+    size_t n = 0;
+    while (n < 64 && (blocks[n] = uhttp_pool_malloc(pool, 4096)) != NULL) n++;
+
+    if (n == 0 || n == 64 || uhttp_pool_malloc(pool, (size_t)1 << 40) != NULL) return 0;
+
+    for (size_t i = 0; i < n; i++) uhttp_pool_free(pool, blocks[i]);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (uhttp_pool_malloc(pool, 4096) == NULL) return 0;
+    }
+
+    return uhttp_pool_malloc(pool, 4096) == NULL;
+}
+
+const test_t uhttp_test_pool[] = {
+    { .name = "Reject regions too small.", .func = uhttp_test_pool_small },
+    { .name = "Allocate power of two classes.", .func = uhttp_test_pool_classes },
+    { .name = "Reuse freed blocks.", .func = uhttp_test_pool_reuse },
+    { .name = "Resize blocks.", .func = uhttp_test_pool_realloc },
+    { .name = "Exhaust the region.", .func = uhttp_test_pool_exhausted },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_pool);
+}
+#endif
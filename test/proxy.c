@@ -0,0 +1,204 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/proxy.h"
+#include "test_common.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* A chunked body with an extension and a trailer, then the next response. */
+static const char chunked_body[] =
+    "5\r\nhello\r\n"
+    "1A;name=value\r\n"
+    "abcdefghijklmnopqrstuvwxyz\r\n"
+    "0\r\n"
+    "Trailer-Field: 1\r\n"
+    "\r\n";
+static const char chunked_next[] = "HTTP/1.1 200 OK\r\n";
+
+// 1
+int uhttp_test_proxy_chunked()
+{
+    // Scan a chunked body followed by more bytes, at once and in chunks of
+    // every size.
+    // Assert:
+    //  retval == length of the body, the bytes after it are not taken.
+    //  The body is done after its trailer section and not before.
+
+    char data[sizeof(chunked_body) + sizeof(chunked_next)];
+    size_t bodylen = sizeof(chunked_body) - 1;
+    size_t len = bodylen + sizeof(chunked_next) - 1;
+    memcpy(data, chunked_body, bodylen);
+    memcpy(data + bodylen, chunked_next, sizeof(chunked_next) - 1);
+
+    for (size_t chunk = 1; chunk <= len; chunk++)
+    {
+        uhttp_chunked_t chunked;
+        uhttp_chunked_init(&chunked);
+
+        size_t total = 0;
+        for (size_t pos = 0; pos < len; pos += chunk)
+        {
+            size_t n = len - pos < chunk ? len - pos : chunk;
+            ssize_t scanned = uhttp_chunked_scan(&chunked, data + pos, n);
+            if (scanned < 0) return 0;
+
+            total += scanned;
+            if (total < bodylen && uhttp_chunked_done(&chunked)) return 0;
+        }
+
+        if (total != bodylen || !uhttp_chunked_done(&chunked)) return 0;
+    }
+
+    return 1;
+}
+
+// 2
+int uhttp_test_proxy_chunked_malformed()
+{
+    // Scan malformed chunked bodies.
+    // Assert:
+    //  retval == -1, errno == EBADMSG
+
+    static const char* malformed[] = {
+        "x\r\n",
+        "3\r\nabcd\r\n",
+        "10000000000000000\r\n",
+    };
+
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+    {
+        uhttp_chunked_t chunked;
+        uhttp_chunked_init(&chunked);
+        if (uhttp_chunked_scan(&chunked, malformed[i], strlen(malformed[i])) != -1 || errno != EBADMSG) return 0;
+    }
+
+    return 1;
+}
+
+// 3
+int uhttp_test_proxy_parse()
+{
+    // Parse upstream response heads.
+    // Assert:
+    //  Status, version, framing, length and persistence follow RFC 9112.
+    //  Incomplete heads return zero, malformed ones EBADMSG.
+
+    static const struct
+    {
+        const char* head;
+        int method_head;
+        int status;
+        uhttp_proxy_framing_t framing;
+        int64_t length;
+        int keep_alive;
+    } cases[] = {
+        { "HTTP/1.1 200 OK\r\nContent-Length: 42\r\n\r\n", 0, 200, UHTTP_PROXY_LENGTH, 42, 1 },
+        { "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\nContent-Length: 3\r\n\r\n", 0, 200, UHTTP_PROXY_CHUNKED, 0, 1 },
+        { "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip\r\n\r\n", 0, 200, UHTTP_PROXY_CLOSE, 0, 0 },
+        { "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n", 0, 200, UHTTP_PROXY_CLOSE, 0, 0 },
+        { "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n", 0, 204, UHTTP_PROXY_LENGTH, 0, 0 },
+        { "HTTP/1.1 304 Not Modified\r\nTransfer-Encoding: chunked\r\n\r\n", 0, 304, UHTTP_PROXY_LENGTH, 0, 1 },
+        { "HTTP/1.1 200 OK\r\nContent-Length: 42\r\n\r\n", 1, 200, UHTTP_PROXY_LENGTH, 0, 1 },
+        { "HTTP/1.0 200 OK\r\nContent-Length: 5\r\n\r\n", 0, 200, UHTTP_PROXY_LENGTH, 5, 0 },
+        { "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 5\r\n\r\n", 0, 200, UHTTP_PROXY_LENGTH, 5, 1 },
+        { "HTTP/1.1 100 Continue\r\n\r\n", 0, 100, UHTTP_PROXY_LENGTH, 0, 1 },
+    };
+    static const char* malformed[] = {
+        "HTTP/2 200 OK\r\n\r\n",
+        "HTTP/1.1 20 OK\r\n\r\n",
+        "HTTP/1.1 200OK\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1x\r\n\r\n",
+    };
+
+    uhttp_proxy_response_t response;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        size_t len = strlen(cases[i].head);
+        if (uhttp_proxy_parse(&response, cases[i].head, len, cases[i].method_head) != (ssize_t)len ||
+            response.status != cases[i].status || response.framing != cases[i].framing ||
+            response.length != cases[i].length || response.keep_alive != cases[i].keep_alive)
+            return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+    {
+        if (uhttp_proxy_parse(&response, malformed[i], strlen(malformed[i]), 0) != -1 || errno != EBADMSG) return 0;
+    }
+
+    static const char partial[] = "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n";
+    return uhttp_proxy_parse(&response, partial, sizeof(partial) - 1, 0) == 0 &&
+        uhttp_proxy_parse(&response, partial, 5, 0) == 0 && response.version == 1;
+}
+
+// 4
+int uhttp_test_proxy_hop_by_hop()
+{
+    // Classify header fields, with and without a Connection field naming
+    // more of them.
+    // Assert:
+    //  Connection fields are hop-by-hop in any case, and so are the fields
+    //  Connection names. End-to-end ones and Transfer-Encoding are not.
+
+    static const char* hop[] = { "Connection", "keep-alive", "TE", "Upgrade", "Proxy-Authorization" };
+    static const char* end[] = { "Content-Length", "Transfer-Encoding", "Host", "Trailer", "Tea" };
+
+    for (size_t i = 0; i < sizeof(hop) / sizeof(hop[0]); i++)
+    {
+        uhttp_str_t name = { hop[i], strlen(hop[i]) };
+        if (!uhttp_proxy_hop_by_hop(&name, NULL)) return 0;
+    }
+
+    for (size_t i = 0; i < sizeof(end) / sizeof(end[0]); i++)
+    {
+        uhttp_str_t name = { end[i], strlen(end[i]) };
+        if (uhttp_proxy_hop_by_hop(&name, NULL)) return 0;
+    }
+
+    static const char options[] = "close, X-Secret ,foo";
+    uhttp_str_t connection = { options, sizeof(options) - 1 };
+    uhttp_str_t secret = { "x-secret", 8 }, foo = { "Foo", 3 }, fo = { "fo", 2 }, host = { "Host", 4 };
+
+    return uhttp_proxy_hop_by_hop(&secret, &connection) && uhttp_proxy_hop_by_hop(&foo, &connection) &&
+        !uhttp_proxy_hop_by_hop(&fo, &connection) && !uhttp_proxy_hop_by_hop(&host, &connection);
+}
+
+// 5
+int uhttp_test_proxy_content_length()
+{
+    // Parse requests with more than one Content-Length, equal or not.
+    // Assert:
+    //  retval == -1, errno == EBADMSG. A single one is parsed.
+
+    static const char* duplicate[] = {
+        "POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 10\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 5\r\ncontent-length: 5\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 5\r\nHost: a\r\nCONTENT-LENGTH: 0\r\n\r\n",
+    };
+    static const char single[] = "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 5\r\n\r\n";
+
+    uhttp_request_t request;
+    for (size_t i = 0; i < sizeof(duplicate) / sizeof(duplicate[0]); i++)
+    {
+        if (uhttp_request_parse(&request, duplicate[i], strlen(duplicate[i])) != -1 || errno != EBADMSG) return 0;
+    }
+
+    return uhttp_request_parse(&request, single, sizeof(single) - 1) == sizeof(single) - 1 && request.content_length == 5;
+}
+
+const test_t uhttp_test_proxy[] = {
+    { .name = "Scan chunked bodies.", .func = uhttp_test_proxy_chunked },
+    { .name = "Reject malformed chunked bodies.", .func = uhttp_test_proxy_chunked_malformed },
+    { .name = "Parse upstream response heads.", .func = uhttp_test_proxy_parse },
+    { .name = "Classify hop-by-hop header fields.", .func = uhttp_test_proxy_hop_by_hop },
+    { .name = "Reject requests with several Content-Length fields.", .func = uhttp_test_proxy_content_length },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_proxy);
+}
+#endif
@@ -0,0 +1,156 @@
+#define _UHTTP_INTERNAL_
+#include "../src/queue.h"
+#include "test_common.h"
+
+#include <errno.h>
+#if !_WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static int counter;
+
+static void uhttp_test_increment(void* arg)
+{
+    counter += (int)(size_t)arg;
+}
+
+// 1
+int uhttp_test_queue_order()
+{
+    // Push and pop tasks on one thread.
+    // Assert:
+    //  Tasks come out in push order, popping an empty queue fails.
+
+    uhttp_queue_t queue;
+    uhttp_task_t task;
+    if (uhttp_queue_create(&queue, 4)) return 0;
+
+    int ok = !uhttp_queue_pop(&queue, &task);
+    for (size_t i = 1; i <= 3; i++)
+    {
+        task.func = uhttp_test_increment;
+        task.arg = (void*)i;
+        ok = ok && uhttp_queue_push(&queue, &task) == 0;
+    }
+
+    for (size_t i = 1; i <= 3; i++)
+    {
+        ok = ok && uhttp_queue_pop(&queue, &task) && task.arg == (void*)i;
+    }
+
+    ok = ok && !uhttp_queue_pop(&queue, &task);
+    uhttp_queue_destroy(&queue);
+    return ok;
+}
+
+// 2
+int uhttp_test_queue_full()
+{
+    // Fill a queue, then keep it cycling past its capacity.
+    // Assert:
+    //  Capacity rounds up to a power of two, a full queue fails with EAGAIN
+    //  and accepts tasks again once popped.
+
+    uhttp_queue_t queue;
+    uhttp_task_t task = { uhttp_test_increment, (void*)1 };
+    if (uhttp_queue_create(&queue, 3)) return 0;
+
+    int ok = queue.mask == 3;
+    for (int i = 0; i < 4; i++)
+    {
+        ok = ok && uhttp_queue_push(&queue, &task) == 0;
+    }
+    ok = ok && uhttp_queue_push(&queue, &task) == -1 && errno == EAGAIN;
+
+    counter = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        ok = ok && uhttp_queue_pop(&queue, &task);
+        task.func(task.arg);
+        ok = ok && uhttp_queue_push(&queue, &task) == 0;
+    }
+
+    uhttp_queue_destroy(&queue);
+    return ok && counter == 100;
+}
+
+#if !_WIN32
+#define UHTTP_TEST_PRODUCERS 4
+#define UHTTP_TEST_TASKS 20000
+
+static uhttp_queue_t shared;
+
+static void* uhttp_test_producer(void* arg)
+{
+    uhttp_task_t task = { uhttp_test_increment, arg };
+
+    for (int i = 0; i < UHTTP_TEST_TASKS; i++)
+    {
+        while (uhttp_queue_push(&shared, &task))
+        {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+// 3
+int uhttp_test_queue_producers()
+{
+    // Push from several threads while one thread pops.
+    // Assert:
+    //  Every task is popped exactly once.
+
+    pthread_t threads[UHTTP_TEST_PRODUCERS];
+    uhttp_task_t task;
+    if (uhttp_queue_create(&shared, 64)) return 0;
+
+    for (size_t i = 0; i < UHTTP_TEST_PRODUCERS; i++)
+    {
+        pthread_create(&threads[i], NULL, uhttp_test_producer, (void*)(i + 1));
+    }
+
+    counter = 0;
+    int popped = 0;
+    while (popped < UHTTP_TEST_PRODUCERS * UHTTP_TEST_TASKS)
+    {
+        if (uhttp_queue_pop(&shared, &task))
+        {
+            task.func(task.arg);
+            popped++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    for (size_t i = 0; i < UHTTP_TEST_PRODUCERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    int ok = !uhttp_queue_pop(&shared, &task);
+    uhttp_queue_destroy(&shared);
+    return ok && counter == UHTTP_TEST_TASKS * (1 + 2 + 3 + 4);
+}
+#endif
+
+const test_t uhttp_test_queue[] = {
+    { .name = "Pop tasks in order.", .func = uhttp_test_queue_order },
+    { .name = "Fill and cycle a queue.", .func = uhttp_test_queue_full },
+#if !_WIN32
+    { .name = "Push from several threads.", .func = uhttp_test_queue_producers },
+#endif
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_queue);
+}
+#endif
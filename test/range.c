@@ -0,0 +1,108 @@
+#define _UHTTP_INTERNAL_
+#include "../src/range.h"
+#include "test_common.h"
+
+#include <string.h>
+
+#define STR(str) { (str), sizeof(str) - 1 }
+
+uhttp_range_t ranges[4];
+
+// 1
+int uhttp_test_range_single()
+{
+    // Parse single byte ranges of a 1000 byte representation.
+    // Assert:
+    //  Open ends and suffixes are resolved against the size.
+
+    uhttp_str_t closed = STR("bytes=0-99");
+    uhttp_str_t open = STR("bytes=900-");
+    uhttp_str_t suffix = STR("bytes=-100");
+    uhttp_str_t clamp = STR("bytes=990-2000");
+    uhttp_str_t whole = STR("bytes=-5000");
+
+    return
+        uhttp_range_parse(&closed, 1000, ranges, 4) == 1 && ranges[0].first == 0 && ranges[0].last == 99 &&
+        uhttp_range_parse(&open, 1000, ranges, 4) == 1 && ranges[0].first == 900 && ranges[0].last == 999 &&
+        uhttp_range_parse(&suffix, 1000, ranges, 4) == 1 && ranges[0].first == 900 && ranges[0].last == 999 &&
+        uhttp_range_parse(&clamp, 1000, ranges, 4) == 1 && ranges[0].first == 990 && ranges[0].last == 999 &&
+        uhttp_range_parse(&whole, 1000, ranges, 4) == 1 && ranges[0].first == 0 && ranges[0].last == 999;
+}
+
+// 2
+int uhttp_test_range_multiple()
+{
+    // Parse range lists.
+    // Assert:
+    //  Ranges keep request order, unsatisfiable ones are skipped.
+
+    uhttp_str_t list = STR("bytes=500-599, 0-9,-1");
+    uhttp_str_t skip = STR("bytes=2000-,10-19");
+
+    if (uhttp_range_parse(&list, 1000, ranges, 4) != 3 ||
+        ranges[0].first != 500 || ranges[0].last != 599 ||
+        ranges[1].first != 0 || ranges[1].last != 9 ||
+        ranges[2].first != 999 || ranges[2].last != 999) return 0;
+
+    return
+        uhttp_range_parse(&skip, 1000, ranges, 4) == 1 &&
+        ranges[0].first == 10 && ranges[0].last == 19;
+}
+
+// 3
+int uhttp_test_range_unsatisfiable()
+{
+    // Parse ranges that select nothing.
+    // Assert:
+    //  -1 when every range lies past the end.
+
+    uhttp_str_t past = STR("bytes=1000-");
+    uhttp_str_t zero = STR("bytes=-0");
+    uhttp_str_t empty = STR("bytes=0-");
+
+    return
+        uhttp_range_parse(&past, 1000, ranges, 4) == -1 &&
+        uhttp_range_parse(&zero, 1000, ranges, 4) == -1 &&
+        uhttp_range_parse(&empty, 0, ranges, 4) == -1;
+}
+
+// 4
+int uhttp_test_range_ignored()
+{
+    // Parse malformed or unsupported headers.
+    // Assert:
+    //  Zero, the header is ignored and the whole representation is sent.
+
+    uhttp_str_t unit = STR("items=0-1");
+    uhttp_str_t reversed = STR("bytes=9-0");
+    uhttp_str_t junk = STR("bytes=0-1x");
+    uhttp_str_t none = STR("bytes=");
+    uhttp_str_t dash = STR("bytes=-");
+    uhttp_str_t many = STR("bytes=0-0,1-1,2-2,3-3,4-4");
+    uhttp_str_t huge = STR("bytes=0-9999999999999999999");
+
+    return
+        uhttp_range_parse(&unit, 1000, ranges, 4) == 0 &&
+        uhttp_range_parse(&reversed, 1000, ranges, 4) == 0 &&
+        uhttp_range_parse(&junk, 1000, ranges, 4) == 0 &&
+        uhttp_range_parse(&none, 1000, ranges, 4) == 0 &&
+        uhttp_range_parse(&dash, 1000, ranges, 4) == 0 &&
+        uhttp_range_parse(&many, 1000, ranges, 4) == 0 &&
+        uhttp_range_parse(&huge, 1000, ranges, 4) == 0;
+}
+
+const test_t uhttp_test_range[] = {
+    { .name = "Parse single ranges.", .func = uhttp_test_range_single },
+    { .name = "Parse range lists.", .func = uhttp_test_range_multiple },
+    { .name = "Parse unsatisfiable ranges.", .func = uhttp_test_range_unsatisfiable },
+    { .name = "Ignore malformed ranges.", .func = uhttp_test_range_ignored },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_range);
+}
+#endif
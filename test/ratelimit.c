@@ -0,0 +1,178 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/ratelimit.h"
+#include "test_common.h"
+
+#include <string.h>
+
+static uhttp_addr_t uhttp_test_addr4(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+    uhttp_addr_t addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.domain = UHTTP_SOCKET_DOMAIN_INET4;
+    addr.address[0] = a;
+    addr.address[1] = b;
+    addr.address[2] = c;
+    addr.address[3] = d;
+    return addr;
+}
+
+// 1
+int uhttp_test_ratelimit_off()
+{
+    // Take tokens from a limiter without a rate, and from a Unix domain
+    // source of a limited one.
+    // Assert:
+    //  Always admitted, no table is allocated until a rate is set.
+
+    uhttp_ratelimit_t limiter;
+    uhttp_ratelimit_create(&limiter);
+    uhttp_addr_t addr = uhttp_test_addr4(10, 0, 0, 1);
+
+    for (int i = 0; i < 100; i++)
+    {
+        if (!uhttp_ratelimit_take(&limiter, &addr, 0)) return 0;
+    }
+    if (limiter.slots != NULL) return 0;
+
+    uhttp_addr_t local;
+    memset(&local, 0, sizeof(local));
+    local.domain = UHTTP_SOCKET_DOMAIN_UNIX;
+
+    int passed = uhttp_ratelimit_set_rate(&limiter, 1, 1024) == 0 && limiter.slots != NULL;
+    for (int i = 0; i < 100; i++)
+    {
+        passed = passed && uhttp_ratelimit_take(&limiter, &local, 0);
+    }
+
+    passed = passed && uhttp_ratelimit_set_rate(&limiter, -1, 1024) == -1;
+
+    uhttp_ratelimit_destroy(&limiter);
+    return passed;
+}
+
+// 2
+int uhttp_test_ratelimit_bucket()
+{
+    // Take tokens at 10 per second with a burst of 3.
+    // Assert:
+    //  Three are admitted at once, the fourth is refused, one more is
+    //  admitted 100ms later and the bucket never holds more than the burst.
+
+    uhttp_ratelimit_t limiter;
+    uhttp_ratelimit_create(&limiter);
+    if (uhttp_ratelimit_set_rate(&limiter, 10, 1024)) return 0;
+    limiter.burst = 3;
+
+    uhttp_addr_t addr = uhttp_test_addr4(10, 0, 0, 1);
+    uint64_t now = 5000;
+
+    int passed =
+        uhttp_ratelimit_take(&limiter, &addr, now) &&
+        uhttp_ratelimit_take(&limiter, &addr, now) &&
+        uhttp_ratelimit_take(&limiter, &addr, now) &&
+        !uhttp_ratelimit_take(&limiter, &addr, now) &&
+        !uhttp_ratelimit_take(&limiter, &addr, now + 99) &&
+        uhttp_ratelimit_take(&limiter, &addr, now + 100) &&
+        !uhttp_ratelimit_take(&limiter, &addr, now + 100);
+
+    now += 60000;
+    int admitted = 0;
+    for (int i = 0; i < 10; i++) admitted += uhttp_ratelimit_take(&limiter, &addr, now);
+
+    uhttp_ratelimit_destroy(&limiter);
+    return passed && admitted == 3;
+}
+
+// 3
+int uhttp_test_ratelimit_prefix()
+{
+    // Exhaust the bucket of one address with a /24 prefix, then of an IPv6
+    // address with the default /64.
+    // Assert:
+    //  Addresses in the prefix share the bucket, others do not, IPv4 and
+    //  its mapped IPv6 address are the same source.
+
+    uhttp_ratelimit_t limiter;
+    uhttp_ratelimit_create(&limiter);
+    if (uhttp_ratelimit_set_rate(&limiter, 1, 1024)) return 0;
+    limiter.prefix4 = 24;
+
+    uhttp_addr_t a = uhttp_test_addr4(192, 168, 1, 10);
+    uhttp_addr_t b = uhttp_test_addr4(192, 168, 1, 200);
+    uhttp_addr_t c = uhttp_test_addr4(192, 168, 2, 10);
+
+    uhttp_addr_t mapped;
+    memset(&mapped, 0, sizeof(mapped));
+    mapped.domain = UHTTP_SOCKET_DOMAIN_INET6;
+    mapped.address[10] = mapped.address[11] = 0xFF;
+    memcpy(mapped.address + 12, a.address, 4);
+
+    uhttp_addr_t v6a;
+    memset(&v6a, 0, sizeof(v6a));
+    v6a.domain = UHTTP_SOCKET_DOMAIN_INET6;
+    v6a.address[0] = 0x20;
+    v6a.address[1] = 0x01;
+    v6a.address[15] = 1;
+    uhttp_addr_t v6b = v6a;
+    v6b.address[8] = 0x80;
+    uhttp_addr_t v6c = v6a;
+    v6c.address[7] = 1;
+
+    int passed =
+        uhttp_ratelimit_take(&limiter, &a, 0) &&
+        !uhttp_ratelimit_take(&limiter, &b, 0) &&
+        !uhttp_ratelimit_take(&limiter, &mapped, 0) &&
+        uhttp_ratelimit_take(&limiter, &c, 0) &&
+        uhttp_ratelimit_take(&limiter, &v6a, 0) &&
+        !uhttp_ratelimit_take(&limiter, &v6b, 0) &&
+        uhttp_ratelimit_take(&limiter, &v6c, 0);
+
+    uhttp_ratelimit_destroy(&limiter);
+    return passed;
+}
+
+// 4
+int uhttp_test_ratelimit_evict()
+{
+    // Exhaust the bucket of one source, then see far more sources than the
+    // table holds, then come back with the first one.
+    // Assert:
+    //  The table keeps its size, the first source was evicted as the least
+    //  recently seen and starts over with a full bucket.
+
+    uhttp_ratelimit_t limiter;
+    uhttp_ratelimit_create(&limiter);
+    if (uhttp_ratelimit_set_rate(&limiter, 1, 1024)) return 0;
+    size_t mask = limiter.mask;
+
+    uhttp_addr_t first = uhttp_test_addr4(10, 0, 0, 1);
+    if (!uhttp_ratelimit_take(&limiter, &first, 0) || uhttp_ratelimit_take(&limiter, &first, 0)) return 0;
+
+    for (int i = 0; i < 4096; i++)
+    {
+        uhttp_addr_t addr = uhttp_test_addr4(10, 1, i >> 8, i & 0xFF);
+        uhttp_ratelimit_take(&limiter, &addr, 1 + i / 64);
+    }
+
+    int passed = limiter.mask == mask && uhttp_ratelimit_take(&limiter, &first, 100);
+
+    uhttp_ratelimit_destroy(&limiter);
+    return passed;
+}
+
+const test_t uhttp_test_ratelimit[] = {
+    { .name = "Admit everything without a rate.", .func = uhttp_test_ratelimit_off },
+    { .name = "Refill token buckets.", .func = uhttp_test_ratelimit_bucket },
+    { .name = "Share buckets within a prefix.", .func = uhttp_test_ratelimit_prefix },
+    { .name = "Evict the least recently seen sources.", .func = uhttp_test_ratelimit_evict },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_ratelimit);
+}
+#endif
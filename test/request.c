@@ -0,0 +1,308 @@
+#define _UHTTP_INTERNAL_
+#include "../src/request.h"
+#include "test_common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+uhttp_request_t request;
+
+#define PARSE(str) uhttp_request_parse(&request, (str), sizeof(str) - 1)
+
+// 1
+int uhttp_test_request_parse_null()
+{
+    // Parse without a request or buffer.
+    // Assert:
+    //  retval == -1
+    //  errno == EINVAL
+
+    return
+        uhttp_request_parse(NULL, "", 0) == -1 && errno == EINVAL &&
+        uhttp_request_parse(&request, NULL, 0) == -1 && errno == EINVAL;
+}
+
+// 2
+int uhttp_test_request_parse_incomplete()
+{
+    // Parse heads missing the blank line.
+    // Assert:
+    //  retval == 0
+
+    return
+        PARSE("") == 0 &&
+        PARSE("GET / HTTP/1.1") == 0 &&
+        PARSE("GET / HTTP/1.1\r\nHost: a\r\n") == 0;
+}
+
+// 3
+int uhttp_test_request_parse_simple()
+{
+    // Parse a minimal request followed by another one.
+    // Assert:
+    //  retval == length of the first head
+    //  method, target, version and header are sliced correctly.
+    //  keep_alive == 1
+
+    static const char head[] = "GET /index.html HTTP/1.1\r\nHost:  example.com \r\n\r\n";
+    static const char pipelined[] = "GET /index.html HTTP/1.1\r\nHost:  example.com \r\n\r\nGET /";
+
+    if (PARSE(pipelined) != sizeof(head) - 1) return 0;
+
+    const uhttp_str_t* host = uhttp_request_header(&request, "host");
+
+    return
+        uhttp_str_ieq(&request.method, "GET") &&
+        uhttp_str_ieq(&request.target, "/index.html") &&
+        request.version == 1 &&
+        request.nheaders == 1 &&
+        host && uhttp_str_ieq(host, "example.com") &&
+        request.content_length == 0 &&
+        request.keep_alive == 1;
+}
+
+// 4
+int uhttp_test_request_parse_leading_lines()
+{
+    // Parse a request after empty lines and with bare line feeds.
+    // Assert:
+    //  retval == length of input
+
+    static const char head[] = "\r\n\nPOST /x HTTP/1.0\nContent-Length: 12\n\n";
+
+    return
+        PARSE(head) == sizeof(head) - 1 &&
+        uhttp_str_ieq(&request.method, "POST") &&
+        request.version == 0 &&
+        request.content_length == 12;
+}
+
+// 5
+int uhttp_test_request_parse_connection()
+{
+    // Connection persistence follows the version and Connection header.
+    // Assert:
+    //  HTTP/1.0 closes without keep-alive.
+    //  HTTP/1.1 persists without close.
+
+    return
+        PARSE("GET / HTTP/1.0\r\n\r\n") > 0 && request.keep_alive == 0 &&
+        PARSE("GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n") > 0 && request.keep_alive == 1 &&
+        PARSE("GET / HTTP/1.1\r\nConnection: upgrade, close\r\n\r\n") > 0 && request.keep_alive == 0 &&
+        PARSE("GET / HTTP/1.1\r\nConnection: closed\r\n\r\n") > 0 && request.keep_alive == 1;
+}
+
+// 6
+int uhttp_test_request_parse_malformed()
+{
+    // Parse malformed request lines and fields.
+    // Assert:
+    //  retval == -1
+    //  errno == EBADMSG
+
+    return
+        PARSE("GET /\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET  / HTTP/1.1\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET / HTTP/2.0\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET / HTTP/1.1\r\nHost a\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET / HTTP/1.1\r\nHost : a\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") == -1 && errno == EBADMSG;
+}
+
+// 7
+int uhttp_test_request_parse_too_many_headers()
+{
+    // Parse a request with more fields than UHTTP_REQUEST_MAX_HEADERS.
+    // Assert:
+    //  retval == -1
+    //  errno == E2BIG
+
+    char head[64 * (UHTTP_REQUEST_MAX_HEADERS + 2)];
+    size_t len = 0;
+
+    len += sprintf(head + len, "GET / HTTP/1.1\r\n");
+    for (int i = 0; i <= UHTTP_REQUEST_MAX_HEADERS; i++)
+    {
+        len += sprintf(head + len, "X-Field-%d: %d\r\n", i, i);
+    }
+    len += sprintf(head + len, "\r\n");
+
+    return uhttp_request_parse(&request, head, len) == -1 && errno == E2BIG;
+}
+
+// 8
+int uhttp_test_request_parse_chunked()
+{
+    // Parse a request with a transfer encoding.
+    // Assert:
+    //  chunked == 1
+
+    return
+        PARSE("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n") > 0 &&
+        request.chunked == 1;
+}
+
+// 9
+int uhttp_test_request_url_decode()
+{
+    // Decode escapes in place.
+    // Assert:
+    //  Valid escapes are decoded, malformed ones kept.
+    //  '+' is only a space when asked for.
+
+    char a[] = "/a%20b%2Fc%zz%4";
+    char b[] = "x+y%2By";
+    char c[] = "x+y";
+
+    size_t alen = uhttp_url_decode(a, sizeof(a) - 1, 0);
+    size_t blen = uhttp_url_decode(b, sizeof(b) - 1, 1);
+    size_t clen = uhttp_url_decode(c, sizeof(c) - 1, 0);
+
+    return
+        alen == 11 && memcmp(a, "/a b/c%zz%4", alen) == 0 &&
+        blen == 5 && memcmp(b, "x y+y", blen) == 0 &&
+        clen == 3 && memcmp(c, "x+y", clen) == 0;
+}
+
+// 10
+int uhttp_test_request_path_normalize()
+{
+    // Remove dot segments.
+    // Assert:
+    //  Results match RFC 3986 5.2.4 for absolute paths.
+
+    static const char* cases[][2] = {
+        { "/a/b/c/./../../g", "/a/g" },
+        { "/../../a", "/a" },
+        { "/a/..", "/" },
+        { "/a/.", "/a/" },
+        { "/a/../", "/" },
+        { "/a//b", "/a//b" },
+        { "/.a/..b/c", "/.a/..b/c" },
+        { "/", "/" },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        char path[32];
+        size_t len = strlen(cases[i][0]);
+        memcpy(path, cases[i][0], len);
+
+        len = uhttp_path_normalize(path, len);
+        if (len != strlen(cases[i][1]) || memcmp(path, cases[i][1], len)) return 0;
+    }
+
+    return 1;
+}
+
+// 11
+int uhttp_test_request_path()
+{
+    // Decode the path of a parsed request.
+    // Assert:
+    //  Encoded dot segments are removed after decoding.
+    //  The target and the query stay raw.
+    //  Absolute form targets yield their path.
+
+    char head[] = "GET /a/%2e%2E/b%20c?x=%41&y HTTP/1.1\r\n\r\n";
+    char absolute[] = "GET http://example.com/d/./e HTTP/1.1\r\n\r\n";
+
+    if (uhttp_request_parse(&request, head, sizeof(head) - 1) <= 0) return 0;
+
+    uhttp_str_t path = uhttp_request_path(&request);
+    uhttp_str_t again = uhttp_request_path(&request);
+    uhttp_str_t query = uhttp_request_query(&request);
+
+    if (!(path.len == 4 && memcmp(path.ptr, "/b c", 4) == 0 && path.ptr == again.ptr && again.len == 4 &&
+        uhttp_str_ieq(&query, "x=%41&y") && uhttp_str_ieq(&request.target, "/a/%2e%2E/b%20c?x=%41&y")))
+        return 0;
+
+    if (uhttp_request_parse(&request, absolute, sizeof(absolute) - 1) <= 0) return 0;
+
+    path = uhttp_request_path(&request);
+    query = uhttp_request_query(&request);
+
+    return path.len == 4 && memcmp(path.ptr, "/d/e", 4) == 0 && query.len == 0 &&
+        uhttp_str_ieq(&request.target, "http://example.com/d/./e");
+}
+
+// 12
+int uhttp_test_request_query()
+{
+    // Iterate and look up query parameters.
+    // Assert:
+    //  Pairs are split on '&' and '=', empty pairs skipped.
+    //  Lookups compare decoded names.
+
+    if (PARSE("GET /?a=1&&b&c%20d=x+y&e+f=2 HTTP/1.1\r\n\r\n") <= 0) return 0;
+
+    uhttp_query_t query;
+    uhttp_str_t name, value;
+    int count = 0;
+
+    uhttp_query_init(&query, uhttp_request_query(&request));
+    while (uhttp_query_next(&query, &name, &value))
+    {
+        if (count == 1 && !(uhttp_str_ieq(&name, "b") && value.len == 0)) return 0;
+        count++;
+    }
+
+    return
+        count == 4 &&
+        uhttp_request_param(&request, "a", &value) && uhttp_str_ieq(&value, "1") &&
+        uhttp_request_param(&request, "c d", &value) && uhttp_str_ieq(&value, "x+y") &&
+        uhttp_request_param(&request, "e f", NULL) &&
+        !uhttp_request_param(&request, "c", NULL) &&
+        !uhttp_request_param(&request, "x", NULL);
+}
+
+// 13
+int uhttp_test_request_path_refused()
+{
+    // Parse targets that decode to line breaks or zero, contain a quote or
+    // decode past UHTTP_REQUEST_PATH_SIZE.
+    // Assert:
+    //  retval == -1
+    //  errno == EBADMSG, ENAMETOOLONG for the long path
+
+    if (!(PARSE("GET /a%0D%0AHost:%20evil?x=1 HTTP/1.1\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET /a%0a HTTP/1.1\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET /a%00.txt HTTP/1.1\r\n\r\n") == -1 && errno == EBADMSG &&
+        PARSE("GET /a\"b HTTP/1.1\r\n\r\n") == -1 && errno == EBADMSG))
+        return 0;
+
+    char head[UHTTP_REQUEST_PATH_SIZE + 64];
+    size_t len = sprintf(head, "GET /%%41");
+    memset(head + len, 'a', UHTTP_REQUEST_PATH_SIZE);
+    len += UHTTP_REQUEST_PATH_SIZE;
+    len += sprintf(head + len, " HTTP/1.1\r\n\r\n");
+
+    return uhttp_request_parse(&request, head, len) == -1 && errno == ENAMETOOLONG;
+}
+
+const test_t uhttp_test_request[] = {
+    { .name = "Parse with null arguments fails.", .func = uhttp_test_request_parse_null },
+    { .name = "Parse incomplete head needs more data.", .func = uhttp_test_request_parse_incomplete },
+    { .name = "Parse simple head slices fields.", .func = uhttp_test_request_parse_simple },
+    { .name = "Parse skips leading empty lines and accepts bare LF.", .func = uhttp_test_request_parse_leading_lines },
+    { .name = "Parse resolves connection persistence.", .func = uhttp_test_request_parse_connection },
+    { .name = "Parse malformed heads fails.", .func = uhttp_test_request_parse_malformed },
+    { .name = "Parse with too many fields fails.", .func = uhttp_test_request_parse_too_many_headers },
+    { .name = "Parse detects transfer encoding.", .func = uhttp_test_request_parse_chunked },
+    { .name = "Decode escapes in place.", .func = uhttp_test_request_url_decode },
+    { .name = "Normalize removes dot segments.", .func = uhttp_test_request_path_normalize },
+    { .name = "Request path is decoded, target and query kept raw.", .func = uhttp_test_request_path },
+    { .name = "Query parameters iterate and look up.", .func = uhttp_test_request_query },
+    { .name = "Paths decoding to line breaks or zero are refused.", .func = uhttp_test_request_path_refused },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_request);
+}
+#endif
@@ -1,13 +1,40 @@
 #define _UHTTP_INTERNAL_
 #include "test_common.h"
+#include "alloc.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
+#if UHTTP_STATIC_MEMORY
+/* Static memory builds never touch the heap by themselves, tests lend them
+   the one of the host they run on. */
+static void* uhttp_test_malloc(void* context, size_t size)
+{
+    return malloc(size);
+}
+
+static void* uhttp_test_realloc(void* context, void* ptr, size_t size)
+{
+    return realloc(ptr, size);
+}
+
+static void uhttp_test_free(void* context, void* ptr)
+{
+    free(ptr);
+}
+
+static const uhttp_allocator_t uhttp_test_allocator = { uhttp_test_malloc, uhttp_test_realloc, uhttp_test_free, NULL };
+#endif
+
 int uhttp_test_main(const test_t* tests)
 {
     clock_t clk_s = clock(), clk_e;
 
+#if UHTTP_STATIC_MEMORY
+    uhttp_alloc_set(&uhttp_test_allocator);
+#endif
+
     printf("Unit Test Start. %d\n", clk_s);
 
     int i = 1;
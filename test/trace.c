@@ -0,0 +1,98 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "../src/trace.h"
+#include "test_common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define UHTTP_TEST_TRACE_FILE "uhttp_test_trace.bin"
+
+static uhttp_trace_header_t header;
+static uhttp_trace_ring_header_t ring;
+static uhttp_trace_record_t records[UHTTP_TRACE_RECORDS];
+
+/**
+ * Read back the first ring of a dump.
+ */
+static int uhttp_test_trace_read(void)
+{
+    FILE* file = fopen(UHTTP_TEST_TRACE_FILE, "rb");
+    if (file == NULL) return 0;
+
+    int ok =
+        fread(&header, sizeof(header), 1, file) == 1 &&
+        fread(&ring, sizeof(ring), 1, file) == 1 &&
+        ring.count <= UHTTP_TRACE_RECORDS &&
+        fread(records, sizeof(uhttp_trace_record_t), (size_t)ring.count, file) == ring.count;
+
+    fclose(file);
+    remove(UHTTP_TEST_TRACE_FILE);
+    return ok;
+}
+
+// 1
+int uhttp_test_trace_dump()
+{
+    // Record fewer trace points than the ring holds and dump them.
+    // Assert:
+    //  The dump holds every record in order with increasing timestamps.
+
+    for (size_t i = 0; i < 10; i++)
+    {
+        uhttp_trace(SEND, (void*)(i + 1), i * 100);
+    }
+
+    if (uhttp_trace_dump(UHTTP_TEST_TRACE_FILE) || !uhttp_test_trace_read()) return 0;
+
+    int ok =
+        memcmp(header.magic, UHTTP_TRACE_MAGIC, 8) == 0 &&
+        header.record_size == sizeof(uhttp_trace_record_t) &&
+        header.nrings == 1 && ring.thread == 1 && ring.count == 10 &&
+        header.time1 >= header.time0 && header.ns1 >= header.ns0;
+
+    for (size_t i = 0; i < 10 && ok; i++)
+    {
+        ok =
+            records[i].event == UHTTP_TRACE_SEND &&
+            records[i].subject == i + 1 &&
+            records[i].value == i * 100 &&
+            (i == 0 || records[i].time >= records[i - 1].time);
+    }
+
+    return ok;
+}
+
+// 2
+int uhttp_test_trace_wrap()
+{
+    // Record more trace points than the ring holds.
+    // Assert:
+    //  Only the latest records are dumped, oldest first.
+
+    for (size_t i = 0; i < UHTTP_TRACE_RECORDS + 5; i++)
+    {
+        uhttp_trace(RECEIVE, (void*)(i + 1), 0);
+    }
+
+    if (uhttp_trace_dump(UHTTP_TEST_TRACE_FILE) || !uhttp_test_trace_read()) return 0;
+
+    return
+        ring.count == UHTTP_TRACE_RECORDS &&
+        records[0].subject == 6 &&
+        records[UHTTP_TRACE_RECORDS - 1].subject == UHTTP_TRACE_RECORDS + 5;
+}
+
+const test_t uhttp_test_trace[] = {
+    { .name = "Dump trace records.", .func = uhttp_test_trace_dump },
+    { .name = "Keep the latest trace records.", .func = uhttp_test_trace_wrap },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_trace);
+}
+#endif
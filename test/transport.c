@@ -0,0 +1,1078 @@
+#define _UHTTP_INTERNAL_
+#include "uhttp.h"
+#include "clock.h"
+#include "config.h"
+#include "test_common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* A captured exchange, pipelined requests and the responses to them. */
+static const char replay_requests[] =
+    "GET /hello HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n"
+    "GET /missing HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n"
+    "POST /hello HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Content-Length: 5\r\n"
+    "\r\n"
+    "abcde"
+    "GET /hello HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+static const char replay_responses[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 5\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "hello"
+    "HTTP/1.1 404 Not Found\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n"
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 5\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "hello"
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 5\r\n"
+    "Content-Type: text/plain\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "hello";
+
+static void uhttp_test_hello(uhttp_request_t* request, void* user)
+{
+    uhttp_respond(request, 200, "Content-Type: text/plain\r\n", "hello", 5);
+}
+
+static void uhttp_test_addr(uhttp_addr_t* addr, uint16_t port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->domain = UHTTP_SOCKET_DOMAIN_INET4;
+    addr->port = port;
+    addr->address[0] = 127;
+    addr->address[3] = 1;
+}
+
+/**
+ * Replay the captured requests in pieces of a size, return the number of
+ * response bytes matching the capture or -1 on failure.
+ */
+static ssize_t uhttp_test_replay(size_t piece)
+{
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 256);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return -1;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+
+    uhttp_route_t route = { .path = "/hello", .handler = uhttp_test_hello };
+    uhttp_addroute(sv, &route);
+
+    ssize_t matched = -1;
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (sock = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET) goto done;
+
+    char response[sizeof(replay_responses) + 64];
+    size_t sent = 0, received = 0;
+    for (int round = 0; round < 10000; round++)
+    {
+        if (sent < sizeof(replay_requests) - 1)
+        {
+            size_t len = sizeof(replay_requests) - 1 - sent;
+            ssize_t n = transport->send(transport, sock, replay_requests + sent, len < piece ? len : piece);
+            if (n > 0) sent += n;
+        }
+
+        uhttp_pollevents(sv);
+
+        ssize_t n = transport->recv(transport, sock, response + received, sizeof(response) - received);
+        if (n == 0) break;
+        if (n > 0) received += n;
+        else if (errno != EAGAIN) goto done;
+    }
+
+    matched = (received == sizeof(replay_responses) - 1 && memcmp(response, replay_responses, received) == 0) ? (ssize_t)received : -1;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return matched;
+}
+
+// 1
+int uhttp_test_transport_ring()
+{
+    // Stream bytes both ways through rings much smaller than the stream.
+    // Assert:
+    //  Every byte arrives in order, empty rings are EAGAIN and full rings
+    //  take no more.
+    //  The peer reads zero after the other end closes.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(2, 64);
+    if (transport == NULL) return 0;
+
+    uhttp_addr_t addr, src;
+    uhttp_test_addr(&addr, 80);
+
+    int ok = 0;
+    uhttp_socket_t listener = transport->listen(transport, &addr, 4);
+    uhttp_socket_t peer = uhttp_memory_connect(transport, &addr);
+    uhttp_socket_t server = transport->accept(transport, listener, &src);
+    if (listener == UHTTP_INVALID_SOCKET || peer == UHTTP_INVALID_SOCKET || server == UHTTP_INVALID_SOCKET) goto done;
+
+    char byte;
+    if (transport->recv(transport, server, &byte, 1) != -1 || errno != EAGAIN) goto done;
+
+    char block[64 + 1];
+    memset(block, 'x', sizeof(block));
+    if (transport->send(transport, peer, block, sizeof(block)) != 64 || transport->send(transport, peer, block, 1) != -1 || errno != EAGAIN) goto done;
+    if (transport->recv(transport, server, block, sizeof(block)) != 64) goto done;
+
+    unsigned char out = 0, in = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        unsigned char chunk[7];
+        for (size_t j = 0; j < sizeof(chunk); j++) chunk[j] = out++;
+        uhttp_str_t parts[2] = { { (const char*)chunk, 3 }, { (const char*)chunk + 3, 4 } };
+        if (transport->sendv(transport, server, parts, 2) != 7) goto done;
+
+        unsigned char got[7];
+        if (transport->recv(transport, peer, got, sizeof(got)) != 7) goto done;
+        for (size_t j = 0; j < sizeof(got); j++)
+        {
+            if (got[j] != in++) goto done;
+        }
+    }
+
+    transport->close(transport, server);
+    server = UHTTP_INVALID_SOCKET;
+    ok = transport->recv(transport, peer, &byte, 1) == 0;
+
+done:
+    if (server != UHTTP_INVALID_SOCKET) transport->close(transport, server);
+    if (peer != UHTTP_INVALID_SOCKET) transport->close(transport, peer);
+    if (listener != UHTTP_INVALID_SOCKET) transport->close(transport, listener);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+// 2
+int uhttp_test_transport_connect()
+{
+    // Connect to an address nobody listens on, then more times than there
+    // are connections.
+    // Assert:
+    //  ECONNREFUSED, then EMFILE once every connection is in use.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(2, 64);
+    if (transport == NULL) return 0;
+
+    uhttp_addr_t addr, other;
+    uhttp_test_addr(&addr, 80);
+    uhttp_test_addr(&other, 81);
+
+    int ok = 0;
+    uhttp_socket_t listener = transport->listen(transport, &addr, 4);
+    uhttp_socket_t peers[2] = { UHTTP_INVALID_SOCKET, UHTTP_INVALID_SOCKET };
+    if (listener == UHTTP_INVALID_SOCKET) goto done;
+
+    if (uhttp_memory_connect(transport, &other) != UHTTP_INVALID_SOCKET || errno != ECONNREFUSED) goto done;
+
+    peers[0] = uhttp_memory_connect(transport, &addr);
+    peers[1] = uhttp_memory_connect(transport, &addr);
+    if (peers[0] == UHTTP_INVALID_SOCKET || peers[1] == UHTTP_INVALID_SOCKET) goto done;
+
+    ok = uhttp_memory_connect(transport, &addr) == UHTTP_INVALID_SOCKET && errno == EMFILE;
+
+done:
+    for (size_t i = 0; i < 2; i++)
+    {
+        if (peers[i] != UHTTP_INVALID_SOCKET) transport->close(transport, peers[i]);
+    }
+    if (listener != UHTTP_INVALID_SOCKET) transport->close(transport, listener);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+// 3
+int uhttp_test_transport_replay()
+{
+    // Replay captured requests through a server, all at once and one byte at
+    // a time.
+    // Assert:
+    //  The responses match the capture byte for byte and the connection is
+    //  closed after the last one.
+
+    return uhttp_test_replay(sizeof(replay_requests)) == sizeof(replay_responses) - 1 &&
+        uhttp_test_replay(1) == sizeof(replay_responses) - 1;
+}
+
+static int uhttp_test_calls;
+
+#if UHTTP_FEATURE_CACHE
+static void uhttp_test_hello_later(uhttp_request_t* request, void* user)
+{
+    // The first request is never answered.
+    if (uhttp_test_calls++ > 0)
+    {
+        uhttp_respond(request, 200, "Content-Type: text/plain\r\n", "hello", 5);
+    }
+}
+
+// 4
+int uhttp_test_transport_cache_abandon()
+{
+    // Request a cached route whose handler does not answer the first
+    // request, request it again on another connection, then close the first.
+    // Assert:
+    //  The second request waits for the first, then goes to the handler
+    //  again and is answered once the first connection is gone.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 256);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+
+    // Static memory builds leave the cache off unless sized.
+    arg.integer = 65536;
+    uhttp_setoption(sv, UHTTP_OPTION_CACHE_SIZE, &arg);
+
+    uhttp_route_t route = { .path = "/hello", .handler = uhttp_test_hello_later, .cache_ttl = 1000 };
+    uhttp_addroute(sv, &route);
+    uhttp_test_calls = 0;
+
+    static const char request[] = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    static const char expect[] = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nContent-Type: text/plain\r\n\r\nhello";
+    char response[sizeof(expect) + 64];
+    size_t received = 0;
+    int ok = 0;
+
+    uhttp_socket_t first = UHTTP_INVALID_SOCKET, second = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (first = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET ||
+        (second = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    transport->send(transport, first, request, sizeof(request) - 1);
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+    transport->send(transport, second, request, sizeof(request) - 1);
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+
+    // Coalesced with the first request, the handler is not invoked again.
+    if (uhttp_test_calls != 1 || transport->recv(transport, second, response, sizeof(response)) != -1) goto done;
+
+    transport->close(transport, first);
+    first = UHTTP_INVALID_SOCKET;
+
+    for (int i = 0; i < 100 && received < sizeof(expect) - 1; i++)
+    {
+        uhttp_pollevents(sv);
+        ssize_t n = transport->recv(transport, second, response + received, sizeof(response) - received);
+        if (n > 0) received += n;
+    }
+
+    ok = uhttp_test_calls == 2 && received == sizeof(expect) - 1 && memcmp(response, expect, received) == 0;
+
+done:
+    if (first != UHTTP_INVALID_SOCKET) transport->close(transport, first);
+    if (second != UHTTP_INVALID_SOCKET) transport->close(transport, second);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+#endif
+
+/**
+ * Send a request and poll the server a number of times, return the length
+ * of the response received.
+ */
+static size_t uhttp_test_exchange(uhttp_server_t* sv, uhttp_transport_t* transport, uhttp_socket_t sock,
+    const char* request, char* response, size_t cap)
+{
+    size_t received = 0;
+    transport->send(transport, sock, request, strlen(request));
+    for (int i = 0; i < 20; i++)
+    {
+        uhttp_pollevents(sv);
+        ssize_t n = transport->recv(transport, sock, response + received, cap - received);
+        if (n > 0) received += n;
+    }
+    return received;
+}
+
+#if UHTTP_FEATURE_CACHE && UHTTP_FEATURE_FILES
+// 5
+int uhttp_test_transport_static_cached()
+{
+    // Request a file from a cached static route twice on one connection and
+    // once on another.
+    // Assert:
+    //  Every request is answered with the whole file, the same response each
+    //  time.
+
+    static const char body[] = "cached static file\n";
+    static const char* path = "uhttp_test_static.txt";
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return 0;
+    fwrite(body, 1, sizeof(body) - 1, file);
+    fclose(file);
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 4096);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+
+    arg.integer = 65536;
+    uhttp_setoption(sv, UHTTP_OPTION_CACHE_SIZE, &arg);
+
+    static uhttp_static_t files = { ".", "/static" };
+    uhttp_route_t route = { .path = "/static/*", .handler = uhttp_static_handler, .user = &files, .cache_ttl = 1000 };
+    uhttp_addroute(sv, &route);
+
+    static const char request[] = "GET /static/uhttp_test_static.txt HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    char first[1024], second[1024], third[1024];
+    size_t len = 0;
+    int ok = 0;
+
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET, other = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (sock = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET ||
+        (other = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    len = uhttp_test_exchange(sv, transport, sock, request, first, sizeof(first));
+    ok = len > sizeof(body) - 1 &&
+        memcmp(first, "HTTP/1.1 200 OK\r\n", 17) == 0 &&
+        memcmp(first + len - (sizeof(body) - 1), body, sizeof(body) - 1) == 0 &&
+        uhttp_test_exchange(sv, transport, sock, request, second, sizeof(second)) == len &&
+        memcmp(first, second, len) == 0 &&
+        uhttp_test_exchange(sv, transport, other, request, third, sizeof(third)) == len &&
+        memcmp(first, third, len) == 0;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    if (other != UHTTP_INVALID_SOCKET) transport->close(transport, other);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    remove(path);
+    return ok;
+}
+#endif
+
+static void uhttp_test_api(uhttp_request_t* request, void* user)
+{
+    uhttp_respond(request, 200, NULL, "api", 3);
+}
+
+static void uhttp_test_admin(uhttp_request_t* request, void* user)
+{
+    uhttp_str_t path = uhttp_request_path(request);
+    uhttp_respond(request, 200, NULL, path.ptr, path.len);
+}
+
+// 6
+int uhttp_test_transport_route_normalized()
+{
+    // Request a path that climbs out of one prefix route into another, and
+    // one that decodes to a line break.
+    // Assert:
+    //  The route of the normalized path answers with that path.
+    //  The line break is answered with 400.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 1024);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+
+    uhttp_route_t api = { .path = "/api/*", .handler = uhttp_test_api };
+    uhttp_route_t admin = { .path = "/admin/*", .handler = uhttp_test_admin };
+    uhttp_addroute(sv, &api);
+    uhttp_addroute(sv, &admin);
+
+    static const char expect[] = "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\n/admin/x";
+    static const char refused[] = "HTTP/1.1 400 Bad Request\r\n";
+    char response[256];
+    size_t len;
+    int ok = 0;
+
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET, other = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (sock = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET ||
+        (other = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    len = uhttp_test_exchange(sv, transport, sock, "GET /api/../admin/x HTTP/1.1\r\n\r\n", response, sizeof(response));
+    if (len != sizeof(expect) - 1 || memcmp(response, expect, len)) goto done;
+
+    len = uhttp_test_exchange(sv, transport, other, "GET /api/%0D%0AHost:%20evil HTTP/1.1\r\n\r\n", response, sizeof(response));
+    ok = len > sizeof(refused) - 1 && memcmp(response, refused, sizeof(refused) - 1) == 0;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    if (other != UHTTP_INVALID_SOCKET) transport->close(transport, other);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+#if UHTTP_FEATURE_CACHE && UHTTP_FEATURE_FILES
+// 7
+int uhttp_test_transport_static_conditional()
+{
+    // Request a range of a file from a cached static route nobody asked for
+    // yet, then revalidate it with the tag of that response.
+    // Assert:
+    //  The range is answered with 206, the revalidation with 304, neither
+    //  is replaced by the whole file.
+
+    static const char body[] = "cached static file\n";
+    static const char* path = "uhttp_test_static.txt";
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return 0;
+    fwrite(body, 1, sizeof(body) - 1, file);
+    fclose(file);
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 4096);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+
+    arg.integer = 65536;
+    uhttp_setoption(sv, UHTTP_OPTION_CACHE_SIZE, &arg);
+
+    static uhttp_static_t files = { ".", "/static" };
+    uhttp_route_t route = { .path = "/static/*", .handler = uhttp_static_handler, .user = &files, .cache_ttl = 1000 };
+    uhttp_addroute(sv, &route);
+
+    static const char partial[] = "HTTP/1.1 206 Partial Content\r\n";
+    static const char unmodified[] = "HTTP/1.1 304 Not Modified\r\n";
+    char response[1024], request[256];
+    size_t len;
+    int ok = 0;
+
+    uhttp_socket_t sock = UHTTP_INVALID_SOCKET, other = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (sock = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET ||
+        (other = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    len = uhttp_test_exchange(sv, transport, sock,
+        "GET /static/uhttp_test_static.txt HTTP/1.1\r\nRange: bytes=0-5\r\n\r\n", response, sizeof(response) - 1);
+    response[len] = '\0';
+
+    const char* etag = strstr(response, "ETag: ");
+    const char* end = etag ? strstr(etag, "\r\n") : NULL;
+    if (len < 6 || memcmp(response, partial, sizeof(partial) - 1) || memcmp(response + len - 6, "cached", 6) || end == NULL)
+        goto done;
+
+    snprintf(request, sizeof(request), "GET /static/uhttp_test_static.txt HTTP/1.1\r\nIf-None-Match: %.*s\r\n\r\n",
+        (int)(end - etag - 6), etag + 6);
+    len = uhttp_test_exchange(sv, transport, other, request, response, sizeof(response));
+    ok = len > sizeof(unmodified) - 1 && memcmp(response, unmodified, sizeof(unmodified) - 1) == 0;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    if (other != UHTTP_INVALID_SOCKET) transport->close(transport, other);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    remove(path);
+    return ok;
+}
+#endif
+
+static uhttp_request_t* uhttp_test_held;
+static int uhttp_test_load;
+
+static void uhttp_test_hold(uhttp_request_t* request, void* user)
+{
+    uhttp_test_held = request;
+}
+
+static void uhttp_test_load_error(int number, const char* description)
+{
+    if (number == EBUSY || number == 0) uhttp_test_load = number;
+}
+
+// 8
+int uhttp_test_transport_shed_requests()
+{
+    // Allow one request at a time, hold a request unanswered, connect
+    // again, then answer the held request and connect once more.
+    // Assert:
+    //  The server starts shedding as soon as the request is dispatched, the
+    //  second connection is answered with 503.
+    //  Once the held request is answered the server stops shedding and the
+    //  third connection is served.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 1024);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+    arg.integer = 1;
+    uhttp_setoption(sv, UHTTP_OPTION_MAX_REQUESTS, &arg);
+    arg.error_func = uhttp_test_load_error;
+    uhttp_setoption(sv, UHTTP_OPTION_ERROR_FUNC, &arg);
+
+    uhttp_route_t held = { .path = "/held", .handler = uhttp_test_hold };
+    uhttp_route_t hello = { .path = "/hello", .handler = uhttp_test_hello };
+    uhttp_addroute(sv, &held);
+    uhttp_addroute(sv, &hello);
+    uhttp_test_held = NULL;
+    uhttp_test_load = -1;
+
+    static const char request[] = "GET /hello HTTP/1.1\r\n\r\n";
+    static const char shed[] = "HTTP/1.1 503 Service Unavailable\r\n";
+    static const char served[] = "HTTP/1.1 200 OK\r\n";
+    char response[256];
+    size_t len;
+    int ok = 0;
+
+    uhttp_socket_t first = UHTTP_INVALID_SOCKET, second = UHTTP_INVALID_SOCKET, third = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (first = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    // Counted from dispatch, nothing is queued for the client yet.
+    static const char hold[] = "GET /held HTTP/1.1\r\n\r\n";
+    transport->send(transport, first, hold, sizeof(hold) - 1);
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+    if (uhttp_test_held == NULL || uhttp_test_load != EBUSY) goto done;
+
+    if ((second = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET) goto done;
+    len = uhttp_test_exchange(sv, transport, second, request, response, sizeof(response));
+    if (len < sizeof(shed) - 1 || memcmp(response, shed, sizeof(shed) - 1)) goto done;
+
+    uhttp_respond(uhttp_test_held, 200, NULL, "held", 4);
+    len = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        uhttp_pollevents(sv);
+        ssize_t n = transport->recv(transport, first, response + len, sizeof(response) - len);
+        if (n > 0) len += n;
+    }
+    if (uhttp_test_load != 0 || len < sizeof(served) - 1 || memcmp(response, served, sizeof(served) - 1)) goto done;
+
+    if ((third = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET) goto done;
+    len = uhttp_test_exchange(sv, transport, third, request, response, sizeof(response));
+    ok = len >= sizeof(served) - 1 && memcmp(response, served, sizeof(served) - 1) == 0;
+
+done:
+    if (first != UHTTP_INVALID_SOCKET) transport->close(transport, first);
+    if (second != UHTTP_INVALID_SOCKET) transport->close(transport, second);
+    if (third != UHTTP_INVALID_SOCKET) transport->close(transport, third);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+// 9
+int uhttp_test_transport_shed_clients()
+{
+    // Allow one client, connect twice, then close the first and connect
+    // again.
+    // Assert:
+    //  The second connection is answered with 503 and closed, the third is
+    //  served.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 1024);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+    arg.integer = 1;
+    uhttp_setoption(sv, UHTTP_OPTION_MAX_CLIENTS, &arg);
+
+    uhttp_route_t route = { .path = "/hello", .handler = uhttp_test_hello };
+    uhttp_addroute(sv, &route);
+
+    static const char request[] = "GET /hello HTTP/1.1\r\n\r\n";
+    static const char shed[] = "HTTP/1.1 503 Service Unavailable\r\n";
+    static const char served[] = "HTTP/1.1 200 OK\r\n";
+    char response[256];
+    size_t len;
+    int ok = 0;
+
+    uhttp_socket_t first = UHTTP_INVALID_SOCKET, second = UHTTP_INVALID_SOCKET, third = UHTTP_INVALID_SOCKET;
+    if (uhttp_start(sv) || (first = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET)
+        goto done;
+
+    len = uhttp_test_exchange(sv, transport, first, request, response, sizeof(response));
+    if (len < sizeof(served) - 1 || memcmp(response, served, sizeof(served) - 1)) goto done;
+
+    if ((second = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET) goto done;
+    len = uhttp_test_exchange(sv, transport, second, request, response, sizeof(response));
+    if (len < sizeof(shed) - 1 || memcmp(response, shed, sizeof(shed) - 1)) goto done;
+
+    transport->close(transport, first);
+    first = UHTTP_INVALID_SOCKET;
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+
+    if ((third = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET) goto done;
+    len = uhttp_test_exchange(sv, transport, third, request, response, sizeof(response));
+    ok = len >= sizeof(served) - 1 && memcmp(response, served, sizeof(served) - 1) == 0;
+
+done:
+    if (first != UHTTP_INVALID_SOCKET) transport->close(transport, first);
+    if (second != UHTTP_INVALID_SOCKET) transport->close(transport, second);
+    if (third != UHTTP_INVALID_SOCKET) transport->close(transport, third);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+static void uhttp_test_big(uhttp_request_t* request, void* user)
+{
+    static char body[1024];
+    memset(body, 'x', sizeof(body));
+    uhttp_test_calls++;
+    uhttp_respond(request, 200, NULL, body, sizeof(body));
+}
+
+/**
+ * Create a server over a transport with a route to large responses and
+ * output limits, return NULL on failure.
+ */
+static uhttp_server_t* uhttp_test_limited(uhttp_transport_t* transport, uhttp_addr_t* addr, int high, int low, int budget, int rate)
+{
+    uhttp_server_t* sv = uhttp_create();
+    if (sv == NULL) return NULL;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    *addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+    arg.integer = high;
+    uhttp_setoption(sv, UHTTP_OPTION_TX_HIGH_WATER, &arg);
+    arg.integer = low;
+    uhttp_setoption(sv, UHTTP_OPTION_TX_LOW_WATER, &arg);
+    arg.integer = budget;
+    uhttp_setoption(sv, UHTTP_OPTION_TX_BUDGET, &arg);
+    arg.integer = rate;
+    uhttp_setoption(sv, UHTTP_OPTION_MIN_SEND_RATE, &arg);
+    arg.integer = 10;
+    uhttp_setoption(sv, UHTTP_OPTION_POLL_TIMEOUT, &arg);
+
+    static uhttp_route_t big = { .path = "/big", .handler = uhttp_test_big };
+    static uhttp_route_t hello = { .path = "/hello", .handler = uhttp_test_hello };
+    uhttp_addroute(sv, &big);
+    uhttp_addroute(sv, &hello);
+    uhttp_test_calls = 0;
+
+    if (uhttp_start(sv))
+    {
+        uhttp_destroy(sv);
+        return NULL;
+    }
+
+    return sv;
+}
+
+/**
+ * Read everything a connection receives while polling the server, return
+ * the number of large responses received whole or -1 once it is closed.
+ */
+static int uhttp_test_drain(uhttp_server_t* sv, uhttp_transport_t* transport, uhttp_socket_t sock)
+{
+    static const char head[] = "HTTP/1.1 200 OK\r\n";
+    char buffer[256];
+    size_t bodies = 0, heads = 0, matched = 0;
+
+    for (int i = 0; i < 50; i++)
+    {
+        uhttp_pollevents(sv);
+        ssize_t n;
+        while ((n = transport->recv(transport, sock, buffer, sizeof(buffer))) > 0)
+        {
+            for (ssize_t j = 0; j < n; j++)
+            {
+                if (buffer[j] == 'x') bodies++;
+                matched = (buffer[j] == head[matched]) ? matched + 1 : (buffer[j] == head[0]);
+                if (matched == sizeof(head) - 1)
+                {
+                    heads++;
+                    matched = 0;
+                }
+            }
+        }
+        if (n == 0) return -1;
+    }
+
+    return bodies == heads * 1024 ? (int)heads : -1;
+}
+
+// 10
+int uhttp_test_transport_watermarks()
+{
+    // Pipeline three requests for responses larger than the high watermark
+    // without reading, then read.
+    // Assert:
+    //  Only the first request is dispatched while nothing is read.
+    //  Reading the responses dispatches the others, all three arrive whole.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 256);
+    uhttp_addr_t addr;
+    uhttp_server_t* sv = transport ? uhttp_test_limited(transport, &addr, 512, 128, 0, 0) : NULL;
+    if (sv == NULL) return 0;
+
+    static const char request[] = "GET /big HTTP/1.1\r\n\r\nGET /big HTTP/1.1\r\n\r\nGET /big HTTP/1.1\r\n\r\n";
+    int ok = 0;
+
+    uhttp_socket_t sock = uhttp_memory_connect(transport, &addr);
+    if (sock == UHTTP_INVALID_SOCKET) goto done;
+
+    transport->send(transport, sock, request, sizeof(request) - 1);
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+    if (uhttp_test_calls != 1) goto done;
+
+    ok = uhttp_test_drain(sv, transport, sock) == 3 && uhttp_test_calls == 3;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+// 11
+int uhttp_test_transport_budget()
+{
+    // Limit the buffers of all clients below one large response, pipeline
+    // two requests for it without reading, request a small response on
+    // another connection, then read the first.
+    // Assert:
+    //  The first connection is throttled after its first response, not
+    //  closed, the other connection is still served.
+    //  Reading the first connection dispatches its second request, both
+    //  responses arrive whole.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 256);
+    uhttp_addr_t addr;
+    uhttp_server_t* sv = transport ? uhttp_test_limited(transport, &addr, 0, 0, 512, 0) : NULL;
+    if (sv == NULL) return 0;
+
+    static const char request[] = "GET /big HTTP/1.1\r\n\r\nGET /big HTTP/1.1\r\n\r\n";
+    static const char served[] = "HTTP/1.1 200 OK\r\n";
+    char response[256];
+    int ok = 0;
+
+    uhttp_socket_t sock = uhttp_memory_connect(transport, &addr);
+    uhttp_socket_t other = uhttp_memory_connect(transport, &addr);
+    if (sock == UHTTP_INVALID_SOCKET || other == UHTTP_INVALID_SOCKET) goto done;
+
+    transport->send(transport, sock, request, sizeof(request) - 1);
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+    if (uhttp_test_calls != 1) goto done;
+
+    size_t len = uhttp_test_exchange(sv, transport, other, "GET /hello HTTP/1.1\r\n\r\n", response, sizeof(response));
+    if (len < sizeof(served) - 1 || memcmp(response, served, sizeof(served) - 1)) goto done;
+
+    ok = uhttp_test_drain(sv, transport, sock) == 2 && uhttp_test_calls == 2;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    if (other != UHTTP_INVALID_SOCKET) transport->close(transport, other);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+// 12
+int uhttp_test_transport_min_send_rate()
+{
+    // Require a send rate, request a large response and do not read it for
+    // longer than the measuring window.
+    // Assert:
+    //  The connection is closed with the response cut short.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(4, 256);
+    uhttp_addr_t addr;
+    uhttp_server_t* sv = transport ? uhttp_test_limited(transport, &addr, 0, 0, 0, 1000000) : NULL;
+    if (sv == NULL) return 0;
+
+    static const char request[] = "GET /big HTTP/1.1\r\n\r\n";
+    char response[1024];
+    size_t received = 0;
+    int ok = 0;
+
+    uhttp_socket_t sock = uhttp_memory_connect(transport, &addr);
+    if (sock == UHTTP_INVALID_SOCKET) goto done;
+
+    transport->send(transport, sock, request, sizeof(request) - 1);
+
+    // The window is 50 ms in this build.
+    for (uint64_t end = uhttp_clock_ms() + 200; uhttp_clock_ms() < end;) uhttp_pollevents(sv);
+
+    ssize_t n;
+    while ((n = transport->recv(transport, sock, response + received, sizeof(response) - received)) > 0)
+    {
+        received += n;
+    }
+
+    ok = uhttp_test_calls == 1 && n == 0 && received > 0 && received < 1024;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+/**
+ * Count the connections answered so far, reading what they received.
+ */
+static int uhttp_test_answered(uhttp_transport_t* transport, const uhttp_socket_t* socks, int* answered, int n)
+{
+    char buffer[256];
+    int count = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (transport->recv(transport, socks[i], buffer, sizeof(buffer)) > 0) answered[i] = 1;
+        count += answered[i];
+    }
+
+    return count;
+}
+
+// 13
+int uhttp_test_transport_accept_budget()
+{
+    // Accept two connections per poll, connect five that all send a request
+    // right away.
+    // Assert:
+    //  Connections are accepted two per poll and answered in the poll after,
+    //  so two, four, then all five are answered.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(8, 256);
+    uhttp_server_t* sv = uhttp_create();
+    if (transport == NULL || sv == NULL) return 0;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    uhttp_addr_t addr = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+    arg.integer = 2;
+    uhttp_setoption(sv, UHTTP_OPTION_ACCEPT_BUDGET, &arg);
+
+    uhttp_route_t route = { .path = "/hello", .handler = uhttp_test_hello };
+    uhttp_addroute(sv, &route);
+
+    static const char request[] = "GET /hello HTTP/1.1\r\n\r\n";
+    static const int expect[] = { 0, 2, 4, 5 };
+    uhttp_socket_t socks[5];
+    int answered[5] = { 0 };
+    int n = 0, ok = 0;
+
+    if (uhttp_start(sv)) goto done;
+
+    for (; n < 5; n++)
+    {
+        if ((socks[n] = uhttp_memory_connect(transport, &addr)) == UHTTP_INVALID_SOCKET) goto done;
+        transport->send(transport, socks[n], request, sizeof(request) - 1);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        uhttp_pollevents(sv);
+        if (uhttp_test_answered(transport, socks, answered, n) != expect[i]) goto done;
+    }
+    ok = 1;
+
+done:
+    while (n-- > 0) transport->close(transport, socks[n]);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+static void uhttp_test_tag(uhttp_request_t* request, void* user)
+{
+    char body[16];
+    int len = snprintf(body, sizeof(body), "tag %d", uhttp_request_tag(request));
+    uhttp_respond(request, 200, NULL, body, len);
+}
+
+/**
+ * Create a server over a transport listening on ports 8080 with tag zero
+ * and 8081 with tag seven, answering with the tag, return NULL on failure.
+ */
+static uhttp_server_t* uhttp_test_listeners(uhttp_transport_t* transport, uhttp_addr_t* first, uhttp_addr_t* second, int budget)
+{
+    uhttp_server_t* sv = uhttp_create();
+    if (sv == NULL) return NULL;
+
+    uhttp_option_arg_t arg;
+    uhttp_test_addr(&arg.addr, 8080);
+    *first = arg.addr;
+    uhttp_setoption(sv, UHTTP_OPTION_BIND_ADDR, &arg);
+    arg.transport = transport;
+    uhttp_setoption(sv, UHTTP_OPTION_TRANSPORT, &arg);
+    arg.integer = budget;
+    uhttp_setoption(sv, UHTTP_OPTION_ACCEPT_BUDGET, &arg);
+
+    uhttp_test_addr(second, 8081);
+    static uhttp_route_t route = { .path = "/tag", .handler = uhttp_test_tag };
+    if (uhttp_addlistener(sv, second, 7) || uhttp_addroute(sv, &route) || uhttp_start(sv))
+    {
+        uhttp_destroy(sv);
+        return NULL;
+    }
+
+    return sv;
+}
+
+// 14
+int uhttp_test_transport_listener_rotation()
+{
+    // Accept one connection per poll, connect twice to each of two
+    // listeners, the first listener first.
+    // Assert:
+    //  The first two connections accepted come from different listeners.
+    //  All four are answered eventually.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(8, 256);
+    uhttp_addr_t first, second;
+    uhttp_server_t* sv = transport ? uhttp_test_listeners(transport, &first, &second, 1) : NULL;
+    if (sv == NULL) return 0;
+
+    static const char request[] = "GET /tag HTTP/1.1\r\n\r\n";
+    uhttp_socket_t socks[4];
+    int answered[4] = { 0 };
+    int n = 0, ok = 0;
+
+    for (; n < 4; n++)
+    {
+        if ((socks[n] = uhttp_memory_connect(transport, n < 2 ? &first : &second)) == UHTTP_INVALID_SOCKET) goto done;
+        transport->send(transport, socks[n], request, sizeof(request) - 1);
+    }
+
+    for (int i = 0; i < 3; i++) uhttp_pollevents(sv);
+    if (uhttp_test_answered(transport, socks, answered, n) != 2 || !answered[0] || !answered[2]) goto done;
+
+    for (int i = 0; i < 10; i++) uhttp_pollevents(sv);
+    ok = uhttp_test_answered(transport, socks, answered, n) == 4;
+
+done:
+    while (n-- > 0) transport->close(transport, socks[n]);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+// 15
+int uhttp_test_transport_listener_tags()
+{
+    // Request the tag of the listener on a connection to each listener.
+    // Assert:
+    //  Requests on the address of UHTTP_OPTION_BIND_ADDR have tag zero,
+    //  those on the added listener its tag.
+
+    uhttp_transport_t* transport = uhttp_memory_transport_create(8, 256);
+    uhttp_addr_t first, second;
+    uhttp_server_t* sv = transport ? uhttp_test_listeners(transport, &first, &second, 16) : NULL;
+    if (sv == NULL) return 0;
+
+    static const char request[] = "GET /tag HTTP/1.1\r\n\r\n";
+    char response[256];
+    size_t len;
+    int ok = 0;
+
+    uhttp_socket_t sock = uhttp_memory_connect(transport, &first);
+    uhttp_socket_t other = uhttp_memory_connect(transport, &second);
+    if (sock == UHTTP_INVALID_SOCKET || other == UHTTP_INVALID_SOCKET) goto done;
+
+    len = uhttp_test_exchange(sv, transport, sock, request, response, sizeof(response));
+    if (len < 5 || memcmp(response + len - 5, "tag 0", 5)) goto done;
+
+    len = uhttp_test_exchange(sv, transport, other, request, response, sizeof(response));
+    ok = len >= 5 && memcmp(response + len - 5, "tag 7", 5) == 0;
+
+done:
+    if (sock != UHTTP_INVALID_SOCKET) transport->close(transport, sock);
+    if (other != UHTTP_INVALID_SOCKET) transport->close(transport, other);
+    uhttp_destroy(sv);
+    uhttp_memory_transport_destroy(transport);
+    return ok;
+}
+
+const test_t uhttp_test_transport[] = {
+    { .name = "Stream through in-memory rings.", .func = uhttp_test_transport_ring },
+    { .name = "Refuse in-memory connections.", .func = uhttp_test_transport_connect },
+    { .name = "Replay captured requests in memory.", .func = uhttp_test_transport_replay },
+#if UHTTP_FEATURE_CACHE
+    { .name = "Abandon the cache entry of an unanswered request.", .func = uhttp_test_transport_cache_abandon },
+#endif
+#if UHTTP_FEATURE_CACHE && UHTTP_FEATURE_FILES
+    { .name = "Serve files from a cached static route.", .func = uhttp_test_transport_static_cached },
+#endif
+    { .name = "Route on the normalized path.", .func = uhttp_test_transport_route_normalized },
+#if UHTTP_FEATURE_CACHE && UHTTP_FEATURE_FILES
+    { .name = "Answer ranges and revalidations on a cached static route.", .func = uhttp_test_transport_static_conditional },
+#endif
+    { .name = "Shed connections while requests are unanswered.", .func = uhttp_test_transport_shed_requests },
+    { .name = "Shed connections beyond the client limit.", .func = uhttp_test_transport_shed_clients },
+    { .name = "Throttle a client over its high watermark.", .func = uhttp_test_transport_watermarks },
+    { .name = "Throttle a client over the transmit budget.", .func = uhttp_test_transport_budget },
+    { .name = "Close a client draining too slowly.", .func = uhttp_test_transport_min_send_rate },
+    { .name = "Accept connections within the budget of a poll.", .func = uhttp_test_transport_accept_budget },
+    { .name = "Rotate the listener accepted from first.", .func = uhttp_test_transport_listener_rotation },
+    { .name = "Tag requests with their listener.", .func = uhttp_test_transport_listener_tags },
+
+    { .name = NULL, .func = NULL }
+};
+
+#ifdef _UHTTP_TEST_STANDALONE_
+int main(int argc, char** argv)
+{
+    return uhttp_test_main(uhttp_test_transport);
+}
+#endif